@@ -0,0 +1,233 @@
+/*
+BatchRenderer class
+- the draw requests of a frame (model, LOD and model matrix of each instance) are collected with Submit, and they are rendered when Flush is called
+- the consecutive requests with the same model and LOD are grouped: the model and normal matrices of all the instances are written in a single
+  instance buffer, and each group is rendered with one instanced draw call per mesh (glDrawElementsInstancedBaseVertex).
+  The instance buffer is a ring buffer (see ring_buffer.h): the matrices of each Flush are written in the region of the current frame, and EndFrame
+  must be called at the end of each frame.
+  The requests are not sorted here: the RenderQueue (see render_queue.h) submits them already sorted by model and LOD
+- the shaders read the matrices as vertex attributes with divisor 1, i.e. with one value per instance instead of one value per vertex
+- a group with a single instance of a model with several meshes allocated in the same GeometryArena (see mesh.h) is rendered with a single glMultiDrawElementsBaseVertex call
+
+See https://learnopengl.com/Advanced-OpenGL/Instancing for details.
+
+N.B. 1)
+OpenGL 4.1 does not have the "base instance" parameter of the draw calls (it is core from OpenGL 4.2): each instanced draw call reads the instance attributes
+starting from the position set with glVertexAttribPointer. So, before each group, we set the pointers of the instance attributes to the first instance of the group
+in the VAO in use: changing an offset in the VAO is much cheaper than setting the uniforms and issuing a draw call for each instance.
+
+N.B. 2)
+The uniforms which depend on the model (numFaces and packedVertex) are set before each group, in the Shader Program passed to Flush.
+The other uniforms and the textures must be set before the call to Flush, and they are the same for all the requests.
+The VAOs and the uniforms go through the state cache (see gl_state.h): consecutive groups with the same VAO or the same uniform values
+do not repeat the calls, and the last VAO stays bound after Flush.
+If a Profiler is passed to Flush, each group is measured in a scope with the name of the model (see profiler.h).
+
+N.B. 3)
+BatchRenderer follows RAII principles and it is a "move-only" class, like the Mesh class.
+
+Real-Time Graphics Programming - a.a. 2022/2023
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <vector>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_inverse.hpp>
+
+#include <utils/shader.h>
+#include <utils/model.h>
+#include <utils/profiler.h>
+#include <utils/ring_buffer.h>
+// InstanceData struct, and composition of the matrices of many instances
+#include <utils/transform_store.h>
+
+// locations of the instance attributes in the vertex shaders: a mat4 uses 4 consecutive locations (one per column), a mat3 uses 3 locations
+#define INSTANCE_MODEL_MATRIX_LOCATION 5
+#define INSTANCE_NORMAL_MATRIX_LOCATION 9
+
+/////////////////// BATCHRENDERER class ///////////////////////
+class BatchRenderer {
+public:
+    // number of draw calls and of instances rendered by the last call to Flush
+    GLuint drawCalls, instances;
+
+    // We want BatchRenderer to be a move-only class. We delete copy constructor and copy assignment
+    BatchRenderer(const BatchRenderer& copy) = delete; //disallow copy
+    BatchRenderer& operator=(const BatchRenderer &) = delete;
+
+    // Constructor: the instance buffer is created with the given capacity per frame (in number of instances), and it grows when needed
+    BatchRenderer(size_t capacity = 256) noexcept
+        : drawCalls(0), instances(0), instanceBuffer(max(capacity, size_t(1)) * sizeof(InstanceData)), instanceOffset(0)
+    {
+    }
+
+    // Move constructor
+    BatchRenderer(BatchRenderer&& move) noexcept
+        : drawCalls(move.drawCalls), instances(move.instances), requests(std::move(move.requests)),
+        instanceBuffer(std::move(move.instanceBuffer)), instanceOffset(move.instanceOffset)
+    {
+    }
+
+    // Move assignment
+    BatchRenderer& operator=(BatchRenderer&& move) noexcept
+    {
+        drawCalls = move.drawCalls;
+        instances = move.instances;
+        requests = std::move(move.requests);
+        instanceBuffer = std::move(move.instanceBuffer);
+        instanceOffset = move.instanceOffset;
+        return *this;
+    }
+
+    //////////////////////////////////////////
+
+    // we add the request of rendering an instance of the model, with the given LOD and model matrix
+    // the model must be valid until the next call to Flush
+    void Submit(Model& model, GLint lod, const glm::mat4& modelMatrix)
+    {
+        this->requests.push_back({ &model, lod, { modelMatrix, glm::inverseTranspose(glm::mat3(modelMatrix)) } });
+    }
+
+    // as above, with the model and normal matrices already computed (e.g., by a TransformStore, see transform_store.h)
+    void Submit(Model& model, GLint lod, const InstanceData& instance)
+    {
+        this->requests.push_back({ &model, lod, instance });
+    }
+
+    // rendering of the requests submitted after the last call to Flush, with the Shader Program in use
+    void Flush(const Shader& shader, bool tessellation, Profiler* profiler = nullptr)
+    {
+        this->drawCalls = 0;
+        this->instances = GLuint(this->requests.size());
+        if (this->requests.empty())
+            return;
+
+        // the matrices of all the instances are written in a single pass in the region of the current frame of the ring buffer:
+        // no allocations, and no waits for the GPU, which can still be reading the regions of the previous frames
+        InstanceData* instanceData = (InstanceData*)this->instanceBuffer.Map(this->requests.size() * sizeof(InstanceData), this->instanceOffset);
+        for (size_t i = 0; i < this->requests.size(); i++)
+            instanceData[i] = this->requests[i].instance;
+        this->instanceBuffer.Unmap();
+
+        GLint numFacesLocation = shader.getUniformLocation("numFaces");
+        GLint packedVertexLocation = shader.getUniformLocation("packedVertex");
+        GLenum mode = tessellation ? GL_PATCHES : GL_TRIANGLES;
+
+        for (size_t first = 0; first < this->requests.size(); )
+        {
+            // the group goes from first to last (excluded)
+            size_t last = first + 1;
+            while (last < this->requests.size() && this->requests[last].model == this->requests[first].model && this->requests[last].lod == this->requests[first].lod)
+                last++;
+            Model& model = *this->requests[first].model;
+            GLint lod = this->requests[first].lod;
+            ProfileScope scope(profiler, model.name.c_str());
+
+            GLState().Uniform1i(numFacesLocation, model.numFaces(lod));
+            GLState().Uniform1i(packedVertexLocation, model.format == PACKED_VERTEX_FORMAT);
+
+            if (last - first == 1 && this->sharedVAO(model))
+                this->multiDraw(model, lod, mode, first);
+            else
+            {
+                for (const Mesh& mesh : model.meshes)
+                {
+                    this->setInstances(mesh.VAO, first);
+                    mesh.DrawElements(mode, lod, GLsizei(last - first));
+                    this->drawCalls++;
+                }
+            }
+            first = last;
+        }
+        this->requests.clear();
+    }
+
+    // end of the frame: the regions of the instance buffer written in this frame are reused after the GPU has read them
+    void EndFrame()
+    {
+        this->instanceBuffer.EndFrame();
+    }
+
+    // frames in which the CPU waited for the GPU before writing the instance buffer (see ring_buffer.h)
+    GLuint Stalls() const
+    {
+        return this->instanceBuffer.stalls;
+    }
+
+private:
+    // a draw request
+    struct DrawRequest {
+        Model* model;
+        GLint lod;
+        InstanceData instance;
+    };
+
+    vector<DrawRequest> requests;
+    // instance buffer, and offset of the matrices of the last Flush
+    RingBuffer instanceBuffer;
+    size_t instanceOffset;
+
+    //////////////////////////////////////////
+
+    // true if the model has several meshes, all allocated in the same GeometryArena
+    bool sharedVAO(const Model& model) const
+    {
+        if (model.meshes.size() < 2)
+            return false;
+        for (const Mesh& mesh : model.meshes)
+            if (mesh.VAO != model.meshes[0].VAO)
+                return false;
+        return true;
+    }
+
+    // the VAO is bound, and the instance attributes start from the given instance (see N.B. 1 above)
+    void setInstances(GLuint VAO, size_t firstInstance)
+    {
+        GLState().BindVertexArray(VAO);
+        size_t offset = this->instanceOffset + firstInstance * sizeof(InstanceData);
+        glBindBuffer(GL_ARRAY_BUFFER, this->instanceBuffer.buffer);
+        for (GLuint i = 0; i < 4; i++)
+        {
+            glEnableVertexAttribArray(INSTANCE_MODEL_MATRIX_LOCATION + i);
+            glVertexAttribPointer(INSTANCE_MODEL_MATRIX_LOCATION + i, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                                  (GLvoid*)(offset + offsetof(InstanceData, modelMatrix) + i * sizeof(glm::vec4)));
+            // the attribute advances once per instance
+            glVertexAttribDivisor(INSTANCE_MODEL_MATRIX_LOCATION + i, 1);
+        }
+        for (GLuint i = 0; i < 3; i++)
+        {
+            glEnableVertexAttribArray(INSTANCE_NORMAL_MATRIX_LOCATION + i);
+            glVertexAttribPointer(INSTANCE_NORMAL_MATRIX_LOCATION + i, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                                  (GLvoid*)(offset + offsetof(InstanceData, normalMatrix) + i * sizeof(glm::vec3)));
+            glVertexAttribDivisor(INSTANCE_NORMAL_MATRIX_LOCATION + i, 1);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // all the meshes of a single instance of the model are rendered with one draw call.
+    // The draw is not instanced: the attributes with divisor 1 use the values of the first instance
+    void multiDraw(const Model& model, GLint lod, GLenum mode, size_t instance)
+    {
+        vector<GLsizei> counts;
+        vector<GLvoid*> offsets;
+        vector<GLint> baseVertices;
+        for (const Mesh& mesh : model.meshes)
+        {
+            const MeshLOD& level = mesh.LOD(lod);
+            counts.push_back(GLsizei(level.nIndices));
+            offsets.push_back(mesh.IndexOffset(level));
+            baseVertices.push_back(mesh.baseVertex);
+        }
+        this->setInstances(model.meshes[0].VAO, instance);
+        glMultiDrawElementsBaseVertex(mode, counts.data(), model.meshes[0].indexType, offsets.data(), GLsizei(counts.size()), baseVertices.data());
+        this->drawCalls++;
+    }
+};
@@ -0,0 +1,464 @@
+/*
+Benchmark class
+- offscreen benchmark mode of the application, activated with the --benchmark command line option
+- the scene is rendered into a FBO at a configurable resolution, inside a hidden window (or without any window system using --headless, e.g. with Mesa llvmpipe on a machine without GPU)
+- for each Shader Program (PLAIN, BUMP, NORMAL, PARALLAX, DISPLACEMENT) and for each texture set, the camera flies along the same deterministic path for a fixed number of frames, with a fixed timestep
+- for each run, min/mean/p95/p99 of the CPU frame time and of the GPU frame time (measured with GL_TIME_ELAPSED timer queries) are saved in a CSV and in a JSON file
+
+FBO : Framebuffer Object - a render target different from the default framebuffer of the window. Here it has a color and a depth renderbuffer.
+See https://learnopengl.com/Advanced-OpenGL/Framebuffers for details.
+
+Command line options:
+--benchmark              activates the benchmark mode
+--headless               uses a surfaceless context (GLFW 3.4 null platform + OSMesa), no window system needed
+--width W --height H     resolution of the FBO (default 1920x1080)
+--frames N               measured frames for each run (default 500)
+--warmup N               frames rendered and not measured at the beginning of each run (default 50, at least 1: see N.B. 2)
+--output NAME            name of the report files, without extension (default "benchmark" -> benchmark.csv, benchmark.json)
+--deferred               the objects are rendered with deferred shading (see gbuffer.h)
+--linear-parallax        parallax mapping uses the linear search instead of cone stepping (see cone_step_map.h)
+--texture-budget MB      GPU memory for the mip levels of the textures (default 256, see TextureLoader in texture_loader.h)
+--trace                  the scopes of the last frames are saved in NAME.trace.json, in the Chrome trace format (see profiler.h)
+
+N.B. 1) Framebuffer and GpuTimer follow RAII principles and they are "move-only" classes, like the Mesh class.
+
+N.B. 2) The packet rendered in a frame has been simulated with the input of the previous frame (see N.B. 1 in frame_pipeline.h): the first
+frame of a run renders the camera of the last frame of the previous run (or, in the first run, the empty input of the first simulation).
+So the first frame of each run is never measured, even with --warmup 0.
+
+Real-Time Graphics Programming - a.a. 2022/2023
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include <utils/gl_state.h>
+
+// frames at the beginning of each run which are never measured, whatever the --warmup option (see N.B. 2 above)
+#define BENCHMARK_MIN_WARMUP 1
+
+// settings of the benchmark mode, read from the command line
+struct BenchmarkSettings {
+    bool enabled = false;
+    bool headless = false;
+    GLuint width = 1920;
+    GLuint height = 1080;
+    GLuint frames = 500;
+    GLuint warmupFrames = 50;
+    string outputPath = "benchmark";
+    bool deferred = false;
+    bool coneStepMapping = true;
+    GLuint textureBudgetMB = 256;
+    bool trace = false;
+};
+
+// we read the benchmark options from the command line. Unknown options are ignored
+inline BenchmarkSettings ParseBenchmarkSettings(int argc, char** argv)
+{
+    BenchmarkSettings settings;
+    for (int i = 1; i < argc; i++)
+    {
+        // options with a value must be followed by another argument
+        bool hasValue = (i + 1 < argc);
+        if (strcmp(argv[i], "--benchmark") == 0)
+            settings.enabled = true;
+        else if (strcmp(argv[i], "--headless") == 0)
+            settings.headless = true;
+        else if (strcmp(argv[i], "--width") == 0 && hasValue)
+            settings.width = max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--height") == 0 && hasValue)
+            settings.height = max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--frames") == 0 && hasValue)
+            settings.frames = max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--warmup") == 0 && hasValue)
+            settings.warmupFrames = max(0, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--output") == 0 && hasValue)
+            settings.outputPath = argv[++i];
+        else if (strcmp(argv[i], "--deferred") == 0)
+            settings.deferred = true;
+        else if (strcmp(argv[i], "--linear-parallax") == 0)
+            settings.coneStepMapping = false;
+        else if (strcmp(argv[i], "--texture-budget") == 0 && hasValue)
+            settings.textureBudgetMB = max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--trace") == 0)
+            settings.trace = true;
+    }
+    return settings;
+}
+
+/////////////////// FRAMEBUFFER class ///////////////////////
+// offscreen render target with a RGBA8 color buffer and a 24 bit depth buffer
+class Framebuffer {
+public:
+    // FBO
+    GLuint FBO;
+    GLuint width, height;
+
+    Framebuffer(const Framebuffer& copy) = delete; //disallow copy
+    Framebuffer& operator=(const Framebuffer &) = delete;
+
+    Framebuffer(GLuint width, GLuint height) noexcept
+        : width(width), height(height)
+    {
+        glGenFramebuffers(1, &this->FBO);
+        glGenRenderbuffers(1, &this->colorBuffer);
+        glGenRenderbuffers(1, &this->depthBuffer);
+
+        glBindRenderbuffer(GL_RENDERBUFFER, this->colorBuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, this->depthBuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        GLState().BindFramebuffer(this->FBO);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, this->colorBuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, this->depthBuffer);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            cout << "ERROR::FRAMEBUFFER:: Framebuffer is not complete!" << endl;
+        GLState().BindFramebuffer(0);
+    }
+
+    Framebuffer(Framebuffer&& move) noexcept
+        : FBO(move.FBO), width(move.width), height(move.height), colorBuffer(move.colorBuffer), depthBuffer(move.depthBuffer)
+    {
+        move.FBO = 0;
+    }
+
+    Framebuffer& operator=(Framebuffer&& move) noexcept
+    {
+        freeGPUresources();
+        FBO = move.FBO;
+        width = move.width;
+        height = move.height;
+        colorBuffer = move.colorBuffer;
+        depthBuffer = move.depthBuffer;
+        move.FBO = 0;
+        return *this;
+    }
+
+    ~Framebuffer() noexcept
+    {
+        freeGPUresources();
+    }
+
+    // the FBO becomes the current render target, and the viewport is set to its dimensions
+    void Bind()
+    {
+        GLState().BindFramebuffer(this->FBO);
+        glViewport(0, 0, this->width, this->height);
+    }
+
+private:
+    GLuint colorBuffer, depthBuffer;
+
+    void freeGPUresources()
+    {
+        if (FBO)
+        {
+            glDeleteFramebuffers(1, &this->FBO);
+            glDeleteRenderbuffers(1, &this->colorBuffer);
+            glDeleteRenderbuffers(1, &this->depthBuffer);
+            GLState().ForgetFramebuffer(this->FBO);
+        }
+    }
+};
+
+/////////////////// GPUTIMER class ///////////////////////
+// GPU time of a frame, measured with GL_TIME_ELAPSED queries.
+// We use a ring of queries: the result of a query is read only when the query is going to be reused some frames later,
+// so the CPU does not wait for the GPU to finish the current frame
+class GpuTimer {
+public:
+    // number of queries in the ring
+    static const GLuint QUERIES = 4;
+
+    GpuTimer(const GpuTimer& copy) = delete; //disallow copy
+    GpuTimer& operator=(const GpuTimer &) = delete;
+
+    GpuTimer() noexcept
+    {
+        glGenQueries(QUERIES, this->queries);
+    }
+
+    GpuTimer(GpuTimer&& move) noexcept
+        : current(move.current), pending(move.pending)
+    {
+        memcpy(this->queries, move.queries, sizeof(this->queries));
+        move.queries[0] = 0;
+    }
+
+    GpuTimer& operator=(GpuTimer&& move) noexcept
+    {
+        freeGPUresources();
+        memcpy(this->queries, move.queries, sizeof(this->queries));
+        current = move.current;
+        pending = move.pending;
+        move.queries[0] = 0;
+        return *this;
+    }
+
+    ~GpuTimer() noexcept
+    {
+        freeGPUresources();
+    }
+
+    // we start the measure of a frame. If the query to use is still pending, its result is read and added to samples
+    void Begin(vector<double>& samples)
+    {
+        if (this->pending == QUERIES)
+            this->readOldest(samples);
+        glBeginQuery(GL_TIME_ELAPSED, this->queries[this->current]);
+    }
+
+    void End()
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+        this->current = (this->current + 1) % QUERIES;
+        this->pending++;
+    }
+
+    // we wait for all the pending queries (at the end of a run)
+    void Flush(vector<double>& samples)
+    {
+        while (this->pending > 0)
+            this->readOldest(samples);
+    }
+
+private:
+    GLuint queries[QUERIES];
+    // index of the next query to use, and number of queries without a read result
+    GLuint current = 0;
+    GLuint pending = 0;
+
+    // the oldest pending query is read (in milliseconds)
+    void readOldest(vector<double>& samples)
+    {
+        GLuint oldest = (this->current + QUERIES - this->pending) % QUERIES;
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(this->queries[oldest], GL_QUERY_RESULT, &elapsed);
+        samples.push_back(elapsed / 1.0e6);
+        this->pending--;
+    }
+
+    void freeGPUresources()
+    {
+        if (queries[0])
+            glDeleteQueries(QUERIES, this->queries);
+    }
+};
+
+// values calculated for a run
+struct BenchmarkResult {
+    string program;
+    string texture;
+    GLuint frames;
+    // min, mean, 95th and 99th percentile of the frame times, in milliseconds
+    double cpu[4];
+    double gpu[4];
+};
+
+// state of the scene for the current benchmark frame
+struct BenchmarkFrame {
+    GLint program;
+    GLint texture;
+    // time from the beginning of the run (fixed timestep), used for animations
+    GLfloat time;
+    glm::vec3 cameraPosition;
+    glm::mat4 view;
+};
+
+/////////////////// BENCHMARK class ///////////////////////
+class Benchmark {
+public:
+    // fixed timestep of the benchmark frames
+    const GLfloat deltaTime = 1.0f / 60.0f;
+
+    Benchmark(const Benchmark& copy) = delete; //disallow copy
+    Benchmark& operator=(const Benchmark &) = delete;
+
+    // the runs are all the combinations of programs (the first nPrograms in programNames) and texture sets
+    Benchmark(const BenchmarkSettings& settings, GLint nPrograms, const char* const programNames[], GLint nTextures, const char* const textureNames[])
+        : settings(settings), nPrograms(nPrograms), nTextures(nTextures), framebuffer(settings.width, settings.height)
+    {
+        for (GLint i = 0; i < nPrograms; i++)
+            this->programNames.push_back(programNames[i]);
+        for (GLint i = 0; i < nTextures; i++)
+            this->textureNames.push_back(textureNames[i]);
+        this->settings.warmupFrames = max(this->settings.warmupFrames, GLuint(BENCHMARK_MIN_WARMUP));
+    }
+
+    //////////////////////////////////////////
+
+    // we set the state of the next frame and we start the measures.
+    // It returns false when all the runs are completed
+    bool BeginFrame(BenchmarkFrame& frame)
+    {
+        GLuint framesPerRun = this->settings.warmupFrames + this->settings.frames;
+        if (this->frameInRun == framesPerRun)
+        {
+            this->endRun();
+            this->run++;
+            this->frameInRun = 0;
+        }
+        if (this->run == this->nPrograms * this->nTextures)
+            return false;
+
+        frame.program = this->run / this->nTextures;
+        frame.texture = this->run % this->nTextures;
+        frame.time = this->frameInRun * this->deltaTime;
+        this->cameraPath((GLfloat)this->frameInRun / framesPerRun, frame.cameraPosition, frame.view);
+
+        this->framebuffer.Bind();
+        this->measuring = (this->frameInRun >= this->settings.warmupFrames);
+        if (this->measuring)
+        {
+            this->timer.Begin(this->gpuTimes);
+            this->frameStart = chrono::steady_clock::now();
+        }
+        return true;
+    }
+
+    // end of the measures for the current frame
+    void EndFrame()
+    {
+        if (this->measuring)
+        {
+            this->timer.End();
+            glFlush();
+            chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - this->frameStart;
+            this->cpuTimes.push_back(elapsed.count());
+        }
+        this->frameInRun++;
+    }
+
+    //////////////////////////////////////////
+
+    // we save the results in <output>.csv and <output>.json
+    void WriteReport()
+    {
+        const char* statNames[] = { "min", "mean", "p95", "p99" };
+        string renderer = (const char*)glGetString(GL_RENDERER);
+
+        ofstream csv(this->settings.outputPath + ".csv");
+        csv << "program,texture,frames";
+        for (const char* source : { "cpu", "gpu" })
+            for (const char* stat : statNames)
+                csv << "," << source << "_" << stat << "_ms";
+        csv << "\n";
+        for (const BenchmarkResult& result : this->results)
+        {
+            csv << result.program << "," << result.texture << "," << result.frames;
+            for (int i = 0; i < 4; i++)
+                csv << "," << result.cpu[i];
+            for (int i = 0; i < 4; i++)
+                csv << "," << result.gpu[i];
+            csv << "\n";
+        }
+
+        ofstream json(this->settings.outputPath + ".json");
+        json << "{\n  \"renderer\": \"" << renderer << "\",\n";
+        json << "  \"width\": " << this->settings.width << ",\n  \"height\": " << this->settings.height << ",\n";
+        json << "  \"frames\": " << this->settings.frames << ",\n  \"warmup\": " << this->settings.warmupFrames << ",\n";
+        json << "  \"deferred\": " << (this->settings.deferred ? "true" : "false") << ",\n";
+        json << "  \"cone_step_mapping\": " << (this->settings.coneStepMapping ? "true" : "false") << ",\n";
+        json << "  \"texture_budget_mb\": " << this->settings.textureBudgetMB << ",\n";
+        json << "  \"runs\": [\n";
+        for (size_t r = 0; r < this->results.size(); r++)
+        {
+            const BenchmarkResult& result = this->results[r];
+            json << "    { \"program\": \"" << result.program << "\", \"texture\": \"" << result.texture << "\"";
+            for (int i = 0; i < 4; i++)
+                json << ", \"cpu_" << statNames[i] << "_ms\": " << result.cpu[i];
+            for (int i = 0; i < 4; i++)
+                json << ", \"gpu_" << statNames[i] << "_ms\": " << result.gpu[i];
+            json << " }" << (r + 1 < this->results.size() ? "," : "") << "\n";
+        }
+        json << "  ]\n}\n";
+
+        cout << "Benchmark completed (" << renderer << "): results saved in " << this->settings.outputPath << ".csv and .json" << endl;
+    }
+
+private:
+    BenchmarkSettings settings;
+    GLint nPrograms, nTextures;
+    vector<string> programNames, textureNames;
+    Framebuffer framebuffer;
+    GpuTimer timer;
+
+    // current run and current frame inside the run
+    GLint run = 0;
+    GLuint frameInRun = 0;
+    bool measuring = false;
+    chrono::steady_clock::time_point frameStart;
+
+    // frame times (in milliseconds) of the current run
+    vector<double> cpuTimes, gpuTimes;
+    vector<BenchmarkResult> results;
+
+    //////////////////////////////////////////
+
+    // deterministic camera path: a full orbit around the objects in the scene (centered in (0,0,-10)),
+    // with a vertical oscillation to see the surfaces from different angles. t is in [0,1)
+    void cameraPath(GLfloat t, glm::vec3& position, glm::mat4& view)
+    {
+        const glm::vec3 center(0.0f, 0.0f, -10.0f);
+        const GLfloat radius = 15.0f;
+        GLfloat angle = 2.0f * glm::pi<GLfloat>() * t;
+        position = center + glm::vec3(radius * sin(angle), 1.8f + 2.0f * sin(2.0f * angle), radius * cos(angle));
+        view = glm::lookAt(position, center, glm::vec3(0.0f, 1.0f, 0.0f));
+    }
+
+    // min, mean, 95th and 99th percentile (nearest rank) of the samples
+    static void statistics(vector<double>& samples, double stats[4])
+    {
+        if (samples.empty())
+        {
+            stats[0] = stats[1] = stats[2] = stats[3] = 0.0;
+            return;
+        }
+        sort(samples.begin(), samples.end());
+        double sum = 0.0;
+        for (double sample : samples)
+            sum += sample;
+        stats[0] = samples.front();
+        stats[1] = sum / samples.size();
+        stats[2] = samples[(size_t)ceil(0.95 * samples.size()) - 1];
+        stats[3] = samples[(size_t)ceil(0.99 * samples.size()) - 1];
+    }
+
+    // we save the results of the current run, and we reset the samples for the next one
+    void endRun()
+    {
+        this->timer.Flush(this->gpuTimes);
+
+        BenchmarkResult result;
+        result.program = this->programNames[this->run / this->nTextures];
+        result.texture = this->textureNames[this->run % this->nTextures];
+        result.frames = this->settings.frames;
+        statistics(this->cpuTimes, result.cpu);
+        statistics(this->gpuTimes, result.gpu);
+        this->results.push_back(result);
+
+        cout << "Benchmark " << result.program << " / " << result.texture << ": cpu mean " << result.cpu[1] << " ms, gpu mean " << result.gpu[1] << " ms" << endl;
+
+        this->cpuTimes.clear();
+        this->gpuTimes.clear();
+    }
+};
@@ -0,0 +1,122 @@
+/*
+Bounding volumes and view frustum
+- AABB (Axis-Aligned Bounding Box): the smallest box, with faces perpendicular to the coordinate axes, containing a set of points
+- Frustum: the 6 planes of the view frustum, extracted from the projection * view matrix, and the test of an AABB against them
+
+N.B. 1)
+The planes are extracted with the method of Gribb and Hartmann ("Fast Extraction of Viewing Frustum Planes from the World-View-Projection Matrix"):
+a point p is inside the clip volume if -w <= x,y,z <= w, where (x,y,z,w) = M * p. Each of the 6 inequalities is a plane (sum or difference
+of the 4th row of M with one of the other rows). If M = projection * view, the planes are in world space, with the normals pointing inside the frustum.
+
+N.B. 2)
+An AABB is outside the frustum if it is completely on the negative side of at least one plane. For each plane we test only the corner of the box
+farthest along the plane normal (the "positive vertex"): if it is outside, the whole box is outside. If the nearest corner (the "negative vertex")
+is inside for all the planes, the box is completely inside the frustum.
+The test is conservative: some boxes near the corners of the frustum are considered intersecting even if they are outside.
+
+Real-Time Graphics Programming - a.a. 2022/2023
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <cfloat>
+#include <cmath>
+
+#include <glm/glm.hpp>
+
+/////////////////// AABB ///////////////////////
+struct AABB {
+    glm::vec3 min, max;
+
+    // an empty box: the first call to Expand sets it to the added point
+    AABB() : min(FLT_MAX), max(-FLT_MAX) {}
+    AABB(const glm::vec3& min, const glm::vec3& max) : min(min), max(max) {}
+
+    bool IsEmpty() const
+    {
+        return this->min.x > this->max.x;
+    }
+
+    void Expand(const glm::vec3& point)
+    {
+        this->min = glm::min(this->min, point);
+        this->max = glm::max(this->max, point);
+    }
+
+    void Expand(const AABB& box)
+    {
+        this->min = glm::min(this->min, box.min);
+        this->max = glm::max(this->max, box.max);
+    }
+
+    glm::vec3 Center() const
+    {
+        return (this->min + this->max) * 0.5f;
+    }
+
+    // half of the size of the box along each axis
+    glm::vec3 Extents() const
+    {
+        return (this->max - this->min) * 0.5f;
+    }
+
+    // box containing the transformed box (J. Arvo, "Transforming axis-aligned bounding boxes", Graphics Gems, 1990):
+    // the center is transformed as a point, and the extents along each axis are the sum of the absolute values of the projections of the transformed axes
+    AABB Transform(const glm::mat4& matrix) const
+    {
+        if (this->IsEmpty())
+            return *this;
+        glm::vec3 center = glm::vec3(matrix * glm::vec4(this->Center(), 1.0f));
+        glm::vec3 extents = this->Extents();
+        glm::vec3 newExtents = glm::abs(glm::vec3(matrix[0])) * extents.x + glm::abs(glm::vec3(matrix[1])) * extents.y + glm::abs(glm::vec3(matrix[2])) * extents.z;
+        return AABB(center - newExtents, center + newExtents);
+    }
+};
+
+// result of the test of a box against the frustum
+enum FrustumTest { OUTSIDE_FRUSTUM, INTERSECTS_FRUSTUM, INSIDE_FRUSTUM };
+
+/////////////////// FRUSTUM ///////////////////////
+struct Frustum {
+    // planes (normal in xyz, distance in w) in the order left, right, bottom, top, near, far
+    glm::vec4 planes[6];
+
+    // extraction of the planes from the projection * view matrix (see N.B. 1 above)
+    // glm matrices are column-major, so the i-th row is (m[0][i], m[1][i], m[2][i], m[3][i])
+    Frustum(const glm::mat4& projectionView)
+    {
+        glm::vec4 rows[4];
+        for (int i = 0; i < 4; i++)
+            rows[i] = glm::vec4(projectionView[0][i], projectionView[1][i], projectionView[2][i], projectionView[3][i]);
+        for (int i = 0; i < 3; i++)
+        {
+            this->planes[2 * i] = rows[3] + rows[i];
+            this->planes[2 * i + 1] = rows[3] - rows[i];
+        }
+        // the planes are normalized, so the w component is the distance from the origin
+        for (glm::vec4& plane : this->planes)
+            plane = plane / glm::length(glm::vec3(plane));
+    }
+
+    // test of a box against the planes (see N.B. 2 above)
+    // the box can be enlarged by a margin in all the directions (e.g., for the vertices displaced by the tessellation)
+    FrustumTest Test(const AABB& box, float margin = 0.0f) const
+    {
+        FrustumTest result = INSIDE_FRUSTUM;
+        for (const glm::vec4& plane : this->planes)
+        {
+            glm::vec3 positive(plane.x >= 0.0f ? box.max.x : box.min.x, plane.y >= 0.0f ? box.max.y : box.min.y, plane.z >= 0.0f ? box.max.z : box.min.z);
+            if (glm::dot(glm::vec3(plane), positive) + plane.w < -margin)
+                return OUTSIDE_FRUSTUM;
+            glm::vec3 negative(plane.x >= 0.0f ? box.min.x : box.max.x, plane.y >= 0.0f ? box.min.y : box.max.y, plane.z >= 0.0f ? box.min.z : box.max.z);
+            if (glm::dot(glm::vec3(plane), negative) + plane.w < margin)
+                result = INTERSECTS_FRUSTUM;
+        }
+        return result;
+    }
+};
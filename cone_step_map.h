@@ -0,0 +1,365 @@
+/*
+Cone step map
+- CPU baker of the relaxed cone step maps used by the cone stepping variant of parallax mapping (see parallax.frag)
+- a cone step map has 2 channels: the height of the source map (R), and the ratio of the cone placed on each texel (G)
+- the map is baked once, and it is cached next to the height map (e.g. "height.png" -> "height.png.conemap")
+
+Occlusion parallax mapping searches the intersection of the view ray with the height field with a linear search, at fixed steps.
+With cone step mapping, each texel stores the widest cone with the apex on the surface, opening upwards, which the ray can cross
+without missing an intersection: a ray above the texel can be moved directly to the boundary of the cone, and the steps are
+long where the surface is far, and short only near the surface.
+The "relaxed" cones of Policarpo and Oliveira (GPU Gems 3, chapter 18) are wider than the original conservative cones: they are not
+empty, but a ray entering the cone from above can cross the surface at most once inside it. So the ray can end below the surface,
+and the intersection is refined with a binary search between the last two positions.
+See https://developer.nvidia.com/gpugems/gpugems3/part-iii-rendering/chapter-18-relaxed-cone-stepping-relief-mapping for details.
+
+N.B. 1)
+The ratio of a cone is (horizontal distance in UV units) / (depth), with depth = 1 - height in [0,1].
+A ray coming from the top of the column of the apex crosses the surface first entering into it, then exiting from it: the cone must
+not contain any exit point above the apex. For each texel T above the apex, we consider the ray from the top of the column of the apex
+to T, and T is an exit point if the ray is above the surface after T (estimated with the gradient of the depth in T, see testTexel).
+The entry points do not limit the cone.
+In parallax.frag the ray moves at most by CONE_MAX_RAY_SLOPE in UV units for a unit of depth, so the points farther from the apex
+can never be reached by a ray, and they are not considered.
+
+N.B. 2)
+The texels near the apex (in a square of 2 * CONE_NEAR_TEXELS texels) are searched by rows, in order of distance from the apex row,
+and each row only in the interval which can still reduce the current cone: the search stops as soon as the whole row is too far.
+The height map repeats (GL_REPEAT), so the distances wrap around the borders: each row of depths (and of gradients) is stored 3 times consecutively,
+so any interval of a row is contiguous in memory.
+The test of 4 texels of a row is done with SSE instructions (if available, like in transform_store.h: it can be disabled defining
+CONE_STEP_MAP_NO_SIMD), including the exit test.
+
+N.B. 3)
+A ray can reach the texels up to CONE_MAX_RAY_SLOPE UV units from the apex (e.g., 200 texels in a 1024x1024 map), and searching all of them
+for each texel would take minutes. Outside the near square, the texels are grouped in blocks, with a size doubling at each "far level":
+each level is a ring of blocks around the square of the previous level, and it is tested only if the current cone reaches it.
+A block is used as a single constraint, with the minimum depth of its texels at their nearest distance from the apex: it is never wider
+than the cone of its texels, so far from the apex the cones are conservative. The minimum depths of the blocks of all the positions
+are computed once per level, each one from 4 blocks of half size of the previous level.
+The texels are grouped in tiles of CONE_TILE_SIZE x CONE_TILE_SIZE, and the tiles are baked in parallel by a set of threads,
+which take the next tile from an atomic counter. Each texel only reads the shared depths, so no other synchronization is needed.
+
+N.B. 4)
+The cone ratios are clamped to CONE_RATIO_MAX, and the square root of ratio / CONE_RATIO_MAX is stored in 8 bits, to have more
+precision on the narrow cones. The value is rounded down, so the stored cone is never wider than the baked one.
+
+Real-Time Graphics Programming - a.a. 2022/2023
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <string>
+#include <vector>
+#include <fstream>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if !defined(CONE_STEP_MAP_NO_SIMD) && (defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1))
+#include <xmmintrin.h>
+#define CONE_STEP_MAP_SSE
+#endif
+
+// HashFile
+#include <utils/mesh_cache.h>
+
+// maximum displacement of the ray in UV units for a unit of depth: it must be equal to the scale of the view direction in parallax.frag
+#define CONE_MAX_RAY_SLOPE 0.2f
+// maximum ratio of the cones: at this ratio, a ray moves by more than 80% of the distance from the surface in a single step
+#define CONE_RATIO_MAX 1.0f
+// size of the tiles baked by each thread
+#define CONE_TILE_SIZE 32
+// half size of the square region around the apex searched texel by texel, and number of blocks on half side of the far levels (see N.B. 3 above)
+#define CONE_NEAR_TEXELS 32
+#define CONE_FAR_BLOCKS 8
+
+// identifier at the beginning of the cache files
+// the last character is the version of the file layout: it must be changed every time ConeStepMapHeader or the baking are changed
+#define CONE_STEP_MAP_MAGIC "RTGPCSM1"
+
+struct ConeStepMapHeader {
+    char magic[8];
+    uint64_t sourceHash;
+    uint32_t width;
+    uint32_t height;
+};
+
+/////////////////// CONESTEPBAKER class ///////////////////////
+// baking of the cone step map of a height map (see N.B. 1, 2 and 3 above)
+class ConeStepBaker
+{
+public:
+    // heights: width x height values (1 byte per texel). The result has 2 bytes per texel: height, square root of the cone ratio
+    ConeStepBaker(const unsigned char* heights, int width, int height)
+        : heights(heights), width(width), height(height), rowStride(3 * width),
+          depths((size_t)3 * width * height + 4), gradientsX(depths.size()), gradientsY(depths.size())
+    {
+        for (int y = 0; y < height; y++)
+            for (int x = 0; x < width; x++)
+                this->store(this->depths, x, y, 1.0f - heights[(size_t)y * width + x] / 255.0f);
+        // gradients of the depth (central differences, in depth units per texel)
+        for (int y = 0; y < height; y++)
+            for (int x = 0; x < width; x++)
+            {
+                this->store(this->gradientsX, x, y, (this->row(this->depths, y)[x + 1] - this->row(this->depths, y)[x - 1]) * 0.5f);
+                this->store(this->gradientsY, x, y, (this->row(this->depths, y + 1)[x] - this->row(this->depths, y - 1)[x]) * 0.5f);
+            }
+
+        // minimum depths of the windows of size x size texels, each one from 4 windows of half size (see N.B. 3 above).
+        // The windows are needed from the size of the blocks of the first far level, until the blocks can be reached by a ray
+        vector<float> windows((size_t)width * height);
+        for (int y = 0; y < height; y++)
+            for (int x = 0; x < width; x++)
+                windows[(size_t)y * width + x] = this->row(this->depths, y)[x];
+        for (int size = 2; float(size * CONE_FAR_BLOCKS / 2) < CONE_MAX_RAY_SLOPE * float(max(width, height)); size *= 2)
+        {
+            vector<float> merged((size_t)width * height);
+            for (int y = 0; y < height; y++)
+                for (int x = 0; x < width; x++)
+                {
+                    int x1 = (x + size / 2) % width, y1 = (y + size / 2) % height;
+                    merged[(size_t)y * width + x] = min(min(windows[(size_t)y * width + x], windows[(size_t)y * width + x1]),
+                                                        min(windows[(size_t)y1 * width + x], windows[(size_t)y1 * width + x1]));
+                }
+            windows.swap(merged);
+            if (size * CONE_FAR_BLOCKS / 2 >= CONE_NEAR_TEXELS)
+                this->minDepths.push_back(windows);
+        }
+    }
+
+    vector<unsigned char> Bake(GLuint nThreads = max(1u, thread::hardware_concurrency()))
+    {
+        vector<unsigned char> coneMap((size_t)this->width * this->height * 2);
+        int tilesX = (this->width + CONE_TILE_SIZE - 1) / CONE_TILE_SIZE;
+        int tilesY = (this->height + CONE_TILE_SIZE - 1) / CONE_TILE_SIZE;
+        atomic<int> nextTile(0);
+
+        auto worker = [&]()
+        {
+            for (int tile = nextTile++; tile < tilesX * tilesY; tile = nextTile++)
+            {
+                int x0 = (tile % tilesX) * CONE_TILE_SIZE, y0 = (tile / tilesX) * CONE_TILE_SIZE;
+                for (int y = y0; y < min(y0 + CONE_TILE_SIZE, this->height); y++)
+                    for (int x = x0; x < min(x0 + CONE_TILE_SIZE, this->width); x++)
+                    {
+                        size_t texel = (size_t)y * this->width + x;
+                        float ratio = this->coneRatio(x, y);
+                        coneMap[2 * texel] = this->heights[texel];
+                        coneMap[2 * texel + 1] = (unsigned char)floor(sqrt(ratio / CONE_RATIO_MAX) * 255.0f);
+                    }
+            }
+        };
+
+        vector<thread> threads;
+        for (GLuint i = 1; i < nThreads; i++)
+            threads.emplace_back(worker);
+        worker();
+        for (thread& t : threads)
+            t.join();
+        return coneMap;
+    }
+
+private:
+    const unsigned char* heights;
+    int width, height;
+    // depths of the texels and their gradients, each row repeated 3 times (see N.B. 2 above).
+    // The 4 additional values at the end can be read by the last block of a row
+    int rowStride;
+    vector<float> depths, gradientsX, gradientsY;
+    // minimum depths of the blocks of the far levels: the block of each level is twice as large as the one of the previous level
+    vector<vector<float>> minDepths;
+
+    //////////////////////////////////////////
+
+    // index of texel 0 of the row y: the row can be read with x in [-width, 2 * width)
+    size_t rowOffset(int y) const
+    {
+        y = ((y % this->height) + this->height) % this->height;
+        return (size_t)y * this->rowStride + this->width;
+    }
+
+    const float* row(const vector<float>& values, int y) const
+    {
+        return &values[this->rowOffset(y)];
+    }
+
+    // we store the value of texel (x, y) in the 3 copies of its row
+    void store(vector<float>& values, int x, int y, float value)
+    {
+        for (int copy = 0; copy < 3; copy++)
+            values[(size_t)y * this->rowStride + copy * this->width + x] = value;
+    }
+
+    // ratio of the relaxed cone of the texel (x, y)
+    float coneRatio(int x, int y) const
+    {
+        float apexDepth = this->row(this->depths, y)[x];
+        float best = CONE_RATIO_MAX;
+        float invWidth2 = 1.0f / float(this->width * this->width);
+        // rows of the near region in order of distance: 0, -1, 1, -2, 2, ...
+        for (int i = 0; i < 2 * CONE_NEAR_TEXELS; i++)
+        {
+            int dy = (i % 2) ? -(i + 1) / 2 : i / 2;
+            float uy = float(dy) / float(this->height);
+            // squared distance from the apex of the texels which can still reduce the cone: the depth of a texel is at least 0, so its
+            // depth difference is at most apexDepth, and the texels at a distance above CONE_MAX_RAY_SLOPE * apexDepth are never reached
+            float reach2 = this->reach2(best, apexDepth);
+            if (uy * uy >= reach2 || abs(dy) > this->height / 2)
+                break;
+            int halfRow = min(int(float(this->width) * sqrt(reach2 - uy * uy)), this->width / 2);
+            this->scanRow(x, y, dy, uy * uy, max(-halfRow, -CONE_NEAR_TEXELS), min(halfRow, CONE_NEAR_TEXELS - 1), apexDepth, invWidth2, best);
+        }
+
+        // blocks of the far levels (see N.B. 3 above): each block is a constraint with its minimum depth, at its nearest distance from the apex
+        int size = 2 * CONE_NEAR_TEXELS / CONE_FAR_BLOCKS;
+        for (const vector<float>& windows : this->minDepths)
+        {
+            // distance of the nearest blocks of the level
+            float inner = float(size * CONE_FAR_BLOCKS / 2) / float(max(this->width, this->height));
+            if (inner * inner >= this->reach2(best, apexDepth))
+                break;
+            for (int by = -CONE_FAR_BLOCKS; by < CONE_FAR_BLOCKS; by++)
+                for (int bx = -CONE_FAR_BLOCKS; bx < CONE_FAR_BLOCKS; bx++)
+                {
+                    // the inner blocks are covered by the previous level
+                    if (bx >= -CONE_FAR_BLOCKS / 2 && bx < CONE_FAR_BLOCKS / 2 && by >= -CONE_FAR_BLOCKS / 2 && by < CONE_FAR_BLOCKS / 2)
+                        continue;
+                    int dx = bx * size, dy = by * size;
+                    float ux = float(max(0, max(dx, -(dx + size - 1)))) / float(this->width);
+                    float uy = float(max(0, max(dy, -(dy + size - 1)))) / float(this->height);
+                    float distance2 = ux * ux + uy * uy;
+                    int windowX = ((x + dx) % this->width + this->width) % this->width, windowY = ((y + dy) % this->height + this->height) % this->height;
+                    float gap = apexDepth - windows[(size_t)windowY * this->width + windowX];
+                    if (gap > 0.0f && distance2 < best * best * gap * gap && distance2 < CONE_MAX_RAY_SLOPE * CONE_MAX_RAY_SLOPE * apexDepth * apexDepth)
+                        best = sqrt(distance2) / gap;
+                }
+            size *= 2;
+        }
+        return best;
+    }
+
+    // squared distance in UV units of the texels which can still reduce the cone (see coneRatio)
+    float reach2(float best, float apexDepth) const
+    {
+        return min(best * best, CONE_MAX_RAY_SLOPE * CONE_MAX_RAY_SLOPE) * apexDepth * apexDepth;
+    }
+
+    // reduction of the cone with the texel at offset (dx, dy) from the apex, if it is an exit point (see N.B. 1 above): the ray from the top
+    // of the column of the apex, moved by one texel after the texel, has depth * (1 + 1 / length), with length the distance in texels,
+    // while the depth of the surface is estimated as depth + gradient . (dx, dy) / length. So the ray is above the surface if gradient . (dx, dy) > depth
+    void testTexel(int dx, int dy, float distance2, float depth, float gradientX, float gradientY, float apexDepth, float& best) const
+    {
+        float gap = apexDepth - depth;
+        if (gap > 0.0f && distance2 < best * best * gap * gap && distance2 < CONE_MAX_RAY_SLOPE * CONE_MAX_RAY_SLOPE * depth * depth
+            && gradientX * float(dx) + gradientY * float(dy) > depth)
+            best = sqrt(distance2) / gap;
+    }
+
+#ifdef CONE_STEP_MAP_SSE
+    // test of the texels of the row at offset dy, with dx from first to last, 4 texels at a time: all the conditions of testTexel are
+    // evaluated in parallel on 4 texels, and only the texels which reduce the cone are processed one at a time.
+    // The last block can read up to 3 texels after last, which are valid texels of the repeated row (see N.B. 2 above)
+    void scanRow(int x, int y, int dy, float uy2, int first, int last, float apexDepth, float invWidth2, float& rowBest) const
+    {
+        size_t offset = this->rowOffset(y + dy) + x;
+        const float* depths = &this->depths[offset];
+        const float* gradientsX = &this->gradientsX[offset];
+        const float* gradientsY = &this->gradientsY[offset];
+        // local copy of the current cone, which the compiler can keep in a register
+        float best = rowBest;
+        __m128 best2 = _mm_set1_ps(best * best);
+        __m128 apex = _mm_set1_ps(apexDepth);
+        __m128 rowDistance2 = _mm_set1_ps(uy2);
+        __m128 rowOffset = _mm_set1_ps(float(dy));
+        __m128 scale = _mm_set1_ps(invWidth2);
+        __m128 maxSlope2 = _mm_set1_ps(CONE_MAX_RAY_SLOPE * CONE_MAX_RAY_SLOPE);
+        __m128 zero = _mm_setzero_ps();
+        __m128 offsets = _mm_setr_ps(float(first), float(first + 1), float(first + 2), float(first + 3));
+        __m128 four = _mm_set1_ps(4.0f);
+        for (int dx = first; dx <= last; dx += 4)
+        {
+            __m128 depth = _mm_loadu_ps(depths + dx);
+            __m128 distance2 = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(offsets, offsets), scale), rowDistance2);
+            __m128 gap = _mm_sub_ps(apex, depth);
+            __m128 slope = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(gradientsX + dx), offsets), _mm_mul_ps(_mm_loadu_ps(gradientsY + dx), rowOffset));
+            __m128 candidate = _mm_and_ps(_mm_cmpgt_ps(gap, zero), _mm_cmplt_ps(distance2, _mm_mul_ps(best2, _mm_mul_ps(gap, gap))));
+            candidate = _mm_and_ps(candidate, _mm_cmplt_ps(distance2, _mm_mul_ps(maxSlope2, _mm_mul_ps(depth, depth))));
+            candidate = _mm_and_ps(candidate, _mm_cmpgt_ps(slope, depth));
+            int mask = _mm_movemask_ps(candidate);
+            if (mask)
+            {
+                float laneDistance2[4];
+                _mm_storeu_ps(laneDistance2, distance2);
+                for (int k = 0; k < 4; k++)
+                    if (mask & (1 << k))
+                        this->testTexel(dx + k, dy, laneDistance2[k], depths[dx + k], gradientsX[dx + k], gradientsY[dx + k], apexDepth, best);
+                best2 = _mm_set1_ps(best * best);
+            }
+            offsets = _mm_add_ps(offsets, four);
+        }
+        rowBest = best;
+    }
+#else
+    // test of the texels of the row at offset dy, with dx from first to last, one at a time
+    void scanRow(int x, int y, int dy, float uy2, int first, int last, float apexDepth, float invWidth2, float& best) const
+    {
+        size_t offset = this->rowOffset(y + dy) + x;
+        const float* depths = &this->depths[offset];
+        const float* gradientsX = &this->gradientsX[offset];
+        const float* gradientsY = &this->gradientsY[offset];
+        for (int dx = first; dx <= last; dx++)
+            this->testTexel(dx, dy, float(dx * dx) * invWidth2 + uy2, depths[dx], gradientsX[dx], gradientsY[dx], apexDepth, best);
+    }
+#endif
+};
+
+//////////////////////////////////////////
+// cache files
+
+// path of the cache of the cone step map of a height map (e.g. "textures/cobble/height.png" -> "textures/cobble/height.png.conemap")
+inline string ConeStepMapPath(const string& heightMapPath)
+{
+    return heightMapPath + ".conemap";
+}
+
+// we save a cone step map (2 bytes per texel). It returns false if the file cannot be written
+inline bool WriteConeStepMap(const string& path, uint64_t sourceHash, GLuint width, GLuint height, const vector<unsigned char>& coneMap)
+{
+    ofstream file(path, ios::binary | ios::trunc);
+    if (!file)
+        return false;
+    ConeStepMapHeader header = {};
+    memcpy(header.magic, CONE_STEP_MAP_MAGIC, sizeof(header.magic));
+    header.sourceHash = sourceHash;
+    header.width = width;
+    header.height = height;
+    file.write((const char*)&header, sizeof(header));
+    file.write((const char*)coneMap.data(), coneMap.size());
+    return (bool)file;
+}
+
+// we read a cone step map saved by WriteConeStepMap. It returns false if the file is missing, or if it was baked from a different height map
+inline bool ReadConeStepMap(const string& path, uint64_t sourceHash, GLuint& width, GLuint& height, vector<unsigned char>& coneMap)
+{
+    ifstream file(path, ios::binary);
+    if (!file)
+        return false;
+    ConeStepMapHeader header;
+    file.read((char*)&header, sizeof(header));
+    if (!file || memcmp(header.magic, CONE_STEP_MAP_MAGIC, sizeof(header.magic)) != 0 || header.sourceHash != sourceHash)
+        return false;
+    width = header.width;
+    height = header.height;
+    coneMap.resize((size_t)width * height * 2);
+    file.read((char*)coneMap.data(), coneMap.size());
+    return (bool)file;
+}
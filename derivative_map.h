@@ -0,0 +1,117 @@
+/*
+Derivative maps
+- conversion of a height map in a derivative map: a two channel texture with the partial derivatives of the height along u and v
+- the bump mapping and displacement shaders compute the perturbed normal from a single fetch of the derivative map,
+  instead of sampling the height map in the fragment and in two neighbouring points
+
+The derivatives are measured in height units per UV unit: the difference between two texels is divided by their distance in UV space
+(1 / width along u, 1 / height along v), so the same height map at different resolutions gives the same derivatives, and the
+strength of the bump does not depend on the size of the image.
+Since the derivatives are linear in the heights, the bilinear filtering and the mipmaps of the derivative map are the derivatives of the
+filtered height map: the perturbed normal is filtered correctly at any distance.
+See M. Mikkelsen, "Bump Mapping Unparametrized Surfaces on the GPU" (2010), and http://www.rorydriscoll.com/2012/01/11/derivative-maps/
+
+N.B. 1)
+The derivatives are computed with the Sobel filter: the central difference along one direction is averaged with weights (1, 2, 1) along
+the other one. The smoothing removes most of the "steps" of the heights quantized in 8 bits, which are evident in the specular highlights.
+The height map is tiled (the textures use GL_REPEAT), so the neighbours of the texels on the borders are on the opposite border.
+
+N.B. 2)
+The heights of each row are converted in floats, with one more texel on both sides copied from the opposite border: in this way the
+filter of 4 consecutive texels is computed with SSE instructions, without checking the borders.
+The SSE code is used if the compiler targets an x86 CPU with SSE, and it can be disabled defining DERIVATIVE_MAP_NO_SIMD (same as
+TransformStore, see transform_store.h).
+
+N.B. 3)
+The derivatives of an 8 bit height map go from fractions of unit (smooth slopes) to thousands (steps between neighbouring texels of a large map):
+they are stored in half floats (GL_RG16F), which have the same relative precision for all the values.
+
+Real-Time Graphics Programming - a.a. 2022/2023
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <vector>
+
+#if !defined(DERIVATIVE_MAP_NO_SIMD) && (defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1))
+#include <xmmintrin.h>
+#define DERIVATIVE_MAP_SSE
+#endif
+
+// texture unit of the derivative map (the units 0-2 are used by the material textures, 3-5 by the lights, 6-8 by the G-buffer)
+enum DerivativeMapTextureUnit { DERIVATIVE_MAP_UNIT = 9 };
+
+//////////////////////////////////////////
+// heights of the row y of the height map (8 bit, one channel every stride bytes) in [0,1], with one more texel on both sides (see N.B. 2 above)
+inline void LoadHeightRow(const unsigned char* heights, int width, int stride, int y, vector<float>& row)
+{
+    const unsigned char* source = heights + (size_t)y * width * stride;
+    for (int x = 0; x < width; x++)
+        row[x + 1] = source[(size_t)x * stride] / 255.0f;
+    row[0] = row[width];
+    row[width + 1] = row[1];
+}
+
+//////////////////////////////////////////
+// derivative map of a height map of width x height texels, with one channel every stride bytes (e.g. 2 for the R channel of a cone step map).
+// It returns the derivatives along u and v of each texel, interleaved (RG), in height units per UV unit
+inline vector<float> BakeDerivativeMap(const unsigned char* heights, int width, int height, int stride = 1)
+{
+    vector<float> derivatives((size_t)width * height * 2);
+    // the rows above, in and below the current one, with the texels of the borders (see N.B. 2 above)
+    vector<float> rows[3];
+    for (vector<float>& row : rows)
+        row.resize(width + 2);
+    LoadHeightRow(heights, width, stride, height - 1, rows[0]);
+    LoadHeightRow(heights, width, stride, 0, rows[1]);
+
+    // Sobel weights are (1, 2, 1) / 4 along the smoothing direction, and the central difference spans 2 texels
+    float scaleU = width / 8.0f, scaleV = height / 8.0f;
+    for (int y = 0; y < height; y++)
+    {
+        LoadHeightRow(heights, width, stride, (y + 1) % height, rows[2]);
+        const float* above = rows[0].data();
+        const float* center = rows[1].data();
+        const float* below = rows[2].data();
+        float* output = &derivatives[(size_t)y * width * 2];
+
+        int x = 0;
+#ifdef DERIVATIVE_MAP_SSE
+        __m128 two = _mm_set1_ps(2.0f);
+        __m128 factorU = _mm_set1_ps(scaleU), factorV = _mm_set1_ps(scaleV);
+        for (; x + 4 <= width; x += 4)
+        {
+            // the texel x of the row is at index x + 1: the left neighbours are at x, the right ones at x + 2
+            __m128 left = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(above + x), _mm_loadu_ps(below + x)), _mm_mul_ps(two, _mm_loadu_ps(center + x)));
+            __m128 right = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(above + x + 2), _mm_loadu_ps(below + x + 2)), _mm_mul_ps(two, _mm_loadu_ps(center + x + 2)));
+            __m128 up = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(above + x), _mm_loadu_ps(above + x + 2)), _mm_mul_ps(two, _mm_loadu_ps(above + x + 1)));
+            __m128 down = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(below + x), _mm_loadu_ps(below + x + 2)), _mm_mul_ps(two, _mm_loadu_ps(below + x + 1)));
+            __m128 du = _mm_mul_ps(_mm_sub_ps(right, left), factorU);
+            __m128 dv = _mm_mul_ps(_mm_sub_ps(down, up), factorV);
+            // we interleave the derivatives of the 4 texels: (du0, dv0, du1, dv1), (du2, dv2, du3, dv3)
+            _mm_storeu_ps(output + 2 * x, _mm_unpacklo_ps(du, dv));
+            _mm_storeu_ps(output + 2 * x + 4, _mm_unpackhi_ps(du, dv));
+        }
+#endif
+        // remaining texels of the row (all of them without SSE), with the same computation
+        for (; x < width; x++)
+        {
+            float left = (above[x] + below[x]) + 2.0f * center[x];
+            float right = (above[x + 2] + below[x + 2]) + 2.0f * center[x + 2];
+            float up = (above[x] + above[x + 2]) + 2.0f * above[x + 1];
+            float down = (below[x] + below[x + 2]) + 2.0f * below[x + 1];
+            output[2 * x] = (right - left) * scaleU;
+            output[2 * x + 1] = (down - up) * scaleV;
+        }
+
+        // the rows move up by one: the row below the current one is loaded at the next iteration
+        swap(rows[0], rows[1]);
+        swap(rows[1], rows[2]);
+    }
+    return derivatives;
+}
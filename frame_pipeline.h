@@ -0,0 +1,177 @@
+/*
+TripleBuffer and FramePipeline classes
+- FramePipeline runs the simulation of the frames (movements of the camera and of the objects, culling, ...) on a worker thread,
+  while the thread owning the OpenGL context renders the previous frame: the CPU work of frame N+1 overlaps the submission of frame N
+- the simulation receives the input of a frame, and it writes the result in a "frame packet": a copy of all the data needed to render the frame.
+  After its publication, a packet is never modified, so the render thread reads it without locks
+- the packets are exchanged through a TripleBuffer: the writer fills the back buffer, the reader reads the front buffer, and the third
+  buffer holds the last published packet. Publish swaps the back and the middle buffer, Acquire swaps the middle and the front buffer:
+  the writer never waits for the reader to finish reading
+
+Usage (render thread):
+Start(input of frame 0)
+loop: packet = Wait() -> changes of the variables read by the simulation (events, GUI, ...) -> Start(input of the next frame) -> rendering of the packet
+
+N.B. 1)
+The packet rendered in a frame has been simulated with the input of the previous frame: the pipeline adds a frame of latency, and in exchange
+the frame time is the maximum of the simulation and of the rendering times, instead of their sum.
+
+N.B. 2)
+Between Wait and Start the simulation thread waits for its input: in this interval the render thread can change the variables read by the
+simulation (e.g., with the GUI). After Start, the render thread must read only the packet, and the variables not written by the simulation.
+The mutex of the TripleBuffer orders the writes of the simulation before the return of Wait (and the ones of the render thread before the
+simulation of the next frame), so no other synchronization is needed.
+
+N.B. 3)
+If threaded is false, Start runs the simulation immediately on the calling thread: the results are the same (with the same latency), without
+the overlap. It is useful to measure the gain of the pipeline, and to debug the simulation.
+
+N.B. 4)
+TripleBuffer and FramePipeline own a mutex (and FramePipeline its thread), so they are not copyable or movable.
+
+Real-Time Graphics Programming - a.a. 2022/2023
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <utility>
+
+/////////////////// TRIPLEBUFFER class ///////////////////////
+template <typename T>
+class TripleBuffer {
+public:
+    TripleBuffer(const TripleBuffer& copy) = delete; //disallow copy
+    TripleBuffer& operator=(const TripleBuffer &) = delete;
+
+    TripleBuffer() : back(0), middle(1), front(2), fresh(false) {}
+
+    // buffer written by the writer (the content is the one of an older packet: the writer must overwrite it completely)
+    T& Back()
+    {
+        return this->buffers[this->back];
+    }
+
+    // publication of the back buffer. If the previous one has not been acquired yet, it is replaced (the reader gets only the last one)
+    void Publish()
+    {
+        {
+            lock_guard<mutex> lock(this->swapMutex);
+            swap(this->back, this->middle);
+            this->fresh = true;
+        }
+        this->published.notify_one();
+    }
+
+    // the reader waits for a packet published after the last call to Acquire, and it gets it. The packet is valid until the next call
+    const T& Acquire()
+    {
+        unique_lock<mutex> lock(this->swapMutex);
+        this->published.wait(lock, [this] { return this->fresh; });
+        swap(this->front, this->middle);
+        this->fresh = false;
+        return this->buffers[this->front];
+    }
+
+private:
+    T buffers[3];
+    // indices of the buffers in the 3 roles
+    GLuint back, middle, front;
+    // true if the middle buffer has been published after the last Acquire
+    bool fresh;
+    mutex swapMutex;
+    condition_variable published;
+};
+
+/////////////////// FRAMEPIPELINE class ///////////////////////
+template <typename Input, typename Packet>
+class FramePipeline {
+public:
+    FramePipeline(const FramePipeline& copy) = delete; //disallow copy
+    FramePipeline& operator=(const FramePipeline &) = delete;
+
+    // simulate computes the packet of a frame from its input. If threaded is true, it is called by the simulation thread (see N.B. 3 above)
+    FramePipeline(function<void(const Input&, Packet&)> simulate, bool threaded = true)
+        : simulate(std::move(simulate)), threaded(threaded), pending(false), stopping(false)
+    {
+        if (this->threaded)
+            this->worker = thread(&FramePipeline::workerLoop, this);
+    }
+
+    // the simulation in progress is completed, and the thread is stopped
+    ~FramePipeline()
+    {
+        if (!this->threaded)
+            return;
+        {
+            lock_guard<mutex> lock(this->inputMutex);
+            this->stopping = true;
+        }
+        this->inputCondition.notify_one();
+        this->worker.join();
+    }
+
+    //////////////////////////////////////////
+
+    // the simulation of the next frame starts with the given input. It must be called once after each Wait (and once before the first one)
+    void Start(const Input& input)
+    {
+        if (!this->threaded)
+        {
+            this->simulate(input, this->packets.Back());
+            this->packets.Publish();
+            return;
+        }
+        {
+            lock_guard<mutex> lock(this->inputMutex);
+            this->input = input;
+            this->pending = true;
+        }
+        this->inputCondition.notify_one();
+    }
+
+    // we wait for the end of the simulation started with the last call to Start, and we get its packet (valid until the next call to Wait)
+    const Packet& Wait()
+    {
+        return this->packets.Acquire();
+    }
+
+private:
+    function<void(const Input&, Packet&)> simulate;
+    bool threaded;
+    TripleBuffer<Packet> packets;
+
+    thread worker;
+    // input of the next frame
+    Input input;
+    bool pending, stopping;
+    mutex inputMutex;
+    condition_variable inputCondition;
+
+    // the simulation thread waits for the input of a frame, and it publishes the packet of the frame
+    void workerLoop()
+    {
+        while (true)
+        {
+            Input frameInput;
+            {
+                unique_lock<mutex> lock(this->inputMutex);
+                this->inputCondition.wait(lock, [this] { return this->stopping || this->pending; });
+                if (this->stopping)
+                    return;
+                frameInput = this->input;
+                this->pending = false;
+            }
+            this->simulate(frameInput, this->packets.Back());
+            this->packets.Publish();
+        }
+    }
+};
@@ -0,0 +1,177 @@
+/*
+GBuffer class
+- render target of the geometry pass of deferred shading: the objects are rendered without lighting, and for each pixel the
+  parameters of the visible surface are saved in a set of textures (the "G-buffer")
+- in the lighting pass, a triangle covering the whole screen reads the G-buffer and computes the Blinn-Phong model once per pixel,
+  only for the lights of the cluster containing the pixel (see light_clusters.h)
+
+With forward shading, the lighting is computed for every rasterized fragment, including the ones later hidden by nearer surfaces (overdraw),
+and the cost of the per-light loop is multiplied by the cost of the technique (e.g., the ray-march of parallax mapping).
+With deferred shading, each technique only computes the perturbed normal and the albedo in the geometry pass, and the lighting cost
+depends only on the number of pixels and on the number of lights.
+See https://learnopengl.com/Advanced-Lighting/Deferred-Shading for details.
+
+G-buffer layout:
+- color attachment 0 (RGBA8): albedo multiplied by Kd (rgb), Ks (a)
+- color attachment 1 (RGBA16F): normal in world space (xyz), shininess (w)
+- depth attachment (24 bit): depth of the pixel. The world space position is reconstructed from the depth and the inverse of the
+  projection * view matrix, so it does not need a texture
+
+N.B. 1)
+The lighting pass writes the depth of the G-buffer in the current framebuffer (gl_FragDepth), so the objects rendered after it
+with forward shading (e.g., the spheres of the lights) are correctly occluded. The pixels without surfaces are discarded,
+and they keep the clear color.
+
+N.B. 2)
+The fullscreen triangle has no vertex attributes: its vertices are computed in the vertex shader from gl_VertexID.
+The core profile requires a VAO for every draw call, so an empty VAO is used.
+
+N.B. 3)
+GBuffer follows RAII principles and it is a "move-only" class, like the Mesh class.
+
+Real-Time Graphics Programming - a.a. 2022/2023
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <iostream>
+
+// the textures, the VAO and the polygon mode are set through the state cache
+#include <utils/gl_state.h>
+
+// texture units of the G-buffer textures in the lighting pass (the units 0-2 are used by the material textures, 3-5 by the lights, see light_clusters.h)
+enum GBufferTextureUnit {
+    GBUFFER_ALBEDO_UNIT = 6,
+    GBUFFER_NORMAL_UNIT = 7,
+    GBUFFER_DEPTH_UNIT = 8
+};
+
+/////////////////// GBUFFER class ///////////////////////
+class GBuffer {
+public:
+    GLuint width, height;
+
+    GBuffer(const GBuffer& copy) = delete; //disallow copy
+    GBuffer& operator=(const GBuffer &) = delete;
+
+    GBuffer(GLuint width, GLuint height) noexcept
+        : width(width), height(height), previousFBO(0)
+    {
+        glGenFramebuffers(1, &this->FBO);
+        glGenTextures(3, this->textures);
+        glGenVertexArrays(1, &this->emptyVAO);
+
+        // internal format, format and type of the albedo, normal and depth textures
+        GLenum formats[3][3] = { { GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE }, { GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT }, { GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT } };
+        for (int i = 0; i < 3; i++)
+        {
+            GLState().BindTexture(GL_TEXTURE_2D, this->textures[i]);
+            glTexImage2D(GL_TEXTURE_2D, 0, formats[i][0], width, height, 0, formats[i][1], formats[i][2], NULL);
+            // the lighting pass reads exactly one texel per pixel
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
+        GLState().BindTexture(GL_TEXTURE_2D, 0);
+
+        // the render target in use is restored at the end
+        GLuint current = GLState().CurrentFramebuffer();
+        GLState().BindFramebuffer(this->FBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->textures[0], 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, this->textures[1], 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, this->textures[2], 0);
+        // the fragment shaders of the geometry pass write in both the color attachments
+        GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+        glDrawBuffers(2, drawBuffers);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            cout << "ERROR::GBUFFER:: Framebuffer is not complete!" << endl;
+        GLState().BindFramebuffer(current);
+    }
+
+    GBuffer(GBuffer&& move) noexcept
+        : width(move.width), height(move.height), FBO(move.FBO), emptyVAO(move.emptyVAO), previousFBO(0)
+    {
+        for (int i = 0; i < 3; i++)
+            this->textures[i] = move.textures[i];
+        move.FBO = 0;
+    }
+
+    GBuffer& operator=(GBuffer&& move) noexcept
+    {
+        freeGPUresources();
+        width = move.width;
+        height = move.height;
+        FBO = move.FBO;
+        emptyVAO = move.emptyVAO;
+        for (int i = 0; i < 3; i++)
+            textures[i] = move.textures[i];
+        move.FBO = 0;
+        return *this;
+    }
+
+    ~GBuffer() noexcept
+    {
+        freeGPUresources();
+    }
+
+    //////////////////////////////////////////
+
+    // the G-buffer becomes the current render target, and it is cleared. The previous render target is restored by EndGeometryPass
+    void BeginGeometryPass()
+    {
+        // the state cache knows the render target in use, so the driver is not queried (see gl_state.h)
+        this->previousFBO = GLState().CurrentFramebuffer();
+        GLState().BindFramebuffer(this->FBO);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    }
+
+    // the previous render target is restored, and the G-buffer textures are bound to their texture units for the lighting pass
+    void EndGeometryPass()
+    {
+        GLState().BindFramebuffer(this->previousFBO);
+        GLenum units[3] = { GBUFFER_ALBEDO_UNIT, GBUFFER_NORMAL_UNIT, GBUFFER_DEPTH_UNIT };
+        for (int i = 0; i < 3; i++)
+            GLState().BindTexture(units[i], GL_TEXTURE_2D, this->textures[i]);
+    }
+
+    // lighting pass, with the Shader Program in use: a triangle covering the whole screen (see N.B. 2 above).
+    // The depth test always passes, because the depth of the pixels is written by the shader (see N.B. 1 above)
+    void DrawLightingPass()
+    {
+        GLenum polygonMode = GLState().CurrentPolygonMode();
+        GLState().PolygonMode(GL_FILL);
+        glDepthFunc(GL_ALWAYS);
+        GLState().BindVertexArray(this->emptyVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glDepthFunc(GL_LESS);
+        GLState().PolygonMode(polygonMode);
+    }
+
+private:
+    GLuint FBO;
+    // albedo, normal and depth textures
+    GLuint textures[3];
+    GLuint emptyVAO;
+    // render target bound before the geometry pass
+    GLuint previousFBO;
+
+    void freeGPUresources()
+    {
+        // If FBO is 0, this instance has been through a move, and no longer owns GPU resources
+        if (FBO)
+        {
+            glDeleteFramebuffers(1, &this->FBO);
+            glDeleteTextures(3, this->textures);
+            glDeleteVertexArrays(1, &this->emptyVAO);
+            GLState().ForgetTextures(3, this->textures);
+            GLState().ForgetVertexArray(this->emptyVAO);
+            GLState().ForgetFramebuffer(this->FBO);
+        }
+    }
+};
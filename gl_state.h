@@ -0,0 +1,284 @@
+/*
+StateCache class
+- "shadow" copy of the OpenGL state changed most often during a frame: Shader Program in use, VAO, textures bound to the texture units,
+  polygon mode, framebuffer (render target), and values of the uniforms of each program
+- each call compares the requested state with the shadow copy, and the OpenGL call is issued only if the state is different:
+  e.g., the textures of the material are bound again only when the texture set changes, and a uniform with the same value of
+  the previous draw call is not uploaded again
+- the calls issued to the driver and the ones skipped ("elided") are counted, and shown in the GUI
+
+Each OpenGL call has a cost on the CPU (validation of the parameters and of the state in the driver), even if the state does not change,
+and some changes (e.g., of the Shader Program) make the driver validate again the whole pipeline at the next draw call.
+See https://www.khronos.org/opengl/wiki/Common_Mistakes and C. Everitt et al., "Approaching Zero Driver Overhead" (GDC 2014).
+
+N.B. 1)
+The shadow copy is valid only if all the changes of this state go through the cache: in the application, glUseProgram, glBindVertexArray,
+glActiveTexture, glBindTexture, glPolygonMode and glBindFramebuffer must not be called directly (Dear ImGui is an exception, because its OpenGL backend
+saves and restores the state it changes). After an external change, Invalidate forces the next calls to be issued.
+
+N.B. 2)
+Since the redundant binds are skipped, the VAOs are not "detached" after the draw calls anymore: the last VAO stays bound.
+A GL_ELEMENT_ARRAY_BUFFER bound while a VAO is bound becomes part of the VAO, so the code which binds an index buffer outside
+of a VAO must first bind the VAO 0 (e.g., the allocation of the meshes in GeometryArena, see mesh.h).
+
+N.B. 3)
+When a texture or a VAO is deleted, OpenGL binds 0 in its place, and the name can be reused for a new object: the deletions must be
+notified with ForgetTextures, ForgetVertexArray and ForgetFramebuffer. In the same way, ForgetProgram removes the uniforms of a deleted program.
+
+N.B. 4)
+The state belongs to the OpenGL context, so the application has a single StateCache (GLState()), used from the thread of the context.
+
+Real-Time Graphics Programming - a.a. 2022/2023
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <unordered_map>
+#include <cstdint>
+#include <cstring>
+
+// texture units tracked by the cache (the application uses the units 0-9): the binds to the other units are always issued
+#define STATE_CACHE_TEXTURE_UNITS 16
+// value of the shadow copy when the actual OpenGL state is unknown
+#define STATE_CACHE_UNKNOWN 0xFFFFFFFFu
+
+/////////////////// STATECACHE class ///////////////////////
+class StateCache {
+public:
+    // OpenGL calls issued and elided after the last call to ResetCounters
+    GLuint issuedCalls, elidedCalls;
+
+    StateCache(const StateCache& copy) = delete; //disallow copy
+    StateCache& operator=(const StateCache &) = delete;
+
+    StateCache() : issuedCalls(0), elidedCalls(0)
+    {
+        this->Invalidate();
+    }
+
+    //////////////////////////////////////////
+
+    void UseProgram(GLuint program)
+    {
+        if (this->check(this->program, program))
+            glUseProgram(program);
+    }
+
+    void BindVertexArray(GLuint VAO)
+    {
+        if (this->check(this->vertexArray, VAO))
+            glBindVertexArray(VAO);
+    }
+
+    // bind of a texture to a texture unit: the active unit is changed only if the bind is needed
+    void BindTexture(GLuint unit, GLenum target, GLuint texture)
+    {
+        GLint slot = targetSlot(target);
+        if (unit >= STATE_CACHE_TEXTURE_UNITS || slot < 0)
+        {
+            this->activeTexture(unit);
+            glBindTexture(target, texture);
+            this->issuedCalls++;
+            return;
+        }
+        if (!this->check(this->textures[unit][slot], texture))
+            return;
+        this->activeTexture(unit);
+        glBindTexture(target, texture);
+    }
+
+    // bind of a texture to the active texture unit (e.g., to upload its content)
+    void BindTexture(GLenum target, GLuint texture)
+    {
+        this->BindTexture((this->activeUnit == STATE_CACHE_UNKNOWN) ? 0 : this->activeUnit, target, texture);
+    }
+
+    // polygon mode of both faces (GL_FILL or GL_LINE), and current value (it avoids a glGetIntegerv, which can wait for the driver)
+    void PolygonMode(GLenum mode)
+    {
+        if (this->check(this->polygonMode, mode))
+            glPolygonMode(GL_FRONT_AND_BACK, mode);
+    }
+
+    GLenum CurrentPolygonMode() const
+    {
+        return (this->polygonMode == STATE_CACHE_UNKNOWN) ? GL_FILL : this->polygonMode;
+    }
+
+    // framebuffer used as render target (both for drawing and reading), and current one: the binding is queried to the driver
+    // only when it is unknown (e.g., after Invalidate), so the code which restores the previous render target does not wait for the driver
+    void BindFramebuffer(GLuint FBO)
+    {
+        if (this->check(this->framebuffer, FBO))
+            glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+    }
+
+    GLuint CurrentFramebuffer()
+    {
+        if (this->framebuffer == STATE_CACHE_UNKNOWN)
+        {
+            GLint current = 0;
+            glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &current);
+            this->framebuffer = GLuint(current);
+        }
+        return this->framebuffer;
+    }
+
+    // uniforms of the Shader Program in use (the location -1 is ignored, like in the glUniform* calls)
+    void Uniform1i(GLint location, GLint value)
+    {
+        if (this->checkUniform(location, &value, sizeof(value)))
+            glUniform1i(location, value);
+    }
+
+    void Uniform1f(GLint location, GLfloat value)
+    {
+        if (this->checkUniform(location, &value, sizeof(value)))
+            glUniform1f(location, value);
+    }
+
+    void Uniform2f(GLint location, GLfloat x, GLfloat y)
+    {
+        GLfloat value[2] = { x, y };
+        if (this->checkUniform(location, value, sizeof(value)))
+            glUniform2f(location, x, y);
+    }
+
+    void UniformMatrix4fv(GLint location, const GLfloat* value)
+    {
+        if (this->checkUniform(location, value, 16 * sizeof(GLfloat)))
+            glUniformMatrix4fv(location, 1, GL_FALSE, value);
+    }
+
+    //////////////////////////////////////////
+
+    // notification of deleted objects (see N.B. 3 above)
+    void ForgetTextures(GLsizei n, const GLuint* deleted)
+    {
+        for (GLsizei i = 0; i < n; i++)
+            for (auto& unit : this->textures)
+                for (GLuint& texture : unit)
+                    if (texture == deleted[i])
+                        texture = 0;
+    }
+
+    void ForgetVertexArray(GLuint VAO)
+    {
+        if (this->vertexArray == VAO)
+            this->vertexArray = 0;
+    }
+
+    // a deleted framebuffer in use is replaced by the default one
+    void ForgetFramebuffer(GLuint FBO)
+    {
+        if (this->framebuffer == FBO)
+            this->framebuffer = 0;
+    }
+
+    void ForgetProgram(GLuint deleted)
+    {
+        // a program deleted while in use is deleted when it is not in use anymore, so the state is unknown
+        if (this->program == deleted)
+            this->program = STATE_CACHE_UNKNOWN;
+        for (auto it = this->uniforms.begin(); it != this->uniforms.end(); )
+            it = (GLuint(it->first >> 32) == deleted) ? this->uniforms.erase(it) : next(it);
+    }
+
+    // the state has been changed outside of the cache (see N.B. 1 above): the next calls are issued
+    void Invalidate()
+    {
+        this->program = this->vertexArray = this->polygonMode = this->framebuffer = this->activeUnit = STATE_CACHE_UNKNOWN;
+        for (auto& unit : this->textures)
+            for (GLuint& texture : unit)
+                texture = STATE_CACHE_UNKNOWN;
+        this->uniforms.clear();
+    }
+
+    void ResetCounters()
+    {
+        this->issuedCalls = this->elidedCalls = 0;
+    }
+
+    // counting of the changes of the state made outside of this class (e.g., the uniform buffers skip the uploads of unchanged blocks)
+    void Count(bool issued)
+    {
+        (issued ? this->issuedCalls : this->elidedCalls)++;
+    }
+
+private:
+    // value of a uniform: up to a mat4
+    struct UniformValue {
+        GLuint size;
+        unsigned char bytes[16 * sizeof(GLfloat)];
+    };
+
+    GLuint program, vertexArray, polygonMode, framebuffer, activeUnit;
+    // textures bound to each unit: GL_TEXTURE_2D and GL_TEXTURE_BUFFER targets
+    GLuint textures[STATE_CACHE_TEXTURE_UNITS][2];
+    // values of the uniforms, with key (program << 32 | location)
+    unordered_map<uint64_t, UniformValue> uniforms;
+
+    //////////////////////////////////////////
+
+    static GLint targetSlot(GLenum target)
+    {
+        return (target == GL_TEXTURE_2D) ? 0 : (target == GL_TEXTURE_BUFFER) ? 1 : -1;
+    }
+
+    // it returns true (and it updates the shadow copy) if the call must be issued
+    bool check(GLuint& current, GLuint value)
+    {
+        if (current == value)
+        {
+            this->elidedCalls++;
+            return false;
+        }
+        current = value;
+        this->issuedCalls++;
+        return true;
+    }
+
+    void activeTexture(GLuint unit)
+    {
+        // the change of the active unit is part of the bind, so it is not counted separately
+        if (this->activeUnit != unit)
+        {
+            glActiveTexture(GL_TEXTURE0 + unit);
+            this->activeUnit = unit;
+        }
+    }
+
+    bool checkUniform(GLint location, const void* value, GLuint size)
+    {
+        if (location < 0)
+            return false;
+        // without the program in use, the value cannot be associated to a program
+        if (this->program == STATE_CACHE_UNKNOWN)
+        {
+            this->issuedCalls++;
+            return true;
+        }
+        UniformValue& cached = this->uniforms[(uint64_t(this->program) << 32) | GLuint(location)];
+        if (cached.size == size && memcmp(cached.bytes, value, size) == 0)
+        {
+            this->elidedCalls++;
+            return false;
+        }
+        cached.size = size;
+        memcpy(cached.bytes, value, size);
+        this->issuedCalls++;
+        return true;
+    }
+};
+
+// the state cache of the OpenGL context of the application (see N.B. 4 above)
+inline StateCache& GLState()
+{
+    static StateCache state;
+    return state;
+}
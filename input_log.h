@@ -0,0 +1,246 @@
+/*
+InputLog class
+- recording of the input of the application in a compact binary log, and replay of the log, to reproduce exactly a session
+  (e.g., to compare the frame times of different builds on the same sequence of frames)
+- for each frame, the log contains the timestep, the keys pressed, and the mouse movement applied to the camera (FrameInput)
+- the other variables which can change the frames (parameters of the GUI, list of the lights, ...) are registered with Track:
+  the log contains only the variables changed in each frame
+
+In record mode, Frame saves the input of the frame and the tracked variables changed since the last call to EndFrame.
+In replay mode, Frame replaces the input of the frame with the recorded one, and it assigns the recorded values to the tracked variables.
+So the application uses the same code in both modes: it calls Frame, it applies the input (movements of the camera and of the lights),
+and then it calls EndFrame.
+
+File layout:
+"RTGPINP1" | number of tracked variables (uint32) | frame 0 | frame 1 | ...
+frame: FrameInput | number of changed variables (uint8) | for each one: index (uint8), size in bytes (uint32), value
+
+N.B. 1)
+The camera and the lights moved with the keys are not tracked: their movements depend only on the input and on the timestep,
+so they are computed again in the same way during the replay. EndFrame saves the values of the tracked variables after these
+movements, so in the next frame only the changes made by the user (e.g., with the GUI) are saved in the log.
+
+N.B. 2)
+The timestep is taken from the log, not from the clock: the sequence of frames of the replay does not depend on how fast the frames
+are rendered. The variables must be registered in the same order in record and replay mode, and the build must have the same tracked
+variables: the log is rejected if the number of variables is different.
+
+N.B. 3)
+The values are saved as raw bytes: the tracked types must be trivially copyable (e.g., no pointers or strings), and the log can be replayed
+only on a CPU with the same endianness (as the mesh cache, see mesh_cache.h).
+
+Real-Time Graphics Programming - a.a. 2022/2023
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <functional>
+#include <type_traits>
+#include <cstdint>
+#include <cstring>
+
+// identifier at the beginning of the log files
+// the last character is the version of the file layout: it must be changed every time FrameInput or the frame layout are changed
+#define INPUT_LOG_MAGIC "RTGPINP1"
+
+enum InputLogMode { RECORD_INPUT, REPLAY_INPUT };
+
+// input of a frame
+struct FrameInput {
+    // timestep of the frame, in seconds
+    float deltaTime;
+    // bit i is set if the i-th key of the keys recorded by the application is pressed
+    uint32_t keys;
+    // offset of the mouse cursor applied to the camera in the frame
+    float mouseX, mouseY;
+};
+
+/////////////////// INPUTLOG class ///////////////////////
+class InputLog {
+public:
+    const InputLogMode mode;
+    // number of frames recorded or replayed
+    uint64_t frames;
+
+    InputLog(const InputLog& copy) = delete; //disallow copy
+    InputLog& operator=(const InputLog &) = delete;
+
+    // the log is opened for writing (record mode) or for reading (replay mode)
+    InputLog(const string& path, InputLogMode mode)
+        : mode(mode), frames(0), started(false)
+    {
+        if (mode == RECORD_INPUT)
+            this->output.open(path, ios::binary | ios::trunc);
+        else
+            this->input.open(path, ios::binary);
+        if (!this->IsOpen())
+            cout << "ERROR::INPUT_LOG:: cannot open " << path << endl;
+    }
+
+    bool IsOpen() const
+    {
+        return (this->mode == RECORD_INPUT) ? this->output.is_open() : this->input.is_open();
+    }
+
+    //////////////////////////////////////////
+
+    // registration of a variable of the application (see N.B. 3 above). It must be called before the first frame
+    template <typename T>
+    void Track(T& variable)
+    {
+        static_assert(is_trivially_copyable<T>::value, "the variables of the input log must be trivially copyable");
+        this->channels.push_back({
+            [&variable](vector<char>& bytes) { bytes.assign((const char*)&variable, (const char*)&variable + sizeof(T)); },
+            [&variable](const vector<char>& bytes) { if (bytes.size() == sizeof(T)) memcpy((void*)&variable, bytes.data(), sizeof(T)); } });
+    }
+
+    // registration of a vector: the number of elements can change
+    template <typename T>
+    void Track(vector<T>& variable)
+    {
+        static_assert(is_trivially_copyable<T>::value, "the variables of the input log must be trivially copyable");
+        this->channels.push_back({
+            [&variable](vector<char>& bytes) { bytes.assign((const char*)variable.data(), (const char*)(variable.data() + variable.size())); },
+            [&variable](const vector<char>& bytes)
+            {
+                variable.resize(bytes.size() / sizeof(T));
+                if (!bytes.empty())
+                    memcpy((void*)variable.data(), bytes.data(), variable.size() * sizeof(T));
+            } });
+    }
+
+    // beginning of a frame: in record mode, the input and the changed variables are saved, in replay mode the recorded input
+    // replaces the given one and the variables are restored. It returns false at the end of the log (or if the log is not valid)
+    bool Frame(FrameInput& frameInput)
+    {
+        if (!this->IsOpen() || !this->start())
+            return false;
+        if (this->mode == RECORD_INPUT)
+            this->record(frameInput);
+        else if (!this->replay(frameInput))
+            return false;
+        this->frames++;
+        return true;
+    }
+
+    // end of the input of a frame: the current values of the variables are the reference for the changes of the next frame (see N.B. 1 above)
+    void EndFrame()
+    {
+        if (this->mode == RECORD_INPUT)
+            for (Channel& channel : this->channels)
+                channel.read(channel.last);
+    }
+
+private:
+    struct Channel {
+        // copy of the value of the variable in bytes, and assignment of a value
+        function<void(vector<char>&)> read;
+        function<void(const vector<char>&)> write;
+        // value at the end of the last frame
+        vector<char> last;
+    };
+
+    vector<Channel> channels;
+    ofstream output;
+    ifstream input;
+    // true after the header of the file
+    bool started;
+    vector<char> value;
+
+    //////////////////////////////////////////
+
+    // the header is written or read at the first frame, when all the variables have been registered
+    bool start()
+    {
+        if (this->started)
+            return true;
+        uint32_t nChannels = uint32_t(this->channels.size());
+        if (this->mode == RECORD_INPUT)
+        {
+            this->output.write(INPUT_LOG_MAGIC, 8);
+            this->output.write((const char*)&nChannels, sizeof(nChannels));
+        }
+        else
+        {
+            char magic[8];
+            uint32_t recorded = 0;
+            if (!this->input.read(magic, 8) || memcmp(magic, INPUT_LOG_MAGIC, 8) != 0 || !this->input.read((char*)&recorded, sizeof(recorded)) || recorded != nChannels)
+            {
+                cout << "ERROR::INPUT_LOG:: the log was not recorded by this version of the application" << endl;
+                this->input.close();
+                return false;
+            }
+        }
+        this->started = true;
+        return true;
+    }
+
+    void record(const FrameInput& frameInput)
+    {
+        // in the first frame all the variables are saved (the initial state of the session)
+        vector<uint8_t> changed;
+        for (size_t i = 0; i < this->channels.size(); i++)
+        {
+            Channel& channel = this->channels[i];
+            channel.read(this->value);
+            if (this->frames == 0 || this->value != channel.last)
+            {
+                changed.push_back(uint8_t(i));
+                channel.last = this->value;
+            }
+        }
+        this->output.write((const char*)&frameInput, sizeof(frameInput));
+        uint8_t nChanged = uint8_t(changed.size());
+        this->output.write((const char*)&nChanged, sizeof(nChanged));
+        for (uint8_t index : changed)
+        {
+            const vector<char>& bytes = this->channels[index].last;
+            uint32_t size = uint32_t(bytes.size());
+            this->output.write((const char*)&index, sizeof(index));
+            this->output.write((const char*)&size, sizeof(size));
+            this->output.write(bytes.data(), size);
+        }
+    }
+
+    bool replay(FrameInput& frameInput)
+    {
+        uint8_t nChanged = 0;
+        if (!this->input.read((char*)&frameInput, sizeof(frameInput)) || !this->input.read((char*)&nChanged, sizeof(nChanged)))
+            return false;
+        for (uint8_t i = 0; i < nChanged; i++)
+        {
+            uint8_t index = 0;
+            uint32_t size = 0;
+            if (!this->input.read((char*)&index, sizeof(index)) || !this->input.read((char*)&size, sizeof(size)) || index >= this->channels.size())
+                return false;
+            this->value.resize(size);
+            if (!this->input.read(this->value.data(), size))
+                return false;
+            this->channels[index].write(this->value);
+        }
+        return true;
+    }
+};
+
+//////////////////////////////////////////
+// FNV-1a 64 bit hash of the pixels of the current framebuffer, to check that two replays of a log render the same frames.
+// N.B.) glReadPixels waits for the GPU to finish the frame, so the frame times are not meaningful when it is used
+inline uint64_t HashFramebuffer(GLuint width, GLuint height)
+{
+    vector<unsigned char> pixels(size_t(width) * height * 4);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char pixel : pixels)
+        hash = (hash ^ pixel) * 1099511628211ULL;
+    return hash;
+}
@@ -0,0 +1,355 @@
+/*
+LightClusters class
+- clustered forward lighting: the view frustum is split in a grid of "clusters" (or "froxels", frustum voxels), and for each cluster
+  we compute on CPU the list of the point lights whose sphere of influence intersects it
+- the fragment shaders compute the cluster containing the fragment, and they evaluate only the lights of its list,
+  instead of all the lights in the scene
+- the lights, the clusters and the lists of lights are uploaded in 3 texture buffers, read in the shaders with texelFetch
+
+The clusters are CLUSTER_GRID_X x CLUSTER_GRID_Y tiles of the screen, each one split in CLUSTER_GRID_Z slices along the view direction.
+The slices are exponentially spaced: slice k goes from depth near * (far / near)^(k / Z) to near * (far / near)^((k + 1) / Z), so the clusters
+have a similar size in all the directions. In the shaders the slice of a fragment is floor(log(depth) * scale + bias) (see LightsBlock in uniform_buffer.h).
+See "Clustered Deferred and Forward Shading" (O. Olsson, M. Billeter, U. Assarsson, HPG 2012) for details.
+
+Texture buffers:
+- lightData (RGBA32F): 2 texels for each light, the position (xyz) and radius (w), and the color (rgb)
+- clusterData (RG32UI): 1 texel for each cluster, the offset of its list in clusterLightIndices and the number of lights in the list
+- clusterLightIndices (R16UI): the lists of the clusters, one after the other
+
+TBO : Texture Buffer Object - a buffer read in the shaders as a one-dimensional texture, without filtering. Unlike the uniform blocks,
+its size is limited only by GL_MAX_TEXTURE_BUFFER_SIZE (at least 64K texels), so the number of lights is not bound to the size of an array in the shaders.
+See https://www.khronos.org/opengl/wiki/Buffer_Texture for details.
+
+N.B. 1)
+The lights are assigned to the clusters in two steps: for each light, we compute the range of slices and of tiles covered by the bounding box of its sphere;
+then, for each cluster in the range, we test the sphere against the bounding box of the cluster in view space.
+The slices are processed in parallel by a pool of worker threads (and by the calling thread): each slice is processed by a single thread,
+which writes only the lists of its clusters, so no synchronization is needed. With few lights, everything is done by the calling thread.
+
+N.B. 2)
+The attenuation of a light goes smoothly to zero at its radius ((1 - (d / r)^4)^2, as in "Real Shading in Unreal Engine 4", B. Karis, 2013),
+so the lights outside their radius can be skipped without changing the result.
+
+N.B. 3) LightClusters owns its threads and its texture buffers, and it is not copyable
+
+Real-Time Graphics Programming - a.a. 2022/2023
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+#include <utils/bounds.h>
+#include <utils/uniform_buffer.h>
+// the texture buffers are bound through the state cache
+#include <utils/gl_state.h>
+
+// size of the grid of clusters
+#define CLUSTER_GRID_X 16
+#define CLUSTER_GRID_Y 9
+#define CLUSTER_GRID_Z 24
+// with less lights, the clusters are computed only by the calling thread
+#define CLUSTER_PARALLEL_MIN_LIGHTS 32
+
+// texture units of the texture buffers (the units from 0 to 2 are used by the textures of the materials)
+enum LightTextureUnit { LIGHT_DATA_UNIT = 3, CLUSTER_DATA_UNIT = 4, CLUSTER_INDICES_UNIT = 5 };
+
+// a point light, with the layout of the 2 texels in lightData
+struct PointLight {
+    glm::vec3 position;
+    // distance where the contribution of the light becomes zero
+    GLfloat radius;
+    glm::vec3 color;
+    GLfloat padding;
+};
+
+/////////////////// LIGHTCLUSTERS class ///////////////////////
+class LightClusters
+{
+public:
+    // total number of light indices in the lists, and maximum number of lights in a cluster, in the last Update
+    GLuint nIndices, maxClusterLights;
+
+    LightClusters(const LightClusters& copy) = delete; //disallow copy
+    LightClusters& operator=(const LightClusters &) = delete;
+
+    // the texture buffers are created, and the worker threads are started. It must be called by the thread owning the OpenGL context
+    LightClusters(GLuint nWorkers = max(1u, thread::hardware_concurrency()) - 1)
+        : nIndices(0), maxClusterLights(0), clusterLists(CLUSTER_GRID_X * CLUSTER_GRID_Y * CLUSTER_GRID_Z),
+          clusterData(CLUSTER_GRID_X * CLUSTER_GRID_Y * CLUSTER_GRID_Z), projection(0.0f)
+    {
+        GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R16UI };
+        glGenBuffers(3, this->buffers);
+        glGenTextures(3, this->textures);
+        for (int i = 0; i < 3; i++)
+        {
+            glBindBuffer(GL_TEXTURE_BUFFER, this->buffers[i]);
+            glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+            GLState().BindTexture(GL_TEXTURE_BUFFER, this->textures[i]);
+            glTexBuffer(GL_TEXTURE_BUFFER, formats[i], this->buffers[i]);
+        }
+        GLState().BindTexture(GL_TEXTURE_BUFFER, 0);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+        for (GLuint i = 0; i < nWorkers; i++)
+            this->workers.emplace_back(&LightClusters::workerLoop, this);
+    }
+
+    ~LightClusters()
+    {
+        {
+            lock_guard<mutex> lock(this->workMutex);
+            this->stopping = true;
+        }
+        this->workCondition.notify_all();
+        for (thread& worker : this->workers)
+            worker.join();
+        glDeleteTextures(3, this->textures);
+        GLState().ForgetTextures(3, this->textures);
+        glDeleteBuffers(3, this->buffers);
+    }
+
+    //////////////////////////////////////////
+
+    // we assign the lights to the clusters of the frustum defined by the view and projection matrices (the projection must be a symmetric perspective),
+    // we upload the texture buffers, and we set the cluster parameters in the Lights block. The viewport size is in pixels
+    void Update(const vector<PointLight>& lights, const glm::mat4& view, const glm::mat4& projection, GLfloat zNear, GLfloat zFar,
+                GLuint viewportWidth, GLuint viewportHeight, LightsBlock& block)
+    {
+        if (projection != this->projection || zNear != this->zNear || zFar != this->zFar)
+            this->computeClusterBounds(projection, zNear, zFar);
+        GLfloat logRatio = log(zFar / zNear);
+        block.clusterGrid = glm::ivec4(CLUSTER_GRID_X, CLUSTER_GRID_Y, CLUSTER_GRID_Z, 0);
+        block.clusterScale = glm::vec4(GLfloat(viewportWidth) / CLUSTER_GRID_X, GLfloat(viewportHeight) / CLUSTER_GRID_Y,
+                                       CLUSTER_GRID_Z / logRatio, -CLUSTER_GRID_Z * log(zNear) / logRatio);
+        block.nLights = GLint(lights.size());
+
+        // Step 1: range of clusters covered by each light (see N.B. 1 above)
+        this->lightRanges.clear();
+        for (GLuint i = 0; i < lights.size(); i++)
+        {
+            LightRange range;
+            if (this->computeRange(lights[i], view, range))
+            {
+                range.light = i;
+                this->lightRanges.push_back(range);
+            }
+        }
+
+        // Step 2: lists of lights of the clusters, computed slice by slice
+        this->nextSlice = 0;
+        if (this->workers.empty() || this->lightRanges.size() < CLUSTER_PARALLEL_MIN_LIGHTS)
+            this->processSlices();
+        else
+        {
+            {
+                lock_guard<mutex> lock(this->workMutex);
+                this->activeWorkers = GLuint(this->workers.size());
+                this->generation++;
+            }
+            this->workCondition.notify_all();
+            this->processSlices();
+            unique_lock<mutex> lock(this->workMutex);
+            this->doneCondition.wait(lock, [this] { return this->activeWorkers == 0; });
+        }
+
+        // Step 3: the lists are concatenated, and the texture buffers are uploaded
+        this->lightIndices.clear();
+        this->maxClusterLights = 0;
+        for (size_t i = 0; i < this->clusterLists.size(); i++)
+        {
+            const vector<uint16_t>& list = this->clusterLists[i];
+            this->clusterData[i] = glm::uvec2(GLuint(this->lightIndices.size()), GLuint(list.size()));
+            this->lightIndices.insert(this->lightIndices.end(), list.begin(), list.end());
+            this->maxClusterLights = max(this->maxClusterLights, GLuint(list.size()));
+        }
+        this->nIndices = GLuint(this->lightIndices.size());
+        this->upload(0, lights.data(), lights.size() * sizeof(PointLight));
+        this->upload(1, this->clusterData.data(), this->clusterData.size() * sizeof(glm::uvec2));
+        this->upload(2, this->lightIndices.data(), this->lightIndices.size() * sizeof(uint16_t));
+    }
+
+    // we bind the texture buffers to their texture units
+    void Bind() const
+    {
+        GLenum units[3] = { LIGHT_DATA_UNIT, CLUSTER_DATA_UNIT, CLUSTER_INDICES_UNIT };
+        for (int i = 0; i < 3; i++)
+            GLState().BindTexture(units[i], GL_TEXTURE_BUFFER, this->textures[i]);
+    }
+
+private:
+    // range of clusters covered by the bounding box of a light
+    struct LightRange {
+        GLuint light;
+        // sphere of the light in view space
+        glm::vec3 center;
+        GLfloat radius;
+        GLint minTile[2], maxTile[2];
+        GLint minSlice, maxSlice;
+    };
+
+    // texture buffers: lightData, clusterData, clusterLightIndices
+    GLuint buffers[3], textures[3];
+    // lists of lights of the clusters, with index (slice * CLUSTER_GRID_Y + y) * CLUSTER_GRID_X + x
+    vector<vector<uint16_t>> clusterLists;
+    // offset and number of lights of each cluster, and concatenated lists, as uploaded in the texture buffers
+    vector<glm::uvec2> clusterData;
+    vector<uint16_t> lightIndices;
+    // bounding boxes of the clusters in view space, and projection parameters used to compute them
+    vector<AABB> clusterBounds;
+    glm::mat4 projection;
+    GLfloat zNear = 0.0f, zFar = 0.0f;
+    // ranges of the lights of the current Update inside the frustum
+    vector<LightRange> lightRanges;
+
+    // pool of worker threads: each Update increments the generation, and the workers process slices until all of them are taken
+    vector<thread> workers;
+    mutex workMutex;
+    condition_variable workCondition, doneCondition;
+    GLuint generation = 0, activeWorkers = 0;
+    bool stopping = false;
+    atomic<GLint> nextSlice{ 0 };
+
+    //////////////////////////////////////////
+
+    // depth of the boundary between slice k - 1 and slice k
+    GLfloat sliceDepth(GLint k) const
+    {
+        return this->zNear * pow(this->zFar / this->zNear, GLfloat(k) / CLUSTER_GRID_Z);
+    }
+
+    // slice containing the given depth (clamped to the grid)
+    GLint depthSlice(GLfloat depth) const
+    {
+        GLint k = GLint(floor(log(depth / this->zNear) / log(this->zFar / this->zNear) * CLUSTER_GRID_Z));
+        return glm::clamp(k, 0, CLUSTER_GRID_Z - 1);
+    }
+
+    // bounding boxes in view space of the clusters: the tile (x, y) of slice k is the part of the frustum between the depths of the slice,
+    // with normalized device coordinates between -1 + 2 * x / CLUSTER_GRID_X and -1 + 2 * (x + 1) / CLUSTER_GRID_X (and the same for y)
+    void computeClusterBounds(const glm::mat4& projection, GLfloat zNear, GLfloat zFar)
+    {
+        this->projection = projection;
+        this->zNear = zNear;
+        this->zFar = zFar;
+        this->clusterBounds.resize(this->clusterLists.size());
+        // in view space, a point at depth d with normalized device coordinates (x, y) is (x * d / P[0][0], y * d / P[1][1], -d)
+        glm::vec2 scale(1.0f / projection[0][0], 1.0f / projection[1][1]);
+        for (GLint k = 0; k < CLUSTER_GRID_Z; k++)
+        {
+            GLfloat depths[2] = { this->sliceDepth(k), this->sliceDepth(k + 1) };
+            for (GLint y = 0; y < CLUSTER_GRID_Y; y++)
+                for (GLint x = 0; x < CLUSTER_GRID_X; x++)
+                {
+                    AABB& bounds = this->clusterBounds[(k * CLUSTER_GRID_Y + y) * CLUSTER_GRID_X + x];
+                    bounds = AABB();
+                    for (GLfloat depth : depths)
+                        for (GLint corner = 0; corner < 4; corner++)
+                        {
+                            glm::vec2 ndc(-1.0f + 2.0f * GLfloat(x + (corner & 1)) / CLUSTER_GRID_X, -1.0f + 2.0f * GLfloat(y + (corner >> 1)) / CLUSTER_GRID_Y);
+                            bounds.Expand(glm::vec3(ndc * scale * depth, -depth));
+                        }
+                }
+        }
+    }
+
+    // range of slices and tiles covered by the light. It returns false if the light is outside the frustum (in depth)
+    bool computeRange(const PointLight& light, const glm::mat4& view, LightRange& range) const
+    {
+        range.center = glm::vec3(view * glm::vec4(light.position, 1.0f));
+        range.radius = light.radius;
+        GLfloat depth = -range.center.z;
+        if (light.radius <= 0.0f || depth + light.radius < this->zNear || depth - light.radius > this->zFar)
+            return false;
+        GLfloat minDepth = max(depth - light.radius, this->zNear);
+        GLfloat maxDepth = min(depth + light.radius, this->zFar);
+        range.minSlice = this->depthSlice(minDepth);
+        range.maxSlice = this->depthSlice(maxDepth);
+
+        // normalized device coordinates of the bounding box of the sphere: for each axis, the extremes are at the minimum or maximum depth
+        GLfloat scales[2] = { this->projection[0][0], this->projection[1][1] };
+        GLint gridSize[2] = { CLUSTER_GRID_X, CLUSTER_GRID_Y };
+        for (int axis = 0; axis < 2; axis++)
+        {
+            GLfloat low = range.center[axis] - light.radius, high = range.center[axis] + light.radius;
+            GLfloat minNDC = min(low / minDepth, low / maxDepth) * scales[axis];
+            GLfloat maxNDC = max(high / minDepth, high / maxDepth) * scales[axis];
+            if (minNDC > 1.0f || maxNDC < -1.0f)
+                return false;
+            range.minTile[axis] = glm::clamp(GLint(floor((minNDC * 0.5f + 0.5f) * gridSize[axis])), 0, gridSize[axis] - 1);
+            range.maxTile[axis] = glm::clamp(GLint(floor((maxNDC * 0.5f + 0.5f) * gridSize[axis])), 0, gridSize[axis] - 1);
+        }
+        return true;
+    }
+
+    // the calling thread and the workers take the slices one at a time, until all of them are processed
+    void processSlices()
+    {
+        GLint k;
+        while ((k = this->nextSlice.fetch_add(1)) < CLUSTER_GRID_Z)
+        {
+            for (GLint cluster = k * CLUSTER_GRID_X * CLUSTER_GRID_Y; cluster < (k + 1) * CLUSTER_GRID_X * CLUSTER_GRID_Y; cluster++)
+                this->clusterLists[cluster].clear();
+            for (const LightRange& range : this->lightRanges)
+            {
+                if (k < range.minSlice || k > range.maxSlice)
+                    continue;
+                for (GLint y = range.minTile[1]; y <= range.maxTile[1]; y++)
+                    for (GLint x = range.minTile[0]; x <= range.maxTile[0]; x++)
+                    {
+                        GLint cluster = (k * CLUSTER_GRID_Y + y) * CLUSTER_GRID_X + x;
+                        // distance between the center of the sphere and the nearest point of the box
+                        const AABB& bounds = this->clusterBounds[cluster];
+                        glm::vec3 offset = glm::clamp(range.center, bounds.min, bounds.max) - range.center;
+                        if (glm::dot(offset, offset) <= range.radius * range.radius)
+                            this->clusterLists[cluster].push_back(uint16_t(range.light));
+                    }
+            }
+        }
+    }
+
+    void workerLoop()
+    {
+        GLuint lastGeneration = 0;
+        while (true)
+        {
+            {
+                unique_lock<mutex> lock(this->workMutex);
+                this->workCondition.wait(lock, [this, lastGeneration] { return this->stopping || this->generation != lastGeneration; });
+                if (this->stopping)
+                    return;
+                lastGeneration = this->generation;
+            }
+            this->processSlices();
+            {
+                lock_guard<mutex> lock(this->workMutex);
+                this->activeWorkers--;
+            }
+            this->doneCondition.notify_one();
+        }
+    }
+
+    // upload of the content of a texture buffer, with orphaning of the previous content
+    void upload(int buffer, const void* data, size_t size)
+    {
+        glBindBuffer(GL_TEXTURE_BUFFER, this->buffers[buffer]);
+        glBufferData(GL_TEXTURE_BUFFER, max(size, size_t(16)), NULL, GL_STREAM_DRAW);
+        if (size > 0)
+            glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+};
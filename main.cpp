@@ -1,616 +1,1124 @@
-// Std. Includes
-#include <string>
-#ifdef _WIN32
-    #define APIENTRY __stdcall
-#endif
-
-#include "imgui/imgui.h"
-#include "imgui/imgui_impl_glfw.h"
-#include "imgui/imgui_impl_opengl3.h"
-
-#include <glad/glad.h>
-
-// GLFW library to create window and to manage I/O
-#include <glfw/glfw3.h>
-
-// another check related to OpenGL loader
-// confirm that GLAD didn't include windows.h
-#ifdef _WINDOWS_
-    #error windows.h was included!
-#endif
-
-// classes developed during lab lectures to manage shaders and to load models
-#include <utils/shader.h>
-#include <utils/model.h>
-#include <utils/camera.h>
-
-// we load the GLM classes used in the application
-#include <glm/glm.hpp>
-#include <glm/gtc/matrix_transform.hpp>
-#include <glm/gtc/matrix_inverse.hpp>
-#include <glm/gtc/type_ptr.hpp>
-
-// we include the library for images loading
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image/stb_image.h"
-
-// dimensions of application's window
-GLuint screenWidth = 1920, screenHeight = 1080;
-
-// callback functions for keyboard events
-void key_callback(GLFWwindow* window, int key, int scancode, int action, int mode);
-void mouse_callback(GLFWwindow* window, double xpos, double ypos);
-// if one of the WASD keys is pressed, we call the corresponding method of the Camera class
-void apply_camera_movements();
-// if one of the arrow keys is pressed, we move the active light in the corresponding direction
-void apply_light_movements(int activeLight);
-void addLight();
-void removeLight();
-
-// setup of Shader Programs for the 5 shaders used in the application
-void SetupShaders();
-// delete Shader Programs whan application ends
-void DeleteShaders();
-// load image from disk and create an OpenGL texture
-GLint LoadTexture(const char* path);
-
-// we initialize an array of booleans for each keyboard key
-bool keys[1024];
-// we need to store the previous mouse position to calculate the offset with the current frame
-GLfloat lastX, lastY;
-// when rendering the first frame, we do not have a "previous state" for the mouse, so we need to manage this situation
-bool firstMouse = true;
-// define if the mouse movement  will cause camer movement or not. It allows to have camera movement and GUI interaction together. 
-bool moveMode = false;
-
-// parameters for time calculation (for animations)
-GLfloat deltaTime = 0.0f;
-GLfloat lastFrame = 0.0f;
-GLfloat elapsedTime = 0.0f;
-unsigned int frameCounter = 0;
-
-// rotation angle on Y axis
-GLfloat orientationY = 1.0f;
-// rotation speed on Y axis
-GLfloat spin_speed = 0.5f;
-// boolean to start/stop animated rotation on Y angle
-GLboolean spinning = GL_TRUE;
-// boolean to activate/deactivate wireframe rendering
-GLboolean wireframe = GL_FALSE;
-
-// enum data structure to manage indices for shaders swapping
-enum available_ShaderPrograms{ PLAIN, BUMP, NORMAL, PARALLAX, DISPLACEMENT, LIGHT };
-// strings with shaders names to print the name of the current one on console
-const char * print_available_ShaderPrograms[] = { "PLAIN", "BUMP", "NORMAL", "PARALLAX", "DISPLACEMENT", "LIGHT"};
-
-// index of the current shader (= 0 in the beginning)
-GLint current_program = 0;
-// a vector for all the Shader Programs used and swapped in the application
-vector<Shader> shaders;
-
-Camera camera(glm::vec3(0.0f, 1.8f, 5.0f), GL_TRUE);
-
-// Uniforms to be passed to shaders
-// pointlights positions
-vector<glm::vec3> lightPositions = {glm::vec3(0.0f, 0.0f, 0.0f)};
-GLuint nLights = 1;
-GLint activeLight = 0;
-const char * LightsNames[] = { "Light 1", "Light 2", "Light 3", "Light 4", "Light 5"};
-
-// specular and ambient components
-GLfloat specularColor[3] = {1.0,1.0,1.0};
-GLfloat ambientColor[3] = {0.1,0.1,0.1};
-// weights for the diffusive, specular and ambient components
-GLfloat Kd = 0.65f;
-GLfloat Ks = 0.1f;
-GLfloat Ka = 0.05f;
-// shininess coefficient for Blinn-Phong shader
-GLfloat shininess = 32.0f;
-
-GLfloat height_scale = 1.5f;
-// UV repetitions
-GLint repeat = 1;
-
-const char * available_textures[] = { "cobble", "brick wall", "sofa"};
-GLint current_texture = 0;
-
-// vector for the textures IDs
-vector<GLint> textureID;
-
-bool tessellation = false;
-
-/////////////////// MAIN function ///////////////////////
-int main()
-{
-    // Initialization of OpenGL context using GLFW
-    glfwInit();
-    // We set OpenGL specifications required for this application
-    // In this case: 4.1 Core
-    // It is possible to raise the values, in order to use functionalities of more recent OpenGL specs.
-    // If not supported by your graphics HW, the context will not be created and the application will close
-    // N.B.) creating GLAD code to load extensions, try to take into account the specifications and any extensions you want to use,
-    // in relation also to the values indicated in these GLFW commands
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-    // we set if the window is resizable
-    glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
-
-    // we create the application's window
-    GLFWwindow* window = glfwCreateWindow(screenWidth, screenHeight, "Bump Mapping", nullptr, nullptr);
-    if (!window)
-    {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
-        return -1;
-    }
-    glfwMakeContextCurrent(window);
-
-    // we put in relation the window and the callbacks
-    glfwSetKeyCallback(window, key_callback);
-    glfwSetCursorPosCallback(window, mouse_callback);
-
-    // GLAD tries to load the context set by GLFW
-    if (!gladLoadGLLoader((GLADloadproc) glfwGetProcAddress))
-    {
-        std::cout << "Failed to initialize OpenGL context" << std::endl;
-        return -1;
-    }
-
-    // we define the viewport dimensions
-    int width, height;
-    glfwGetFramebufferSize(window, &width, &height);
-    glViewport(0, 0, width, height);
-
-    // we enable Z test
-    glEnable(GL_DEPTH_TEST);
-
-    //the "clear" color for the frame buffer
-    glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
-
-    // we create the Shader Programs used in the application
-    SetupShaders();
-
-    // we load the model(s) (code of Model class is in include/utils/model.h)
-    Model planeModel("../../models/plane.obj");
-    Model sphereModel("../../models/sphere.obj");
-    Model potModel("../../models/pot.obj");
-
-    // we load the images and store them in a vector
-    //cobble
-    textureID.push_back(LoadTexture("../../textures/cobble/diffuse.png"));
-    textureID.push_back(LoadTexture("../../textures/cobble/normal.png"));
-    textureID.push_back(LoadTexture("../../textures/cobble/height.png"));
-    //brick wall
-    textureID.push_back(LoadTexture("../../textures/bw/diffuse.png"));
-    textureID.push_back(LoadTexture("../../textures/bw/normal.png"));
-    textureID.push_back(LoadTexture("../../textures/bw/height.png"));
-    //sofa
-    textureID.push_back(LoadTexture("../../textures/sofa/diffuse.jpg"));
-    textureID.push_back(LoadTexture("../../textures/sofa/normal.jpg"));
-    textureID.push_back(LoadTexture("../../textures/sofa/height.jpg"));
-
-    // Projection matrix: FOV angle, aspect ratio, near and far planes
-    glm::mat4 projection = glm::perspective(45.0f, (float)screenWidth/(float)screenHeight, 0.1f, 10000.0f);
-    // View matrix: the camera moves, so we just set to indentity now
-    glm::mat4 view = glm::mat4(1.0f);
-
-    // Model and Normal transformation matrices for the objects in the scene: we set to identity
-    glm::mat4 sphereModelMatrix = glm::mat4(1.0f);
-    glm::mat3 sphereNormalMatrix = glm::mat3(1.0f);
-    glm::mat4 planeModelMatrix = glm::mat4(1.0f);
-    glm::mat3 planeNormalMatrix = glm::mat3(1.0f);
-    glm::mat4 potModelMatrix = glm::mat4(1.0f);
-    glm::mat3 potNormalMatrix = glm::mat3(1.0f);
-
-    //set that we work with triangular texels
-    glPatchParameteri(GL_PATCH_VERTICES, 3);
-
-    //set up IMGUI
-    IMGUI_CHECKVERSION();
-    ImGui::CreateContext();
-    ImGuiIO& io = ImGui::GetIO(); (void)io;
-    ImGui::StyleColorsDark();
-    ImGui_ImplGlfw_InitForOpenGL(window, true);
-    ImGui_ImplOpenGL3_Init("#version 400");
-
-    glfwSwapInterval(0);
-
-    // Rendering loop: this code is executed at each frame
-    while(!glfwWindowShouldClose(window))
-    {
-        // we determine the time passed from the beginning
-        // and we calculate time difference between current frame rendering and the previous one
-        GLfloat currentFrame = glfwGetTime();
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
-        frameCounter++;
-        elapsedTime+=deltaTime;
-
-        //every second we update the fps
-        if(elapsedTime>=1){
-            std::string FPS = std::to_string(frameCounter/elapsedTime);
-            frameCounter = 0;
-            elapsedTime = 0.0f;
-            std::string newTitle = "Bump Mapping - " + FPS + " fps";
-            glfwSetWindowTitle(window, newTitle.c_str());
-        }
-
-        // Check is an I/O event is happening
-        glfwPollEvents();
-        apply_camera_movements();
-        apply_light_movements(activeLight);
-
-        view = camera.GetViewMatrix();
-
-        // we "clear" the frame and z buffer
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        ImGui_ImplOpenGL3_NewFrame();
-        ImGui_ImplGlfw_NewFrame();
-        ImGui::NewFrame();
-
-        // we set the rendering mode
-        if (wireframe)
-            // Draw in wireframe
-            glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-        else
-            glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-
-        // if animated rotation is activated, then we increment the rotation angle using delta time and the rotation speed parameter
-        if (spinning)
-            orientationY+=(deltaTime*spin_speed);
-
-        // We "install" the selected Shader Program as part of the current rendering process
-        shaders[current_program].Use();
-
-        GLint diffuseMapLocation = glGetUniformLocation(shaders[current_program].Program, "diffuseMap");
-        GLint normalMapLocation = glGetUniformLocation(shaders[current_program].Program, "normalMap");
-        GLint heightMapLocation = glGetUniformLocation(shaders[current_program].Program, "heightMap");
-        GLint repeatLocation = glGetUniformLocation(shaders[current_program].Program, "repeat");
-        GLint matAmbientLocation = glGetUniformLocation(shaders[current_program].Program, "ambientColor");
-        GLint matSpecularLocation = glGetUniformLocation(shaders[current_program].Program, "specularColor");
-        GLint kaLocation = glGetUniformLocation(shaders[current_program].Program, "Ka");
-        GLint kdLocation = glGetUniformLocation(shaders[current_program].Program, "Kd");
-        GLint ksLocation = glGetUniformLocation(shaders[current_program].Program, "Ks");
-        GLint shineLocation = glGetUniformLocation(shaders[current_program].Program, "shininess");
-        GLint numFacesLocation = glGetUniformLocation(shaders[current_program].Program, "numFaces");
-        
-        // we assign the value to the uniform variables
-        glUniform3fv(matAmbientLocation, 1, ambientColor);
-        glUniform3fv(matSpecularLocation, 1, specularColor);
-        glUniform1f(shineLocation, shininess);
-        glUniform1f(kaLocation, Ka);
-        glUniform1f(kdLocation, Kd);
-        glUniform1f(ksLocation, Ks);
-        glUniform1i(diffuseMapLocation, 0);
-        glUniform1i(normalMapLocation, 1);
-        glUniform1i(heightMapLocation, 2);
-        glUniform1i(repeatLocation, repeat);
-
-        // we pass projection and view matrices to the Shader Program
-        glUniformMatrix4fv(glGetUniformLocation(shaders[current_program].Program, "projectionMatrix"), 1, GL_FALSE, glm::value_ptr(projection));
-        glUniformMatrix4fv(glGetUniformLocation(shaders[current_program].Program, "viewMatrix"), 1, GL_FALSE, glm::value_ptr(view));
-        // we pass light position to the shader
-        for (GLuint i = 0; i < nLights; i++)
-        {
-            string number = to_string(i);
-            glUniform3fv(glGetUniformLocation(shaders[current_program].Program, ("pointLightPosition[" + number + "]").c_str()), 1, glm::value_ptr(lightPositions[i]));
-        }
-        glUniform1i(glGetUniformLocation(shaders[current_program].Program, "nLights"), nLights);
-        glUniform3fv(glGetUniformLocation(shaders[current_program].Program,"viewPosition"), 1, glm::value_ptr(camera.Position));
-
-        //diffuseMap
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, textureID[3*current_texture]);
-        //normalMap
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, textureID[3*current_texture+1]);
-        //heightMap
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, textureID[3*current_texture+2]);        
-
-        //if we are using the displacement shader we pass the height scale variable and activate tessellation
-        if(current_program == 4){
-            GLint heightScaleLocation = glGetUniformLocation(shaders[current_program].Program, "height_scale");
-            glUniform1f(heightScaleLocation, height_scale);
-            tessellation = true;
-        }else{
-            tessellation = false;
-        }
-
-        //PLANE
-        glUniform1i(numFacesLocation, planeModel.numFaces());
-        planeModelMatrix = glm::mat4(1.0f);
-        planeNormalMatrix = glm::mat3(1.0f);
-        planeModelMatrix = glm::translate(planeModelMatrix, glm::vec3(0.0f, 0.0f, -10.0f));
-        planeModelMatrix = glm::rotate(planeModelMatrix, orientationY, glm::vec3(0.0f, 1.0f, 0.0f));
-        planeModelMatrix = glm::rotate(planeModelMatrix,  glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-        planeModelMatrix = glm::scale(planeModelMatrix, glm::vec3(1.0f, 1.0f, 1.0f));
-        planeNormalMatrix = glm::inverseTranspose(glm::mat3(planeModelMatrix));
-        glUniformMatrix4fv(glGetUniformLocation(shaders[current_program].Program, "modelMatrix"), 1, GL_FALSE, glm::value_ptr(planeModelMatrix));
-        glUniformMatrix3fv(glGetUniformLocation(shaders[current_program].Program, "normalMatrix"), 1, GL_FALSE, glm::value_ptr(planeNormalMatrix));
-        planeModel.Draw(tessellation);
-
-        //POT
-        glUniform1i(numFacesLocation, potModel.numFaces());
-        potModelMatrix = glm::mat4(1.0f);
-        potNormalMatrix = glm::mat3(1.0f);
-        potModelMatrix = glm::translate(potModelMatrix, glm::vec3(10.0f, 0.0f, -10.0f));
-        potModelMatrix = glm::rotate(potModelMatrix, orientationY, glm::vec3(0.0f, 1.0f, 0.0f));
-        potModelMatrix = glm::scale(potModelMatrix, glm::vec3(3.0f, 3.0f, 3.0f));
-        potNormalMatrix = glm::inverseTranspose(glm::mat3(potModelMatrix));
-        glUniformMatrix4fv(glGetUniformLocation(shaders[current_program].Program, "modelMatrix"), 1, GL_FALSE, glm::value_ptr(potModelMatrix));
-        glUniformMatrix3fv(glGetUniformLocation(shaders[current_program].Program, "normalMatrix"), 1, GL_FALSE, glm::value_ptr(potNormalMatrix));
-        potModel.Draw(tessellation);
-
-        //SPHERE
-        glUniform1i(numFacesLocation, sphereModel.numFaces());
-        sphereModelMatrix = glm::mat4(1.0f);
-        sphereNormalMatrix = glm::mat3(1.0f);
-        sphereModelMatrix = glm::translate(sphereModelMatrix, glm::vec3(-10.0f, 0.0f, -10.0f));
-        sphereModelMatrix = glm::rotate(sphereModelMatrix, orientationY, glm::vec3(0.0f, 1.0f, 0.0f));
-        sphereModelMatrix = glm::scale(sphereModelMatrix, glm::vec3(2.0f, 2.0f, 2.0f));
-        sphereNormalMatrix = glm::inverseTranspose(glm::mat3(sphereModelMatrix));
-        glUniformMatrix4fv(glGetUniformLocation(shaders[current_program].Program, "modelMatrix"), 1, GL_FALSE, glm::value_ptr(sphereModelMatrix));
-        glUniformMatrix3fv(glGetUniformLocation(shaders[current_program].Program, "normalMatrix"), 1, GL_FALSE, glm::value_ptr(sphereNormalMatrix));
-        sphereModel.Draw(tessellation);
-        
-        //LIGHTS
-        shaders[LIGHT].Use();
-        glUniformMatrix4fv(glGetUniformLocation(shaders[LIGHT].Program, "projectionMatrix"), 1, GL_FALSE, glm::value_ptr(projection));
-        glUniformMatrix4fv(glGetUniformLocation(shaders[LIGHT].Program, "viewMatrix"), 1, GL_FALSE, glm::value_ptr(view));
-
-        for(int i=0; i<nLights; i++){
-            sphereModelMatrix = glm::mat4(1.0f);
-            sphereNormalMatrix = glm::mat3(1.0f);
-            sphereModelMatrix = glm::translate(sphereModelMatrix, lightPositions[i]);
-            sphereModelMatrix = glm::scale(sphereModelMatrix, glm::vec3(0.2f));
-            sphereNormalMatrix = glm::inverseTranspose(glm::mat3(sphereModelMatrix));
-            glUniformMatrix4fv(glGetUniformLocation(shaders[LIGHT].Program, "modelMatrix"), 1, GL_FALSE, glm::value_ptr(sphereModelMatrix));
-            glUniformMatrix3fv(glGetUniformLocation(shaders[LIGHT].Program, "normalMatrix"), 1, GL_FALSE, glm::value_ptr(sphereNormalMatrix));
-            sphereModel.Draw(false);
-        }
-        
-
-        //IMGUI Control panels definition
-        ImGui::Begin("Blinn-Phong parameters");
-        ImGui::SliderFloat("Kd", &Kd, 0, 1);
-        ImGui::SliderFloat("Ks", &Ks, 0, 1);
-        ImGui::SliderFloat("Ka", &Ka, 0, 1);
-        ImGui::SliderFloat("Shininess", &shininess, 0, 128);
-        ImGui::ColorEdit3("Specular color", specularColor);
-        ImGui::ColorEdit3("Ambient  color", ambientColor);
-        ImGui::End();
-
-        ImGui::Begin("Objects appearance");
-        ImGui::SliderInt("Repeat", &repeat, 1, 5);
-        ImGui::Combo("Shader", &current_program, print_available_ShaderPrograms, IM_ARRAYSIZE(print_available_ShaderPrograms));
-        if(current_program==4){
-            ImGui::SliderFloat("Height scale", &height_scale, 0, 3);
-        }
-        ImGui::Combo("Texture", &current_texture, available_textures, IM_ARRAYSIZE(available_textures));
-        ImGui::SliderFloat("Spin speed", &spin_speed, 0, 10);
-        ImGui::End();
-
-        ImGui::Begin("Light panel");
-        if (ImGui::Button("addLight"))
-            addLight();
-        if (ImGui::Button("removeLight"))
-            removeLight();
-        for(int i=0; i<nLights; i++){
-            ImGui::PushID(i);
-            ImGui::RadioButton(LightsNames[i], &activeLight, i); ImGui::SameLine();
-            ImGui::PopID();
-        }
-        ImGui::End();
-
-        ImGui::Render();
-        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-
-        // Swapping back and front buffers
-        glfwSwapBuffers(window);
-    }
-
-    //IMGUI cleanup
-    ImGui_ImplOpenGL3_Shutdown();
-    ImGui_ImplGlfw_Shutdown();
-    ImGui::DestroyContext();
-
-    // when I exit from the graphics loop, it is because the application is closing
-    // we delete the Shader Programs
-    DeleteShaders();
-    // we close and delete the created context
-    glfwTerminate();
-    return 0;
-}
-
-
-//////////////////////////////////////////
-// we create and compile shaders (code of Shader class is in include/utils/shader.h), and we add them to the list of available shaders
-void SetupShaders()
-{
-    Shader shader1("shaders/basic.vert", "shaders/basic.frag");
-    shaders.push_back(shader1);
-    Shader shader2("shaders/blinn_bump.vert", "shaders/blinn_bump.frag");
-    shaders.push_back(shader2);
-    Shader shader3("shaders/tangent.vert", "shaders/normal.frag");
-    shaders.push_back(shader3);
-    Shader shader4("shaders/tangent.vert", "shaders/parallax.frag");
-    shaders.push_back(shader4);
-    Shader shader5("shaders/displacement.vert", "shaders/displacement.frag", "shaders/displacement.tcs", "shaders/displacement.tes");
-    shaders.push_back(shader5);
-    Shader shader6("shaders/light.vert", "shaders/light.frag");
-    shaders.push_back(shader6);
-}
-
-//////////////////////////////////////////
-// we delete all the Shaders Programs
-void DeleteShaders()
-{
-    for(GLuint i = 0; i < shaders.size(); i++)
-        shaders[i].Delete();
-}
-
-//////////////////////////////////////////
-// callback for keyboard events
-void key_callback(GLFWwindow* window, int key, int scancode, int action, int mode)
-{   
-    GLuint new_program;
-    // if ESC is pressed, we close the application
-    if(key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
-        glfwSetWindowShouldClose(window, GL_TRUE);
-
-    if(key == GLFW_KEY_SPACE && action == GLFW_PRESS)
-       moveMode = true;
-    if(key == GLFW_KEY_SPACE && action == GLFW_RELEASE)
-       moveMode = false;
-
-    // if P is pressed, we start/stop the animated rotation of models
-    if(key == GLFW_KEY_P && action == GLFW_PRESS)
-        spinning=!spinning;
-
-    // if L is pressed, we activate/deactivate wireframe rendering of models
-    if(key == GLFW_KEY_L && action == GLFW_PRESS)
-        wireframe=!wireframe;
-
-    if(action == GLFW_PRESS)
-        keys[key] = true;
-    else if(action == GLFW_RELEASE)
-        keys[key] = false;
-}
-
-GLint LoadTexture(const char* path)
-{
-    GLuint textureImage;
-    int w, h, channels;
-    unsigned char* image;
-    stbi_set_flip_vertically_on_load(1);
-    image = stbi_load(path, &w, &h, &channels, STBI_rgb);
-    if (image == nullptr)
-        std::cout << "Failed to load texture!" << std::endl;
-    if(channels == 4){
-        stbi_image_free(image);
-        image = stbi_load(path, &w, &h, &channels, STBI_rgb_alpha);
-    }
-    glGenTextures(1, &textureImage);
-    glBindTexture(GL_TEXTURE_2D, textureImage);
-    // 3 channels = RGB ; 4 channel = RGBA
-    if (channels==3){
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, w, h, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-    }
-    else if (channels==4){
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-    }
-    glGenerateMipmap(GL_TEXTURE_2D);
-    // we set how to consider UVs outside [0,1] range
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    // we set the filtering for minification and magnification
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST_MIPMAP_NEAREST);
-
-    // we free the memory once we have created an OpenGL texture
-    stbi_image_free(image);
-
-    // we set the binding to 0 once we have finished
-    glBindTexture(GL_TEXTURE_2D, 0);
-
-    return textureImage;
-
-}
-
-//////////////////////////////////////////
-// callback for mouse events
-void mouse_callback(GLFWwindow* window, double xpos, double ypos)
-{
-    
-    // we move the camera view following the mouse cursor
-    // we calculate the offset of the mouse cursor from the position in the last frame
-    // when rendering the first frame, we do not have a "previous state" for the mouse, so we set the previous state equal to the initial values (thus, the offset will be = 0)
-    if(firstMouse)
-    {
-        lastX = xpos;
-        lastY = ypos;
-        firstMouse = false;
-    }
-
-    // offset of mouse cursor position
-    GLfloat xoffset = xpos - lastX;
-    GLfloat yoffset = lastY - ypos;
-
-    // the new position will be the previous one for the next frame
-    lastX = xpos;
-    lastY = ypos;
-    
-    if(moveMode){
-        // we pass the offset to the Camera class instance in order to update the rendering
-        camera.ProcessMouseMovement(xoffset, yoffset);
-    }
-
-}
-
-//////////////////////////////////////////
-// If one of the WASD keys is pressed, the camera is moved accordingly (the code is in utils/camera.h)
-void apply_camera_movements()
-{
-    // if a single WASD key is pressed, then we will apply the full value of velocity v in the corresponding direction.
-    // However, if two keys are pressed together in order to move diagonally (W+D, W+A, S+D, S+A), 
-    // then the camera will apply a compensation factor to the velocities applied in the single directions, 
-    // in order to have the full v applied in the diagonal direction  
-    // the XOR on A and D is to avoid the application of a wrong attenuation in the case W+A+D or S+A+D are pressed together.  
-    GLboolean diagonal_movement = (keys[GLFW_KEY_W] ^ keys[GLFW_KEY_S]) && (keys[GLFW_KEY_A] ^ keys[GLFW_KEY_D]); 
-    camera.SetMovementCompensation(diagonal_movement);
-    
-    if(keys[GLFW_KEY_W])
-        camera.ProcessKeyboard(FORWARD, deltaTime);  
-    if(keys[GLFW_KEY_S])
-        camera.ProcessKeyboard(BACKWARD, deltaTime);
-    if(keys[GLFW_KEY_A])
-        camera.ProcessKeyboard(LEFT, deltaTime);
-    if(keys[GLFW_KEY_D])
-        camera.ProcessKeyboard(RIGHT, deltaTime);
-}
-
-void apply_light_movements(int activeLight)
-{
-    GLboolean diagonal_movement = (keys[GLFW_KEY_UP] ^ keys[GLFW_KEY_DOWN]) && (keys[GLFW_KEY_LEFT] ^ keys[GLFW_KEY_RIGHT]) && (keys[GLFW_KEY_PAGE_UP] ^ keys[GLFW_KEY_PAGE_DOWN]); 
-    GLfloat movementCompensation = (diagonal_movement ? DIAGONAL_COMPENSATION : 1.0f);
-    GLfloat movementSpeed = 5.0f;
-    GLfloat velocity = movementSpeed * deltaTime * movementCompensation;
-    if(keys[GLFW_KEY_UP])
-        lightPositions[activeLight] += camera.Front * velocity;
-    if(keys[GLFW_KEY_DOWN])
-        lightPositions[activeLight] -= camera.Front * velocity;
-    if(keys[GLFW_KEY_RIGHT])
-        lightPositions[activeLight] += camera.Right * velocity;
-    if(keys[GLFW_KEY_LEFT])
-        lightPositions[activeLight] -= camera.Right * velocity;
-    if(keys[GLFW_KEY_PAGE_UP])
-        lightPositions[activeLight] += camera.Up * velocity;
-    if(keys[GLFW_KEY_PAGE_DOWN])
-        lightPositions[activeLight] -= camera.Up * velocity;
-        
-}
-
-void addLight(){
-    if (nLights<5){
-        lightPositions.push_back(glm::vec3(0.0, 0.0, 0.0));
-        nLights++;
-        activeLight = nLights - 1;
-    }else{
-        std::cout << "Max number of lights reached" << std::endl;
-    }
-}
-
-void removeLight(){
-    if(nLights>0){
-        lightPositions.pop_back();
-        nLights--;
-    }
-    if(activeLight>=nLights){
-        activeLight = nLights - 1;
-    }
-}
-    
\ No newline at end of file
+// Std. Includes
+#include <string>
+#include <memory>
+#include <cstring>
+#include <random>
+#ifdef _WIN32
+    #define APIENTRY __stdcall
+#endif
+
+#include "imgui/imgui.h"
+#include "imgui/imgui_impl_glfw.h"
+#include "imgui/imgui_impl_opengl3.h"
+
+#include <glad/glad.h>
+
+// GLFW library to create window and to manage I/O
+#include <glfw/glfw3.h>
+
+// another check related to OpenGL loader
+// confirm that GLAD didn't include windows.h
+#ifdef _WINDOWS_
+    #error windows.h was included!
+#endif
+
+// classes developed during lab lectures to manage shaders and to load models
+#include <utils/shader.h>
+#include <utils/uniform_buffer.h>
+#include <utils/model.h>
+#include <utils/render_queue.h>
+#include <utils/scene.h>
+#include <utils/light_clusters.h>
+#include <utils/gbuffer.h>
+#include <utils/camera.h>
+// offscreen benchmark mode
+#include <utils/benchmark.h>
+// CPU and GPU timing of the phases of the frame
+#include <utils/profiler.h>
+// record and replay of the input
+#include <utils/input_log.h>
+// simulation of the next frame in parallel with the rendering of the current one
+#include <utils/frame_pipeline.h>
+
+// we load the GLM classes used in the application
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/matrix_inverse.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+// we include the library for images loading
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image/stb_image.h"
+// asynchronous loading of the textures (parallel decoding and upload through PBO)
+#include <utils/texture_loader.h>
+
+// dimensions of application's window
+GLuint screenWidth = 1920, screenHeight = 1080;
+
+// callback functions for keyboard events
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mode);
+void mouse_callback(GLFWwindow* window, double xpos, double ypos);
+// if one of the WASD keys is pressed in the input of the frame, we call the corresponding method of the Camera class
+void apply_camera_movements(const bool* pressed, GLfloat deltaTime);
+// if one of the arrow keys is pressed in the input of the frame, we move the active light in the corresponding direction
+void apply_light_movements(int activeLight, const bool* pressed, GLfloat deltaTime);
+void addLight();
+void removeLight();
+void addRandomLights(GLuint count);
+
+// setup of Shader Programs for the 5 shaders used in the application
+void SetupShaders(ProgramCache* cache);
+// connection of the uniform blocks and of the texture units of a Shader Program (it is called for each permutation)
+void SetupShaderInterface(Shader& shader);
+// delete Shader Programs whan application ends
+void DeleteShaders();
+// definition of the IMGUI control panels
+void BuildGUI();
+// panel with the times of the phases of the frame measured by the profiler
+void BuildProfilerGUI(Profiler& profiler);
+
+// we initialize an array of booleans for each keyboard key
+bool keys[1024];
+// we need to store the previous mouse position to calculate the offset with the current frame
+GLfloat lastX, lastY;
+// when rendering the first frame, we do not have a "previous state" for the mouse, so we need to manage this situation
+bool firstMouse = true;
+// define if the mouse movement  will cause camer movement or not. It allows to have camera movement and GUI interaction together. 
+bool moveMode = false;
+// offset of the mouse cursor since the last frame: it is applied to the camera once per frame, so it can be saved in the input log
+GLfloat mouseOffsetX = 0.0f, mouseOffsetY = 0.0f;
+// keys saved in the input log (see input_log.h): they are the keys used by apply_camera_movements and apply_light_movements
+const int recordedKeys[] = { GLFW_KEY_W, GLFW_KEY_S, GLFW_KEY_A, GLFW_KEY_D, GLFW_KEY_UP, GLFW_KEY_DOWN, GLFW_KEY_LEFT, GLFW_KEY_RIGHT, GLFW_KEY_PAGE_UP, GLFW_KEY_PAGE_DOWN };
+// if true, the input comes from the log given with the --replay command line option, and the keyboard, the mouse and the GUI are ignored
+bool replayingInput = false;
+
+// parameters for time calculation (for animations)
+GLfloat deltaTime = 0.0f;
+GLfloat lastFrame = 0.0f;
+GLfloat elapsedTime = 0.0f;
+unsigned int frameCounter = 0;
+
+// rotation angle on Y axis
+GLfloat orientationY = 1.0f;
+// rotation speed on Y axis
+GLfloat spin_speed = 0.5f;
+// boolean to start/stop animated rotation on Y angle
+GLboolean spinning = GL_TRUE;
+// boolean to activate/deactivate wireframe rendering
+GLboolean wireframe = GL_FALSE;
+
+// enum data structure to manage indices for shaders swapping
+// DEFERRED_LIGHTING is the lighting pass of deferred shading: it is not selectable, so it has no name in the list below
+enum available_ShaderPrograms{ PLAIN, BUMP, NORMAL, PARALLAX, DISPLACEMENT, LIGHT, DEFERRED_LIGHTING };
+// strings with shaders names to print the name of the current one on console
+const char * print_available_ShaderPrograms[] = { "PLAIN", "BUMP", "NORMAL", "PARALLAX", "DISPLACEMENT", "LIGHT"};
+// passes of the render queue: the objects, and then the spheres of the lights (after the lighting pass, in deferred shading)
+enum render_passes { OBJECTS_PASS, LIGHTS_PASS };
+
+// index of the current shader (= 0 in the beginning)
+GLint current_program = 0;
+// a vector for all the Shader Programs used and swapped in the application, each one with its permutations (see ShaderPermutations in include/utils/shader.h)
+vector<ShaderPermutations> shaders;
+
+Camera camera(glm::vec3(0.0f, 1.8f, 5.0f), GL_TRUE);
+
+// Uniforms to be passed to shaders
+// pointlights: position, radius and color (see include/utils/light_clusters.h)
+vector<PointLight> lights = { { glm::vec3(0.0f, 0.0f, 0.0f), 50.0f, glm::vec3(1.0f), 0.0f } };
+GLuint nLights = 1;
+GLint activeLight = 0;
+// with at most this number of lights, the Shader Programs are specialized on the number of lights and they evaluate all the lights,
+// otherwise they evaluate only the lights of the clusters (see ShaderPermutations in include/utils/shader.h)
+#define MAX_SPECIALIZED_LIGHTS 4
+
+// specular and ambient components
+GLfloat specularColor[3] = {1.0,1.0,1.0};
+GLfloat ambientColor[3] = {0.1,0.1,0.1};
+// weights for the diffusive, specular and ambient components
+GLfloat Kd = 0.65f;
+GLfloat Ks = 0.1f;
+GLfloat Ka = 0.05f;
+// shininess coefficient for Blinn-Phong shader
+GLfloat shininess = 32.0f;
+
+GLfloat height_scale = 1.5f;
+// target length in pixels of the edges of the tessellated triangles (see displacement.tcs)
+GLfloat tessellationEdgePixels = 8.0f;
+// UV repetitions
+GLint repeat = 1;
+
+const char * available_textures[] = { "cobble", "brick wall", "sofa"};
+GLint current_texture = 0;
+
+// vector for the textures IDs: for each set, diffuse map, normal map, height map (converted in cone step map) and derivative map
+vector<GLint> textureID;
+
+bool tessellation = false;
+
+// layout of the vertices of the models in the GPU buffers (see mesh.h)
+// the packed layout is the default one, the full layout can be selected with the --full-vertex-format command line option
+VertexFormat vertexFormat = PACKED_VERTEX_FORMAT;
+// the models are processed by the mesh optimizer (see mesh_optimizer.h), unless the --no-mesh-optimization command line option is used
+bool optimizeMeshes = true;
+// number of Levels Of Detail generated for each mesh (see mesh_simplifier.h), and maximum error on screen (in pixels) of the selected LODs
+GLuint nLODs = 4;
+GLfloat lodMaxPixelError = 1.0f;
+// LODs selected for the objects in the scene (shown in the GUI)
+GLint planeLOD = 0, potLOD = 0, sphereLOD = 0;
+// the displaced vertices can be outside the bounding boxes: in the frustum culling, the boxes are enlarged by height_scale times the largest scale of the objects (3, the pot)
+#define MAX_OBJECT_SCALE 3.0f
+// visible objects and total objects in the last frame (see scene.h)
+GLuint frameVisibleObjects = 0, frameSceneObjects = 0;
+// true if the objects in the last frame were rendered with a specialized permutation of the Shader Program
+bool frameSpecializedShader = false;
+// entries in the lists of lights of the clusters, and maximum number of lights in a cluster, in the last frame (see light_clusters.h)
+GLuint frameClusterIndices = 0, frameMaxClusterLights = 0;
+// if true, the objects are rendered with deferred shading (see gbuffer.h): the geometry pass writes the G-buffer, and the lighting is computed once per pixel
+bool deferredShading = false;
+// if true, parallax mapping marches the ray with the cones of the cone step maps, instead of the linear search (see cone_step_map.h)
+bool coneStepMapping = true;
+// draw calls and rendered instances in the last frame (see render_queue.h and batch_renderer.h)
+GLuint frameDrawCalls = 0, frameInstances = 0;
+// OpenGL calls issued and skipped by the state cache in the last frame (see gl_state.h)
+GLuint frameIssuedCalls = 0, frameElidedCalls = 0;
+// frames in which the instance buffer waited for the GPU, since the beginning (see ring_buffer.h)
+GLuint ringBufferStalls = 0;
+// GPU memory for the mip levels of the textures, and memory used by the resident levels in the last frame (see texture_loader.h)
+GLint textureBudgetMB = 256;
+GLfloat frameTextureMB = 0.0f;
+// statistics of the profiler shown in the GUI, and result of the last export of the trace (see profiler.h)
+vector<ProfileStats> profileStats;
+string traceMessage;
+// if true, the simulation of the next frame runs on a worker thread while the current frame is rendered (see frame_pipeline.h),
+// otherwise it runs on the main thread (--serial-simulation command line option). Time of the simulation of the last frame, in ms
+bool pipelinedSimulation = true;
+GLfloat frameSimulationTime = 0.0f;
+
+// input of the simulation of a frame: the values of the keyboard and of the mouse, received by the callbacks, are copied here
+// (the other variables read by the simulation are changed only between Wait and Start, see N.B. 2 in frame_pipeline.h)
+struct SimulationInput {
+    // timestep, keys and mouse movement (see input_log.h)
+    FrameInput input;
+    bool spinning;
+    // in benchmark mode, the camera and the animation are set by the Benchmark class
+    bool benchmark;
+    BenchmarkFrame benchmarkFrame;
+    // enlargement of the bounding boxes in frustum culling
+    GLfloat cullingMargin;
+};
+
+// draw of an instance of a model in a frame packet
+struct PacketDraw {
+    GLuint pass;
+    Model* model;
+    GLint lod;
+    InstanceData instance;
+    // distance from the camera, for the sort of the render queue (see render_queue.h)
+    GLfloat depth;
+};
+
+// result of the simulation of a frame: the render thread renders the frame using only these values
+struct FramePacket {
+    glm::mat4 view;
+    glm::vec3 cameraPosition;
+    vector<PointLight> lights;
+    // visible objects and spheres of the lights
+    vector<PacketDraw> draws;
+    // diameter on the screen of the largest visible object (for the streaming of the textures)
+    GLfloat maxDiameter;
+    // statistics shown in the GUI
+    GLuint visibleObjects, sceneObjects;
+    GLint planeLOD, potLOD, sphereLOD;
+    GLfloat simulationTime;
+};
+
+/////////////////// MAIN function ///////////////////////
+int main(int argc, char** argv)
+{
+    // we check if the application must run in benchmark mode (code of Benchmark class is in include/utils/benchmark.h)
+    BenchmarkSettings benchmarkSettings = ParseBenchmarkSettings(argc, argv);
+    // the input of the session can be saved in a log (--record FILE) and replayed (--replay FILE), optionally saving the hash of each frame (--frame-hashes FILE)
+    string recordPath, replayPath, hashesPath;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--full-vertex-format") == 0)
+            vertexFormat = FULL_VERTEX_FORMAT;
+        else if (strcmp(argv[i], "--no-mesh-optimization") == 0)
+            optimizeMeshes = false;
+        else if (strcmp(argv[i], "--lods") == 0 && i + 1 < argc)
+            nLODs = max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+            recordPath = argv[++i];
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+            replayPath = argv[++i];
+        else if (strcmp(argv[i], "--frame-hashes") == 0 && i + 1 < argc)
+            hashesPath = argv[++i];
+        else if (strcmp(argv[i], "--serial-simulation") == 0)
+            pipelinedSimulation = false;
+    }
+
+#ifdef GLFW_PLATFORM_NULL
+    // in headless benchmark mode we do not need a window system: we ask GLFW (>= 3.4) for the null platform,
+    // and the OpenGL context is created with OSMesa (e.g. Mesa llvmpipe on a machine without GPU)
+    if (benchmarkSettings.enabled && benchmarkSettings.headless)
+        glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#else
+    // with GLFW < 3.4 there is no null platform: the benchmark needs a window system, and it renders in a hidden window
+    if (benchmarkSettings.enabled && benchmarkSettings.headless)
+        std::cout << "WARNING::BENCHMARK:: --headless needs GLFW >= 3.4 with OSMesa, this build uses GLFW " << GLFW_VERSION_MAJOR << "." << GLFW_VERSION_MINOR
+                  << ": the benchmark runs in a hidden window, which needs a window system" << std::endl;
+#endif
+    // Initialization of OpenGL context using GLFW
+    glfwInit();
+    // We set OpenGL specifications required for this application
+    // In this case: 4.1 Core
+    // It is possible to raise the values, in order to use functionalities of more recent OpenGL specs.
+    // If not supported by your graphics HW, the context will not be created and the application will close
+    // N.B.) creating GLAD code to load extensions, try to take into account the specifications and any extensions you want to use,
+    // in relation also to the values indicated in these GLFW commands
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    // we set if the window is resizable
+    glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
+    // in benchmark mode the window is hidden, because we render in an offscreen framebuffer
+    if (benchmarkSettings.enabled)
+    {
+        glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+#ifdef GLFW_PLATFORM_NULL
+        if (benchmarkSettings.headless)
+            glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+#endif
+    }
+
+    // we create the application's window
+    GLFWwindow* window = glfwCreateWindow(screenWidth, screenHeight, "Bump Mapping", nullptr, nullptr);
+    if (!window)
+    {
+        std::cout << "Failed to create GLFW window" << std::endl;
+        glfwTerminate();
+        return -1;
+    }
+    glfwMakeContextCurrent(window);
+
+    // we put in relation the window and the callbacks
+    glfwSetKeyCallback(window, key_callback);
+    glfwSetCursorPosCallback(window, mouse_callback);
+
+    // GLAD tries to load the context set by GLFW
+    if (!gladLoadGLLoader((GLADloadproc) glfwGetProcAddress))
+    {
+        std::cout << "Failed to initialize OpenGL context" << std::endl;
+        return -1;
+    }
+
+    // we define the viewport dimensions
+    int width, height;
+    glfwGetFramebufferSize(window, &width, &height);
+    glViewport(0, 0, width, height);
+
+    // we enable Z test
+    glEnable(GL_DEPTH_TEST);
+
+    //the "clear" color for the frame buffer
+    glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
+
+    // we create the Shader Programs used in the application: they are restored from the binary cache saved at the previous launch
+    // (code of ProgramCache class is in include/utils/program_cache.h), or compiled in parallel by the driver, if supported
+    EnableParallelShaderCompile((GLADloadproc) glfwGetProcAddress);
+    ProgramCache programCache;
+    GLfloat shadersStartTime = glfwGetTime();
+    SetupShaders(&programCache);
+    // we start the compilation of the permutations for the initial number of lights and repeat value
+    for (GLuint i = 0; i < LIGHT; i++)
+        shaders[i].Select((nLights <= MAX_SPECIALIZED_LIGHTS) ? GLint(nLights) : -1, ((repeat == 1) ? UNIT_REPEAT_FEATURE : 0) | ((i == PARALLAX) ? CONE_STEP_FEATURE : 0));
+    shaders[DEFERRED_LIGHTING].Select((nLights <= MAX_SPECIALIZED_LIGHTS) ? GLint(nLights) : -1, 0);
+    // the per-frame data of the draws are written in ring buffers, persistently mapped if the driver supports it (see include/utils/ring_buffer.h)
+    std::cout << "Instance buffer: " << (EnableBufferStorage((GLADloadproc) glfwGetProcAddress) ? "persistently mapped" : "mapped ranges") << std::endl;
+    size_t nPrograms = 0;
+    for (ShaderPermutations& permutations : shaders)
+        nPrograms += permutations.Size();
+    std::cout << "Shader Programs: " << programCache.loaded << " / " << nPrograms << " loaded from the cache, parallel compile "
+              << (ParallelShaderCompile() ? "on" : "off") << ", setup in " << (glfwGetTime() - shadersStartTime) * 1000.0 << " ms" << std::endl;
+
+    // we create the uniform buffers shared by all the Shader Programs (code of UniformBuffer class is in include/utils/uniform_buffer.h)
+    UniformBuffer cameraUBO(sizeof(CameraBlock), CAMERA_BLOCK);
+    UniformBuffer lightsUBO(sizeof(LightsBlock), LIGHTS_BLOCK);
+    UniformBuffer materialUBO(sizeof(MaterialBlock), MATERIAL_BLOCK);
+    CameraBlock cameraBlock;
+    LightsBlock lightsBlock;
+    MaterialBlock materialBlock;
+    // the lights are assigned to the clusters of the view frustum, and uploaded in texture buffers (code of LightClusters class is in include/utils/light_clusters.h)
+    LightClusters lightClusters;
+
+    // the meshes of all the models are allocated in the shared buffers of a single arena (code of GeometryArena class is in include/utils/mesh.h)
+    GeometryArena geometryArena(vertexFormat);
+    // we load the model(s) (code of Model class is in include/utils/model.h)
+    Model planeModel("../../models/plane.obj", vertexFormat, optimizeMeshes, nLODs, &geometryArena);
+    Model sphereModel("../../models/sphere.obj", vertexFormat, optimizeMeshes, nLODs, &geometryArena);
+    Model potModel("../../models/pot.obj", vertexFormat, optimizeMeshes, nLODs, &geometryArena);
+    // the draws are sorted by state, and the instances of the models are rendered in batches
+    // (code of RenderQueue class is in include/utils/render_queue.h, and of BatchRenderer class in include/utils/batch_renderer.h)
+    RenderQueue renderQueue;
+
+    // we load the images and store them in a vector (code of TextureLoader class is in include/utils/texture_loader.h)
+    // the images are decoded in parallel: until they are uploaded, the textures contain a placeholder color
+    // the height maps are converted in cone step maps, used by parallax mapping (see cone_step_map.h),
+    // and in derivative maps, used to perturb the normals in bump mapping and displacement mapping (see derivative_map.h)
+    TextureLoader textureLoader;
+    //cobble
+    textureID.push_back(textureLoader.Load("../../textures/cobble/diffuse.png", DIFFUSE_PLACEHOLDER));
+    textureID.push_back(textureLoader.Load("../../textures/cobble/normal.png", NORMAL_PLACEHOLDER));
+    textureID.push_back(textureLoader.LoadConeStepMap("../../textures/cobble/height.png"));
+    textureID.push_back(textureLoader.LoadDerivativeMap("../../textures/cobble/height.png"));
+    //brick wall
+    textureID.push_back(textureLoader.Load("../../textures/bw/diffuse.png", DIFFUSE_PLACEHOLDER));
+    textureID.push_back(textureLoader.Load("../../textures/bw/normal.png", NORMAL_PLACEHOLDER));
+    textureID.push_back(textureLoader.LoadConeStepMap("../../textures/bw/height.png"));
+    textureID.push_back(textureLoader.LoadDerivativeMap("../../textures/bw/height.png"));
+    //sofa
+    textureID.push_back(textureLoader.Load("../../textures/sofa/diffuse.jpg", DIFFUSE_PLACEHOLDER));
+    textureID.push_back(textureLoader.Load("../../textures/sofa/normal.jpg", NORMAL_PLACEHOLDER));
+    textureID.push_back(textureLoader.LoadConeStepMap("../../textures/sofa/height.jpg"));
+    textureID.push_back(textureLoader.LoadDerivativeMap("../../textures/sofa/height.jpg"));
+
+    // in benchmark mode we create the offscreen framebuffer and the timers, and the aspect ratio is the one of the framebuffer
+    // the runs use all the Shader Programs before LIGHT (PLAIN, BUMP, NORMAL, PARALLAX, DISPLACEMENT) and all the texture sets
+    std::unique_ptr<Benchmark> benchmark;
+    BenchmarkFrame benchmarkFrame;
+    if (benchmarkSettings.enabled)
+    {
+        benchmark = std::make_unique<Benchmark>(benchmarkSettings, LIGHT, print_available_ShaderPrograms, IM_ARRAYSIZE(available_textures), available_textures);
+        screenWidth = benchmarkSettings.width;
+        screenHeight = benchmarkSettings.height;
+        deferredShading = benchmarkSettings.deferred;
+        coneStepMapping = benchmarkSettings.coneStepMapping;
+        textureBudgetMB = GLint(benchmarkSettings.textureBudgetMB);
+        // the measures must not include frames rendered with the placeholders
+        textureLoader.Finish();
+    }
+
+    // Projection matrix: FOV angle, aspect ratio, near and far planes
+    const GLfloat zNear = 0.1f, zFar = 10000.0f;
+    glm::mat4 projection = glm::perspective(45.0f, (float)screenWidth/(float)screenHeight, zNear, zFar);
+    // size of the framebuffer, for the tiles of the light clusters
+    GLuint viewportWidth = benchmark ? screenWidth : width, viewportHeight = benchmark ? screenHeight : height;
+    // render target of the geometry pass of deferred shading (code of GBuffer class is in include/utils/gbuffer.h)
+    GBuffer gbuffer(viewportWidth, viewportHeight);
+    // transformations (position, rotation, scale) of the objects in the scene: the model and normal matrices are composed by the TransformStore
+    // only when the transformations change (code of TransformStore class is in include/utils/transform_store.h)
+    TransformStore transforms;
+    const glm::quat noRotation(1.0f, 0.0f, 0.0f, 0.0f);
+    // the plane is rotated of 90 degrees around the X axis, before the spinning around the Y axis
+    const glm::quat planeTilt = glm::angleAxis(glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+    GLuint planeTransform = transforms.Add(glm::vec3(0.0f, 0.0f, -10.0f), planeTilt, glm::vec3(1.0f));
+    GLuint potTransform = transforms.Add(glm::vec3(10.0f, 0.0f, -10.0f), noRotation, glm::vec3(3.0f));
+    GLuint sphereTransform = transforms.Add(glm::vec3(-10.0f, 0.0f, -10.0f), noRotation, glm::vec3(2.0f));
+    transforms.Update();
+    // the transformations of the spheres of the lights: the entry i is the light i
+    TransformStore lightTransforms;
+
+    // the objects are added to the scene, which discards the objects outside the view frustum (code of Scene class is in include/utils/scene.h)
+    Scene scene;
+    GLuint planeObject = scene.Add(planeModel, transforms.instances[planeTransform].modelMatrix);
+    GLuint potObject = scene.Add(potModel, transforms.instances[potTransform].modelMatrix);
+    GLuint sphereObject = scene.Add(sphereModel, transforms.instances[sphereTransform].modelMatrix);
+    // the spheres of the lights are rendered with a different Shader Program, so they are in a different scene.
+    // The scene has a sphere for each light in use (the object i is the light i): the spheres are added and removed by the simulation
+    Scene lightScene;
+    // indices of the visible objects of a scene
+    vector<GLuint> visibleObjects;
+
+    //set that we work with triangular texels
+    glPatchParameteri(GL_PATCH_VERTICES, 3);
+
+    //set up IMGUI
+    IMGUI_CHECKVERSION();
+    ImGui::CreateContext();
+    ImGuiIO& io = ImGui::GetIO(); (void)io;
+    ImGui::StyleColorsDark();
+    ImGui_ImplGlfw_InitForOpenGL(window, true);
+    ImGui_ImplOpenGL3_Init("#version 400");
+
+    glfwSwapInterval(0);
+
+    // CPU and GPU times of the phases of the frame (code of Profiler class is in include/utils/profiler.h)
+    Profiler profiler;
+
+    // the input of the session is saved in a log, or read from a log (code of InputLog class is in include/utils/input_log.h).
+    // The log tracks all the variables changed by the GUI which change the rendered frames (the benchmark mode has its own input)
+    std::unique_ptr<InputLog> inputLog;
+    if (!benchmark && !replayPath.empty())
+        inputLog = std::make_unique<InputLog>(replayPath, REPLAY_INPUT);
+    else if (!benchmark && !recordPath.empty())
+        inputLog = std::make_unique<InputLog>(recordPath, RECORD_INPUT);
+    if (inputLog)
+    {
+        replayingInput = (inputLog->mode == REPLAY_INPUT);
+        for (GLint* variable : { &current_program, &current_texture, &repeat, &textureBudgetMB, &activeLight })
+            inputLog->Track(*variable);
+        for (GLfloat* variable : { &Kd, &Ks, &Ka, &shininess, &height_scale, &tessellationEdgePixels, &spin_speed, &lodMaxPixelError })
+            inputLog->Track(*variable);
+        for (bool* variable : { &deferredShading, &coneStepMapping })
+            inputLog->Track(*variable);
+        inputLog->Track(specularColor);
+        inputLog->Track(ambientColor);
+        inputLog->Track(spinning);
+        inputLog->Track(wireframe);
+        inputLog->Track(lights);
+        inputLog->Track(nLights);
+    }
+    // in replay mode, the hash of each frame and the frame times are saved
+    ofstream frameHashes;
+    if (replayingInput && !hashesPath.empty())
+        frameHashes.open(hashesPath);
+    vector<GLfloat> replayFrameTimes;
+
+    // simulation of a frame, executed by the simulation thread (code of FramePipeline class is in include/utils/frame_pipeline.h):
+    // the camera, the lights and the objects are moved, the visible objects are culled and their LODs are selected.
+    // The simulation owns the camera, the transformations and the scenes, and it writes in the packet everything needed to render the frame
+    auto simulate = [&](const SimulationInput& input, FramePacket& packet)
+    {
+        auto simulationStart = chrono::steady_clock::now();
+        if (input.benchmark)
+        {
+            // in benchmark mode, camera and animation are set by the Benchmark class
+            camera.Position = input.benchmarkFrame.cameraPosition;
+            packet.view = input.benchmarkFrame.view;
+            orientationY = 1.0f + input.benchmarkFrame.time * spin_speed;
+        }
+        else
+        {
+            // the keys of the input of the frame
+            bool pressed[1024] = {};
+            for (int i = 0; i < IM_ARRAYSIZE(recordedKeys); i++)
+                pressed[recordedKeys[i]] = (input.input.keys >> i) & 1;
+            if (input.input.mouseX != 0.0f || input.input.mouseY != 0.0f)
+                camera.ProcessMouseMovement(input.input.mouseX, input.input.mouseY);
+            apply_camera_movements(pressed, input.input.deltaTime);
+            apply_light_movements(activeLight, pressed, input.input.deltaTime);
+            // if animated rotation is activated, then we increment the rotation angle using delta time and the rotation speed parameter
+            if (input.spinning)
+                orientationY += (input.input.deltaTime * spin_speed);
+            packet.view = camera.GetViewMatrix();
+        }
+        packet.cameraPosition = camera.Position;
+        packet.lights = lights;
+
+        // parameters for the selection of the LODs of the objects
+        LODContext lodContext;
+        lodContext.cameraPosition = camera.Position;
+        lodContext.projectionScale = 0.5f * screenHeight * projection[1][1];
+        lodContext.maxPixelError = lodMaxPixelError;
+
+        // we update the transformations of the objects in the scene: the objects spin around the Y axis, and the spheres follow the lights
+        glm::quat spin = glm::angleAxis(orientationY, glm::vec3(0.0f, 1.0f, 0.0f));
+        transforms.SetRotation(planeTransform, spin * planeTilt);
+        transforms.SetRotation(potTransform, spin);
+        transforms.SetRotation(sphereTransform, spin);
+        transforms.Update();
+
+        scene.SetTransform(planeObject, transforms.instances[planeTransform]);
+        scene.SetTransform(potObject, transforms.instances[potTransform]);
+        scene.SetTransform(sphereObject, transforms.instances[sphereTransform]);
+
+        // the BVH is refitted to the new transformations, and the visible objects are added to the draws of the packet, with their distance from the camera
+        packet.draws.clear();
+        scene.Update();
+        scene.Cull(projection * packet.view, visibleObjects, input.cullingMargin);
+        packet.maxDiameter = 0.0f;
+        for (GLuint object : visibleObjects)
+        {
+            SceneObject& sceneObject = scene.objects[object];
+            sceneObject.lod = sceneObject.model->SelectLOD(sceneObject.instance.modelMatrix, lodContext, sceneObject.lod);
+            packet.draws.push_back({ OBJECTS_PASS, sceneObject.model, sceneObject.lod, sceneObject.instance,
+                                     glm::distance(camera.Position, sceneObject.worldBounds.Center()) });
+            packet.maxDiameter = max(packet.maxDiameter, sceneObject.model->ProjectedDiameter(sceneObject.instance.modelMatrix, lodContext));
+        }
+        packet.visibleObjects = scene.visibleObjects;
+        packet.sceneObjects = GLuint(scene.objects.size());
+        packet.planeLOD = scene.objects[planeObject].lod;
+        packet.potLOD = scene.objects[potObject].lod;
+        packet.sphereLOD = scene.objects[sphereObject].lod;
+
+        //LIGHTS
+        // the spheres of the lights are in the last pass, with a different Shader Program and no textures
+        // the shaders of the lights do not depend on the number of lights, so they have no permutations
+        // The spheres are added or removed when the number of lights changes (with the GUI, or in the replay of the input log),
+        // so the transformations and the BVH contain only the lights in use
+        while (lightTransforms.Size() > nLights)
+        {
+            lightTransforms.RemoveLast();
+            lightScene.RemoveLast();
+        }
+        while (lightTransforms.Size() < nLights)
+        {
+            lightTransforms.Add(lights[lightTransforms.Size()].position, noRotation, glm::vec3(0.2f));
+            lightScene.Add(sphereModel, glm::mat4(1.0f));
+        }
+        for (GLuint i = 0; i < nLights; i++)
+            lightTransforms.SetPosition(i, lights[i].position);
+        lightTransforms.Update();
+        for (GLuint i = 0; i < nLights; i++)
+            lightScene.SetTransform(i, lightTransforms.instances[i]);
+        lightScene.Update();
+        lightScene.Cull(projection * packet.view, visibleObjects);
+        for (GLuint object : visibleObjects)
+        {
+            SceneObject& sceneObject = lightScene.objects[object];
+            sceneObject.lod = sceneObject.model->SelectLOD(sceneObject.instance.modelMatrix, lodContext, sceneObject.lod);
+            packet.draws.push_back({ LIGHTS_PASS, sceneObject.model, sceneObject.lod, sceneObject.instance,
+                                     glm::distance(camera.Position, sceneObject.worldBounds.Center()) });
+        }
+        packet.simulationTime = chrono::duration<GLfloat, milli>(chrono::steady_clock::now() - simulationStart).count();
+    };
+    // the first frame is simulated with an empty input
+    FramePipeline<SimulationInput, FramePacket> pipeline(simulate, pipelinedSimulation);
+    pipeline.Start(SimulationInput());
+
+    // Rendering loop: this code is executed at each frame
+    while(!glfwWindowShouldClose(window))
+    {
+        // we determine the time passed from the beginning
+        // and we calculate time difference between current frame rendering and the previous one
+        GLfloat currentFrame = glfwGetTime();
+        deltaTime = currentFrame - lastFrame;
+        lastFrame = currentFrame;
+        frameCounter++;
+        elapsedTime+=deltaTime;
+
+        //every second we update the fps
+        if(elapsedTime>=1){
+            std::string FPS = std::to_string(frameCounter/elapsedTime);
+            frameCounter = 0;
+            elapsedTime = 0.0f;
+            std::string newTitle = "Bump Mapping - " + FPS + " fps";
+            glfwSetWindowTitle(window, newTitle.c_str());
+        }
+
+        // the profiler reads the GPU times of an older frame (see N.B. 2 in profiler.h), and it starts the measures of this one
+        profiler.BeginFrame();
+        GLState().ResetCounters();
+
+        // we upload the textures decoded since the last frame, and we request the mip levels needed by the last frame, within the memory budget
+        profiler.BeginScope("Resource updates");
+        textureLoader.memoryBudget = size_t(textureBudgetMB) * 1024 * 1024;
+        textureLoader.Update();
+        // in benchmark and replay mode, the requested levels are uploaded before rendering, so the measures do not depend on the decoding time
+        if (benchmark || replayingInput)
+            textureLoader.Finish();
+        frameTextureMB = textureLoader.ResidentBytes() / (1024.0f * 1024.0f);
+
+        // we finalize the Shader Programs already compiled in background by the driver (the program in use is finalized by Use, if needed)
+        for (ShaderPermutations& permutations : shaders)
+            permutations.Update();
+        profiler.EndScope();
+
+        // we wait for the packet of this frame: it has been simulated by the simulation thread while the previous frame was rendered
+        profiler.BeginScope("Simulation wait", false);
+        const FramePacket& packet = pipeline.Wait();
+        profiler.EndScope();
+
+        // the movements applied by the simulation of the last frame are not changes of the user (see N.B. 1 in input_log.h).
+        // The reference values are saved before the events are processed: the changes made by the keyboard callback (e.g., P and L) are saved in the log
+        if (inputLog)
+            inputLog->EndFrame();
+
+        // the simulation thread is waiting for its input, so now we can change the variables it reads (see N.B. 2 in frame_pipeline.h)
+        // Check is an I/O event is happening
+        profiler.BeginScope("Input", false);
+        glfwPollEvents();
+        SimulationInput simulationInput = {};
+        if (benchmark)
+        {
+            // in benchmark mode, shader, texture, camera and animation are set by the Benchmark class, with a fixed timestep
+            if (!benchmark->BeginFrame(benchmarkFrame))
+                break;
+            current_program = benchmarkFrame.program;
+            current_texture = benchmarkFrame.texture;
+            simulationInput.benchmark = true;
+            simulationInput.benchmarkFrame = benchmarkFrame;
+        }
+        else
+        {
+            // no GUI in replay mode: the frames must depend only on the log
+            if (!replayingInput)
+            {
+                ImGui_ImplOpenGL3_NewFrame();
+                ImGui_ImplGlfw_NewFrame();
+                ImGui::NewFrame();
+                BuildGUI();
+                BuildProfilerGUI(profiler);
+            }
+
+            // the input of the frame (keys, mouse and timestep) is saved in the log, or replaced by the recorded one, together with the tracked variables
+            FrameInput frameInput = { deltaTime, 0, mouseOffsetX, mouseOffsetY };
+            for (int i = 0; i < IM_ARRAYSIZE(recordedKeys); i++)
+                frameInput.keys |= (keys[recordedKeys[i]] ? 1u : 0u) << i;
+            mouseOffsetX = mouseOffsetY = 0.0f;
+            if (inputLog && !inputLog->Frame(frameInput))
+                break;
+            if (replayingInput)
+                replayFrameTimes.push_back(deltaTime);
+            simulationInput.input = frameInput;
+        }
+        // the value of spinning is copied in the input, because the keyboard callback changes it
+        simulationInput.spinning = spinning;
+        // the displaced vertices can be outside the bounding boxes of the objects
+        simulationInput.cullingMargin = (current_program == DISPLACEMENT) ? height_scale * MAX_OBJECT_SCALE : 0.0f;
+        pipeline.Start(simulationInput);
+        profiler.EndScope();
+
+        // we "clear" the frame and z buffer
+        profiler.BeginScope("Uniform setup");
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        // we set the rendering mode (the state cache skips the call if the mode is not changed, see gl_state.h)
+        if (wireframe)
+            // Draw in wireframe
+            GLState().PolygonMode(GL_LINE);
+        else
+            GLState().PolygonMode(GL_FILL);
+
+        // we update the uniform blocks shared by all the Shader Programs: they are uploaded once per frame
+        cameraBlock.projectionMatrix = projection;
+        cameraBlock.viewMatrix = packet.view;
+        cameraBlock.viewPosition = glm::vec4(packet.cameraPosition, 1.0f);
+        cameraUBO.Update(&cameraBlock);
+
+        // the lights are assigned to the clusters, and the parameters of the clusters are set in the uniform block
+        lightClusters.Update(packet.lights, packet.view, projection, zNear, zFar, viewportWidth, viewportHeight, lightsBlock);
+        lightsUBO.Update(&lightsBlock);
+        lightClusters.Bind();
+        frameClusterIndices = lightClusters.nIndices;
+        frameMaxClusterLights = lightClusters.maxClusterLights;
+
+        materialBlock.ambientColor = glm::vec3(ambientColor[0], ambientColor[1], ambientColor[2]);
+        materialBlock.specularColor = glm::vec3(specularColor[0], specularColor[1], specularColor[2]);
+        materialBlock.Ka = Ka;
+        materialBlock.Kd = Kd;
+        materialBlock.Ks = Ks;
+        materialBlock.shininess = shininess;
+        materialBlock.repeat = repeat;
+        materialBlock.height_scale = height_scale;
+        materialUBO.Update(&materialBlock);
+
+        // We select the Shader Program of the objects (it is "installed" by the render queue, when the objects are rendered):
+        // we use the permutation specialized for the current number of lights and repeat value, if it has already been compiled.
+        // In deferred shading, the objects are rendered in the G-buffer with the permutation without lighting, and the number of lights
+        // selects the permutation of the lighting pass
+        GLuint packetLights = GLuint(packet.lights.size());
+        GLint specializedLights = (packetLights <= MAX_SPECIALIZED_LIGHTS) ? GLint(packetLights) : -1;
+        GLuint features = (repeat == 1) ? UNIT_REPEAT_FEATURE : 0;
+        if (current_program == PARALLAX && coneStepMapping)
+            features |= CONE_STEP_FEATURE;
+        Shader& objectShader = deferredShading ? shaders[current_program].Select(-1, features | GBUFFER_OUTPUT_FEATURE)
+                                               : shaders[current_program].Select(specializedLights, features, replayingInput);
+        frameSpecializedShader = (&objectShader != &shaders[current_program].Generic());
+
+        //if we are using the displacement shader we activate tessellation
+        tessellation = (current_program == DISPLACEMENT);
+        if (tessellation)
+        {
+            // the uniforms are part of the state of the program: they are set now, and the render queue uses the program later
+            objectShader.Use();
+            // the tessellation levels depend on the length in pixels of the edges of the patches
+            GLState().Uniform2f(objectShader.getUniformLocation("viewportSize"), GLfloat(viewportWidth), GLfloat(viewportHeight));
+            GLState().Uniform1f(objectShader.getUniformLocation("edgePixels"), tessellationEdgePixels);
+        }
+        profiler.EndScope();
+
+        // the draws of the packet are submitted to the render queue, with their Shader Program and material:
+        // the queue sorts them to reduce the changes of state and to render them front-to-back
+        profiler.BeginScope("Queue submission", false);
+        GLuint programs[] = { renderQueue.Program(objectShader, tessellation), renderQueue.Program(shaders[LIGHT].Generic()) };
+        GLuint materials[] = { renderQueue.Material(&textureID[4*current_texture]), NO_MATERIAL };
+        for (const PacketDraw& draw : packet.draws)
+            renderQueue.Submit(draw.pass, programs[draw.pass], materials[draw.pass], *draw.model, draw.lod, draw.instance, draw.depth);
+        // the textures of the material are streamed with the resolution needed by the largest visible object (see texture_loader.h):
+        // we assume that the UV space wraps once around its bounding sphere (e.g., the u coordinate of the sphere spans its circumference),
+        // and the textures are repeated "repeat" times in the UV space
+        for (GLuint i = 0; i < 4; i++)
+            textureLoader.Use(textureID[4*current_texture+i], packet.maxDiameter * glm::pi<float>() / repeat);
+        profiler.EndScope();
+
+        // each group of instances of a model is measured in a nested scope
+        profiler.BeginScope("Objects pass");
+        if (deferredShading)
+            gbuffer.BeginGeometryPass();
+        renderQueue.Flush(OBJECTS_PASS, &profiler);
+        profiler.EndScope();
+        frameDrawCalls = renderQueue.drawCalls;
+        frameInstances = renderQueue.instances;
+        if (deferredShading)
+        {
+            profiler.BeginScope("Lighting pass");
+            // lighting pass: the world space position of the pixels is reconstructed from the depth of the G-buffer
+            gbuffer.EndGeometryPass();
+            Shader& lightingShader = shaders[DEFERRED_LIGHTING].Select(specializedLights, 0, replayingInput);
+            frameSpecializedShader = (&lightingShader != &shaders[DEFERRED_LIGHTING].Generic());
+            lightingShader.Use();
+            glm::mat4 inverseProjectionView = glm::inverse(projection * packet.view);
+            GLState().UniformMatrix4fv(lightingShader.getUniformLocation("inverseProjectionView"), glm::value_ptr(inverseProjectionView));
+            gbuffer.DrawLightingPass();
+            profiler.EndScope();
+        }
+        frameVisibleObjects = packet.visibleObjects;
+        frameSceneObjects = packet.sceneObjects;
+        planeLOD = packet.planeLOD;
+        potLOD = packet.potLOD;
+        sphereLOD = packet.sphereLOD;
+        frameSimulationTime = packet.simulationTime;
+
+        //LIGHTS
+        // the spheres of the lights with the same LOD are rendered with a single instanced draw call
+        profiler.BeginScope("Lights pass");
+        renderQueue.Flush(LIGHTS_PASS);
+        profiler.EndScope();
+        frameDrawCalls += renderQueue.drawCalls;
+        frameInstances += renderQueue.instances;
+        frameVisibleObjects += renderQueue.instances;
+        frameSceneObjects += packetLights;
+        frameIssuedCalls = GLState().issuedCalls;
+        frameElidedCalls = GLState().elidedCalls;
+        ringBufferStalls = renderQueue.Stalls();
+        
+
+        if (benchmark)
+        {
+            // no GUI in benchmark mode: we just stop the measures of the frame
+            benchmark->EndFrame();
+            profiler.EndFrame();
+            continue;
+        }
+
+        // the GUI has been built before the start of the simulation: here it is rendered
+        if (replayingInput)
+        {
+            if (frameHashes.is_open())
+                frameHashes << inputLog->frames - 1 << " " << hex << HashFramebuffer(viewportWidth, viewportHeight) << dec << "\n";
+        }
+        else
+        {
+            profiler.BeginScope("ImGui");
+            ImGui::Render();
+            ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+            profiler.EndScope();
+        }
+        profiler.EndFrame();
+
+        // Swapping back and front buffers
+        glfwSwapBuffers(window);
+    }
+
+    // in benchmark mode we save the results
+    if (benchmark)
+        benchmark->WriteReport();
+    // the trace contains the last PROFILER_HISTORY frames of the last run
+    if (benchmark && benchmarkSettings.trace)
+    {
+        profiler.Flush();
+        string tracePath = benchmarkSettings.outputPath + ".trace.json";
+        if (profiler.ExportChromeTrace(tracePath))
+            cout << "Trace of the last frames saved in " << tracePath << endl;
+    }
+    // in replay mode we print the frame times (the first frame is excluded: its time includes the loading of the application)
+    if (replayingInput && replayFrameTimes.size() > 1)
+    {
+        sort(replayFrameTimes.begin() + 1, replayFrameTimes.end());
+        GLfloat total = 0.0f;
+        for (size_t i = 1; i < replayFrameTimes.size(); i++)
+            total += replayFrameTimes[i];
+        size_t n = replayFrameTimes.size() - 1;
+        std::cout << "Replay completed: " << n << " frames, frame time mean " << total / n * 1000.0f << " ms, p95 "
+                  << replayFrameTimes[1 + min(n - 1, size_t(0.95 * n))] * 1000.0f << " ms" << std::endl;
+    }
+
+    //IMGUI cleanup
+    ImGui_ImplOpenGL3_Shutdown();
+    ImGui_ImplGlfw_Shutdown();
+    ImGui::DestroyContext();
+
+    // when I exit from the graphics loop, it is because the application is closing
+    // we delete the Shader Programs
+    DeleteShaders();
+    // we close and delete the created context
+    glfwTerminate();
+    return 0;
+}
+
+
+//////////////////////////////////////////
+// IMGUI Control panels definition
+void BuildGUI()
+{
+    ImGui::Begin("Blinn-Phong parameters");
+    ImGui::SliderFloat("Kd", &Kd, 0, 1);
+    ImGui::SliderFloat("Ks", &Ks, 0, 1);
+    ImGui::SliderFloat("Ka", &Ka, 0, 1);
+    ImGui::SliderFloat("Shininess", &shininess, 0, 128);
+    ImGui::ColorEdit3("Specular color", specularColor);
+    ImGui::ColorEdit3("Ambient  color", ambientColor);
+    ImGui::End();
+
+    ImGui::Begin("Objects appearance");
+    ImGui::SliderInt("Repeat", &repeat, 1, 5);
+    ImGui::Combo("Shader", &current_program, print_available_ShaderPrograms, IM_ARRAYSIZE(print_available_ShaderPrograms));
+    if(current_program==4){
+        ImGui::SliderFloat("Height scale", &height_scale, 0, 3);
+        ImGui::SliderFloat("Edge length (pixels)", &tessellationEdgePixels, 2, 64);
+    }
+    if(current_program==3)
+        ImGui::Checkbox("Cone step mapping", &coneStepMapping);
+    ImGui::Combo("Texture", &current_texture, available_textures, IM_ARRAYSIZE(available_textures));
+    ImGui::SliderFloat("Spin speed", &spin_speed, 0, 10);
+    ImGui::SliderFloat("LOD error (pixels)", &lodMaxPixelError, 0.1f, 10.0f);
+    ImGui::Text("LOD: plane %d, pot %d, sphere %d", planeLOD, potLOD, sphereLOD);
+    ImGui::Text("Draw calls: %u (%u instances)", frameDrawCalls, frameInstances);
+    ImGui::Text("Instance buffer: %s, %u waits for the GPU", BufferStorage() ? "persistent" : "mapped ranges", ringBufferStalls);
+    ImGui::Text("State changes: %u issued, %u elided", frameIssuedCalls, frameElidedCalls);
+    ImGui::Text("Simulation: %.2f ms (%s)", frameSimulationTime, pipelinedSimulation ? "worker thread" : "main thread");
+    ImGui::SliderInt("Texture budget (MB)", &textureBudgetMB, 16, 1024);
+    ImGui::Text("Resident textures: %.1f MB", frameTextureMB);
+    ImGui::Text("Visible objects: %u / %u", frameVisibleObjects, frameSceneObjects);
+    ImGui::Checkbox("Deferred shading", &deferredShading);
+    ImGui::Text("Shader permutation: %s", frameSpecializedShader ? "specialized" : "generic");
+    ImGui::End();
+
+    ImGui::Begin("Light panel");
+    if (ImGui::Button("addLight"))
+        addLight();
+    ImGui::SameLine();
+    if (ImGui::Button("removeLight"))
+        removeLight();
+    ImGui::SameLine();
+    if (ImGui::Button("add 100 random lights"))
+        addRandomLights(100);
+    ImGui::Text("Lights: %u, cluster lists: %u entries, max %u lights per cluster", nLights, frameClusterIndices, frameMaxClusterLights);
+    if (nLights > 0)
+    {
+        // the arrows and the page up/down keys move the active light
+        ImGui::SliderInt("Active light", &activeLight, 0, nLights - 1);
+        ImGui::SliderFloat("Radius", &lights[activeLight].radius, 0.1f, 100.0f);
+        ImGui::ColorEdit3("Color", &lights[activeLight].color[0]);
+    }
+    ImGui::End();
+}
+
+//////////////////////////////////////////
+// times of the phases of the last frames: average and maximum on CPU and GPU, and histogram of the times of each frame
+// (the GPU times for the scopes measured on the GPU, the CPU times for the others)
+void BuildProfilerGUI(Profiler& profiler)
+{
+    ImGui::Begin("Profiler");
+    ImGui::Checkbox("Enabled", &profiler.enabled);
+    ImGui::SameLine();
+    if (ImGui::Button("Export trace"))
+        traceMessage = profiler.ExportChromeTrace("profile.trace.json") ? "saved in profile.trace.json" : "cannot write profile.trace.json";
+    ImGui::SameLine();
+    ImGui::Text("%s", traceMessage.c_str());
+
+    profiler.Statistics(profileStats);
+    for (GLuint i = 0; i < profileStats.size(); i++)
+    {
+        const ProfileStats& stats = profileStats[i];
+        // the nested scopes are indented
+        ImGui::Text("%*s%s", int(2 * stats.depth), "", stats.name);
+        ImGui::SameLine(200);
+        if (stats.gpu)
+            ImGui::Text("CPU %.2f ms (max %.2f), GPU %.2f ms (max %.2f)", stats.cpuAverage, stats.cpuMax, stats.gpuAverage, stats.gpuMax);
+        else
+            ImGui::Text("CPU %.2f ms (max %.2f)", stats.cpuAverage, stats.cpuMax);
+        const vector<float>& times = stats.gpu ? stats.gpuTimes : stats.cpuTimes;
+        ImGui::PushID(i);
+        ImGui::PlotHistogram("##times", times.data(), int(times.size()), 0, nullptr, 0.0f, max(stats.gpu ? stats.gpuMax : stats.cpuMax, 0.01f), ImVec2(0, 30));
+        ImGui::PopID();
+    }
+    ImGui::End();
+}
+
+//////////////////////////////////////////
+// we create and compile shaders (code of Shader class is in include/utils/shader.h), and we add them to the list of available shaders
+// the constructors do not wait for compilation: each program is finalized when it is used for the first time, or when the driver has finished compiling it.
+// Here only the generic version of each program is created: the permutations are created when they are requested
+void SetupShaders(ProgramCache* cache)
+{
+    shaders.emplace_back("shaders/basic.vert", "shaders/basic.frag", nullptr, nullptr, cache, SetupShaderInterface);
+    shaders.emplace_back("shaders/blinn_bump.vert", "shaders/blinn_bump.frag", nullptr, nullptr, cache, SetupShaderInterface);
+    shaders.emplace_back("shaders/tangent.vert", "shaders/normal.frag", nullptr, nullptr, cache, SetupShaderInterface);
+    shaders.emplace_back("shaders/tangent.vert", "shaders/parallax.frag", nullptr, nullptr, cache, SetupShaderInterface);
+    shaders.emplace_back("shaders/displacement.vert", "shaders/displacement.frag", "shaders/displacement.tcs", "shaders/displacement.tes", cache, SetupShaderInterface);
+    shaders.emplace_back("shaders/light.vert", "shaders/light.frag", nullptr, nullptr, cache, SetupShaderInterface);
+    shaders.emplace_back("shaders/deferred_lighting.vert", "shaders/deferred_lighting.frag", nullptr, nullptr, cache, SetupShaderInterface);
+}
+
+//////////////////////////////////////////
+// we connect the uniform blocks of all the Shader Programs to the shared binding points (see include/utils/uniform_buffer.h),
+// and we assign the texture units to the samplers. These values never change, so they are set once after linking
+// (if a program is still compiling, the Shader class applies them when the program is finalized)
+void SetupShaderInterface(Shader& shader)
+{
+    shader.BindUniformBlock("Camera", CAMERA_BLOCK);
+    shader.BindUniformBlock("Lights", LIGHTS_BLOCK);
+    shader.BindUniformBlock("Material", MATERIAL_BLOCK);
+
+    shader.SetSampler("diffuseMap", 0);
+    shader.SetSampler("normalMap", 1);
+    shader.SetSampler("heightMap", 2);
+    shader.SetSampler("derivativeMap", DERIVATIVE_MAP_UNIT);
+    shader.SetSampler("lightData", LIGHT_DATA_UNIT);
+    shader.SetSampler("clusterData", CLUSTER_DATA_UNIT);
+    shader.SetSampler("clusterLightIndices", CLUSTER_INDICES_UNIT);
+    shader.SetSampler("gAlbedoSpecular", GBUFFER_ALBEDO_UNIT);
+    shader.SetSampler("gNormalShininess", GBUFFER_NORMAL_UNIT);
+    shader.SetSampler("gDepth", GBUFFER_DEPTH_UNIT);
+}
+
+//////////////////////////////////////////
+// we delete all the Shaders Programs
+void DeleteShaders()
+{
+    for(GLuint i = 0; i < shaders.size(); i++)
+        shaders[i].Delete();
+}
+
+//////////////////////////////////////////
+// callback for keyboard events
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mode)
+{   
+    GLuint new_program;
+    // if ESC is pressed, we close the application
+    if(key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
+        glfwSetWindowShouldClose(window, GL_TRUE);
+
+    // in replay mode the input comes from the log
+    if (replayingInput)
+        return;
+
+    if(key == GLFW_KEY_SPACE && action == GLFW_PRESS)
+       moveMode = true;
+    if(key == GLFW_KEY_SPACE && action == GLFW_RELEASE)
+       moveMode = false;
+
+    // if P is pressed, we start/stop the animated rotation of models
+    if(key == GLFW_KEY_P && action == GLFW_PRESS)
+        spinning=!spinning;
+
+    // if L is pressed, we activate/deactivate wireframe rendering of models
+    if(key == GLFW_KEY_L && action == GLFW_PRESS)
+        wireframe=!wireframe;
+
+    if(action == GLFW_PRESS)
+        keys[key] = true;
+    else if(action == GLFW_RELEASE)
+        keys[key] = false;
+}
+
+//////////////////////////////////////////
+// callback for mouse events
+void mouse_callback(GLFWwindow* window, double xpos, double ypos)
+{
+    
+    // we move the camera view following the mouse cursor
+    // we calculate the offset of the mouse cursor from the position in the last frame
+    // when rendering the first frame, we do not have a "previous state" for the mouse, so we set the previous state equal to the initial values (thus, the offset will be = 0)
+    if(firstMouse)
+    {
+        lastX = xpos;
+        lastY = ypos;
+        firstMouse = false;
+    }
+
+    // offset of mouse cursor position
+    GLfloat xoffset = xpos - lastX;
+    GLfloat yoffset = lastY - ypos;
+
+    // the new position will be the previous one for the next frame
+    lastX = xpos;
+    lastY = ypos;
+    
+    if(moveMode && !replayingInput){
+        // we accumulate the offset: it is passed to the Camera class instance once per frame, in the rendering loop
+        mouseOffsetX += xoffset;
+        mouseOffsetY += yoffset;
+    }
+
+}
+
+//////////////////////////////////////////
+// If one of the WASD keys is pressed, the camera is moved accordingly (the code is in utils/camera.h)
+void apply_camera_movements(const bool* pressed, GLfloat deltaTime)
+{
+    // if a single WASD key is pressed, then we will apply the full value of velocity v in the corresponding direction.
+    // However, if two keys are pressed together in order to move diagonally (W+D, W+A, S+D, S+A), 
+    // then the camera will apply a compensation factor to the velocities applied in the single directions, 
+    // in order to have the full v applied in the diagonal direction  
+    // the XOR on A and D is to avoid the application of a wrong attenuation in the case W+A+D or S+A+D are pressed together.  
+    GLboolean diagonal_movement = (pressed[GLFW_KEY_W] ^ pressed[GLFW_KEY_S]) && (pressed[GLFW_KEY_A] ^ pressed[GLFW_KEY_D]); 
+    camera.SetMovementCompensation(diagonal_movement);
+    
+    if(pressed[GLFW_KEY_W])
+        camera.ProcessKeyboard(FORWARD, deltaTime);  
+    if(pressed[GLFW_KEY_S])
+        camera.ProcessKeyboard(BACKWARD, deltaTime);
+    if(pressed[GLFW_KEY_A])
+        camera.ProcessKeyboard(LEFT, deltaTime);
+    if(pressed[GLFW_KEY_D])
+        camera.ProcessKeyboard(RIGHT, deltaTime);
+}
+
+void apply_light_movements(int activeLight, const bool* pressed, GLfloat deltaTime)
+{
+    if (activeLight < 0)
+        return;
+    GLboolean diagonal_movement = (pressed[GLFW_KEY_UP] ^ pressed[GLFW_KEY_DOWN]) && (pressed[GLFW_KEY_LEFT] ^ pressed[GLFW_KEY_RIGHT]) && (pressed[GLFW_KEY_PAGE_UP] ^ pressed[GLFW_KEY_PAGE_DOWN]); 
+    GLfloat movementCompensation = (diagonal_movement ? DIAGONAL_COMPENSATION : 1.0f);
+    GLfloat movementSpeed = 5.0f;
+    GLfloat velocity = movementSpeed * deltaTime * movementCompensation;
+    if(pressed[GLFW_KEY_UP])
+        lights[activeLight].position += camera.Front * velocity;
+    if(pressed[GLFW_KEY_DOWN])
+        lights[activeLight].position -= camera.Front * velocity;
+    if(pressed[GLFW_KEY_RIGHT])
+        lights[activeLight].position += camera.Right * velocity;
+    if(pressed[GLFW_KEY_LEFT])
+        lights[activeLight].position -= camera.Right * velocity;
+    if(pressed[GLFW_KEY_PAGE_UP])
+        lights[activeLight].position += camera.Up * velocity;
+    if(pressed[GLFW_KEY_PAGE_DOWN])
+        lights[activeLight].position -= camera.Up * velocity;
+        
+}
+
+void addLight(){
+    if (nLights<MAX_NR_LIGHTS){
+        lights.push_back({ glm::vec3(0.0f, 0.0f, 0.0f), 50.0f, glm::vec3(1.0f), 0.0f });
+        nLights++;
+        activeLight = nLights - 1;
+    }else{
+        std::cout << "Max number of lights reached" << std::endl;
+    }
+}
+
+void removeLight(){
+    if(nLights>0){
+        lights.pop_back();
+        nLights--;
+    }
+    if(activeLight>=nLights){
+        activeLight = nLights - 1;
+    }
+}
+    
+
+// we add lights with random position around the objects, and random radius and color
+void addRandomLights(GLuint count){
+    static std::mt19937 generator(1234);
+    std::uniform_real_distribution<GLfloat> x(-20.0f, 20.0f), y(-6.0f, 6.0f), z(-25.0f, 5.0f), radius(3.0f, 8.0f), channel(0.2f, 1.0f);
+    for (GLuint i = 0; i < count && nLights < MAX_NR_LIGHTS; i++){
+        lights.push_back({ glm::vec3(x(generator), y(generator), z(generator)), radius(generator), glm::vec3(channel(generator), channel(generator), channel(generator)), 0.0f });
+        nLights++;
+    }
+    activeLight = nLights - 1;
+}
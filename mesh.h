@@ -1,206 +1,596 @@
-/*
-Mesh class
-- the class allocates and initializes VBO, VAO, and EBO buffers, and it sets as OpenGL must consider the data in the buffers
-
-VBO : Vertex Buffer Object - memory allocated on GPU memory to store the mesh data (vertices and their attributes, like e.g. normals, etc)
-EBO : Element Buffer Object - a buffer maintaining the indices of vertices composing the mesh faces
-VAO : Vertex Array Object - a buffer that helps to "manage" VBO and its inner structure. It stores pointers to the different vertex attributes stored in the VBO. When we need to render an object, we can just bind the corresponding VAO, and all the needed calls to set up the binding between vertex attributes and memory positions in the VBO are automatically configured.
-See https://learnopengl.com/#!Getting-started/Hello-Triangle for details.
-
-N.B. 1)
-Model and Mesh classes follow RAII principles (https://en.cppreference.com/w/cpp/language/raii).
-Mesh class is in charge of releasing the allocated GPU buffers, and
-it is a "move-only" class. A move-only class ensures that you always have a 1:1 relationship between the total number of resources being created and the total number of actual instantiations occurring.
-Moreover, we want to have, CPU-side, a Mesh instance, with associated GPU resources, which is responsible of their life cycle (RAII), and which could be "moved" in memory keeping the ownership of its resources
-
-N.B. 2) no texturing in this version of the class
-
-N.B. 3) based on https://github.com/JoeyDeVries/LearnOpenGL/blob/master/includes/learnopengl/mesh.h
-
-author: Davide Gadia, Michael Marchesan
-
-Real-Time Graphics Programming - a.a. 2022/2023
-Master degree in Computer Science
-Universita' degli Studi di Milano
-*/
-
-#pragma once
-
-using namespace std;
-
-// Std. Includes
-#include <vector>
-
-// data structure for vertices
-struct Vertex {
-    // vertex coordinates
-    glm::vec3 Position;
-    // Normal
-    glm::vec3 Normal;
-    // Texture coordinates
-    glm::vec2 TexCoords;
-    // Tangent
-    glm::vec3 Tangent;
-    // Bitangent
-    glm::vec3 Bitangent;
-};
-
-/////////////////// MESH class ///////////////////////
-class Mesh {
-public:
-    // data structures for vertices, and indices of vertices (for faces)
-    vector<Vertex> vertices;
-    vector<GLuint> indices;
-    // VAO
-    GLuint VAO;
-
-    // We want Mesh to be a move-only class. We delete copy constructor and copy assignment
-    // see:
-    // https://docs.microsoft.com/en-us/cpp/cpp/constructors-cpp?view=vs-2019
-    // https://en.cppreference.com/w/cpp/language/copy_constructor
-    // https://en.cppreference.com/w/cpp/language/copy_assignment
-    // https://www.geeksforgeeks.org/preventing-object-copy-in-cpp-3-different-ways/
-    // Section 4.6 of the "A Tour in C++" book
-    Mesh(const Mesh& copy) = delete; //disallow copy
-    Mesh& operator=(const Mesh &) = delete;
-
-    // Constructor
-    // We use initializer list and std::move in order to avoid a copy of the arguments
-    // This constructor empties the source vectors (vertices and indices)
-    Mesh(vector<Vertex>& vertices, vector<GLuint>& indices) noexcept
-        : vertices(std::move(vertices)), indices(std::move(indices))
-    {
-        this->setupMesh();
-    }
-
-    // We implement a user-defined move constructor and move assignment
-    // see:
-    // https://docs.microsoft.com/en-us/cpp/cpp/move-constructors-and-move-assignment-operators-cpp?view=vs-2019
-    // https://en.cppreference.com/w/cpp/language/move_constructor
-    // https://en.cppreference.com/w/cpp/language/move_assignment
-    // https://www.learncpp.com/cpp-tutorial/15-1-intro-to-smart-pointers-move-semantics/
-    // https://www.learncpp.com/cpp-tutorial/15-3-move-constructors-and-move-assignment/
-    // Section 4.6 of the "A Tour in C++" book
-
-    // Move constructor
-    // The source object of a move constructor is not expected to be valid after the move.
-    // In our case it will no longer imply ownership of the GPU resources and its vectors will be empty.
-    Mesh(Mesh&& move) noexcept
-        // Calls move for both vectors, which internally consists of a simple pointer swap between the new instance and the source one.
-        : vertices(std::move(move.vertices)), indices(std::move(move.indices)),
-        VAO(move.VAO), VBO(move.VBO), EBO(move.EBO)
-    {
-        move.VAO = 0; // We *could* set VBO and EBO to 0 too,
-        // but since we bring all the 3 values around we can use just one of them to check ownership of the 3 resources.
-    }
-
-    // Move assignment
-    Mesh& operator=(Mesh&& move) noexcept
-    {
-        // calls the function which will delete (if needed) the GPU resources for this instance
-        freeGPUresources();
-
-        if (move.VAO) // source instance has GPU resources
-        {
-            vertices = std::move(move.vertices);
-            indices = std::move(move.indices);
-            VAO = move.VAO;
-            VBO = move.VBO;
-            EBO = move.EBO;
-
-            move.VAO = 0;
-        }
-        else // source instance was already invalid
-        {
-            VAO = 0;
-        }
-        return *this;
-    }
-
-    // destructor
-    ~Mesh() noexcept
-    {
-        // calls the function which will delete (if needed) the GPU resources
-        freeGPUresources();
-    }
-
-    //////////////////////////////////////////
-
-    // rendering of mesh
-    void Draw(bool tessellation)
-    {
-        // VAO is made "active"
-        glBindVertexArray(this->VAO);
-        if (tessellation)
-            glDrawElements(GL_PATCHES, this->indices.size(), GL_UNSIGNED_INT, 0);
-        else
-        // rendering of data in the VAO
-            glDrawElements(GL_TRIANGLES, this->indices.size(), GL_UNSIGNED_INT, 0);
-        // VAO is "detached"
-        glBindVertexArray(0);
-    }
-
-private:
-
-    // VBO and EBO
-    GLuint VBO, EBO;
-
-    //////////////////////////////////////////
-    // buffer objects\arrays are initialized
-    // a brief description of their role and how they are binded can be found at:
-    // https://learnopengl.com/#!Getting-started/Hello-Triangle
-    // (in different parts of the page), or here:
-    // http://www.informit.com/articles/article.aspx?p=1377833&seqNum=8
-    void setupMesh()
-    {
-        // we create the buffers
-        glGenVertexArrays(1, &this->VAO);
-        glGenBuffers(1, &this->VBO);
-        glGenBuffers(1, &this->EBO);
-
-        // VAO is made "active"
-        glBindVertexArray(this->VAO);
-        // we copy data in the VBO - we must set the data dimension, and the pointer to the structure cointaining the data
-        glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
-        glBufferData(GL_ARRAY_BUFFER, this->vertices.size() * sizeof(Vertex), &this->vertices[0], GL_STATIC_DRAW);
-        // we copy data in the EBO - we must set the data dimension, and the pointer to the structure cointaining the data
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->indices.size() * sizeof(GLuint), &this->indices[0], GL_STATIC_DRAW);
-
-        // we set in the VAO the pointers to the different vertex attributes (with the relative offsets inside the data structure)
-        // vertex positions
-        // these will be the positions to use in the layout qualifiers in the shaders ("layout (location = ...)"")
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
-        // Normals
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Normal));
-        // Texture Coordinates
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, TexCoords));
-        // Tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Tangent));
-        // Bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Bitangent));
-
-        // Note that this is allowed, the call to glVertexAttribPointer registered VBO as the currently bound vertex buffer object so afterwards we can safely unbind
-        glBindBuffer(GL_ARRAY_BUFFER, 0); 
-        // Unbind VAO (it's always a good thing to unbind any buffer/array to prevent strange bugs), remember: do NOT unbind the EBO, keep it bound to this VAO
-        glBindVertexArray(0);    }
-
-    //////////////////////////////////////////
-
-    void freeGPUresources()
-    {
-        // If VAO is 0, this instance of Mesh has been through a move, and no longer owns GPU resources,
-        // so there's no need for deleting.
-        if (VAO)
-        {
-            glDeleteVertexArrays(1, &this->VAO);
-            glDeleteBuffers(1, &this->VBO);
-            glDeleteBuffers(1, &this->EBO);
-        }
-    }
-};
+/*
+Mesh class
+- the class allocates and initializes VBO, VAO, and EBO buffers, and it sets as OpenGL must consider the data in the buffers
+
+VBO : Vertex Buffer Object - memory allocated on GPU memory to store the mesh data (vertices and their attributes, like e.g. normals, etc)
+EBO : Element Buffer Object - a buffer maintaining the indices of vertices composing the mesh faces
+VAO : Vertex Array Object - a buffer that helps to "manage" VBO and its inner structure. It stores pointers to the different vertex attributes stored in the VBO. When we need to render an object, we can just bind the corresponding VAO, and all the needed calls to set up the binding between vertex attributes and memory positions in the VBO are automatically configured.
+See https://learnopengl.com/#!Getting-started/Hello-Triangle for details.
+
+N.B. 1)
+Model and Mesh classes follow RAII principles (https://en.cppreference.com/w/cpp/language/raii).
+Mesh class is in charge of releasing the allocated GPU buffers, and
+it is a "move-only" class. A move-only class ensures that you always have a 1:1 relationship between the total number of resources being created and the total number of actual instantiations occurring.
+Moreover, we want to have, CPU-side, a Mesh instance, with associated GPU resources, which is responsible of their life cycle (RAII), and which could be "moved" in memory keeping the ownership of its resources
+
+N.B. 2) no texturing in this version of the class
+
+N.B. 3) based on https://github.com/JoeyDeVries/LearnOpenGL/blob/master/includes/learnopengl/mesh.h
+
+N.B. 4)
+Each Mesh can upload its vertices to the GPU in two layouts (VertexFormat):
+- FULL_VERTEX_FORMAT: the Vertex struct as it is (56 bytes per vertex, all floats), and 32 bit indices
+- PACKED_VERTEX_FORMAT: the PackedVertex struct (24 bytes per vertex): UVs as half floats, normal and tangent with octahedral encoding
+  (https://jcgt.org/published/0003/02/01/), and the bitangent reconstructed in the vertex shaders as cross(normal, tangent) * handedness.
+  If the mesh has less than 65536 vertices, the indices are 16 bit.
+The CPU-side vectors (and the mesh cache) always use the Vertex struct: the conversion is performed only when the GPU buffers are filled.
+The vertex shaders decode the attributes according to the "packedVertex" uniform, which must be set before drawing the mesh.
+
+N.B. 5)
+A Mesh can have several Levels Of Detail (see mesh_simplifier.h). All the LODs share the same vertices, and their index buffers are stored one after
+the other in the "indices" vector (and in the EBO): each MeshLOD is a range of indices, and the error of the simplified surface.
+
+N.B. 6)
+A Mesh can be allocated in a GeometryArena instead of creating its own buffers: the arena has a single VBO, EBO and VAO for all the meshes
+with the same vertex format, so consecutive draw calls of different meshes do not change the VAO, and several meshes can be drawn
+with a single glMultiDrawElementsBaseVertex call (see batch_renderer.h). The indices of each mesh are not changed: the draw calls
+use baseVertex (position of the first vertex of the mesh in the VBO) and baseIndex (position of its first index in the EBO).
+The arena uses 16 bit indices for the packed format: meshes with more vertices get their own buffers.
+The space of the meshes is never released (the arena is meant for the models loaded at startup): the arena releases all its buffers when destroyed,
+so it must be destroyed after the meshes allocated in it have been used for the last time.
+
+author: Davide Gadia, Michael Marchesan
+
+Real-Time Graphics Programming - a.a. 2022/2023
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <vector>
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+// half float conversion of the texture coordinates
+#include <glm/gtc/packing.hpp>
+
+// bounding box of the mesh
+#include <utils/bounds.h>
+// the VAOs are bound through the state cache, which skips the redundant binds
+#include <utils/gl_state.h>
+
+// version of the layout of the Vertex struct
+// it must be incremented every time the struct is changed, in order to invalidate the mesh cache files (see mesh_cache.h)
+#define VERTEX_LAYOUT_VERSION 1
+
+// data structure for vertices
+struct Vertex {
+    // vertex coordinates
+    glm::vec3 Position;
+    // Normal
+    glm::vec3 Normal;
+    // Texture coordinates
+    glm::vec2 TexCoords;
+    // Tangent
+    glm::vec3 Tangent;
+    // Bitangent
+    glm::vec3 Bitangent;
+};
+
+// layout of the vertices in the GPU buffers (see N.B. 4 above)
+enum VertexFormat { FULL_VERTEX_FORMAT, PACKED_VERTEX_FORMAT };
+
+// compact version of the Vertex struct, used for PACKED_VERTEX_FORMAT
+struct PackedVertex {
+    // vertex coordinates
+    glm::vec3 Position;
+    // Texture coordinates, 2 half floats (they can be outside [0,1], so we do not use normalized integers)
+    GLuint TexCoords;
+    // Normal, octahedral encoding in 2 16 bit normalized integers
+    GLshort Normal[2];
+    // Tangent, octahedral encoding in the x and y 10 bit components, and handedness of the tangent space (+1 or -1) in the w 2 bit component (GL_INT_2_10_10_10_REV)
+    GLuint Tangent;
+};
+
+//////////////////////////////////////////
+// octahedral encoding of a direction: the unit sphere is projected on the octahedron |x|+|y|+|z| = 1, and the lower half is folded on the upper one,
+// so the direction is represented by a point in the [-1,1]x[-1,1] square
+inline glm::vec2 OctahedralEncode(glm::vec3 n)
+{
+    float length1 = fabs(n.x) + fabs(n.y) + fabs(n.z);
+    // zero vectors (e.g., tangents of models without UV coordinates) are encoded as the +Z direction
+    if (length1 == 0.0f)
+        return glm::vec2(0.0f);
+    glm::vec2 p = glm::vec2(n.x, n.y) / length1;
+    if (n.z < 0.0f)
+        p = glm::vec2((1.0f - fabs(p.y)) * (p.x >= 0.0f ? 1.0f : -1.0f), (1.0f - fabs(p.x)) * (p.y >= 0.0f ? 1.0f : -1.0f));
+    return p;
+}
+
+// conversion of a value in [-1,1] to a signed normalized integer with the given number of bits
+inline GLint PackSnorm(float value, int bits)
+{
+    float maxValue = float((1 << (bits - 1)) - 1);
+    return GLint(round(glm::clamp(value, -1.0f, 1.0f) * maxValue));
+}
+
+// conversion of a Vertex in the PackedVertex format
+inline PackedVertex PackVertex(const Vertex& vertex)
+{
+    PackedVertex packed;
+    packed.Position = vertex.Position;
+    packed.TexCoords = glm::packHalf2x16(vertex.TexCoords);
+
+    glm::vec2 normal = OctahedralEncode(vertex.Normal);
+    packed.Normal[0] = (GLshort)PackSnorm(normal.x, 16);
+    packed.Normal[1] = (GLshort)PackSnorm(normal.y, 16);
+
+    // the handedness tells if the bitangent has the same direction of cross(normal, tangent), or the opposite one
+    glm::vec2 tangent = OctahedralEncode(vertex.Tangent);
+    GLint handedness = (glm::dot(glm::cross(vertex.Normal, vertex.Tangent), vertex.Bitangent) < 0.0f) ? -1 : 1;
+    packed.Tangent = (GLuint(PackSnorm(tangent.x, 10)) & 0x3FF) |
+                     ((GLuint(PackSnorm(tangent.y, 10)) & 0x3FF) << 10) |
+                     ((GLuint(handedness) & 0x3) << 30);
+    return packed;
+}
+
+// a Level Of Detail of a Mesh: range of the indices in the EBO, and maximum distance from the original surface (in model space)
+struct MeshLOD {
+    GLuint firstIndex;
+    GLuint nIndices;
+    float error;
+};
+
+// the vertex attributes of a VertexFormat are set in the currently bound VAO, reading from the currently bound GL_ARRAY_BUFFER
+// these will be the positions to use in the layout qualifiers in the shaders ("layout (location = ...)"")
+inline void SetVertexAttributes(VertexFormat format)
+{
+    if (format == PACKED_VERTEX_FORMAT)
+    {
+        // the attributes use the same locations of the full format: the shaders read the octahedral normal in the xy components of location 1,
+        // and the octahedral tangent and the handedness in the xy and w components of location 3. Location 4 (bitangent) is not used
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(PackedVertex), (GLvoid*)0);
+        // Normals
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, Normal));
+        // Texture Coordinates
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, TexCoords));
+        // Tangent and handedness
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, Tangent));
+        return;
+    }
+
+    // we set in the VAO the pointers to the different vertex attributes (with the relative offsets inside the data structure)
+    // vertex positions
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
+    // Normals
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Normal));
+    // Texture Coordinates
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, TexCoords));
+    // Tangent
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Tangent));
+    // Bitangent
+    glEnableVertexAttribArray(4);
+    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Bitangent));
+}
+
+// size in bytes of a vertex in the GPU buffers
+inline size_t VertexSize(VertexFormat format)
+{
+    return format == PACKED_VERTEX_FORMAT ? sizeof(PackedVertex) : sizeof(Vertex);
+}
+
+// size in bytes of an index in the GPU buffers
+inline size_t IndexSize(GLenum indexType)
+{
+    return indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+}
+
+// upload of vertices and indices in the currently bound GL_ARRAY_BUFFER and GL_ELEMENT_ARRAY_BUFFER, starting from the given vertex and index,
+// converting them in the given vertex format and index type
+inline void UploadGeometry(VertexFormat format, GLenum indexType, const Vertex* vertexData, size_t nVertices, size_t firstVertex,
+                           const GLuint* indexData, size_t nIndices, size_t firstIndex)
+{
+    if (format == PACKED_VERTEX_FORMAT)
+    {
+        vector<PackedVertex> packedVertices(nVertices);
+        for (size_t i = 0; i < nVertices; i++)
+            packedVertices[i] = PackVertex(vertexData[i]);
+        glBufferSubData(GL_ARRAY_BUFFER, firstVertex * sizeof(PackedVertex), nVertices * sizeof(PackedVertex), packedVertices.data());
+    }
+    else
+        glBufferSubData(GL_ARRAY_BUFFER, firstVertex * sizeof(Vertex), nVertices * sizeof(Vertex), vertexData);
+
+    if (indexType == GL_UNSIGNED_SHORT)
+    {
+        vector<GLushort> shortIndices(indexData, indexData + nIndices);
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, firstIndex * sizeof(GLushort), nIndices * sizeof(GLushort), shortIndices.data());
+    }
+    else
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, firstIndex * sizeof(GLuint), nIndices * sizeof(GLuint), indexData);
+}
+
+/////////////////// GEOMETRYARENA class ///////////////////////
+// shared VBO and EBO for all the meshes with the same vertex format, with a single VAO (see N.B. 6 above)
+class GeometryArena {
+public:
+    // layout of the vertices, and type of the indices (16 bit for the packed format, 32 bit for the full format)
+    VertexFormat format;
+    GLenum indexType;
+    // VAO, shared by all the meshes in the arena
+    GLuint VAO;
+    // number of vertices and indices allocated to the meshes
+    size_t nVertices, nIndices;
+
+    // We want GeometryArena to be a move-only class. We delete copy constructor and copy assignment
+    GeometryArena(const GeometryArena& copy) = delete; //disallow copy
+    GeometryArena& operator=(const GeometryArena &) = delete;
+
+    // Constructor: the buffers are created with the given capacity (in number of vertices and indices), and they grow when needed
+    GeometryArena(VertexFormat format, size_t vertexCapacity = 65536, size_t indexCapacity = 262144) noexcept
+        : format(format), indexType(format == PACKED_VERTEX_FORMAT ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT), nVertices(0), nIndices(0),
+        vertexCapacity(max(vertexCapacity, size_t(1))), indexCapacity(max(indexCapacity, size_t(1)))
+    {
+        glGenVertexArrays(1, &this->VAO);
+        this->VBO = this->createBuffer(GL_ARRAY_BUFFER, this->vertexCapacity * VertexSize(format));
+        this->EBO = this->createBuffer(GL_ELEMENT_ARRAY_BUFFER, this->indexCapacity * IndexSize(this->indexType));
+        this->setupVAO();
+    }
+
+    // Move constructor
+    GeometryArena(GeometryArena&& move) noexcept
+        : format(move.format), indexType(move.indexType), VAO(move.VAO), nVertices(move.nVertices), nIndices(move.nIndices),
+        vertexCapacity(move.vertexCapacity), indexCapacity(move.indexCapacity), VBO(move.VBO), EBO(move.EBO)
+    {
+        move.VAO = 0;
+    }
+
+    // Move assignment
+    GeometryArena& operator=(GeometryArena&& move) noexcept
+    {
+        freeGPUresources();
+        format = move.format;
+        indexType = move.indexType;
+        VAO = move.VAO;
+        nVertices = move.nVertices;
+        nIndices = move.nIndices;
+        vertexCapacity = move.vertexCapacity;
+        indexCapacity = move.indexCapacity;
+        VBO = move.VBO;
+        EBO = move.EBO;
+        move.VAO = 0;
+        return *this;
+    }
+
+    // destructor
+    ~GeometryArena() noexcept
+    {
+        freeGPUresources();
+    }
+
+    //////////////////////////////////////////
+
+    // sub-allocation of a mesh: vertices and indices are added after the ones already in the buffers.
+    // The indices are not changed: the draw calls add baseVertex to them (glDrawElementsBaseVertex), and start from baseIndex.
+    // It returns false if the indices of the mesh cannot be represented with the index type of the arena
+    bool Allocate(const Vertex* vertexData, size_t nVertices, const GLuint* indexData, size_t nIndices, GLint& baseVertex, GLuint& baseIndex)
+    {
+        if (this->indexType == GL_UNSIGNED_SHORT && nVertices > 65536)
+            return false;
+
+        // the buffers grow doubling their capacity, like a vector
+        size_t newVertexCapacity = this->vertexCapacity, newIndexCapacity = this->indexCapacity;
+        while (this->nVertices + nVertices > newVertexCapacity)
+            newVertexCapacity *= 2;
+        while (this->nIndices + nIndices > newIndexCapacity)
+            newIndexCapacity *= 2;
+        if (newVertexCapacity != this->vertexCapacity || newIndexCapacity != this->indexCapacity)
+            this->grow(newVertexCapacity, newIndexCapacity);
+
+        // the index buffer must not be attached to the VAO left bound by the last draw call (see N.B. 2 in gl_state.h)
+        GLState().BindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
+        UploadGeometry(this->format, this->indexType, vertexData, nVertices, this->nVertices, indexData, nIndices, this->nIndices);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+        baseVertex = GLint(this->nVertices);
+        baseIndex = GLuint(this->nIndices);
+        this->nVertices += nVertices;
+        this->nIndices += nIndices;
+        return true;
+    }
+
+private:
+    // capacity of the buffers, in number of vertices and indices
+    size_t vertexCapacity, indexCapacity;
+    // VBO and EBO
+    GLuint VBO, EBO;
+
+    //////////////////////////////////////////
+
+    GLuint createBuffer(GLenum target, size_t size)
+    {
+        GLuint buffer;
+        GLState().BindVertexArray(0);
+        glGenBuffers(1, &buffer);
+        glBindBuffer(target, buffer);
+        glBufferData(target, size, NULL, GL_STATIC_DRAW);
+        glBindBuffer(target, 0);
+        return buffer;
+    }
+
+    // the VAO reads the vertex attributes from the VBO, and the indices from the EBO
+    void setupVAO()
+    {
+        GLState().BindVertexArray(this->VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
+        SetVertexAttributes(this->format);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        GLState().BindVertexArray(0);
+    }
+
+    // new buffers with the given capacity: the content of the old buffers is copied on the GPU, and the VAO is updated
+    void grow(size_t newVertexCapacity, size_t newIndexCapacity)
+    {
+        GLuint newVBO = this->createBuffer(GL_ARRAY_BUFFER, newVertexCapacity * VertexSize(this->format));
+        GLuint newEBO = this->createBuffer(GL_ELEMENT_ARRAY_BUFFER, newIndexCapacity * IndexSize(this->indexType));
+
+        glBindBuffer(GL_COPY_READ_BUFFER, this->VBO);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, newVBO);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, this->nVertices * VertexSize(this->format));
+        glBindBuffer(GL_COPY_READ_BUFFER, this->EBO);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, newEBO);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, this->nIndices * IndexSize(this->indexType));
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        glDeleteBuffers(1, &this->VBO);
+        glDeleteBuffers(1, &this->EBO);
+        this->VBO = newVBO;
+        this->EBO = newEBO;
+        this->vertexCapacity = newVertexCapacity;
+        this->indexCapacity = newIndexCapacity;
+        this->setupVAO();
+    }
+
+    void freeGPUresources()
+    {
+        // If VAO is 0, this instance has been through a move, and no longer owns GPU resources
+        if (VAO)
+        {
+            glDeleteVertexArrays(1, &this->VAO);
+            GLState().ForgetVertexArray(this->VAO);
+            glDeleteBuffers(1, &this->VBO);
+            glDeleteBuffers(1, &this->EBO);
+        }
+    }
+};
+
+/////////////////// MESH class ///////////////////////
+class Mesh {
+public:
+    // data structures for vertices, and indices of vertices (for faces)
+    vector<Vertex> vertices;
+    vector<GLuint> indices;
+    // Levels Of Detail (the first one is the original mesh)
+    vector<MeshLOD> lods;
+    // VAO (owned by the arena, if the mesh has been allocated in a GeometryArena)
+    GLuint VAO;
+    // layout of the vertices in the VBO, and type of the indices in the EBO
+    VertexFormat format;
+    GLenum indexType;
+    // position of the first vertex and of the first index of the mesh in the buffers (they are 0 if the mesh owns its buffers)
+    GLint baseVertex;
+    GLuint baseIndex;
+    // bounding box of the vertices, in model space
+    AABB bounds;
+
+    // We want Mesh to be a move-only class. We delete copy constructor and copy assignment
+    // see:
+    // https://docs.microsoft.com/en-us/cpp/cpp/constructors-cpp?view=vs-2019
+    // https://en.cppreference.com/w/cpp/language/copy_constructor
+    // https://en.cppreference.com/w/cpp/language/copy_assignment
+    // https://www.geeksforgeeks.org/preventing-object-copy-in-cpp-3-different-ways/
+    // Section 4.6 of the "A Tour in C++" book
+    Mesh(const Mesh& copy) = delete; //disallow copy
+    Mesh& operator=(const Mesh &) = delete;
+
+    // Constructor
+    // We use initializer list and std::move in order to avoid a copy of the arguments
+    // This constructor empties the source vectors (vertices and indices)
+    // If no LODs are provided, the mesh has a single LOD with all the indices
+    // If an arena with the same vertex format is provided, the mesh is allocated in its buffers (see N.B. 6 above)
+    Mesh(vector<Vertex>& vertices, vector<GLuint>& indices, VertexFormat format = FULL_VERTEX_FORMAT, const vector<MeshLOD>& lods = {}, GeometryArena* arena = nullptr) noexcept
+        : vertices(std::move(vertices)), indices(std::move(indices)), lods(lods), format(format)
+    {
+        this->setupMesh(this->vertices.data(), this->indices.data(), arena);
+    }
+
+    // Constructor from arrays already in the final layout (e.g., memory-mapped from the mesh cache, see mesh_cache.h)
+    // The GPU buffers are filled directly from the source memory, and the CPU-side vectors are filled with a single copy, without per-vertex conversion
+    Mesh(const Vertex* vertexData, size_t nVertices, const GLuint* indexData, size_t nIndices, VertexFormat format = FULL_VERTEX_FORMAT, const vector<MeshLOD>& lods = {}, GeometryArena* arena = nullptr) noexcept
+        : vertices(vertexData, vertexData + nVertices), indices(indexData, indexData + nIndices), lods(lods), format(format)
+    {
+        this->setupMesh(vertexData, indexData, arena);
+    }
+
+    // We implement a user-defined move constructor and move assignment
+    // see:
+    // https://docs.microsoft.com/en-us/cpp/cpp/move-constructors-and-move-assignment-operators-cpp?view=vs-2019
+    // https://en.cppreference.com/w/cpp/language/move_constructor
+    // https://en.cppreference.com/w/cpp/language/move_assignment
+    // https://www.learncpp.com/cpp-tutorial/15-1-intro-to-smart-pointers-move-semantics/
+    // https://www.learncpp.com/cpp-tutorial/15-3-move-constructors-and-move-assignment/
+    // Section 4.6 of the "A Tour in C++" book
+
+    // Move constructor
+    // The source object of a move constructor is not expected to be valid after the move.
+    // In our case it will no longer imply ownership of the GPU resources and its vectors will be empty.
+    Mesh(Mesh&& move) noexcept
+        // Calls move for both vectors, which internally consists of a simple pointer swap between the new instance and the source one.
+        : vertices(std::move(move.vertices)), indices(std::move(move.indices)), lods(std::move(move.lods)),
+        VAO(move.VAO), format(move.format), indexType(move.indexType), baseVertex(move.baseVertex), baseIndex(move.baseIndex), bounds(move.bounds),
+        VBO(move.VBO), EBO(move.EBO)
+    {
+        move.VAO = 0; // We *could* set VBO and EBO to 0 too,
+        // but since we bring all the 3 values around we can use just one of them to check ownership of the 3 resources.
+    }
+
+    // Move assignment
+    Mesh& operator=(Mesh&& move) noexcept
+    {
+        // calls the function which will delete (if needed) the GPU resources for this instance
+        freeGPUresources();
+
+        if (move.VAO) // source instance has GPU resources
+        {
+            vertices = std::move(move.vertices);
+            indices = std::move(move.indices);
+            lods = std::move(move.lods);
+            VAO = move.VAO;
+            format = move.format;
+            indexType = move.indexType;
+            baseVertex = move.baseVertex;
+            baseIndex = move.baseIndex;
+            bounds = move.bounds;
+            VBO = move.VBO;
+            EBO = move.EBO;
+
+            move.VAO = 0;
+        }
+        else // source instance was already invalid
+        {
+            VAO = 0;
+        }
+        return *this;
+    }
+
+    // destructor
+    ~Mesh() noexcept
+    {
+        // calls the function which will delete (if needed) the GPU resources
+        freeGPUresources();
+    }
+
+    //////////////////////////////////////////
+
+    // rendering of mesh, using the requested LOD (or the coarsest available one)
+    // the model and normal matrices are read by the shaders from the instance attributes, which must be set in the VAO (see batch_renderer.h)
+    void Draw(bool tessellation, size_t lod = 0, GLsizei instanceCount = 1)
+    {
+        // VAO is made "active" (if it is not already the active one: it is not "detached" after the draw call, see N.B. 2 in gl_state.h)
+        GLState().BindVertexArray(this->VAO);
+        // rendering of data in the VAO
+        this->DrawElements(tessellation ? GL_PATCHES : GL_TRIANGLES, lod, instanceCount);
+    }
+
+    // draw call of a LOD of the mesh, with the VAO already bound
+    void DrawElements(GLenum mode, size_t lod, GLsizei instanceCount) const
+    {
+        const MeshLOD& level = this->LOD(lod);
+        glDrawElementsInstancedBaseVertex(mode, level.nIndices, this->indexType, this->IndexOffset(level), instanceCount, this->baseVertex);
+    }
+
+    // requested LOD, or the coarsest available one
+    const MeshLOD& LOD(size_t lod) const
+    {
+        return this->lods[min(lod, this->lods.size() - 1)];
+    }
+
+    // offset in bytes of the first index of a LOD in the EBO
+    GLvoid* IndexOffset(const MeshLOD& level) const
+    {
+        return (GLvoid*)(size_t(this->baseIndex + level.firstIndex) * IndexSize(this->indexType));
+    }
+
+private:
+
+    // VBO and EBO (they are 0 if the mesh has been allocated in a GeometryArena)
+    GLuint VBO, EBO;
+
+    //////////////////////////////////////////
+    // buffer objects\arrays are initialized
+    // a brief description of their role and how they are binded can be found at:
+    // https://learnopengl.com/#!Getting-started/Hello-Triangle
+    // (in different parts of the page), or here:
+    // http://www.informit.com/articles/article.aspx?p=1377833&seqNum=8
+    // The data are copied from the provided pointers, which must contain vertices.size() vertices and indices.size() indices
+    void setupMesh(const Vertex* vertexData, const GLuint* indexData, GeometryArena* arena)
+    {
+        if (this->lods.empty())
+            this->lods.push_back({ 0, GLuint(this->indices.size()), 0.0f });
+
+        for (const Vertex& vertex : this->vertices)
+            this->bounds.Expand(vertex.Position);
+
+        // if possible, the mesh is allocated in the shared buffers of the arena
+        if (arena && arena->format == this->format &&
+            arena->Allocate(vertexData, this->vertices.size(), indexData, this->indices.size(), this->baseVertex, this->baseIndex))
+        {
+            this->VAO = arena->VAO;
+            this->indexType = arena->indexType;
+            this->VBO = this->EBO = 0;
+            return;
+        }
+
+        // otherwise, the mesh has its own buffers: 32 bit indices for the full format, and 16 bit indices for the packed format if possible
+        this->baseVertex = 0;
+        this->baseIndex = 0;
+        this->indexType = (this->format == PACKED_VERTEX_FORMAT && this->vertices.size() < 65536) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+
+        // we create the buffers
+        glGenVertexArrays(1, &this->VAO);
+        glGenBuffers(1, &this->VBO);
+        glGenBuffers(1, &this->EBO);
+
+        // VAO is made "active"
+        GLState().BindVertexArray(this->VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
+
+        // we allocate the buffers, and we copy the data (converted in the vertex format and index type of the mesh)
+        glBufferData(GL_ARRAY_BUFFER, this->vertices.size() * VertexSize(this->format), NULL, GL_STATIC_DRAW);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->indices.size() * IndexSize(this->indexType), NULL, GL_STATIC_DRAW);
+        UploadGeometry(this->format, this->indexType, vertexData, this->vertices.size(), 0, indexData, this->indices.size(), 0);
+
+        // we set in the VAO the pointers to the different vertex attributes
+        SetVertexAttributes(this->format);
+
+        // Note that this is allowed, the call to glVertexAttribPointer registered VBO as the currently bound vertex buffer object so afterwards we can safely unbind
+        glBindBuffer(GL_ARRAY_BUFFER, 0); 
+        // Unbind VAO (it's always a good thing to unbind any buffer/array to prevent strange bugs), remember: do NOT unbind the EBO, keep it bound to this VAO
+        GLState().BindVertexArray(0);
+    }
+
+    //////////////////////////////////////////
+
+    void freeGPUresources()
+    {
+        // If VAO is 0, this instance of Mesh has been through a move, and no longer owns GPU resources,
+        // so there's no need for deleting.
+        // If VBO is 0, the buffers and the VAO are owned by the arena
+        if (VAO && VBO)
+        {
+            glDeleteVertexArrays(1, &this->VAO);
+            GLState().ForgetVertexArray(this->VAO);
+            glDeleteBuffers(1, &this->VBO);
+            glDeleteBuffers(1, &this->EBO);
+        }
+    }
+};
@@ -0,0 +1,243 @@
+/*
+Mesh cache
+- binary cache of the meshes of a model, saved next to the source file (e.g. "sphere.obj" -> "sphere.obj.meshcache")
+- the cache stores, for each Mesh, the final arrays of Vertex and indices, so at the next launch the model is loaded without Assimp and without any per-vertex conversion
+- the file is memory-mapped (where available), and the GPU buffers are filled directly from the mapped memory
+
+File layout:
+MeshCacheHeader | MeshCacheEntry 0 | MeshLOD array 0 | Vertex array 0 | index array 0 | MeshCacheEntry 1 | ...
+
+The cache is valid only if the header matches:
+- the hash of the source file content (the cache is rebuilt if the model changes)
+- the Assimp post-processing flags used to load the model
+- the use of the mesh optimizer (see mesh_optimizer.h) and the number of requested LODs (see mesh_simplifier.h)
+- the layout of the Vertex struct (VERTEX_LAYOUT_VERSION and sizeof(Vertex), see mesh.h)
+Otherwise the model is loaded with Assimp and the cache file is overwritten.
+
+Real-Time Graphics Programming - a.a. 2022/2023
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <cstdint>
+#include <cstring>
+
+// on POSIX systems the cache is memory-mapped, otherwise it is read in a buffer
+#if defined(__unix__) || defined(__APPLE__)
+    #define MESH_CACHE_MMAP
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+#include <utils/mesh.h>
+
+// identifier at the beginning of the cache files
+// the last character is the version of the file layout: it must be changed every time MeshCacheHeader or MeshCacheEntry are changed
+#define MESH_CACHE_MAGIC "RTGPMSH3"
+
+struct MeshCacheHeader {
+    char magic[8];
+    uint32_t vertexLayoutVersion;
+    uint32_t vertexSize;
+    uint64_t sourceHash;
+    uint32_t postProcessFlags;
+    uint32_t optimized;
+    uint32_t nLODs;
+    uint32_t nMeshes;
+};
+
+struct MeshCacheEntry {
+    uint64_t nVertices;
+    uint64_t nIndices;
+    uint64_t nLODs;
+};
+
+//////////////////////////////////////////
+// FNV-1a 64 bit hash of the content of a file (0 if the file cannot be read)
+inline uint64_t HashFile(const string& path)
+{
+    ifstream file(path, ios::binary);
+    if (!file)
+        return 0;
+    uint64_t hash = 14695981039346656037ULL;
+    vector<char> buffer(1 << 16);
+    while (file)
+    {
+        file.read(buffer.data(), buffer.size());
+        streamsize count = file.gcount();
+        for (streamsize i = 0; i < count; i++)
+        {
+            hash ^= (unsigned char)buffer[i];
+            hash *= 1099511628211ULL;
+        }
+    }
+    return hash;
+}
+
+/////////////////// MAPPEDFILE class ///////////////////////
+// read-only view of the content of a file. It is a move-only class, which releases the mapping (or the buffer) in the destructor
+class MappedFile {
+public:
+    MappedFile(const MappedFile& copy) = delete; //disallow copy
+    MappedFile& operator=(const MappedFile &) = delete;
+
+    MappedFile(const string& path) noexcept
+    {
+#ifdef MESH_CACHE_MMAP
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return;
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0)
+        {
+            void* mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping != MAP_FAILED)
+            {
+                this->mapped = (const char*)mapping;
+                this->length = info.st_size;
+            }
+        }
+        // the mapping remains valid after closing the file descriptor
+        close(fd);
+#else
+        ifstream file(path, ios::binary | ios::ate);
+        if (!file)
+            return;
+        this->buffer.resize((size_t)file.tellg());
+        file.seekg(0);
+        file.read(this->buffer.data(), this->buffer.size());
+        this->length = this->buffer.size();
+#endif
+    }
+
+    MappedFile(MappedFile&& move) noexcept
+        : mapped(move.mapped), length(move.length), buffer(std::move(move.buffer))
+    {
+        move.mapped = nullptr;
+        move.length = 0;
+    }
+
+    ~MappedFile() noexcept
+    {
+#ifdef MESH_CACHE_MMAP
+        if (this->mapped)
+            munmap((void*)this->mapped, this->length);
+#endif
+    }
+
+    // pointer to the content of the file (nullptr if the file cannot be read)
+    const char* data() const { return this->mapped ? this->mapped : (this->buffer.empty() ? nullptr : this->buffer.data()); }
+    size_t size() const { return this->length; }
+
+private:
+    const char* mapped = nullptr;
+    size_t length = 0;
+    // used only if memory mapping is not available
+    vector<char> buffer;
+};
+
+//////////////////////////////////////////
+// we save the meshes of a model in the cache file. If the file cannot be written, the application continues without cache
+inline void WriteMeshCache(const string& cachePath, uint64_t sourceHash, uint32_t postProcessFlags, bool optimized, uint32_t nLODs, const vector<Mesh>& meshes)
+{
+    ofstream file(cachePath, ios::binary | ios::trunc);
+    if (!file)
+    {
+        cout << "WARNING::MESH_CACHE:: cannot write " << cachePath << endl;
+        return;
+    }
+
+    MeshCacheHeader header;
+    memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+    header.vertexLayoutVersion = VERTEX_LAYOUT_VERSION;
+    header.vertexSize = sizeof(Vertex);
+    header.sourceHash = sourceHash;
+    header.postProcessFlags = postProcessFlags;
+    header.optimized = optimized ? 1 : 0;
+    header.nLODs = nLODs;
+    header.nMeshes = (uint32_t)meshes.size();
+    file.write((const char*)&header, sizeof(header));
+
+    for (const Mesh& mesh : meshes)
+    {
+        MeshCacheEntry entry;
+        entry.nVertices = mesh.vertices.size();
+        entry.nIndices = mesh.indices.size();
+        entry.nLODs = mesh.lods.size();
+        file.write((const char*)&entry, sizeof(entry));
+        file.write((const char*)mesh.lods.data(), entry.nLODs * sizeof(MeshLOD));
+        file.write((const char*)mesh.vertices.data(), entry.nVertices * sizeof(Vertex));
+        file.write((const char*)mesh.indices.data(), entry.nIndices * sizeof(GLuint));
+    }
+}
+
+// pointers to the arrays of a mesh inside the cache file
+struct MeshCacheView {
+    const Vertex* vertices;
+    size_t nVertices;
+    const GLuint* indices;
+    size_t nIndices;
+    const MeshLOD* lods;
+    size_t nLODs;
+};
+
+//////////////////////////////////////////
+// we check that the cache file is valid for the current source file, flags, optimization, number of LODs and Vertex layout.
+// If it is valid, for each mesh we add to "entries" the pointers to its LODs, vertices and indices inside the file
+inline bool ReadMeshCache(const MappedFile& cache, uint64_t sourceHash, uint32_t postProcessFlags, bool optimized, uint32_t nLODs, vector<MeshCacheView>& entries)
+{
+    const char* data = cache.data();
+    size_t size = cache.size();
+    if (!data || size < sizeof(MeshCacheHeader))
+        return false;
+
+    MeshCacheHeader header;
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.vertexLayoutVersion != VERTEX_LAYOUT_VERSION ||
+        header.vertexSize != sizeof(Vertex) ||
+        header.sourceHash != sourceHash ||
+        header.postProcessFlags != postProcessFlags ||
+        header.optimized != (optimized ? 1u : 0u) ||
+        header.nLODs != nLODs)
+        return false;
+
+    size_t offset = sizeof(header);
+    for (uint32_t i = 0; i < header.nMeshes; i++)
+    {
+        if (offset + sizeof(MeshCacheEntry) > size)
+            return false;
+        MeshCacheEntry entry;
+        memcpy(&entry, data + offset, sizeof(entry));
+        offset += sizeof(entry);
+
+        size_t lodsSize = entry.nLODs * sizeof(MeshLOD);
+        size_t verticesSize = entry.nVertices * sizeof(Vertex);
+        size_t indicesSize = entry.nIndices * sizeof(GLuint);
+        if (offset + lodsSize + verticesSize + indicesSize > size)
+            return false;
+
+        // all the sizes in the file are multiple of 4 bytes, so the arrays are correctly aligned for float and GLuint
+        MeshCacheView view;
+        view.lods = (const MeshLOD*)(data + offset);
+        view.nLODs = entry.nLODs;
+        view.vertices = (const Vertex*)(data + offset + lodsSize);
+        view.nVertices = entry.nVertices;
+        view.indices = (const GLuint*)(data + offset + lodsSize + verticesSize);
+        view.nIndices = entry.nIndices;
+        entries.push_back(view);
+        offset += lodsSize + verticesSize + indicesSize;
+    }
+    return true;
+}
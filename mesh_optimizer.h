@@ -0,0 +1,337 @@
+/*
+Mesh optimizer
+- optimization of the order of triangles and vertices of a mesh, performed after the loading with Assimp and before the creation of the GPU buffers:
+  1) triangles are reordered to increase the hit rate of the post-transform vertex cache (Tipsify algorithm)
+  2) clusters of triangles are reordered to reduce overdraw, using a view-independent heuristic (triangles facing outward are drawn first)
+  3) vertices are reordered in the order of their first use in the index buffer, to improve the locality of the vertex fetch
+- the quality of the vertex cache usage is measured with ACMR and ATVR, simulating a FIFO cache
+
+Post-transform vertex cache: the GPU keeps the results of the vertex shader for the most recently processed vertices, so a vertex shared by
+several triangles is processed once if the triangles are close in the index buffer.
+ACMR : Average Cache Miss Ratio - number of vertex shader invocations per triangle (3 in the worst case, ~0.5 in the best case for regular meshes)
+ATVR : Average Transformed Vertex Ratio - number of vertex shader invocations per vertex (1 is the optimum)
+
+Overdraw: fragments shaded and then overwritten by nearer fragments. With the PARALLAX shader each overdrawn fragment costs a ray marching in the height map.
+
+References:
+- P. V. Sander, D. Nehab, J. Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw", ACM SIGGRAPH 2007
+- https://github.com/zeux/meshoptimizer (clustering of the overdraw optimization)
+
+Real-Time Graphics Programming - a.a. 2022/2023
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <vector>
+#include <algorithm>
+#include <numeric>
+
+#include <glm/glm.hpp>
+
+#include <utils/mesh.h>
+
+// size of the simulated FIFO vertex cache
+#define VERTEX_CACHE_SIZE 16
+// a cluster of triangles is split if its ACMR can be kept below this factor of the ACMR of the original cluster (see GenerateOverdrawClusters)
+#define OVERDRAW_CLUSTER_THRESHOLD 1.05f
+
+// statistics of the vertex cache usage of an index buffer
+struct VertexCacheStatistics {
+    float ACMR;
+    float ATVR;
+};
+
+/////////////////// FIFO vertex cache simulation ///////////////////////
+// each vertex stores the "time" of its insertion in the cache: it is in the cache if less than cacheSize insertions have happened after it
+class VertexCacheSimulation {
+public:
+    VertexCacheSimulation(size_t nVertices, GLuint cacheSize = VERTEX_CACHE_SIZE)
+        : timestamps(nVertices, 0), time(cacheSize + 1), cacheSize(cacheSize)
+    {}
+
+    // processing of a vertex: it returns true if it is a cache miss
+    bool Access(GLuint vertex)
+    {
+        if (this->time - this->timestamps[vertex] > this->cacheSize)
+        {
+            this->timestamps[vertex] = this->time++;
+            return true;
+        }
+        return false;
+    }
+
+    // all the vertices are removed from the cache
+    void Reset()
+    {
+        this->time += this->cacheSize + 1;
+    }
+
+private:
+    vector<GLuint> timestamps;
+    GLuint time;
+    GLuint cacheSize;
+};
+
+//////////////////////////////////////////
+// ACMR and ATVR of an index buffer of triangles
+inline VertexCacheStatistics AnalyzeVertexCache(const vector<GLuint>& indices, size_t nVertices, GLuint cacheSize = VERTEX_CACHE_SIZE)
+{
+    VertexCacheSimulation cache(nVertices, cacheSize);
+    vector<bool> used(nVertices, false);
+    size_t misses = 0, nUsed = 0;
+    for (GLuint index : indices)
+    {
+        if (cache.Access(index))
+            misses++;
+        if (!used[index])
+        {
+            used[index] = true;
+            nUsed++;
+        }
+    }
+    VertexCacheStatistics statistics;
+    statistics.ACMR = indices.empty() ? 0.0f : float(misses) / float(indices.size() / 3);
+    statistics.ATVR = nUsed == 0 ? 0.0f : float(misses) / float(nUsed);
+    return statistics;
+}
+
+//////////////////////////////////////////
+// Tipsify: the triangles are emitted "fanning" around a vertex, and the next fanning vertex is chosen among the vertices of the last emitted triangles
+// which will still be in the cache after the emission of all their remaining triangles. If there are no such vertices (dead end), we restart from
+// the most recently used vertex with remaining triangles, or from the next vertex in the input order.
+inline vector<GLuint> OptimizeVertexCache(const vector<GLuint>& indices, size_t nVertices, GLuint cacheSize = VERTEX_CACHE_SIZE)
+{
+    size_t nTriangles = indices.size() / 3;
+
+    // adjacency: for each vertex, the list of the triangles using it (in a single array, with offsets)
+    vector<GLuint> liveTriangles(nVertices, 0);
+    for (GLuint index : indices)
+        liveTriangles[index]++;
+    vector<GLuint> adjacencyOffsets(nVertices + 1, 0);
+    for (size_t v = 0; v < nVertices; v++)
+        adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+    vector<GLuint> adjacency(indices.size());
+    vector<GLuint> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); i++)
+        adjacency[fill[indices[i]]++] = GLuint(i / 3);
+
+    vector<GLuint> timestamps(nVertices, 0);
+    GLuint time = cacheSize + 1;
+    vector<bool> emitted(nTriangles, false);
+    vector<GLuint> deadEndStack;
+    vector<GLuint> candidates;
+    vector<GLuint> result;
+    result.reserve(indices.size());
+
+    // cursor for the search of a new fanning vertex in the input order
+    size_t cursor = 0;
+    GLint fanning = nVertices > 0 ? 0 : -1;
+    while (fanning >= 0)
+    {
+        candidates.clear();
+        // we emit all the remaining triangles of the fanning vertex
+        for (GLuint a = adjacencyOffsets[fanning]; a < adjacencyOffsets[fanning + 1]; a++)
+        {
+            GLuint triangle = adjacency[a];
+            if (emitted[triangle])
+                continue;
+            for (int k = 0; k < 3; k++)
+            {
+                GLuint v = indices[triangle * 3 + k];
+                result.push_back(v);
+                deadEndStack.push_back(v);
+                candidates.push_back(v);
+                liveTriangles[v]--;
+                if (time - timestamps[v] > cacheSize)
+                    timestamps[v] = time++;
+            }
+            emitted[triangle] = true;
+        }
+
+        // the next fanning vertex is the candidate which entered the cache earliest among the ones which will still be in the cache
+        // after the emission of their remaining triangles (each triangle adds at most 2 new vertices)
+        fanning = -1;
+        GLint bestPriority = -1;
+        for (GLuint v : candidates)
+        {
+            if (liveTriangles[v] == 0)
+                continue;
+            GLint priority = 0;
+            if (time - timestamps[v] + 2 * liveTriangles[v] <= cacheSize)
+                priority = time - timestamps[v];
+            if (priority > bestPriority)
+            {
+                bestPriority = priority;
+                fanning = v;
+            }
+        }
+
+        // dead end: most recently used vertices first, then the input order
+        if (fanning < 0)
+        {
+            while (!deadEndStack.empty() && fanning < 0)
+            {
+                GLuint v = deadEndStack.back();
+                deadEndStack.pop_back();
+                if (liveTriangles[v] > 0)
+                    fanning = v;
+            }
+            while (fanning < 0 && cursor < nVertices)
+            {
+                if (liveTriangles[cursor] > 0)
+                    fanning = GLint(cursor);
+                cursor++;
+            }
+        }
+    }
+    return result;
+}
+
+//////////////////////////////////////////
+// we split the index buffer (already optimized for the vertex cache) in clusters of triangles which can be moved without degrading the cache hit rate.
+// A cluster starts when the cache simulation has a miss on all the 3 vertices of a triangle (a "hard" boundary, e.g. a dead end of Tipsify).
+// Each cluster is then split again when its running ACMR falls below OVERDRAW_CLUSTER_THRESHOLD times its ACMR ("soft" boundaries).
+// The function returns the index of the first triangle of each cluster
+inline vector<size_t> GenerateOverdrawClusters(const vector<GLuint>& indices, size_t nVertices, GLuint cacheSize)
+{
+    size_t nTriangles = indices.size() / 3;
+    vector<size_t> hardClusters;
+    VertexCacheSimulation cache(nVertices, cacheSize);
+    for (size_t t = 0; t < nTriangles; t++)
+    {
+        int misses = 0;
+        for (int k = 0; k < 3; k++)
+            misses += cache.Access(indices[t * 3 + k]) ? 1 : 0;
+        if (t == 0 || misses == 3)
+            hardClusters.push_back(t);
+    }
+    hardClusters.push_back(nTriangles);
+
+    vector<size_t> clusters;
+    for (size_t c = 0; c + 1 < hardClusters.size(); c++)
+    {
+        size_t start = hardClusters[c], end = hardClusters[c + 1];
+
+        // ACMR of the whole cluster
+        cache.Reset();
+        size_t clusterMisses = 0;
+        for (size_t i = start * 3; i < end * 3; i++)
+            clusterMisses += cache.Access(indices[i]) ? 1 : 0;
+        float threshold = OVERDRAW_CLUSTER_THRESHOLD * float(clusterMisses) / float(end - start);
+
+        cache.Reset();
+        clusters.push_back(start);
+        size_t subStart = start, misses = 0;
+        for (size_t t = start; t < end; t++)
+        {
+            for (int k = 0; k < 3; k++)
+                misses += cache.Access(indices[t * 3 + k]) ? 1 : 0;
+            if (t + 1 < end && float(misses) / float(t + 1 - subStart) <= threshold)
+            {
+                clusters.push_back(t + 1);
+                subStart = t + 1;
+                misses = 0;
+                cache.Reset();
+            }
+        }
+    }
+    return clusters;
+}
+
+//////////////////////////////////////////
+// the clusters are sorted so that the ones facing outward (with respect to the center of the mesh) are drawn first: they are more likely to occlude
+// the other clusters from any point of view
+inline vector<GLuint> OptimizeOverdraw(const vector<GLuint>& indices, const vector<Vertex>& vertices, GLuint cacheSize = VERTEX_CACHE_SIZE)
+{
+    size_t nTriangles = indices.size() / 3;
+    if (nTriangles == 0)
+        return indices;
+    vector<size_t> clusters = GenerateOverdrawClusters(indices, vertices.size(), cacheSize);
+    clusters.push_back(nTriangles);
+
+    // area-weighted centroid of the mesh
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    for (size_t t = 0; t < nTriangles; t++)
+    {
+        const glm::vec3& p0 = vertices[indices[t * 3]].Position;
+        const glm::vec3& p1 = vertices[indices[t * 3 + 1]].Position;
+        const glm::vec3& p2 = vertices[indices[t * 3 + 2]].Position;
+        float area = glm::length(glm::cross(p1 - p0, p2 - p0));
+        meshCentroid += (p0 + p1 + p2) * (area / 3.0f);
+        meshArea += area;
+    }
+    if (meshArea > 0.0f)
+        meshCentroid /= meshArea;
+
+    // for each cluster: area-weighted centroid and normal, and the sort key
+    size_t nClusters = clusters.size() - 1;
+    vector<float> sortKeys(nClusters);
+    for (size_t c = 0; c < nClusters; c++)
+    {
+        glm::vec3 centroid(0.0f), normal(0.0f);
+        float area = 0.0f;
+        for (size_t t = clusters[c]; t < clusters[c + 1]; t++)
+        {
+            const glm::vec3& p0 = vertices[indices[t * 3]].Position;
+            const glm::vec3& p1 = vertices[indices[t * 3 + 1]].Position;
+            const glm::vec3& p2 = vertices[indices[t * 3 + 2]].Position;
+            glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+            float triangleArea = glm::length(n);
+            centroid += (p0 + p1 + p2) * (triangleArea / 3.0f);
+            normal += n;
+            area += triangleArea;
+        }
+        if (area > 0.0f)
+            centroid /= area;
+        float normalLength = glm::length(normal);
+        sortKeys[c] = normalLength > 0.0f ? glm::dot(centroid - meshCentroid, normal / normalLength) : 0.0f;
+    }
+
+    vector<size_t> order(nClusters);
+    iota(order.begin(), order.end(), 0);
+    stable_sort(order.begin(), order.end(), [&sortKeys](size_t a, size_t b) { return sortKeys[a] > sortKeys[b]; });
+
+    vector<GLuint> result;
+    result.reserve(indices.size());
+    for (size_t c : order)
+        result.insert(result.end(), indices.begin() + clusters[c] * 3, indices.begin() + clusters[c + 1] * 3);
+    return result;
+}
+
+//////////////////////////////////////////
+// vertices are reordered in the order of their first reference in the index buffer, and the indices are remapped.
+// Vertices not referenced by any triangle are removed
+inline void OptimizeVertexFetch(vector<Vertex>& vertices, vector<GLuint>& indices)
+{
+    const GLuint unused = ~0u;
+    vector<GLuint> remap(vertices.size(), unused);
+    vector<Vertex> result;
+    result.reserve(vertices.size());
+    for (GLuint& index : indices)
+    {
+        if (remap[index] == unused)
+        {
+            remap[index] = GLuint(result.size());
+            result.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    vertices = std::move(result);
+}
+
+//////////////////////////////////////////
+// complete optimization of a mesh (vertex cache, overdraw, vertex fetch). It returns the statistics of the vertex cache before and after the optimization
+inline void OptimizeMesh(vector<Vertex>& vertices, vector<GLuint>& indices, VertexCacheStatistics& before, VertexCacheStatistics& after)
+{
+    before = AnalyzeVertexCache(indices, vertices.size());
+    indices = OptimizeVertexCache(indices, vertices.size());
+    indices = OptimizeOverdraw(indices, vertices);
+    OptimizeVertexFetch(vertices, indices);
+    after = AnalyzeVertexCache(indices, vertices.size());
+}
@@ -0,0 +1,444 @@
+/*
+Mesh simplifier
+- generation of simplified versions (Levels Of Detail) of a mesh with quadric error metrics and edge collapses
+- each collapse moves a vertex onto one of its neighbours ("half-edge collapse"): the simplified index buffers reference the same vertices of the
+  original mesh, so all the LODs of a Mesh share the same VBO, and the attributes of the remaining vertices (UVs, tangent frames) are not interpolated
+- UV seams and tangent frames are preserved:
+  - a vertex whose position is shared by other vertices with different attributes (a UV or normal seam) is never removed
+  - a vertex on an open border can be moved only along the border, onto another border vertex
+  - a collapse is rejected if the two vertices have tangent spaces with different handedness, or too different normals, or if it flips a triangle
+- the error of each LOD is the maximum distance (in model space) of the original vertices from the simplified surface: each removed vertex is
+  compared with the triangles near the vertex which replaced it. The quadrics are used only to choose the order of the collapses
+
+Quadric error metric: for each vertex we sum the quadrics of the planes of its triangles (weighted by area). The quadric evaluated in a point gives
+the (weighted) sum of the squared distances of the point from the planes, so it estimates the error introduced by moving the vertex there.
+Border edges add planes perpendicular to the triangle, with a large weight, to preserve the outline of open meshes.
+
+References:
+- M. Garland, P. Heckbert, "Surface Simplification Using Quadric Error Metrics", SIGGRAPH 1997
+- https://github.com/zeux/meshoptimizer (classification of the vertices and iterative collapses)
+
+Real-Time Graphics Programming - a.a. 2022/2023
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <cfloat>
+
+#include <glm/glm.hpp>
+
+#include <utils/mesh.h>
+
+// weight of the quadrics of the border edges, relative to the ones of the triangles
+#define BORDER_QUADRIC_WEIGHT 10.0
+// minimum cosine of the angle between the normals of two vertices which can be collapsed
+#define COLLAPSE_MIN_NORMAL_DOT 0.5f
+// minimum cosine of the angle between the normal of a triangle before and after a collapse
+#define COLLAPSE_MIN_TRIANGLE_DOT 0.25f
+
+//////////////////////////////////////////
+// distance of a point from a triangle (closest point computation from C. Ericson, "Real-Time Collision Detection", 5.1.5)
+inline float PointTriangleDistance(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+{
+    glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+    float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f)
+        return glm::length(p - a);
+    glm::vec3 bp = p - b;
+    float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3)
+        return glm::length(p - b);
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+        return glm::length(p - (a + ab * (d1 / (d1 - d3))));
+    glm::vec3 cp = p - c;
+    float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6)
+        return glm::length(p - c);
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+        return glm::length(p - (a + ac * (d2 / (d2 - d6))));
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+        return glm::length(p - (b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)))));
+    float denominator = 1.0f / (va + vb + vc);
+    return glm::length(p - (a + ab * (vb * denominator) + ac * (vc * denominator)));
+}
+
+/////////////////// QUADRIC ///////////////////////
+// symmetric 4x4 matrix of the quadric (10 coefficients), and sum of the weights, used to normalize the error
+struct Quadric {
+    double a2 = 0, ab = 0, ac = 0, ad = 0;
+    double b2 = 0, bc = 0, bd = 0;
+    double c2 = 0, cd = 0;
+    double d2 = 0;
+    double weight = 0;
+
+    // quadric of the plane ax + by + cz + d = 0 (with (a,b,c) unit normal)
+    static Quadric FromPlane(double a, double b, double c, double d, double weight)
+    {
+        Quadric q;
+        q.a2 = weight * a * a; q.ab = weight * a * b; q.ac = weight * a * c; q.ad = weight * a * d;
+        q.b2 = weight * b * b; q.bc = weight * b * c; q.bd = weight * b * d;
+        q.c2 = weight * c * c; q.cd = weight * c * d;
+        q.d2 = weight * d * d;
+        q.weight = weight;
+        return q;
+    }
+
+    void Add(const Quadric& q)
+    {
+        a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad;
+        b2 += q.b2; bc += q.bc; bd += q.bd;
+        c2 += q.c2; cd += q.cd;
+        d2 += q.d2;
+        weight += q.weight;
+    }
+
+    // weighted mean of the squared distances of the point from the planes
+    double Error(const glm::vec3& p) const
+    {
+        double x = p.x, y = p.y, z = p.z;
+        double e = a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x
+                 + b2 * y * y + 2 * bc * y * z + 2 * bd * y
+                 + c2 * z * z + 2 * cd * z
+                 + d2;
+        return weight > 0 ? fabs(e) / weight : 0.0;
+    }
+};
+
+/////////////////// MESHSIMPLIFIER class ///////////////////////
+// the simplification is incremental: each call to Simplify continues from the result of the previous one, so a LOD chain is built with
+// successive calls with decreasing targets, and the error of each LOD includes the error of the previous ones
+class MeshSimplifier {
+public:
+    MeshSimplifier(const vector<Vertex>& vertices, const vector<GLuint>& indices)
+        : vertices(vertices), indices(indices), quadrics(vertices.size()), collapsed(vertices.size()), error(0.0f)
+    {
+        for (size_t i = 0; i < collapsed.size(); i++)
+            collapsed[i] = GLuint(i);
+        this->classifyVertices();
+        this->computeQuadrics();
+    }
+
+    // edge collapses are performed until the index buffer has at most targetIndexCount indices, or no more collapses are possible.
+    // The function returns the simplified index buffer
+    const vector<GLuint>& Simplify(size_t targetIndexCount)
+    {
+        while (this->indices.size() > targetIndexCount)
+        {
+            size_t previousCount = this->indices.size();
+            this->collapsePass(targetIndexCount);
+            if (this->indices.size() == previousCount)
+                break;
+        }
+        this->measureError();
+        return this->indices;
+    }
+
+    // maximum distance of the original vertices from the simplified surface (in model space)
+    float Error() const
+    {
+        return this->error;
+    }
+
+private:
+    // classification of the vertices: vertices with SEAM or LOCKED kind are never removed
+    enum VertexKind { MANIFOLD, BORDER, SEAM, LOCKED };
+
+    struct Collapse {
+        GLuint from, to;
+        double error;
+    };
+
+    const vector<Vertex>& vertices;
+    vector<GLuint> indices;
+    vector<Quadric> quadrics;
+    // index of the vertex with the same position of each vertex (the first one in the buffer)
+    vector<GLuint> positionRemap;
+    vector<VertexKind> kinds;
+    // for each vertex, the vertex it has been collapsed on (itself if it has not been removed)
+    vector<GLuint> collapsed;
+    // error of the last simplification
+    float error;
+
+    // key of an edge between two positions, independent of the direction of the edge
+    static uint64_t edgeKey(GLuint a, GLuint b)
+    {
+        return a < b ? (uint64_t(a) << 32) | b : (uint64_t(b) << 32) | a;
+    }
+
+    //////////////////////////////////////////
+    // number of triangles sharing each edge, counted on positions (so the two sides of a seam are the same edge)
+    unordered_map<uint64_t, GLuint> countEdges() const
+    {
+        unordered_map<uint64_t, GLuint> edges;
+        edges.reserve(this->indices.size());
+        for (size_t t = 0; t < this->indices.size(); t += 3)
+            for (int k = 0; k < 3; k++)
+                edges[edgeKey(this->positionRemap[this->indices[t + k]], this->positionRemap[this->indices[t + (k + 1) % 3]])]++;
+        return edges;
+    }
+
+    //////////////////////////////////////////
+    void classifyVertices()
+    {
+        // vertices with the same position
+        struct PositionHash {
+            size_t operator()(const glm::vec3& p) const
+            {
+                uint32_t h[3];
+                memcpy(h, &p, sizeof(h));
+                return size_t(h[0] * 73856093u ^ h[1] * 19349663u ^ h[2] * 83492791u);
+            }
+        };
+        struct PositionEqual {
+            bool operator()(const glm::vec3& a, const glm::vec3& b) const { return a.x == b.x && a.y == b.y && a.z == b.z; }
+        };
+        unordered_map<glm::vec3, GLuint, PositionHash, PositionEqual> firstVertex;
+        this->positionRemap.resize(this->vertices.size());
+        vector<GLuint> nWedges(this->vertices.size(), 0);
+        for (size_t i = 0; i < this->vertices.size(); i++)
+        {
+            auto it = firstVertex.emplace(this->vertices[i].Position, GLuint(i)).first;
+            this->positionRemap[i] = it->second;
+            nWedges[it->second]++;
+        }
+
+        this->kinds.assign(this->vertices.size(), MANIFOLD);
+        for (size_t i = 0; i < this->vertices.size(); i++)
+            if (nWedges[this->positionRemap[i]] > 1)
+                this->kinds[i] = SEAM;
+
+        // vertices on edges used by a single triangle are on the border, vertices on edges used by more than 2 triangles are locked
+        unordered_map<uint64_t, GLuint> edges = this->countEdges();
+        for (size_t t = 0; t < this->indices.size(); t += 3)
+            for (int k = 0; k < 3; k++)
+            {
+                GLuint a = this->indices[t + k], b = this->indices[t + (k + 1) % 3];
+                GLuint count = edges[edgeKey(this->positionRemap[a], this->positionRemap[b])];
+                for (GLuint v : { a, b })
+                {
+                    if (count > 2)
+                        this->kinds[v] = LOCKED;
+                    else if (count == 1 && this->kinds[v] == MANIFOLD)
+                        this->kinds[v] = BORDER;
+                }
+            }
+    }
+
+    //////////////////////////////////////////
+    void computeQuadrics()
+    {
+        unordered_map<uint64_t, GLuint> edges = this->countEdges();
+        for (size_t t = 0; t < this->indices.size(); t += 3)
+        {
+            GLuint v[3] = { this->indices[t], this->indices[t + 1], this->indices[t + 2] };
+            glm::vec3 p0 = this->vertices[v[0]].Position, p1 = this->vertices[v[1]].Position, p2 = this->vertices[v[2]].Position;
+            glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+            float area = glm::length(n);
+            if (area == 0.0f)
+                continue;
+            n /= area;
+            Quadric plane = Quadric::FromPlane(n.x, n.y, n.z, -glm::dot(n, p0), area);
+            for (int k = 0; k < 3; k++)
+                this->quadrics[v[k]].Add(plane);
+
+            // border edges: plane containing the edge and perpendicular to the triangle
+            for (int k = 0; k < 3; k++)
+            {
+                GLuint a = v[k], b = v[(k + 1) % 3];
+                if (edges[edgeKey(this->positionRemap[a], this->positionRemap[b])] != 1)
+                    continue;
+                glm::vec3 edge = this->vertices[b].Position - this->vertices[a].Position;
+                float length = glm::length(edge);
+                if (length == 0.0f)
+                    continue;
+                glm::vec3 m = glm::normalize(glm::cross(edge, n));
+                Quadric border = Quadric::FromPlane(m.x, m.y, m.z, -glm::dot(m, this->vertices[a].Position), BORDER_QUADRIC_WEIGHT * length * length);
+                this->quadrics[a].Add(border);
+                this->quadrics[b].Add(border);
+            }
+        }
+    }
+
+    //////////////////////////////////////////
+    // checks on the attributes and on the topology of the collapse of "from" onto "to"
+    bool canCollapse(GLuint from, GLuint to, const unordered_map<uint64_t, GLuint>& edges) const
+    {
+        VertexKind kind = this->kinds[from];
+        if (kind == SEAM || kind == LOCKED)
+            return false;
+        if (kind == BORDER)
+        {
+            // a border vertex can move only along a border edge
+            auto it = edges.find(edgeKey(this->positionRemap[from], this->positionRemap[to]));
+            if (this->kinds[to] != BORDER || it == edges.end() || it->second != 1)
+                return false;
+        }
+
+        const Vertex& a = this->vertices[from];
+        const Vertex& b = this->vertices[to];
+        if (glm::dot(a.Normal, b.Normal) < COLLAPSE_MIN_NORMAL_DOT)
+            return false;
+        bool handednessA = glm::dot(glm::cross(a.Normal, a.Tangent), a.Bitangent) < 0.0f;
+        bool handednessB = glm::dot(glm::cross(b.Normal, b.Tangent), b.Bitangent) < 0.0f;
+        return handednessA == handednessB;
+    }
+
+    //////////////////////////////////////////
+    // the collapse must not flip the triangles around "from" which are not removed
+    bool flipsTriangles(GLuint from, GLuint to, const vector<GLuint>& adjacencyOffsets, const vector<GLuint>& adjacency) const
+    {
+        const glm::vec3& target = this->vertices[to].Position;
+        for (GLuint a = adjacencyOffsets[from]; a < adjacencyOffsets[from + 1]; a++)
+        {
+            const GLuint* triangle = &this->indices[adjacency[a] * 3];
+            if (triangle[0] == to || triangle[1] == to || triangle[2] == to)
+                continue;
+            glm::vec3 p[3], q[3];
+            for (int k = 0; k < 3; k++)
+            {
+                p[k] = this->vertices[triangle[k]].Position;
+                q[k] = (triangle[k] == from) ? target : p[k];
+            }
+            glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+            glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+            if (glm::dot(before, after) <= COLLAPSE_MIN_TRIANGLE_DOT * glm::length(before) * glm::length(after))
+                return true;
+        }
+        return false;
+    }
+
+    //////////////////////////////////////////
+    // each removed vertex is compared with the triangles near the vertex which replaces it in the simplified mesh
+    void measureError()
+    {
+        size_t nVertices = this->vertices.size();
+        vector<GLuint> adjacencyOffsets, adjacency;
+        this->buildAdjacency(adjacencyOffsets, adjacency);
+
+        float maxDistance = 0.0f;
+        for (size_t v = 0; v < nVertices; v++)
+        {
+            // final vertex of the chain of collapses
+            GLuint representative = GLuint(v);
+            while (this->collapsed[representative] != representative)
+                representative = this->collapsed[representative];
+            if (representative == v || adjacencyOffsets[representative] == adjacencyOffsets[representative + 1])
+                continue;
+
+            // triangles around the representative and around its neighbours (the removed vertex can be far from the representative on flat regions)
+            float distance = FLT_MAX;
+            for (GLuint a = adjacencyOffsets[representative]; a < adjacencyOffsets[representative + 1]; a++)
+                for (int k = 0; k < 3; k++)
+                {
+                    GLuint neighbour = this->indices[adjacency[a] * 3 + k];
+                    for (GLuint b = adjacencyOffsets[neighbour]; b < adjacencyOffsets[neighbour + 1]; b++)
+                    {
+                        const GLuint* triangle = &this->indices[adjacency[b] * 3];
+                        distance = min(distance, PointTriangleDistance(this->vertices[v].Position, this->vertices[triangle[0]].Position,
+                                                                       this->vertices[triangle[1]].Position, this->vertices[triangle[2]].Position));
+                    }
+                }
+            maxDistance = max(maxDistance, distance);
+        }
+        // the error cannot decrease from one LOD to the next one
+        this->error = max(this->error, maxDistance);
+    }
+
+    //////////////////////////////////////////
+    // for each vertex, the list of the triangles using it (in a single array, with offsets)
+    void buildAdjacency(vector<GLuint>& adjacencyOffsets, vector<GLuint>& adjacency) const
+    {
+        size_t nVertices = this->vertices.size();
+        adjacencyOffsets.assign(nVertices + 1, 0);
+        for (GLuint index : this->indices)
+            adjacencyOffsets[index + 1]++;
+        for (size_t v = 0; v < nVertices; v++)
+            adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+        adjacency.resize(this->indices.size());
+        vector<GLuint> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (size_t i = 0; i < this->indices.size(); i++)
+            adjacency[fill[this->indices[i]]++] = GLuint(i / 3);
+    }
+
+    //////////////////////////////////////////
+    // a pass collapses the cheapest edges, with at most one collapse in the neighbourhood of each vertex,
+    // then the index buffer is updated and the degenerate triangles are removed
+    void collapsePass(size_t targetIndexCount)
+    {
+        size_t nVertices = this->vertices.size();
+        vector<GLuint> adjacencyOffsets, adjacency;
+        this->buildAdjacency(adjacencyOffsets, adjacency);
+
+        unordered_map<uint64_t, GLuint> edges = this->countEdges();
+
+        // candidate collapses (in both directions for each edge), sorted by error
+        vector<Collapse> candidates;
+        candidates.reserve(this->indices.size() * 2);
+        for (size_t t = 0; t < this->indices.size(); t += 3)
+            for (int k = 0; k < 3; k++)
+            {
+                GLuint a = this->indices[t + k], b = this->indices[t + (k + 1) % 3];
+                for (int direction = 0; direction < 2; direction++)
+                {
+                    GLuint from = direction ? b : a, to = direction ? a : b;
+                    if (!this->canCollapse(from, to, edges))
+                        continue;
+                    Quadric q = this->quadrics[from];
+                    q.Add(this->quadrics[to]);
+                    candidates.push_back({ from, to, q.Error(this->vertices[to].Position) });
+                }
+            }
+        sort(candidates.begin(), candidates.end(), [](const Collapse& a, const Collapse& b) { return a.error < b.error; });
+
+        // we estimate the removed triangles (2 for each interior edge, 1 for each border edge), and we stop when the target is reached
+        vector<bool> locked(nVertices, false);
+        size_t nTriangles = this->indices.size() / 3;
+        size_t targetTriangles = targetIndexCount / 3;
+        for (const Collapse& collapse : candidates)
+        {
+            if (nTriangles <= targetTriangles)
+                break;
+            if (locked[collapse.from] || locked[collapse.to])
+                continue;
+            if (this->flipsTriangles(collapse.from, collapse.to, adjacencyOffsets, adjacency))
+                continue;
+
+            this->collapsed[collapse.from] = collapse.to;
+            this->quadrics[collapse.to].Add(this->quadrics[collapse.from]);
+            nTriangles -= (this->kinds[collapse.from] == BORDER) ? 1 : 2;
+
+            // the vertices of the triangles around the removed vertex cannot be changed again in this pass
+            for (GLuint a = adjacencyOffsets[collapse.from]; a < adjacencyOffsets[collapse.from + 1]; a++)
+                for (int k = 0; k < 3; k++)
+                    locked[this->indices[adjacency[a] * 3 + k]] = true;
+        }
+
+        // we update the index buffer, removing the triangles with two equal vertices
+        vector<GLuint> result;
+        result.reserve(this->indices.size());
+        for (size_t t = 0; t < this->indices.size(); t += 3)
+        {
+            GLuint a = this->collapsed[this->indices[t]], b = this->collapsed[this->indices[t + 1]], c = this->collapsed[this->indices[t + 2]];
+            if (a == b || b == c || a == c)
+                continue;
+            result.push_back(a);
+            result.push_back(b);
+            result.push_back(c);
+        }
+        this->indices = std::move(result);
+    }
+};
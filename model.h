@@ -1,217 +1,402 @@
-/*
-Model class
-- OBJ models loading using Assimp library
-- the class converts data from Assimp data structure to a OpenGL-compatible data structure (Mesh class in mesh.h)
-
-N.B. 1)
-Model and Mesh classes follow RAII principles (https://en.cppreference.com/w/cpp/language/raii).
-Model is a "move-only" class. A move-only class ensures that you always have a 1:1 relationship between the total number of resources being created and the total number of actual instantiations occurring.
-
-N.B. 2) no texturing in this version of the class
-
-N.B. 3) based on https://github.com/JoeyDeVries/LearnOpenGL/blob/master/includes/learnopengl/model.h
-
-authors: Davide Gadia, Michael Marchesan
-
-Real-Time Graphics Programming - a.a. 2022/2023
-Master degree in Computer Science
-Universita' degli Studi di Milano
-*/
-
-
-
-#pragma once
-using namespace std;
-
-// we use GLM data structures to convert data in the Assimp data structures in a data structures suited for VBO, VAO and EBO buffers
-#include <glm/glm.hpp>
-
-// Assimp includes
-#include <assimp/Importer.hpp>
-#include <assimp/scene.h>
-#include <assimp/postprocess.h>
-
-// we include the Mesh class, which manages the "OpenGL side" (= creation and allocation of VBO, VAO, EBO buffers) of the loading of models
-#include <utils/mesh.h>
-
-/////////////////// MODEL class ///////////////////////
-class Model
-{
-public:
-    // at the end of loading, we will have a vector of Mesh class instances
-    vector<Mesh> meshes;
-
-    //////////////////////////////////////////
-
-    // We want Model to be a move-only class. We delete copy constructor and copy assignment
-    // see:
-    // https://docs.microsoft.com/en-us/cpp/cpp/constructors-cpp?view=vs-2019
-    // https://en.cppreference.com/w/cpp/language/copy_constructor
-    // https://en.cppreference.com/w/cpp/language/copy_assignment
-    // https://www.geeksforgeeks.org/preventing-object-copy-in-cpp-3-different-ways/
-    // Section 4.6 of the "A Tour in C++" book
-    Model(const Model& copy) = delete; //disallow copy
-    Model& operator=(const Model&) = delete;
-
-    // For the Model class, a default move constructor and move assignment is sufficient
-    // see:
-    // https://docs.microsoft.com/en-us/cpp/cpp/move-constructors-and-move-assignment-operators-cpp?view=vs-2019
-    // https://en.cppreference.com/w/cpp/language/move_constructor
-    // https://en.cppreference.com/w/cpp/language/move_assignment
-    // https://www.learncpp.com/cpp-tutorial/15-1-intro-to-smart-pointers-move-semantics/
-    // https://www.learncpp.com/cpp-tutorial/15-3-move-constructors-and-move-assignment/
-    // Section 4.6 of the "A Tour in C++" book
-    Model(Model&& move) = default; //internally does a memberwise std::move
-    Model& operator=(Model&&) noexcept = default;
-
-    // constructor
-    // to notice that Model class is not strictly following the Rules of 5
-    // https://en.cppreference.com/w/cpp/language/rule_of_three
-    // because we are not writing a user-defined destructor.
-    Model(const string& path)
-    {
-        this->loadModel(path);
-    }
-
-    //////////////////////////////////////////
-
-    // model rendering: calls rendering methods of each instance of Mesh class in the vector
-    void Draw(bool tesselation)
-    {
-        for(GLuint i = 0; i < this->meshes.size(); i++)
-            this->meshes[i].Draw(tesselation);
-    }
-
-    int numFaces(){
-        int nVert = 0;
-        for (int i = 0; i < this->meshes.size(); i++)
-        {
-           nVert+=meshes[i].vertices.size();
-        }
-        return int(2 * (sqrt(nVert) - 1) * (sqrt(nVert) - 1));
-        
-    }
-
-    //////////////////////////////////////////
-
-
-private:
-
-    //////////////////////////////////////////
-    // loading of the model using Assimp library. Nodes are processed to build a vector of Mesh class instances
-    void loadModel(string path)
-    {
-        // loading using Assimp
-        // N.B.: it is possible to set, if needed, some operations to be performed by Assimp after the loading.
-        // Details on the different flags to use are available at: http://assimp.sourceforge.net/lib_html/postprocess_8h.html#a64795260b95f5a4b3f3dc1be4f52e410
-        // VERY IMPORTANT: calculation of Tangents and Bitangents is possible only if the model has Texture Coordinates
-        // If they are not present, the calculation is skipped (but no error is provided in the following checks!)
-        Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_FlipUVs | aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace);
-
-        // check for errors (see comment above)
-        if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
-        {
-            cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
-            return;
-        }
-
-        // we start the recursive processing of nodes in the Assimp data structure
-        this->processNode(scene->mRootNode, scene);
-    }
-
-    //////////////////////////////////////////
-
-    // Recursive processing of nodes of Assimp data structure
-    void processNode(aiNode* node, const aiScene* scene)
-    {
-        // we process each mesh inside the current node
-        for(GLuint i = 0; i < node->mNumMeshes; i++)
-        {
-            // the "node" object contains only the indices to objects in the scene
-            // "Scene" contains all the data. Class node is used only to point to one or more mesh inside the scene and to maintain informations on relations between nodes
-            aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            // we start processing of the Assimp mesh using processMesh method.
-            // the result (an istance of the Mesh class) is added to the vector
-            // we use emplace_back instead as push_back, so to have the instance created directly in the
-            // vector memory, without the creation of a temp copy.
-            // https://en.cppreference.com/w/cpp/container/vector/emplace_back
-            this->meshes.emplace_back(processMesh(mesh));
-        }
-        // we then recursively process each of the children nodes
-        for(GLuint i = 0; i < node->mNumChildren; i++)
-        {
-            this->processNode(node->mChildren[i], scene);
-        }
-
-    }
-
-    //////////////////////////////////////////
-
-    // Processing of the Assimp mesh in order to obtain an "OpenGL mesh"
-    // = we create and allocate the buffers used to send mesh data to the GPU
-    Mesh processMesh(aiMesh* mesh)
-    {
-        // data structures for vertices and indices of vertices (for faces)
-        vector<Vertex> vertices;
-        vector<GLuint> indices;
-
-        for(GLuint i = 0; i < mesh->mNumVertices; i++)
-        {
-            Vertex vertex;
-            // the vector data type used by Assimp is different than the GLM vector needed to allocate the OpenGL buffers
-            // I need to convert the data structures (from Assimp to GLM, which are fully compatible to the OpenGL)
-            glm::vec3 vector;
-            // vertices coordinates
-            vector.x = mesh->mVertices[i].x;
-            vector.y = mesh->mVertices[i].y;
-            vector.z = mesh->mVertices[i].z;
-            vertex.Position = vector;
-            // Normals
-            vector.x = mesh->mNormals[i].x;
-            vector.y = mesh->mNormals[i].y;
-            vector.z = mesh->mNormals[i].z;
-            vertex.Normal = vector;
-            // Texture Coordinates
-            // if the model has texture coordinates, than we assign them to a GLM data structure, otherwise we set them at 0
-            // if texture coordinates are present, than Assimp can calculate tangents and bitangents, otherwise we set them at 0 too
-            if(mesh->mTextureCoords[0])
-            {
-                glm::vec2 vec;
-                // in this example we assume the model has only one set of texture coordinates. Actually, a vertex can have up to 8 different texture coordinates. For other models and formats, this code needs to be adapted and modified.
-                vec.x = mesh->mTextureCoords[0][i].x;
-                vec.y = mesh->mTextureCoords[0][i].y;
-                vertex.TexCoords = vec;
-
-                // Tangents
-                vector.x = mesh->mTangents[i].x;
-                vector.y = mesh->mTangents[i].y;
-                vector.z = mesh->mTangents[i].z;
-                vertex.Tangent = vector;
-                // Bitangents
-                vector.x = mesh->mBitangents[i].x;
-                vector.y = mesh->mBitangents[i].y;
-                vector.z = mesh->mBitangents[i].z;
-                vertex.Bitangent = vector;
-            }
-            else{
-                vertex.TexCoords = glm::vec2(0.0f, 0.0f);
-                cout << "WARNING::ASSIMP:: MODEL WITHOUT UV COORDINATES -> TANGENT AND BITANGENT ARE = 0" << endl;
-            }
-            // we add the vertex to the list
-            vertices.emplace_back(vertex);
-        }
-
-        // for each face of the mesh, we retrieve the indices of its vertices , and we store them in a vector data structure
-        for(GLuint i = 0; i < mesh->mNumFaces; i++)
-        {
-            aiFace* face = &mesh->mFaces[i];
-             for(GLuint j = 0; j < face->mNumIndices; j++)
-                 indices.emplace_back(face->mIndices[j]);
-
-        }
-
-        // we return an instance of the Mesh class created using the vertices and faces data structures we have created above.
-        return Mesh(vertices, indices);
-    }
-};
+/*
+Model class
+- OBJ models loading using Assimp library
+- the class converts data from Assimp data structure to a OpenGL-compatible data structure (Mesh class in mesh.h)
+
+N.B. 1)
+Model and Mesh classes follow RAII principles (https://en.cppreference.com/w/cpp/language/raii).
+Model is a "move-only" class. A move-only class ensures that you always have a 1:1 relationship between the total number of resources being created and the total number of actual instantiations occurring.
+
+N.B. 2) no texturing in this version of the class
+
+N.B. 3) based on https://github.com/JoeyDeVries/LearnOpenGL/blob/master/includes/learnopengl/model.h
+
+N.B. 4) if requested, the triangles and the vertices of each mesh are reordered by the mesh optimizer (see mesh_optimizer.h) before the creation of the Mesh.
+The statistics of the vertex cache before and after the optimization are printed on console. The optimized meshes are saved in the mesh cache.
+
+N.B. 5) if more than one LOD is requested, each mesh is simplified at load time (see mesh_simplifier.h), halving the number of triangles at each level.
+The LOD of each instance of the model is chosen with SelectLOD, from the error of the LODs projected on the screen: we use the coarsest LOD whose error
+is below a threshold in pixels. The current LOD of each instance is kept until the error crosses the threshold with a margin (hysteresis),
+to avoid continuous switches (popping) when the distance is close to the threshold.
+
+N.B. 6) if a GeometryArena is provided, the meshes are allocated in its shared buffers (see mesh.h), and the vertex format is the one of the arena.
+The instances of the model are rendered by the BatchRenderer class (see batch_renderer.h).
+
+authors: Davide Gadia, Michael Marchesan
+
+Real-Time Graphics Programming - a.a. 2022/2023
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+
+
+#pragma once
+using namespace std;
+
+// we use GLM data structures to convert data in the Assimp data structures in a data structures suited for VBO, VAO and EBO buffers
+#include <glm/glm.hpp>
+
+// Std. Includes
+#include <cfloat>
+
+// Assimp includes
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+// we include the Mesh class, which manages the "OpenGL side" (= creation and allocation of VBO, VAO, EBO buffers) of the loading of models
+#include <utils/mesh.h>
+// binary cache of the meshes, used to skip Assimp when the model has already been loaded in a previous launch
+#include <utils/mesh_cache.h>
+// reordering of triangles and vertices for vertex cache, overdraw and vertex fetch
+#include <utils/mesh_optimizer.h>
+// generation of the Levels Of Detail
+#include <utils/mesh_simplifier.h>
+
+// a coarser LOD is selected only if its projected error is below this fraction of the threshold
+#define LOD_HYSTERESIS 0.75f
+
+// parameters of the LOD selection, computed once per frame
+struct LODContext {
+    // camera position in world space
+    glm::vec3 cameraPosition;
+    // a length L at distance d from the camera is projected on L / d * projectionScale pixels (= viewport height * projection[1][1] / 2)
+    float projectionScale;
+    // maximum error on screen, in pixels
+    float maxPixelError;
+};
+
+/////////////////// MODEL class ///////////////////////
+class Model
+{
+public:
+    // at the end of loading, we will have a vector of Mesh class instances
+    vector<Mesh> meshes;
+    // layout of the vertices in the GPU buffers of the meshes (see mesh.h)
+    VertexFormat format;
+    // true if the meshes are processed by the mesh optimizer
+    bool optimize;
+    // number of requested LODs for each mesh (1 = no simplification)
+    GLuint nLODs;
+    // for each LOD of the model, maximum error of the LODs of the meshes
+    vector<float> lodErrors;
+    // number of triangles of each LOD of the model (sum on all the meshes)
+    vector<GLuint> lodTriangles;
+    // bounding box and bounding sphere of the model (in model space)
+    AABB bounds;
+    glm::vec3 boundsCenter;
+    float boundsRadius;
+    // arena where the meshes are allocated (nullptr if each mesh has its own buffers)
+    GeometryArena* arena;
+    // name of the file of the model, without the directories (e.g., for the scopes of the profiler, see profiler.h)
+    string name;
+
+    //////////////////////////////////////////
+
+    // We want Model to be a move-only class. We delete copy constructor and copy assignment
+    // see:
+    // https://docs.microsoft.com/en-us/cpp/cpp/constructors-cpp?view=vs-2019
+    // https://en.cppreference.com/w/cpp/language/copy_constructor
+    // https://en.cppreference.com/w/cpp/language/copy_assignment
+    // https://www.geeksforgeeks.org/preventing-object-copy-in-cpp-3-different-ways/
+    // Section 4.6 of the "A Tour in C++" book
+    Model(const Model& copy) = delete; //disallow copy
+    Model& operator=(const Model&) = delete;
+
+    // For the Model class, a default move constructor and move assignment is sufficient
+    // see:
+    // https://docs.microsoft.com/en-us/cpp/cpp/move-constructors-and-move-assignment-operators-cpp?view=vs-2019
+    // https://en.cppreference.com/w/cpp/language/move_constructor
+    // https://en.cppreference.com/w/cpp/language/move_assignment
+    // https://www.learncpp.com/cpp-tutorial/15-1-intro-to-smart-pointers-move-semantics/
+    // https://www.learncpp.com/cpp-tutorial/15-3-move-constructors-and-move-assignment/
+    // Section 4.6 of the "A Tour in C++" book
+    Model(Model&& move) = default; //internally does a memberwise std::move
+    Model& operator=(Model&&) noexcept = default;
+
+    // constructor
+    // to notice that Model class is not strictly following the Rules of 5
+    // https://en.cppreference.com/w/cpp/language/rule_of_three
+    // because we are not writing a user-defined destructor.
+    Model(const string& path, VertexFormat format = FULL_VERTEX_FORMAT, bool optimize = false, GLuint nLODs = 1, GeometryArena* arena = nullptr)
+        : format(arena ? arena->format : format), optimize(optimize), nLODs(max(nLODs, 1u)), arena(arena), name(path.substr(path.find_last_of("/\\") + 1))
+    {
+        this->loadModel(path);
+        this->computeBoundsAndLODs();
+    }
+
+    //////////////////////////////////////////
+
+    // model rendering: calls rendering methods of each instance of Mesh class in the vector, with the requested LOD and number of instances
+    // (the instance attributes must be set in the VAOs of the meshes: usually the models are rendered with the BatchRenderer class, see batch_renderer.h)
+    void Draw(bool tesselation, size_t lod = 0, GLsizei instanceCount = 1)
+    {
+        for(GLuint i = 0; i < this->meshes.size(); i++)
+            this->meshes[i].Draw(tesselation, lod, instanceCount);
+    }
+
+    // selection of the LOD of an instance of the model, given its model matrix and its LOD in the previous frame (see N.B. 5)
+    GLint SelectLOD(const glm::mat4& modelMatrix, const LODContext& context, GLint currentLOD) const
+    {
+        if (this->lodErrors.size() < 2)
+            return 0;
+        float pixelsPerUnit = this->pixelsPerUnit(modelMatrix, context);
+
+        // coarsest LOD below the threshold, and below the threshold with the hysteresis margin
+        GLint lod = 0, coarserLOD = 0;
+        for (size_t l = 1; l < this->lodErrors.size(); l++)
+        {
+            float pixelError = this->lodErrors[l] * pixelsPerUnit;
+            if (pixelError <= context.maxPixelError)
+                lod = GLint(l);
+            if (pixelError <= context.maxPixelError * LOD_HYSTERESIS)
+                coarserLOD = GLint(l);
+        }
+        currentLOD = min(currentLOD, GLint(this->lodErrors.size()) - 1);
+        // we switch to a coarser LOD only with the margin, and to a finer LOD as soon as the current one exceeds the threshold
+        if (coarserLOD > currentLOD)
+            return coarserLOD;
+        if (lod < currentLOD)
+            return lod;
+        return currentLOD;
+    }
+
+    // diameter in pixels of the bounding sphere of an instance projected on the screen, at the distance of its nearest point
+    // (used to estimate the resolution needed for the textures of the instance, see TextureLoader in texture_loader.h)
+    float ProjectedDiameter(const glm::mat4& modelMatrix, const LODContext& context) const
+    {
+        return 2.0f * this->boundsRadius * this->pixelsPerUnit(modelMatrix, context);
+    }
+
+    // number of triangles of a LOD of the model (computed at load time)
+    int numFaces(size_t lod = 0) const
+    {
+        if (this->lodTriangles.empty())
+            return 0;
+        return int(this->lodTriangles[min(lod, this->lodTriangles.size() - 1)]);
+    }
+
+    //////////////////////////////////////////
+
+
+private:
+
+    //////////////////////////////////////////
+    // pixels on the screen for a unit of length in model space, at the distance of the nearest point of the bounding sphere of the instance
+    float pixelsPerUnit(const glm::mat4& modelMatrix, const LODContext& context) const
+    {
+        // the scale of the model matrix scales the lengths too (we consider the maximum scale on the 3 axes)
+        float scale = max(glm::length(glm::vec3(modelMatrix[0])), max(glm::length(glm::vec3(modelMatrix[1])), glm::length(glm::vec3(modelMatrix[2]))));
+        glm::vec3 center = glm::vec3(modelMatrix * glm::vec4(this->boundsCenter, 1.0f));
+        // distance of the nearest point of the bounding sphere (at least a small value, when the camera is inside the sphere)
+        float distance = max(glm::length(center - context.cameraPosition) - this->boundsRadius * scale, 0.1f);
+        return scale * context.projectionScale / distance;
+    }
+
+    //////////////////////////////////////////
+    // loading of the model using Assimp library. Nodes are processed to build a vector of Mesh class instances
+    void loadModel(string path)
+    {
+        // post-processing performed by Assimp after the loading (they are part of the key of the mesh cache)
+        const uint32_t postProcessFlags = aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_FlipUVs | aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace;
+
+        // if a valid cache file is available, we create the meshes directly from it (see mesh_cache.h)
+        uint64_t sourceHash = HashFile(path);
+        string cachePath = path + ".meshcache";
+        if (this->loadCache(cachePath, sourceHash, postProcessFlags))
+            return;
+
+        // loading using Assimp
+        // N.B.: it is possible to set, if needed, some operations to be performed by Assimp after the loading.
+        // Details on the different flags to use are available at: http://assimp.sourceforge.net/lib_html/postprocess_8h.html#a64795260b95f5a4b3f3dc1be4f52e410
+        // VERY IMPORTANT: calculation of Tangents and Bitangents is possible only if the model has Texture Coordinates
+        // If they are not present, the calculation is skipped (but no error is provided in the following checks!)
+        Assimp::Importer importer;
+        const aiScene* scene = importer.ReadFile(path, postProcessFlags);
+
+        // check for errors (see comment above)
+        if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+        {
+            cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+            return;
+        }
+
+        // we start the recursive processing of nodes in the Assimp data structure
+        this->processNode(scene->mRootNode, scene);
+
+        // we save the result for the next launches
+        WriteMeshCache(cachePath, sourceHash, postProcessFlags, this->optimize, this->nLODs, this->meshes);
+    }
+
+    //////////////////////////////////////////
+
+    // bounding box and bounding sphere of the model (from the bounding boxes of the meshes), and error and number of triangles of each LOD of the model
+    void computeBoundsAndLODs()
+    {
+        size_t maxLODs = 0;
+        for (const Mesh& mesh : this->meshes)
+        {
+            this->bounds.Expand(mesh.bounds);
+            maxLODs = max(maxLODs, mesh.lods.size());
+        }
+        this->boundsCenter = this->bounds.IsEmpty() ? glm::vec3(0.0f) : this->bounds.Center();
+        this->boundsRadius = 0.0f;
+        for (const Mesh& mesh : this->meshes)
+            for (const Vertex& vertex : mesh.vertices)
+                this->boundsRadius = max(this->boundsRadius, glm::length(vertex.Position - this->boundsCenter));
+
+        // meshes with less LODs use their coarsest LOD also for the following levels
+        this->lodErrors.assign(maxLODs, 0.0f);
+        for (const Mesh& mesh : this->meshes)
+            for (size_t l = 0; l < maxLODs; l++)
+                this->lodErrors[l] = max(this->lodErrors[l], mesh.lods[min(l, mesh.lods.size() - 1)].error);
+        this->lodTriangles.assign(max(maxLODs, size_t(1)), 0);
+        for (const Mesh& mesh : this->meshes)
+            for (size_t l = 0; l < this->lodTriangles.size(); l++)
+                this->lodTriangles[l] += mesh.LOD(l).nIndices / 3;
+    }
+
+    //////////////////////////////////////////
+
+    // loading of the meshes from the cache file. It returns false if the cache is missing or not valid for the source file
+    bool loadCache(const string& cachePath, uint64_t sourceHash, uint32_t postProcessFlags)
+    {
+        // the source file could not be read: we let Assimp report the error
+        if (sourceHash == 0)
+            return false;
+
+        MappedFile cache(cachePath);
+        vector<MeshCacheView> entries;
+        if (!ReadMeshCache(cache, sourceHash, postProcessFlags, this->optimize, this->nLODs, entries))
+            return false;
+
+        for (const MeshCacheView& entry : entries)
+            this->meshes.emplace_back(entry.vertices, entry.nVertices, entry.indices, entry.nIndices, this->format, vector<MeshLOD>(entry.lods, entry.lods + entry.nLODs), this->arena);
+        return true;
+    }
+
+    //////////////////////////////////////////
+
+    // Recursive processing of nodes of Assimp data structure
+    void processNode(aiNode* node, const aiScene* scene)
+    {
+        // we process each mesh inside the current node
+        for(GLuint i = 0; i < node->mNumMeshes; i++)
+        {
+            // the "node" object contains only the indices to objects in the scene
+            // "Scene" contains all the data. Class node is used only to point to one or more mesh inside the scene and to maintain informations on relations between nodes
+            aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
+            // we start processing of the Assimp mesh using processMesh method.
+            // the result (an istance of the Mesh class) is added to the vector
+            // we use emplace_back instead as push_back, so to have the instance created directly in the
+            // vector memory, without the creation of a temp copy.
+            // https://en.cppreference.com/w/cpp/container/vector/emplace_back
+            this->meshes.emplace_back(processMesh(mesh));
+        }
+        // we then recursively process each of the children nodes
+        for(GLuint i = 0; i < node->mNumChildren; i++)
+        {
+            this->processNode(node->mChildren[i], scene);
+        }
+
+    }
+
+    //////////////////////////////////////////
+
+    // Processing of the Assimp mesh in order to obtain an "OpenGL mesh"
+    // = we create and allocate the buffers used to send mesh data to the GPU
+    Mesh processMesh(aiMesh* mesh)
+    {
+        // data structures for vertices and indices of vertices (for faces)
+        vector<Vertex> vertices;
+        vector<GLuint> indices;
+
+        for(GLuint i = 0; i < mesh->mNumVertices; i++)
+        {
+            Vertex vertex;
+            // the vector data type used by Assimp is different than the GLM vector needed to allocate the OpenGL buffers
+            // I need to convert the data structures (from Assimp to GLM, which are fully compatible to the OpenGL)
+            glm::vec3 vector;
+            // vertices coordinates
+            vector.x = mesh->mVertices[i].x;
+            vector.y = mesh->mVertices[i].y;
+            vector.z = mesh->mVertices[i].z;
+            vertex.Position = vector;
+            // Normals
+            vector.x = mesh->mNormals[i].x;
+            vector.y = mesh->mNormals[i].y;
+            vector.z = mesh->mNormals[i].z;
+            vertex.Normal = vector;
+            // Texture Coordinates
+            // if the model has texture coordinates, than we assign them to a GLM data structure, otherwise we set them at 0
+            // if texture coordinates are present, than Assimp can calculate tangents and bitangents, otherwise we set them at 0 too
+            if(mesh->mTextureCoords[0])
+            {
+                glm::vec2 vec;
+                // in this example we assume the model has only one set of texture coordinates. Actually, a vertex can have up to 8 different texture coordinates. For other models and formats, this code needs to be adapted and modified.
+                vec.x = mesh->mTextureCoords[0][i].x;
+                vec.y = mesh->mTextureCoords[0][i].y;
+                vertex.TexCoords = vec;
+
+                // Tangents
+                vector.x = mesh->mTangents[i].x;
+                vector.y = mesh->mTangents[i].y;
+                vector.z = mesh->mTangents[i].z;
+                vertex.Tangent = vector;
+                // Bitangents
+                vector.x = mesh->mBitangents[i].x;
+                vector.y = mesh->mBitangents[i].y;
+                vector.z = mesh->mBitangents[i].z;
+                vertex.Bitangent = vector;
+            }
+            else{
+                vertex.TexCoords = glm::vec2(0.0f, 0.0f);
+                cout << "WARNING::ASSIMP:: MODEL WITHOUT UV COORDINATES -> TANGENT AND BITANGENT ARE = 0" << endl;
+            }
+            // we add the vertex to the list
+            vertices.emplace_back(vertex);
+        }
+
+        // for each face of the mesh, we retrieve the indices of its vertices , and we store them in a vector data structure
+        for(GLuint i = 0; i < mesh->mNumFaces; i++)
+        {
+            aiFace* face = &mesh->mFaces[i];
+             for(GLuint j = 0; j < face->mNumIndices; j++)
+                 indices.emplace_back(face->mIndices[j]);
+
+        }
+
+        // if requested, we reorder triangles and vertices (see mesh_optimizer.h)
+        if (this->optimize)
+        {
+            VertexCacheStatistics before, after;
+            OptimizeMesh(vertices, indices, before, after);
+            cout << "MESH_OPTIMIZER:: mesh " << this->meshes.size() << " (" << indices.size() / 3 << " triangles): ACMR " << before.ACMR << " -> " << after.ACMR
+                 << ", ATVR " << before.ATVR << " -> " << after.ATVR << endl;
+        }
+
+        // if requested, we add the LODs: each one has half the triangles of the previous one, and its indices are added after the previous ones
+        vector<MeshLOD> lods = { { 0, GLuint(indices.size()), 0.0f } };
+        if (this->nLODs > 1)
+        {
+            MeshSimplifier simplifier(vertices, indices);
+            size_t nLOD0Indices = indices.size();
+            for (GLuint l = 1; l < this->nLODs; l++)
+            {
+                vector<GLuint> lodIndices = simplifier.Simplify(((nLOD0Indices / 3) >> l) * 3);
+                // we stop if the simplification cannot remove at least 10% of the triangles of the previous LOD
+                if (lodIndices.empty() || lodIndices.size() > lods.back().nIndices * 9 / 10)
+                    break;
+                if (this->optimize)
+                    lodIndices = OptimizeVertexCache(lodIndices, vertices.size());
+                lods.push_back({ GLuint(indices.size()), GLuint(lodIndices.size()), simplifier.Error() });
+                indices.insert(indices.end(), lodIndices.begin(), lodIndices.end());
+                cout << "MESH_SIMPLIFIER:: mesh " << this->meshes.size() << " LOD " << l << ": " << lodIndices.size() / 3 << " triangles, error " << simplifier.Error() << endl;
+            }
+        }
+
+        // we return an instance of the Mesh class created using the vertices and faces data structures we have created above.
+        return Mesh(vertices, indices, this->format, lods, this->arena);
+    }
+};
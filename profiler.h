@@ -0,0 +1,507 @@
+/*
+Profiler class
+- CPU and GPU timing of the phases of a frame (input, uniform setup, rendering of each model, lights pass, GUI, ...)
+- each phase is a "scope", opened with BeginScope and closed with EndScope (or with a ProfileScope object, which closes it when it goes out of scope).
+  Scopes can be nested: e.g., the scopes of the models are inside the scope of the objects pass
+- the results of the last PROFILER_HISTORY frames are kept in a lock-free ring buffer (ProfileHistory), used for the statistics shown
+  in the GUI and for the export in the Chrome trace format (open chrome://tracing or https://ui.perfetto.dev and load the file)
+
+The CPU time of a scope is measured with std::chrono::steady_clock. The GPU time is measured with timer queries: the GPU writes its clock
+in a query object when it reaches the glQueryCounter command in the command stream, so the time between the two queries of a scope
+is the time spent by the GPU on the commands of the scope.
+See https://www.khronos.org/opengl/wiki/Query_Object#Timer_queries
+
+N.B. 1)
+The queries use GL_TIMESTAMP instead of GL_TIME_ELAPSED ranges: only one GL_TIME_ELAPSED query can be active at the same time,
+so the ranges could not be nested (and the GpuTimer of the benchmark mode already uses one around the whole frame, see benchmark.h).
+Timestamps have no such limit, and they place the GPU work on a timeline which can be compared with the CPU one in the trace.
+
+N.B. 2)
+The results of the queries are available only when the GPU has executed the commands, usually one or two frames later: reading them
+immediately would stall the CPU until the GPU has finished the frame. The queries of each frame are kept in one of PROFILER_LATENCY
+sets, used in rotation: the results of a frame are read when its set is used again, PROFILER_LATENCY frames later, when the GPU has
+already finished it (same approach of GpuTimer in benchmark.h). So the statistics are PROFILER_LATENCY frames "old".
+
+N.B. 3)
+ProfileHistory is a single-producer ring buffer protected by a "sequence lock" for each slot: the writer increments the sequence number
+before (odd = write in progress) and after the copy of the frame, and a reader repeats the read if the sequence number is odd or it has
+changed during the copy. In this way the render thread never waits for the readers (e.g., a thread which saves the trace), and the
+readers never see a frame partially written.
+A reader can copy a frame while the writer is overwriting it: with plain copies this would be a data race (undefined behavior in C++,
+even if the torn copy is then discarded). So the frames are stored as arrays of 64 bit atomic words, copied with relaxed loads and stores.
+See https://en.wikipedia.org/wiki/Seqlock and H.-J. Boehm, "Can Seqlocks Get Along with Programming Language Memory Models?" (2012)
+
+N.B. 4)
+The names of the scopes are not copied: they must be valid until the profiler is destroyed (string literals, or names of the models).
+
+N.B. 5)
+Profiler follows RAII principles and it is a "move-only" class, like the Mesh class.
+
+Real-Time Graphics Programming - a.a. 2022/2023
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <string>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <fstream>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// number of sets of queries used in rotation (see N.B. 2 above)
+#define PROFILER_LATENCY 3
+// maximum number of scopes in a frame (the following ones are ignored)
+#define PROFILER_MAX_SCOPES 64
+// number of frames in the history
+#define PROFILER_HISTORY 256
+
+// a scope of a frame. The times are in milliseconds from the creation of the profiler. gpuStart and gpuEnd are valid only if gpu is true
+struct ProfileRecord {
+    const char* name;
+    // nesting level (0 = outer scope)
+    GLuint depth;
+    bool gpu;
+    double cpuStart, cpuEnd;
+    double gpuStart, gpuEnd;
+};
+
+// the scopes of a frame, in the order they have been opened
+struct ProfileFrame {
+    uint64_t index;
+    // beginning and end of the frame on the CPU
+    double cpuStart, cpuEnd;
+    GLuint nScopes;
+    ProfileRecord scopes[PROFILER_MAX_SCOPES];
+};
+
+// statistics of the scopes with the same name, on the frames of the history
+struct ProfileStats {
+    const char* name;
+    GLuint depth;
+    bool gpu;
+    // time of the scopes in each frame (the sum, if the scope is opened several times in the frame), from the oldest frame
+    vector<float> cpuTimes, gpuTimes;
+    float cpuAverage, cpuMax, gpuAverage, gpuMax;
+};
+
+// size of a frame in 64 bit words (the frames are copied word by word in the history, see N.B. 3 above)
+#define PROFILE_FRAME_WORDS (sizeof(ProfileFrame) / sizeof(uint64_t))
+static_assert(sizeof(ProfileFrame) % sizeof(uint64_t) == 0 && is_trivially_copyable<ProfileFrame>::value,
+              "ProfileFrame must be a trivially copyable sequence of 64 bit words");
+
+/////////////////// PROFILEHISTORY class ///////////////////////
+// lock-free ring buffer of the last PROFILER_HISTORY frames, with a single writer (see N.B. 3 above)
+class ProfileHistory {
+public:
+    ProfileHistory() : written(0) {}
+
+    ProfileHistory(const ProfileHistory& copy) = delete; //disallow copy
+    ProfileHistory& operator=(const ProfileHistory &) = delete;
+
+    // addition of a frame (only from the thread of the profiler): it overwrites the oldest one
+    void Push(const ProfileFrame& frame)
+    {
+        uint64_t position = this->written.load(memory_order_relaxed);
+        Slot& slot = this->slots[position % PROFILER_HISTORY];
+        uint64_t sequence = slot.sequence.load(memory_order_relaxed);
+        slot.sequence.store(sequence + 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        uint64_t words[PROFILE_FRAME_WORDS];
+        memcpy(words, &frame, sizeof(ProfileFrame));
+        for (size_t i = 0; i < PROFILE_FRAME_WORDS; i++)
+            slot.words[i].store(words[i], memory_order_relaxed);
+        slot.sequence.store(sequence + 2, memory_order_release);
+        this->written.store(position + 1, memory_order_release);
+    }
+
+    // number of frames added from the beginning (the last PROFILER_HISTORY are available)
+    uint64_t Written() const
+    {
+        return this->written.load(memory_order_acquire);
+    }
+
+    // copy of the frame added in the given position (from 0). It returns false if the frame has been overwritten
+    bool Read(uint64_t position, ProfileFrame& frame) const
+    {
+        const Slot& slot = this->slots[position % PROFILER_HISTORY];
+        uint64_t words[PROFILE_FRAME_WORDS];
+        for (;;)
+        {
+            uint64_t before = slot.sequence.load(memory_order_acquire);
+            if (before & 1)
+                continue;
+            for (size_t i = 0; i < PROFILE_FRAME_WORDS; i++)
+                words[i] = slot.words[i].load(memory_order_relaxed);
+            atomic_thread_fence(memory_order_acquire);
+            if (slot.sequence.load(memory_order_relaxed) == before)
+                break;
+        }
+        // the copy is consistent: the words are the bytes of a frame written by Push
+        memcpy(&frame, words, sizeof(ProfileFrame));
+        // the slot now contains a more recent frame
+        return this->Written() - position <= PROFILER_HISTORY;
+    }
+
+private:
+    struct Slot {
+        atomic<uint64_t> sequence{ 0 };
+        // the frame, as atomic words (see N.B. 3 above)
+        atomic<uint64_t> words[PROFILE_FRAME_WORDS] = {};
+    };
+    Slot slots[PROFILER_HISTORY];
+    atomic<uint64_t> written;
+};
+
+/////////////////// PROFILER class ///////////////////////
+class Profiler {
+public:
+    // if false, the next frames are not measured
+    bool enabled = true;
+
+    // We want Profiler to be a move-only class. We delete copy constructor and copy assignment
+    Profiler(const Profiler& copy) = delete; //disallow copy
+    Profiler& operator=(const Profiler &) = delete;
+
+    Profiler() noexcept
+        : history(new ProfileHistory()), frames(new ProfileFrame[PROFILER_LATENCY]), queries(PROFILER_LATENCY * PROFILER_MAX_SCOPES * 2)
+    {
+        glGenQueries(GLsizei(this->queries.size()), this->queries.data());
+        // the origins of the CPU and GPU clocks are taken at the same moment (see timeline())
+        this->origin = chrono::steady_clock::now();
+        glGetInteger64v(GL_TIMESTAMP, &this->gpuOrigin);
+        for (GLuint i = 0; i < PROFILER_LATENCY; i++)
+            this->pending[i] = false;
+    }
+
+    Profiler(Profiler&& move) noexcept
+        : enabled(move.enabled), history(std::move(move.history)), frames(std::move(move.frames)), queries(std::move(move.queries)),
+          origin(move.origin), gpuOrigin(move.gpuOrigin), frameIndex(move.frameIndex), recording(move.recording), stack(std::move(move.stack))
+    {
+        memcpy(this->pending, move.pending, sizeof(this->pending));
+        move.queries.clear();
+    }
+
+    Profiler& operator=(Profiler&& move) noexcept
+    {
+        freeGPUresources();
+        this->enabled = move.enabled;
+        this->history = std::move(move.history);
+        this->frames = std::move(move.frames);
+        this->queries = std::move(move.queries);
+        this->origin = move.origin;
+        this->gpuOrigin = move.gpuOrigin;
+        this->frameIndex = move.frameIndex;
+        this->recording = move.recording;
+        this->stack = std::move(move.stack);
+        memcpy(this->pending, move.pending, sizeof(this->pending));
+        move.queries.clear();
+        return *this;
+    }
+
+    ~Profiler() noexcept
+    {
+        freeGPUresources();
+    }
+
+    //////////////////////////////////////////
+
+    // beginning of a frame: the frame measured PROFILER_LATENCY frames ago is completed with the GPU times, and added to the history
+    void BeginFrame()
+    {
+        GLuint set = GLuint(this->frameIndex % PROFILER_LATENCY);
+        if (this->pending[set])
+            this->resolve(set);
+
+        this->recording = this->enabled;
+        this->stack.clear();
+        ProfileFrame& frame = this->frames[set];
+        frame.index = this->frameIndex;
+        frame.nScopes = 0;
+        frame.cpuStart = this->now();
+    }
+
+    void EndFrame()
+    {
+        if (this->recording)
+        {
+            GLuint set = GLuint(this->frameIndex % PROFILER_LATENCY);
+            this->frames[set].cpuEnd = this->now();
+            this->pending[set] = true;
+        }
+        this->recording = false;
+        this->frameIndex++;
+    }
+
+    // beginning of a scope, with the GPU measure if gpu is true (the scopes with only CPU work do not need the queries)
+    void BeginScope(const char* name, bool gpu = true)
+    {
+        if (!this->recording)
+            return;
+        GLuint set = GLuint(this->frameIndex % PROFILER_LATENCY);
+        ProfileFrame& frame = this->frames[set];
+        if (frame.nScopes == PROFILER_MAX_SCOPES)
+        {
+            // the scope is ignored, but EndScope must know it
+            this->stack.push_back(PROFILER_MAX_SCOPES);
+            return;
+        }
+        GLuint scope = frame.nScopes++;
+        ProfileRecord& record = frame.scopes[scope];
+        record.name = name;
+        record.depth = GLuint(this->stack.size());
+        record.gpu = gpu;
+        if (gpu)
+            glQueryCounter(this->query(set, scope, 0), GL_TIMESTAMP);
+        this->stack.push_back(scope);
+        record.cpuStart = this->now();
+    }
+
+    // end of the last scope opened
+    void EndScope()
+    {
+        if (!this->recording || this->stack.empty())
+            return;
+        double end = this->now();
+        GLuint scope = this->stack.back();
+        this->stack.pop_back();
+        if (scope == PROFILER_MAX_SCOPES)
+            return;
+        GLuint set = GLuint(this->frameIndex % PROFILER_LATENCY);
+        ProfileRecord& record = this->frames[set].scopes[scope];
+        record.cpuEnd = end;
+        if (record.gpu)
+            glQueryCounter(this->query(set, scope, 1), GL_TIMESTAMP);
+    }
+
+    // we wait for the results of all the measured frames, and we add them to the history (e.g., before the export of the last frames)
+    void Flush()
+    {
+        for (uint64_t i = 0; i < PROFILER_LATENCY; i++)
+        {
+            GLuint set = GLuint((this->frameIndex + i) % PROFILER_LATENCY);
+            if (this->pending[set])
+                this->resolve(set);
+        }
+    }
+
+    // the frames in the history can be read from any thread (see N.B. 3 above)
+    const ProfileHistory& History() const
+    {
+        return *this->history;
+    }
+
+    // statistics of the last nFrames frames of the history (at most PROFILER_HISTORY). The first entry is the whole frame ("Frame"),
+    // followed by the scopes in the order of the most recent frame: on the GPU, the frame goes from the first to the last GPU measure
+    void Statistics(vector<ProfileStats>& stats, GLuint nFrames = PROFILER_HISTORY) const
+    {
+        vector<ProfileFrame> frames;
+        this->readHistory(frames, nFrames);
+        stats.clear();
+        if (frames.empty())
+            return;
+
+        stats.push_back({ "Frame", 0, true });
+        const ProfileFrame& last = frames.back();
+        for (GLuint i = 0; i < last.nScopes; i++)
+        {
+            // the scopes opened several times are listed once, with the sum of the times
+            bool listed = false;
+            for (size_t s = 1; s < stats.size() && !listed; s++)
+                listed = (strcmp(stats[s].name, last.scopes[i].name) == 0);
+            if (!listed)
+                stats.push_back({ last.scopes[i].name, last.scopes[i].depth + 1, last.scopes[i].gpu });
+        }
+
+        for (const ProfileFrame& frame : frames)
+        {
+            stats[0].cpuTimes.push_back(float(frame.cpuEnd - frame.cpuStart));
+            double gpuStart = 0.0, gpuEnd = 0.0;
+            bool gpu = false;
+            for (size_t s = 1; s < stats.size(); s++)
+            {
+                float cpuTime = 0.0f, gpuTime = 0.0f;
+                for (GLuint i = 0; i < frame.nScopes; i++)
+                {
+                    const ProfileRecord& record = frame.scopes[i];
+                    if (strcmp(stats[s].name, record.name) != 0)
+                        continue;
+                    cpuTime += float(record.cpuEnd - record.cpuStart);
+                    if (record.gpu)
+                        gpuTime += float(record.gpuEnd - record.gpuStart);
+                }
+                stats[s].cpuTimes.push_back(cpuTime);
+                stats[s].gpuTimes.push_back(gpuTime);
+            }
+            for (GLuint i = 0; i < frame.nScopes; i++)
+            {
+                const ProfileRecord& record = frame.scopes[i];
+                if (!record.gpu)
+                    continue;
+                gpuStart = gpu ? min(gpuStart, record.gpuStart) : record.gpuStart;
+                gpuEnd = gpu ? max(gpuEnd, record.gpuEnd) : record.gpuEnd;
+                gpu = true;
+            }
+            stats[0].gpuTimes.push_back(float(gpuEnd - gpuStart));
+        }
+
+        for (ProfileStats& entry : stats)
+        {
+            entry.cpuAverage = entry.gpuAverage = entry.cpuMax = entry.gpuMax = 0.0f;
+            for (size_t f = 0; f < frames.size(); f++)
+            {
+                entry.cpuAverage += entry.cpuTimes[f] / frames.size();
+                entry.gpuAverage += entry.gpuTimes[f] / frames.size();
+                entry.cpuMax = max(entry.cpuMax, entry.cpuTimes[f]);
+                entry.gpuMax = max(entry.gpuMax, entry.gpuTimes[f]);
+            }
+        }
+    }
+
+    // export of the frames in the history in the Chrome trace format (JSON): the CPU scopes are in the thread 1, the GPU scopes in the thread 2.
+    // It returns false if the file cannot be written
+    bool ExportChromeTrace(const string& path) const
+    {
+        vector<ProfileFrame> frames;
+        this->readHistory(frames, PROFILER_HISTORY);
+        ofstream json(path);
+        if (!json)
+            return false;
+
+        // "X" events are complete events, with beginning (ts) and duration (dur) in microseconds. "M" events give the names of the threads
+        json << "{\n\"displayTimeUnit\": \"ms\",\n\"traceEvents\": [\n";
+        json << "{ \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 1, \"args\": { \"name\": \"CPU\" } },\n";
+        json << "{ \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 2, \"args\": { \"name\": \"GPU\" } }";
+        json.precision(3);
+        json << fixed;
+        for (const ProfileFrame& frame : frames)
+        {
+            writeEvent(json, "Frame", 1, frame.cpuStart, frame.cpuEnd);
+            for (GLuint i = 0; i < frame.nScopes; i++)
+            {
+                const ProfileRecord& record = frame.scopes[i];
+                writeEvent(json, record.name, 1, record.cpuStart, record.cpuEnd);
+                if (record.gpu)
+                    writeEvent(json, record.name, 2, record.gpuStart, record.gpuEnd);
+            }
+        }
+        json << "\n]\n}\n";
+        return bool(json);
+    }
+
+private:
+    unique_ptr<ProfileHistory> history;
+    // frames measured and not yet added to the history, one for each set of queries
+    unique_ptr<ProfileFrame[]> frames;
+    bool pending[PROFILER_LATENCY];
+    // two queries (beginning and end) for each scope of each set
+    vector<GLuint> queries;
+    // origins of the CPU and GPU clocks (the GPU one in nanoseconds)
+    chrono::steady_clock::time_point origin;
+    GLint64 gpuOrigin;
+    uint64_t frameIndex = 0;
+    // true if the current frame is measured
+    bool recording = false;
+    // scopes currently opened
+    vector<GLuint> stack;
+
+    //////////////////////////////////////////
+
+    // milliseconds from the creation of the profiler, on the CPU
+    double now() const
+    {
+        return chrono::duration<double, milli>(chrono::steady_clock::now() - this->origin).count();
+    }
+
+    GLuint query(GLuint set, GLuint scope, GLuint end) const
+    {
+        return this->queries[(set * PROFILER_MAX_SCOPES + scope) * 2 + end];
+    }
+
+    // we read the GPU times of the frame measured with the given set of queries, and we add the frame to the history
+    void resolve(GLuint set)
+    {
+        ProfileFrame& frame = this->frames[set];
+        for (GLuint i = 0; i < frame.nScopes; i++)
+        {
+            ProfileRecord& record = frame.scopes[i];
+            if (!record.gpu)
+                continue;
+            GLuint64 start, end;
+            glGetQueryObjectui64v(this->query(set, i, 0), GL_QUERY_RESULT, &start);
+            glGetQueryObjectui64v(this->query(set, i, 1), GL_QUERY_RESULT, &end);
+            // the GPU times are moved on the CPU timeline
+            record.gpuStart = (GLint64(start) - this->gpuOrigin) / 1.0e6;
+            record.gpuEnd = (GLint64(end) - this->gpuOrigin) / 1.0e6;
+        }
+        this->history->Push(frame);
+        this->pending[set] = false;
+    }
+
+    // copy of the last nFrames frames of the history, from the oldest one
+    void readHistory(vector<ProfileFrame>& frames, GLuint nFrames) const
+    {
+        uint64_t written = this->history->Written();
+        uint64_t count = min<uint64_t>(written, min<GLuint>(nFrames, PROFILER_HISTORY));
+        frames.clear();
+        frames.reserve(count);
+        ProfileFrame frame;
+        for (uint64_t position = written - count; position < written; position++)
+            if (this->history->Read(position, frame))
+                frames.push_back(frame);
+    }
+
+    static void writeEvent(ofstream& json, const char* name, int thread, double start, double end)
+    {
+        json << ",\n{ \"name\": \"";
+        // quotes and backslashes must be escaped in JSON strings
+        for (const char* c = name; *c; c++)
+        {
+            if (*c == '"' || *c == '\\')
+                json << '\\';
+            json << *c;
+        }
+        json << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << thread << ", \"ts\": " << start * 1000.0 << ", \"dur\": " << (end - start) * 1000.0 << " }";
+    }
+
+    void freeGPUresources()
+    {
+        if (!this->queries.empty())
+        {
+            glDeleteQueries(GLsizei(this->queries.size()), this->queries.data());
+            this->queries.clear();
+        }
+    }
+};
+
+/////////////////// PROFILESCOPE class ///////////////////////
+// scope of a profiler, closed when the object is destroyed. If the profiler is nullptr, nothing is measured
+class ProfileScope {
+public:
+    ProfileScope(Profiler* profiler, const char* name, bool gpu = true) : profiler(profiler)
+    {
+        if (this->profiler)
+            this->profiler->BeginScope(name, gpu);
+    }
+
+    ProfileScope(const ProfileScope& copy) = delete; //disallow copy
+    ProfileScope& operator=(const ProfileScope &) = delete;
+
+    ~ProfileScope()
+    {
+        if (this->profiler)
+            this->profiler->EndScope();
+    }
+
+private:
+    Profiler* profiler;
+};
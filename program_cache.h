@@ -0,0 +1,157 @@
+/*
+Program cache
+- binary cache of the linked Shader Programs, saved in the shaders folder (one file for each program)
+- after linking, the program is retrieved in the driver internal format with glGetProgramBinary; at the next launch it is restored with glProgramBinary,
+  without compiling and linking the sources again
+- the Shader class (see shader.h) uses the cache if a ProgramCache is passed to its constructor
+
+File layout:
+ProgramCacheHeader | program binary
+
+The name of the file is the hash of the paths of the stages of the program, so each program has always the same file.
+The cache is valid only if the header matches:
+- the hash of the source code of all the stages (the program is compiled again if a shader is changed)
+- the hash of the vendor, renderer and version strings of the driver (the binary formats are not portable between GPUs or driver versions)
+Otherwise the program is compiled from the sources and the file is overwritten.
+
+N.B.) the driver can reject a binary even if the header matches (e.g., after an update with the same version string):
+in that case glProgramBinary fails, the link status of the program is GL_FALSE, and the Shader class compiles the sources.
+
+See https://www.khronos.org/opengl/wiki/Shader_Compilation#Binary_upload for details.
+
+Real-Time Graphics Programming - a.a. 2022/2023
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+
+// identifier at the beginning of the cache files
+// the last character is the version of the file layout: it must be changed every time ProgramCacheHeader is changed
+#define PROGRAM_CACHE_MAGIC "RTGPPRG1"
+
+struct ProgramCacheHeader {
+    char magic[8];
+    uint64_t sourceHash;
+    uint64_t driverHash;
+    uint32_t binaryFormat;
+    uint32_t length;
+};
+
+//////////////////////////////////////////
+// FNV-1a 64 bit hash of a string. The hash of a previous string can be passed to combine the two
+inline uint64_t HashString(const string& text, uint64_t hash = 14695981039346656037ULL)
+{
+    for (unsigned char c : text)
+    {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/////////////////// PROGRAMCACHE class ///////////////////////
+class ProgramCache
+{
+public:
+    // number of programs loaded from the cache, and number of programs saved in the cache (i.e., compiled from the sources)
+    GLuint loaded, saved;
+
+    // the cache files are saved in the given folder. It must be created by the thread owning the OpenGL context
+    ProgramCache(const string& directory = "shaders/")
+        : loaded(0), saved(0), directory(directory), driverHash(0)
+    {
+        // if the driver does not support any binary format, the cache is disabled
+        GLint nFormats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &nFormats);
+        this->enabled = (nFormats > 0);
+        for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION })
+        {
+            const GLubyte* value = glGetString(name);
+            this->driverHash = HashString(value ? (const char*)value : "", this->driverHash);
+        }
+    }
+
+    bool IsEnabled() const
+    {
+        return this->enabled;
+    }
+
+    // we try to restore the program from the cache file of the program with the given key (hash of the stage paths).
+    // It returns false if the file is missing or not valid, or if the driver rejects the binary
+    bool Load(GLuint program, uint64_t key, uint64_t sourceHash)
+    {
+        if (!this->enabled)
+            return false;
+        ifstream file(this->path(key), ios::binary);
+        if (!file)
+            return false;
+        ProgramCacheHeader header;
+        if (!file.read((char*)&header, sizeof(header)) || memcmp(header.magic, PROGRAM_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+            header.sourceHash != sourceHash || header.driverHash != this->driverHash)
+            return false;
+        vector<char> binary(header.length);
+        if (!file.read(binary.data(), binary.size()))
+            return false;
+
+        glProgramBinary(program, header.binaryFormat, binary.data(), GLsizei(binary.size()));
+        GLint success = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (success)
+            this->loaded++;
+        return success == GL_TRUE;
+    }
+
+    // we save the binary of a linked program. The program must have been linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set to GL_TRUE
+    void Save(GLuint program, uint64_t key, uint64_t sourceHash)
+    {
+        if (!this->enabled)
+            return;
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+        vector<char> binary(length);
+        GLenum binaryFormat;
+        glGetProgramBinary(program, length, &length, &binaryFormat, binary.data());
+
+        ProgramCacheHeader header;
+        memcpy(header.magic, PROGRAM_CACHE_MAGIC, sizeof(header.magic));
+        header.sourceHash = sourceHash;
+        header.driverHash = this->driverHash;
+        header.binaryFormat = binaryFormat;
+        header.length = uint32_t(length);
+        ofstream file(this->path(key), ios::binary | ios::trunc);
+        if (!file)
+            return;
+        file.write((const char*)&header, sizeof(header));
+        file.write(binary.data(), length);
+        this->saved++;
+    }
+
+private:
+    string directory;
+    // hash of the vendor, renderer and version strings
+    uint64_t driverHash;
+    bool enabled;
+
+    //////////////////////////////////////////
+
+    // path of the cache file of a program
+    string path(uint64_t key) const
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.programcache", (unsigned long long)key);
+        return this->directory + name;
+    }
+};
@@ -0,0 +1,294 @@
+/*
+RenderQueue class
+- the draws of a frame are collected in a queue: each draw has a 64 bit sort key, with the state needed to render it packed in its bits
+  (render pass, Shader Program, material, model and LOD, distance from the camera)
+- the queue is sorted with a radix sort, and the draws are rendered in the order of the keys: the draws with the same Shader Program
+  and material are contiguous, so the program and the textures are changed once for each group, and the instances of the same model
+  and LOD are contiguous, so they are rendered with a single instanced draw call (see batch_renderer.h)
+- the instances of a model are sorted front-to-back: the nearest objects write the depth buffer first, and the fragments of the farther ones
+  behind them are discarded by the depth test before the fragment shader (early-Z)
+
+Layout of the key, from the most significant bit:
+pass (4 bits) | Shader Program (8 bits) | material (8 bits) | model (14 bits) | LOD (6 bits) | depth (24 bits)
+The order of the fields is the priority of the sort: a change of pass or of Shader Program is more expensive than a change of textures,
+which is more expensive than a change of model. The depth is the last field, so it orders only the instances of the same model and LOD:
+sorting the depth before the state would give a better early-Z, but it would break the groups of state and of instances.
+See C. Ericson, "Order your graphics draw calls around!" (2008), http://realtimecollisiondetection.net/blog/?p=86
+
+N.B. 1)
+The Shader Programs, the materials and the models are stored in tables, and the keys contain their indices in the tables: the indices
+returned by Program and Material are valid until all the passes of the queue have been rendered (usually, one frame). The fields have a
+limited number of bits: at most 16 passes, 256 programs, 255 materials (plus NO_MATERIAL), 16384 models and 64 LODs in the queue
+at the same time. A larger index would be truncated and it would alias another one, so the draw would be rendered with the state of
+another group: Submit checks the limits with an assert (in release builds the application must respect them).
+The models allocated in the same GeometryArena (see mesh.h) share a single VAO, so the VAO is not in the key: the consecutive draws of
+different models of the arena do not change the VAO anyway.
+
+N.B. 2)
+The bits of a positive float, read as an unsigned integer, grow with its value (the exponent is in the most significant bits, after the sign):
+the depth field is made of the 24 most significant bits of the distance, with no need to know the range of the distances.
+
+N.B. 3)
+Radix sort (Least Significant Digit): the keys are sorted on each byte, from the least significant one, with a counting sort, which is stable:
+8 passes on the keys, with no comparisons, instead of the O(n log n) comparisons of std::sort. The histograms of the 8 bytes are computed
+in a single pass, and the bytes with the same value in all the keys (e.g., the pass and the program, when there is a single program)
+are skipped. The draws with the same key are rendered in the order of submission.
+
+N.B. 4)
+Flush renders the passes in order, so the application can do other work between two passes (e.g., the lighting pass of deferred shading).
+The uniforms which depend on the Shader Program (e.g., the parameters of tessellation) are not in the queue: they are part of the state of
+the program, so they can be set before the draws are submitted.
+When all the passes have been rendered the frame is complete: the instance buffer of the renderer moves to the region of the next frame.
+
+Real-Time Graphics Programming - a.a. 2022/2023
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <cassert>
+
+#include <utils/shader.h>
+#include <utils/model.h>
+#include <utils/batch_renderer.h>
+#include <utils/profiler.h>
+#include <utils/gl_state.h>
+// texture unit of the derivative maps
+#include <utils/derivative_map.h>
+
+// bits of the fields of the sort keys (see the layout above)
+#define RENDER_KEY_PASS_BITS 4
+#define RENDER_KEY_PROGRAM_BITS 8
+#define RENDER_KEY_MATERIAL_BITS 8
+#define RENDER_KEY_MODEL_BITS 14
+#define RENDER_KEY_LOD_BITS 6
+#define RENDER_KEY_DEPTH_BITS 24
+
+// number of textures of a material: diffuse map, normal map, height map (cone step map) and derivative map
+#define MATERIAL_TEXTURES 4
+// material of the draws without textures (e.g., the spheres of the lights)
+#define NO_MATERIAL 0
+
+// texture units of the textures of a material
+const GLuint materialTextureUnits[MATERIAL_TEXTURES] = { 0, 1, 2, DERIVATIVE_MAP_UNIT };
+
+/////////////////// RENDERQUEUE class ///////////////////////
+class RenderQueue {
+public:
+    // number of draw calls and of instances rendered by the last call to Flush
+    GLuint drawCalls, instances;
+
+    RenderQueue(const RenderQueue& copy) = delete; //disallow copy
+    RenderQueue& operator=(const RenderQueue &) = delete;
+
+    RenderQueue() : drawCalls(0), instances(0), next(0), sorted(true) {}
+
+    //////////////////////////////////////////
+
+    // index of a Shader Program in the keys (see N.B. 1 above). If tessellation is true, the program renders patches
+    GLuint Program(Shader& shader, bool tessellation = false)
+    {
+        for (GLuint i = 0; i < this->programs.size(); i++)
+            if (this->programs[i].shader == &shader && this->programs[i].tessellation == tessellation)
+                return i;
+        this->programs.push_back({ &shader, tessellation });
+        return GLuint(this->programs.size() - 1);
+    }
+
+    // index of a material: the MATERIAL_TEXTURES textures are bound to the units in materialTextureUnits (nullptr: NO_MATERIAL)
+    GLuint Material(const GLint* textures)
+    {
+        if (!textures)
+            return NO_MATERIAL;
+        for (GLuint i = 0; i < this->materials.size(); i++)
+            if (memcmp(this->materials[i].textures, textures, sizeof(this->materials[i].textures)) == 0)
+                return i + 1;
+        MaterialEntry material;
+        memcpy(material.textures, textures, sizeof(material.textures));
+        this->materials.push_back(material);
+        return GLuint(this->materials.size());
+    }
+
+    // we add a draw of an instance of the model, with the given LOD and matrices, in a pass. depth is the distance from the camera
+    // the model must be valid until the pass is rendered
+    void Submit(GLuint pass, GLuint program, GLuint material, Model& model, GLint lod, const InstanceData& instance, GLfloat depth)
+    {
+        auto inserted = this->models.insert({ &model, GLuint(this->models.size()) });
+        uint64_t key = field(pass, RENDER_KEY_PASS_BITS);
+        key = (key << RENDER_KEY_PROGRAM_BITS) | field(program, RENDER_KEY_PROGRAM_BITS);
+        key = (key << RENDER_KEY_MATERIAL_BITS) | field(material, RENDER_KEY_MATERIAL_BITS);
+        key = (key << RENDER_KEY_MODEL_BITS) | field(inserted.first->second, RENDER_KEY_MODEL_BITS);
+        key = (key << RENDER_KEY_LOD_BITS) | field(GLuint(lod), RENDER_KEY_LOD_BITS);
+        key = (key << RENDER_KEY_DEPTH_BITS) | depthBits(depth);
+        this->entries.push_back({ key, GLuint(this->items.size()) });
+        this->items.push_back({ &model, lod, instance });
+        this->sorted = false;
+    }
+
+    // rendering of the draws of the passes up to the given one which have not been rendered yet (see N.B. 4 above)
+    // If a Profiler is passed, each group of instances is measured in a scope (see batch_renderer.h)
+    void Flush(GLuint pass, Profiler* profiler = nullptr)
+    {
+        this->drawCalls = this->instances = 0;
+        if (!this->sorted)
+        {
+            // the draws submitted after a partial Flush are sorted with the ones not rendered yet
+            this->entries.erase(this->entries.begin(), this->entries.begin() + this->next);
+            this->next = 0;
+            this->sort();
+            this->sorted = true;
+        }
+
+        const GLuint stateShift = RENDER_KEY_MODEL_BITS + RENDER_KEY_LOD_BITS + RENDER_KEY_DEPTH_BITS;
+        size_t end = this->next;
+        while (end < this->entries.size() && (this->entries[end].key >> (64 - RENDER_KEY_PASS_BITS)) <= pass)
+            end++;
+
+        for (size_t first = this->next; first < end; )
+        {
+            // the group goes from first to last (excluded): the draws have the same pass, Shader Program and material
+            uint64_t state = this->entries[first].key >> stateShift;
+            size_t last = first + 1;
+            while (last < end && (this->entries[last].key >> stateShift) == state)
+                last++;
+
+            const ProgramEntry& program = this->programs[(state >> RENDER_KEY_MATERIAL_BITS) & ((1u << RENDER_KEY_PROGRAM_BITS) - 1)];
+            GLuint material = GLuint(state & ((1u << RENDER_KEY_MATERIAL_BITS) - 1));
+            program.shader->Use();
+            // the state cache skips the binds of the textures already bound (see gl_state.h)
+            if (material != NO_MATERIAL)
+                for (GLuint i = 0; i < MATERIAL_TEXTURES; i++)
+                    GLState().BindTexture(materialTextureUnits[i], GL_TEXTURE_2D, this->materials[material - 1].textures[i]);
+
+            // the instances of the same model and LOD are consecutive, so the renderer groups them in instanced draw calls
+            for (size_t i = first; i < last; i++)
+            {
+                const DrawItem& item = this->items[this->entries[i].item];
+                this->renderer.Submit(*item.model, item.lod, item.instance);
+            }
+            this->renderer.Flush(*program.shader, program.tessellation, profiler);
+            this->drawCalls += this->renderer.drawCalls;
+            this->instances += this->renderer.instances;
+            first = last;
+        }
+        this->next = end;
+
+        // all the passes have been rendered: the tables are emptied for the next frame
+        if (this->next == this->entries.size())
+        {
+            this->clear();
+            this->renderer.EndFrame();
+        }
+    }
+
+    // frames in which the renderer waited for the GPU before writing the instance buffer (see ring_buffer.h)
+    GLuint Stalls() const
+    {
+        return this->renderer.Stalls();
+    }
+
+private:
+    struct ProgramEntry {
+        Shader* shader;
+        bool tessellation;
+    };
+
+    struct MaterialEntry {
+        GLint textures[MATERIAL_TEXTURES];
+    };
+
+    struct DrawItem {
+        Model* model;
+        GLint lod;
+        InstanceData instance;
+    };
+
+    // sort key of a draw, and index of the draw in items: the radix sort moves only these entries
+    struct SortEntry {
+        uint64_t key;
+        GLuint item;
+    };
+
+    vector<ProgramEntry> programs;
+    vector<MaterialEntry> materials;
+    unordered_map<const Model*, GLuint> models;
+    vector<DrawItem> items;
+    vector<SortEntry> entries, scratch;
+    // first entry not rendered yet
+    size_t next;
+    bool sorted;
+    BatchRenderer renderer;
+
+    //////////////////////////////////////////
+
+    // value of a field of the key: it must fit in the bits of the field (see N.B. 1 above)
+    static uint64_t field(GLuint value, GLuint bits)
+    {
+        assert(uint64_t(value) < (uint64_t(1) << bits) && "RenderQueue: too many passes, programs, materials, models or LODs for the sort key");
+        return uint64_t(value) & ((uint64_t(1) << bits) - 1);
+    }
+
+    // the most significant bits of the distance (see N.B. 2 above): the negative distances are clamped to 0
+    static uint64_t depthBits(GLfloat depth)
+    {
+        depth = max(depth, 0.0f);
+        uint32_t bits;
+        memcpy(&bits, &depth, sizeof(bits));
+        return bits >> (32 - RENDER_KEY_DEPTH_BITS);
+    }
+
+    // LSD radix sort of the entries on the 8 bytes of the keys (see N.B. 3 above)
+    void sort()
+    {
+        size_t n = this->entries.size();
+        if (n < 2)
+            return;
+        size_t counts[8][256] = {};
+        for (const SortEntry& entry : this->entries)
+            for (GLuint b = 0; b < 8; b++)
+                counts[b][(entry.key >> (8 * b)) & 0xFF]++;
+
+        this->scratch.resize(n);
+        SortEntry* source = this->entries.data();
+        SortEntry* destination = this->scratch.data();
+        for (GLuint b = 0; b < 8; b++)
+        {
+            // all the keys have the same value of this byte: the pass would not change the order
+            if (counts[b][(source[0].key >> (8 * b)) & 0xFF] == n)
+                continue;
+            // position of the first entry with each value of the byte
+            size_t offsets[256];
+            size_t offset = 0;
+            for (GLuint digit = 0; digit < 256; digit++)
+            {
+                offsets[digit] = offset;
+                offset += counts[b][digit];
+            }
+            for (size_t i = 0; i < n; i++)
+                destination[offsets[(source[i].key >> (8 * b)) & 0xFF]++] = source[i];
+            swap(source, destination);
+        }
+        // after an odd number of passes, the sorted entries are in the scratch buffer
+        if (source != this->entries.data())
+            this->entries.swap(this->scratch);
+    }
+
+    void clear()
+    {
+        this->programs.clear();
+        this->materials.clear();
+        this->models.clear();
+        this->items.clear();
+        this->entries.clear();
+        this->next = 0;
+    }
+};
@@ -0,0 +1,259 @@
+/*
+RingBuffer class
+- a buffer for the data written by the CPU in every frame (e.g., the matrices of the instances, see batch_renderer.h), divided in
+  RING_BUFFER_FRAMES regions: in each frame the data are written in the next region, while the GPU can still read the regions of the previous frames
+- at the end of a frame, a fence is inserted in the command stream: before writing again in a region, the CPU waits for the fence of the
+  frame which used it (glClientWaitSync). With 3 regions, the CPU can be 2 frames ahead of the GPU before waiting
+- if the driver supports ARB_buffer_storage (core in OpenGL 4.4), the buffer is mapped once, with a persistent and coherent mapping,
+  and the data are copied directly in the memory read by the GPU. Otherwise each write maps its range with GL_MAP_UNSYNCHRONIZED_BIT:
+  the driver does not check if the GPU is using the buffer, because the fences already guarantee that the range is not in use
+
+With a single buffer updated with glBufferSubData (or orphaned with glBufferData) for each group of draw calls, the driver must copy the data
+or allocate a new buffer at each update. Here the data of all the draws of a frame are written in a single buffer, with no allocations.
+See https://www.khronos.org/opengl/wiki/Buffer_Object_Streaming and C. Everitt et al., "Approaching Zero Driver Overhead" (GDC 2014).
+
+N.B. 1)
+If the data of a frame do not fit in a region, the buffer is replaced by a new one with larger regions (the old one is deleted, but OpenGL keeps
+it alive until the draw calls already issued have read it). So the offsets returned by Map are valid only with the current buffer.
+
+N.B. 2)
+The buffer storage functions are not part of OpenGL 4.1: EnableBufferStorage loads glBufferStorage, if the extension is available,
+with the loader of the OpenGL functions (like EnableParallelShaderCompile in shader.h). It must be called before the creation of the buffers.
+
+N.B. 3)
+RingBuffer follows RAII principles and it is a "move-only" class, like the Mesh class.
+
+Real-Time Graphics Programming - a.a. 2022/2023
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <cstring>
+#include <algorithm>
+
+// number of regions of the ring buffers: the frames which can be written while the GPU reads the previous ones
+#define RING_BUFFER_FRAMES 3
+
+// constants of ARB_buffer_storage (not defined by an OpenGL 4.1 loader)
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+typedef void (APIENTRYP BufferStorageProc)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+
+// glBufferStorage, if supported by the driver (nullptr otherwise)
+inline BufferStorageProc& BufferStorage()
+{
+    static BufferStorageProc function = nullptr;
+    return function;
+}
+
+// if ARB_buffer_storage is supported, we load glBufferStorage (see N.B. 2 above).
+// It must be called after the creation of the OpenGL context, with the loader of the OpenGL functions (e.g., glfwGetProcAddress)
+inline bool EnableBufferStorage(GLADloadproc loader)
+{
+    GLint nExtensions = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &nExtensions);
+    for (GLint i = 0; i < nExtensions && !BufferStorage(); i++)
+        if (strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), "GL_ARB_buffer_storage") == 0)
+            BufferStorage() = (BufferStorageProc)loader("glBufferStorage");
+    return BufferStorage() != nullptr;
+}
+
+/////////////////// RINGBUFFER class ///////////////////////
+class RingBuffer {
+public:
+    // name of the buffer, and number of frames in which the CPU had to wait for the GPU before writing
+    GLuint buffer, stalls;
+
+    // We want RingBuffer to be a move-only class. We delete copy constructor and copy assignment
+    RingBuffer(const RingBuffer& copy) = delete; //disallow copy
+    RingBuffer& operator=(const RingBuffer &) = delete;
+
+    // Constructor: each region can contain frameSize bytes, and it grows when needed (see N.B. 1 above)
+    RingBuffer(size_t frameSize, GLenum target = GL_ARRAY_BUFFER) noexcept
+        : buffer(0), stalls(0), target(target), frameSize(max(frameSize, size_t(256))), mapped(nullptr), frame(0), offset(0), inFrame(false)
+    {
+        for (GLsync& fence : this->fences)
+            fence = 0;
+        this->create();
+    }
+
+    // Move constructor
+    RingBuffer(RingBuffer&& move) noexcept
+        : buffer(move.buffer), stalls(move.stalls), target(move.target), frameSize(move.frameSize), mapped(move.mapped),
+        frame(move.frame), offset(move.offset), inFrame(move.inFrame)
+    {
+        for (GLuint i = 0; i < RING_BUFFER_FRAMES; i++)
+        {
+            this->fences[i] = move.fences[i];
+            move.fences[i] = 0;
+        }
+        move.buffer = 0;
+        move.mapped = nullptr;
+    }
+
+    // Move assignment
+    RingBuffer& operator=(RingBuffer&& move) noexcept
+    {
+        freeGPUresources();
+        buffer = move.buffer;
+        stalls = move.stalls;
+        target = move.target;
+        frameSize = move.frameSize;
+        mapped = move.mapped;
+        frame = move.frame;
+        offset = move.offset;
+        inFrame = move.inFrame;
+        for (GLuint i = 0; i < RING_BUFFER_FRAMES; i++)
+        {
+            fences[i] = move.fences[i];
+            move.fences[i] = 0;
+        }
+        move.buffer = 0;
+        move.mapped = nullptr;
+        return *this;
+    }
+
+    // destructor
+    ~RingBuffer() noexcept
+    {
+        freeGPUresources();
+    }
+
+    //////////////////////////////////////////
+
+    // true if the buffer is persistently mapped (ARB_buffer_storage)
+    bool Persistent() const
+    {
+        return this->mapped != nullptr;
+    }
+
+    // space for size bytes in the region of the current frame: it returns the pointer where the data must be written, and their offset
+    // in the buffer (aligned to alignment bytes). The data must be written before the call to Unmap, which must precede the draw calls reading them
+    void* Map(size_t size, size_t& dataOffset, size_t alignment = 16)
+    {
+        if (!this->inFrame)
+            this->beginFrame();
+        dataOffset = (this->offset + alignment - 1) / alignment * alignment;
+        if (dataOffset + size > (this->frame + 1) * this->frameSize)
+        {
+            // the data of the frame do not fit in the region: the regions are enlarged (see N.B. 1 above)
+            this->frameSize = max(2 * this->frameSize, size + alignment);
+            this->freeGPUresources();
+            this->create();
+            this->inFrame = true;
+            this->offset = this->frame * this->frameSize;
+            dataOffset = (this->offset + alignment - 1) / alignment * alignment;
+        }
+        this->offset = dataOffset + size;
+        if (this->mapped)
+            return this->mapped + dataOffset;
+        // without persistent mapping, only the range is mapped, and the driver does not wait for the GPU (the fences have already waited)
+        glBindBuffer(this->target, this->buffer);
+        return glMapBufferRange(this->target, dataOffset, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    }
+
+    // end of the writing of the data returned by the last call to Map
+    void Unmap()
+    {
+        // the persistent mapping is coherent: the writes are visible to the GPU without flushes
+        if (this->mapped)
+            return;
+        glUnmapBuffer(this->target);
+        glBindBuffer(this->target, 0);
+    }
+
+    // end of the frame: the fence is signaled when the GPU has executed all the commands reading the region of the frame
+    void EndFrame()
+    {
+        if (!this->inFrame)
+            return;
+        this->fences[this->frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        this->frame = (this->frame + 1) % RING_BUFFER_FRAMES;
+        this->inFrame = false;
+    }
+
+private:
+    GLenum target;
+    // size of a region, in bytes
+    size_t frameSize;
+    // address of the buffer, if persistently mapped
+    char* mapped;
+    // fences of the last frames written in the regions (0 if the region is free)
+    GLsync fences[RING_BUFFER_FRAMES];
+    // current region, and first free byte in the buffer
+    GLuint frame;
+    size_t offset;
+    bool inFrame;
+
+    //////////////////////////////////////////
+
+    // the CPU waits until the GPU has finished reading the region of the current frame
+    void beginFrame()
+    {
+        GLsync& fence = this->fences[this->frame];
+        if (fence)
+        {
+            GLenum result = glClientWaitSync(fence, 0, 0);
+            if (result == GL_TIMEOUT_EXPIRED)
+            {
+                this->stalls++;
+                // the flush bit makes sure that the fence is sent to the GPU, otherwise the wait could never end
+                while (result == GL_TIMEOUT_EXPIRED)
+                    result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+            }
+            glDeleteSync(fence);
+            fence = 0;
+        }
+        this->offset = this->frame * this->frameSize;
+        this->inFrame = true;
+    }
+
+    void create()
+    {
+        GLsizeiptr size = GLsizeiptr(RING_BUFFER_FRAMES * this->frameSize);
+        glGenBuffers(1, &this->buffer);
+        glBindBuffer(this->target, this->buffer);
+        if (BufferStorage())
+        {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            BufferStorage()(this->target, size, NULL, flags);
+            this->mapped = (char*)glMapBufferRange(this->target, 0, size, flags);
+        }
+        else
+            glBufferData(this->target, size, NULL, GL_STREAM_DRAW);
+        glBindBuffer(this->target, 0);
+    }
+
+    void freeGPUresources()
+    {
+        // If buffer is 0, this instance has been through a move, and no longer owns GPU resources
+        if (!this->buffer)
+            return;
+        // the fences guard the regions of this buffer: after its deletion they are not needed anymore
+        for (GLsync& fence : this->fences)
+        {
+            if (fence)
+                glDeleteSync(fence);
+            fence = 0;
+        }
+        if (this->mapped)
+        {
+            glBindBuffer(this->target, this->buffer);
+            glUnmapBuffer(this->target);
+            glBindBuffer(this->target, 0);
+            this->mapped = nullptr;
+        }
+        glDeleteBuffers(1, &this->buffer);
+        this->buffer = 0;
+    }
+};
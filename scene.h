@@ -0,0 +1,255 @@
+/*
+Scene class
+- container of the objects in the scene: each object is an instance of a Model, with its model matrix and its bounding box in world space
+- the objects are organized in a BVH (Bounding Volume Hierarchy): a binary tree where each node has the bounding box of all the objects in its subtree
+- at each frame, the objects outside the view frustum are discarded traversing the BVH (see bounds.h): if a node is outside the frustum,
+  all its subtree is skipped, and if it is completely inside, all its objects are visible without further tests
+
+BVH construction: top-down, the objects of a node are split in two halves at the median of their centers, along the longest axis of the box of the centers.
+The objects of a subtree are contiguous in the "order" vector, so each node (not only the leaves) has a range of objects, and the objects of
+a node inside the frustum are added to the visible list with a single copy.
+See Chapter 6 of "Real-Time Collision Detection" (C. Ericson, 2005) for details.
+
+N.B. 1)
+When an object moves, the BVH is not rebuilt: the box of the object leaf is recomputed, and the boxes of the nodes on the path from the leaf to the root
+are enlarged or shrunk to the union of the boxes of their children ("refit"). The structure of the tree does not change, so after many
+movements the tree could become less efficient (large overlapping boxes): in that case Rebuild can be called.
+The tree is built automatically at the first Update after the addition of objects.
+
+N.B. 2)
+The nodes are stored in a vector in depth-first order, so the index of a node is always smaller than the ones of its children:
+visiting the modified nodes in decreasing order, the children are always refitted before their parent.
+
+Real-Time Graphics Programming - a.a. 2022/2023
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <vector>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_inverse.hpp>
+
+#include <utils/bounds.h>
+#include <utils/model.h>
+// InstanceData struct
+#include <utils/transform_store.h>
+
+// maximum number of objects in a leaf of the BVH
+#define BVH_LEAF_SIZE 4
+
+// an instance of a Model in the scene
+struct SceneObject {
+    Model* model;
+    // model and normal matrices
+    InstanceData instance;
+    // bounding box of the model transformed by the model matrix
+    AABB worldBounds;
+    // LOD selected in the previous frame (needed for the hysteresis in Model::SelectLOD)
+    GLint lod;
+    // leaf of the BVH containing the object
+    GLint leaf;
+};
+
+/////////////////// SCENE class ///////////////////////
+class Scene
+{
+public:
+    vector<SceneObject> objects;
+    // number of BVH nodes tested against the frustum, and number of visible objects, in the last call to Cull
+    GLuint testedNodes, visibleObjects;
+
+    Scene() : testedNodes(0), visibleObjects(0), rebuild(false) {}
+
+    // addition of an instance of the model: it returns the index of the object
+    // the model must be valid until the object is used for rendering
+    GLuint Add(Model& model, const glm::mat4& modelMatrix)
+    {
+        this->objects.push_back({ &model, { modelMatrix, glm::inverseTranspose(glm::mat3(modelMatrix)) }, model.bounds.Transform(modelMatrix), 0, -1 });
+        this->rebuild = true;
+        return GLuint(this->objects.size() - 1);
+    }
+
+    // removal of the last object added: the BVH is built again at the next call to Update
+    void RemoveLast()
+    {
+        if (this->objects.empty())
+            return;
+        this->objects.pop_back();
+        this->rebuild = true;
+    }
+
+    // new model matrix of an object: the BVH is updated at the next call to Update
+    void SetTransform(GLuint object, const glm::mat4& modelMatrix)
+    {
+        this->SetTransform(object, { modelMatrix, glm::inverseTranspose(glm::mat3(modelMatrix)) });
+    }
+
+    // as above, with the model and normal matrices already computed (e.g., by a TransformStore, see transform_store.h)
+    void SetTransform(GLuint object, const InstanceData& instance)
+    {
+        SceneObject& sceneObject = this->objects[object];
+        sceneObject.instance = instance;
+        sceneObject.worldBounds = sceneObject.model->bounds.Transform(instance.modelMatrix);
+        if (sceneObject.leaf >= 0)
+            this->markModified(sceneObject.leaf);
+    }
+
+    // the BVH is built (if objects have been added) or refitted (if objects have been moved, see N.B. 1 above)
+    void Update()
+    {
+        if (this->rebuild)
+        {
+            this->Rebuild();
+            return;
+        }
+        // the children have greater indices than their parent (see N.B. 2 above)
+        sort(this->modifiedNodes.begin(), this->modifiedNodes.end(), greater<GLint>());
+        for (GLint index : this->modifiedNodes)
+        {
+            BVHNode& node = this->nodes[index];
+            node.bounds = AABB();
+            if (node.left < 0)
+                for (GLuint i = node.first; i < node.first + node.count; i++)
+                    node.bounds.Expand(this->objects[this->order[i]].worldBounds);
+            else
+            {
+                node.bounds.Expand(this->nodes[node.left].bounds);
+                node.bounds.Expand(this->nodes[node.right].bounds);
+            }
+            node.modified = false;
+        }
+        this->modifiedNodes.clear();
+    }
+
+    // construction of the BVH from scratch
+    void Rebuild()
+    {
+        this->nodes.clear();
+        this->modifiedNodes.clear();
+        this->order.resize(this->objects.size());
+        for (GLuint i = 0; i < this->order.size(); i++)
+            this->order[i] = i;
+        if (!this->objects.empty())
+            this->build(0, GLuint(this->objects.size()), -1);
+        this->rebuild = false;
+    }
+
+    // indices of the objects (at least partially) inside the frustum defined by the projection * view matrix
+    // the bounding boxes are enlarged by the margin (in world space), if the vertices are moved by the shaders
+    void Cull(const glm::mat4& projectionView, vector<GLuint>& visible, float margin = 0.0f)
+    {
+        visible.clear();
+        this->testedNodes = 0;
+        if (!this->nodes.empty())
+        {
+            Frustum frustum(projectionView);
+            // iterative traversal of the tree, with an explicit stack
+            this->stack.clear();
+            this->stack.push_back(0);
+            while (!this->stack.empty())
+            {
+                const BVHNode& node = this->nodes[this->stack.back()];
+                this->stack.pop_back();
+                this->testedNodes++;
+                FrustumTest test = frustum.Test(node.bounds, margin);
+                if (test == OUTSIDE_FRUSTUM)
+                    continue;
+                if (test == INSIDE_FRUSTUM)
+                    visible.insert(visible.end(), this->order.begin() + node.first, this->order.begin() + node.first + node.count);
+                else if (node.left < 0)
+                {
+                    // leaf intersecting the frustum: we test each object
+                    for (GLuint i = node.first; i < node.first + node.count; i++)
+                        if (frustum.Test(this->objects[this->order[i]].worldBounds, margin) != OUTSIDE_FRUSTUM)
+                            visible.push_back(this->order[i]);
+                }
+                else
+                {
+                    this->stack.push_back(node.left);
+                    this->stack.push_back(node.right);
+                }
+            }
+        }
+        this->visibleObjects = GLuint(visible.size());
+    }
+
+private:
+    // a node of the BVH: the objects of the node are order[first] ... order[first + count - 1]. For the leaves, left and right are -1
+    struct BVHNode {
+        AABB bounds;
+        GLint parent, left, right;
+        GLuint first, count;
+        // true if the node is in the modifiedNodes list
+        bool modified;
+    };
+
+    vector<BVHNode> nodes;
+    // indices of the objects, in the order of the leaves of the BVH
+    vector<GLuint> order;
+    // nodes to refit at the next Update
+    vector<GLint> modifiedNodes;
+    // stack of the nodes to visit during Cull
+    vector<GLint> stack;
+    // true if objects have been added after the last construction of the BVH
+    bool rebuild;
+
+    //////////////////////////////////////////
+
+    // recursive construction of the node with the objects order[first] ... order[first + count - 1]. It returns the index of the node
+    GLint build(GLuint first, GLuint count, GLint parent)
+    {
+        GLint index = GLint(this->nodes.size());
+        this->nodes.push_back({ AABB(), parent, -1, -1, first, count, false });
+
+        AABB bounds, centers;
+        for (GLuint i = first; i < first + count; i++)
+        {
+            const AABB& objectBounds = this->objects[this->order[i]].worldBounds;
+            bounds.Expand(objectBounds);
+            centers.Expand(objectBounds.Center());
+        }
+        this->nodes[index].bounds = bounds;
+
+        if (count <= BVH_LEAF_SIZE)
+        {
+            for (GLuint i = first; i < first + count; i++)
+                this->objects[this->order[i]].leaf = index;
+            return index;
+        }
+
+        // split at the median along the longest axis of the box of the centers
+        glm::vec3 size = centers.max - centers.min;
+        int axis = (size.x >= size.y && size.x >= size.z) ? 0 : (size.y >= size.z ? 1 : 2);
+        GLuint middle = first + count / 2;
+        nth_element(this->order.begin() + first, this->order.begin() + middle, this->order.begin() + first + count, [this, axis](GLuint a, GLuint b)
+        {
+            return this->objects[a].worldBounds.Center()[axis] < this->objects[b].worldBounds.Center()[axis];
+        });
+
+        // the vector of the nodes can be reallocated by the recursive calls, so we do not keep references to its elements
+        GLint left = this->build(first, middle - first, index);
+        GLint right = this->build(middle, first + count - middle, index);
+        this->nodes[index].left = left;
+        this->nodes[index].right = right;
+        return index;
+    }
+
+    // the node and its ancestors are added to the list of the nodes to refit
+    void markModified(GLint index)
+    {
+        // if a node is already in the list, its ancestors are in the list too
+        while (index >= 0 && !this->nodes[index].modified)
+        {
+            this->nodes[index].modified = true;
+            this->modifiedNodes.push_back(index);
+            index = this->nodes[index].parent;
+        }
+    }
+};
@@ -0,0 +1,488 @@
+/*
+Shader class
+- loading Shader source code, Shader Program creation
+- the optional tessellation control and evaluation stages are compiled and attached only if their paths are provided
+- active uniforms are reflected once after linking and stored in a table of locations, so the application never calls glGetUniformLocation inside the rendering loop
+- if a ProgramCache is provided, the linked program is restored from its binary saved at the previous launch (see program_cache.h)
+
+N.B. 1) uniform blocks are not reflected in the table: they are connected to the shared binding points with BindUniformBlock (see uniform_buffer.h)
+
+N.B. 2) adaptation of https://github.com/JoeyDeVries/LearnOpenGL/blob/master/includes/learnopengl/shader.h
+
+N.B. 3)
+The constructor does not wait for the end of compilation and linking: the errors are checked, and the uniforms are reflected, in Finalize,
+which is called automatically by Use. If the driver supports KHR_parallel_shader_compile (see EnableParallelShaderCompile below), the programs
+created in sequence are compiled by the driver in background threads, and IsReady tells (without waiting) if a program can be finalized.
+So the application waits only for the program it actually uses, while the others are still compiled.
+Without the extension, IsReady always returns true, and Finalize waits for the driver as usual.
+The uniform block bindings and the texture units of the samplers set before Finalize are stored, and they are applied after linking.
+
+N.B. 4)
+ShaderPermutations manages the specialized versions ("permutations") of a Shader Program: the same source code is compiled with a set of #define
+for the exact number of lights (NR_LIGHTS) and for the features known on CPU side (ShaderFeature), so the compiler can unroll the loops on the lights
+and skip the code of the disabled features. Without NR_LIGHTS, the shaders evaluate the lights of the cluster of the fragment (see light_clusters.h).
+Each permutation is compiled the first time it is requested, and until it is ready the generic program is used in its place
+(except for the G-buffer permutations of deferred shading, which write different outputs, see gbuffer.h).
+
+based on the Shader class developed during lab lectures (Davide Gadia)
+
+Real-Time Graphics Programming - a.a. 2022/2023
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <functional>
+#include <cstring>
+
+#include <utils/program_cache.h>
+// redundant glUseProgram calls are skipped
+#include <utils/gl_state.h>
+
+// KHR_parallel_shader_compile is not part of the OpenGL 4.1 core headers: we define the token and the function type
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+typedef void (APIENTRYP MaxShaderCompilerThreadsProc)(GLuint count);
+
+// true if the driver compiles the Shader Programs in background threads
+inline bool& ParallelShaderCompile()
+{
+    static bool enabled = false;
+    return enabled;
+}
+
+// if KHR_parallel_shader_compile (or the equivalent ARB extension) is supported, we let the driver use all the threads it wants for compilation.
+// It must be called after the creation of the OpenGL context, with the loader of the OpenGL functions (e.g., glfwGetProcAddress)
+inline bool EnableParallelShaderCompile(GLADloadproc loader)
+{
+    const char* extensions[2][2] = { { "GL_KHR_parallel_shader_compile", "glMaxShaderCompilerThreadsKHR" },
+                                     { "GL_ARB_parallel_shader_compile", "glMaxShaderCompilerThreadsARB" } };
+    GLint nExtensions = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &nExtensions);
+    for (GLint i = 0; i < nExtensions && !ParallelShaderCompile(); i++)
+    {
+        const char* name = (const char*)glGetStringi(GL_EXTENSIONS, i);
+        for (const auto& extension : extensions)
+        {
+            if (strcmp(name, extension[0]) != 0)
+                continue;
+            // 0xFFFFFFFF: the number of threads is chosen by the driver
+            MaxShaderCompilerThreadsProc maxThreads = (MaxShaderCompilerThreadsProc)loader(extension[1]);
+            if (maxThreads)
+                maxThreads(0xFFFFFFFF);
+            ParallelShaderCompile() = true;
+            break;
+        }
+    }
+    return ParallelShaderCompile();
+}
+
+/////////////////// SHADER class ///////////////////////
+class Shader
+{
+public:
+    // Shader Program identifier
+    GLuint Program;
+
+    //////////////////////////////////////////
+
+    // constructor: tessellation stages are used only if both paths are provided
+    // the program is restored from the cache if possible, otherwise it is compiled and linked (without waiting for the result, see N.B. 3 above)
+    // the defines (e.g. "NR_LIGHTS 2") are added to the source code of all the stages, after the #version directive (see N.B. 4 above)
+    Shader(const GLchar* vertexPath, const GLchar* fragmentPath, const GLchar* tessControlPath = nullptr, const GLchar* tessEvaluationPath = nullptr,
+           ProgramCache* cache = nullptr, const vector<string>& defines = {})
+        : cache(cache), pending(true), cacheKey(0), sourceHash(0)
+    {
+        // Step 1: we retrieve shaders source code from provided filepaths
+        vector<ShaderStage> stages = { { GL_VERTEX_SHADER, vertexPath, "VERTEX" }, { GL_FRAGMENT_SHADER, fragmentPath, "FRAGMENT" } };
+        if (tessControlPath != nullptr && tessEvaluationPath != nullptr)
+        {
+            stages.push_back({ GL_TESS_CONTROL_SHADER, tessControlPath, "TESS_CONTROL" });
+            stages.push_back({ GL_TESS_EVALUATION_SHADER, tessEvaluationPath, "TESS_EVALUATION" });
+        }
+        for (ShaderStage& stage : stages)
+        {
+            stage.code = this->injectDefines(this->readSource(stage.path), defines);
+            this->cacheKey = HashString(stage.path, this->cacheKey);
+            this->sourceHash = HashString(stage.code, this->sourceHash);
+        }
+        // each permutation has its own cache file
+        for (const string& define : defines)
+            this->cacheKey = HashString(define, this->cacheKey);
+
+        // Step 2: we create the Shader Program, and we try to restore it from the cache
+        this->Program = glCreateProgram();
+        if (this->cache && this->cache->Load(this->Program, this->cacheKey, this->sourceHash))
+        {
+            // the program is already linked, so it must not be saved again
+            this->cache = nullptr;
+            return;
+        }
+
+        // Step 3: we compile the shaders, we attach them and we link the program. The errors are checked in Finalize
+        for (ShaderStage& stage : stages)
+        {
+            const GLchar* shaderCode = stage.code.c_str();
+            GLuint shader = glCreateShader(stage.type);
+            glShaderSource(shader, 1, &shaderCode, NULL);
+            glCompileShader(shader);
+            glAttachShader(this->Program, shader);
+            this->compiledShaders.push_back({ shader, stage.typeName });
+        }
+        // the binary of the program must be retrievable, to save it in the cache
+        if (this->cache)
+            glProgramParameteri(this->Program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(this->Program);
+    }
+
+    //////////////////////////////////////////
+
+    // true if the program can be finalized without waiting for the driver (see N.B. 3 above)
+    bool IsReady() const
+    {
+        if (!this->pending || !ParallelShaderCompile())
+            return true;
+        GLint completed = GL_FALSE;
+        glGetProgramiv(this->Program, GL_COMPLETION_STATUS_KHR, &completed);
+        return completed == GL_TRUE;
+    }
+
+    // we check compilation and linking errors, we save the program in the cache, we build the table of the active uniforms,
+    // and we apply the uniform block bindings and the texture units set so far. If the driver is still compiling, we wait for it
+    void Finalize()
+    {
+        if (!this->pending)
+            return;
+        this->pending = false;
+
+        // the shaders are not needed anymore after linking
+        for (const auto& shader : this->compiledShaders)
+        {
+            this->checkCompileErrors(shader.first, shader.second);
+            glDeleteShader(shader.first);
+        }
+        this->compiledShaders.clear();
+        GLint success = this->checkCompileErrors(this->Program, "PROGRAM");
+        if (success && this->cache)
+            this->cache->Save(this->Program, this->cacheKey, this->sourceHash);
+        this->cache = nullptr;
+
+        this->reflectUniforms();
+        for (const auto& binding : this->blockBindings)
+            this->BindUniformBlock(binding.first.c_str(), binding.second);
+        this->blockBindings.clear();
+        for (const auto& sampler : this->samplerUnits)
+            this->SetSampler(sampler.first, sampler.second);
+        this->samplerUnits.clear();
+    }
+
+    //////////////////////////////////////////
+
+    // We activate the Shader Program as part of the current rendering process
+    void Use()
+    {
+        this->Finalize();
+        GLState().UseProgram(this->Program);
+    }
+
+    // We delete the Shader Program when application closes
+    void Delete()
+    {
+        for (const auto& shader : this->compiledShaders)
+            glDeleteShader(shader.first);
+        this->compiledShaders.clear();
+        glDeleteProgram(this->Program);
+        GLState().ForgetProgram(this->Program);
+    }
+
+    //////////////////////////////////////////
+
+    // returns the cached location of a uniform, or -1 if the uniform is not active in the Shader Program
+    // (like glGetUniformLocation, a -1 location is silently ignored by the glUniform* calls)
+    // Array uniforms can be retrieved both with their base name ("name") and with the first element name ("name[0]")
+    GLint getUniformLocation(const string& name) const
+    {
+        auto it = this->uniformLocations.find(name);
+        return (it != this->uniformLocations.end()) ? it->second : -1;
+    }
+
+    // we connect a uniform block of the Shader Program to one of the shared binding points
+    // if the block is not used by the program, the call is skipped. Before Finalize, the binding is stored and applied after linking
+    void BindUniformBlock(const GLchar* blockName, GLuint bindingPoint)
+    {
+        if (this->pending)
+        {
+            this->blockBindings.push_back({ blockName, bindingPoint });
+            return;
+        }
+        GLuint blockIndex = glGetUniformBlockIndex(this->Program, blockName);
+        if (blockIndex != GL_INVALID_INDEX)
+            glUniformBlockBinding(this->Program, blockIndex, bindingPoint);
+    }
+
+    // we assign a texture unit to a sampler of the Shader Program (the program does not need to be in use).
+    // Before Finalize, the unit is stored and assigned after linking
+    void SetSampler(const string& name, GLint unit)
+    {
+        if (this->pending)
+            this->samplerUnits.push_back({ name, unit });
+        else
+            glProgramUniform1i(this->Program, this->getUniformLocation(name), unit);
+    }
+
+private:
+    // a stage of the Shader Program
+    struct ShaderStage {
+        GLenum type;
+        const GLchar* path;
+        string typeName;
+        string code;
+    };
+
+    // table of the active uniforms, filled once after linking
+    unordered_map<string, GLint> uniformLocations;
+    // cache where the program is saved after linking (nullptr if the program has been restored from the cache)
+    ProgramCache* cache;
+    // true until Finalize is called
+    bool pending;
+    // hash of the paths of the stages (name of the cache file) and hash of their source code
+    uint64_t cacheKey, sourceHash;
+    // shaders attached to the program, with their type names for the error messages
+    vector<pair<GLuint, string>> compiledShaders;
+    // uniform block bindings and texture units set before Finalize
+    vector<pair<string, GLuint>> blockBindings;
+    vector<pair<string, GLint>> samplerUnits;
+
+    //////////////////////////////////////////
+
+    // we read the source code from file
+    string readSource(const GLchar* path)
+    {
+        string code;
+        ifstream shaderFile;
+        // ensure ifstream objects can throw exceptions
+        shaderFile.exceptions(ifstream::failbit | ifstream::badbit);
+        try
+        {
+            shaderFile.open(path);
+            stringstream shaderStream;
+            shaderStream << shaderFile.rdbuf();
+            shaderFile.close();
+            code = shaderStream.str();
+        }
+        catch (ifstream::failure& e)
+        {
+            cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << path << endl;
+        }
+        return code;
+    }
+
+    //////////////////////////////////////////
+
+    // we add a #define line for each define after the #version directive, which must be the first line of the source code.
+    // The #line directive restores the original line numbers in the error messages
+    string injectDefines(const string& code, const vector<string>& defines)
+    {
+        if (defines.empty())
+            return code;
+        string::size_type version = code.find("#version");
+        if (version == string::npos)
+            return code;
+        string::size_type lineEnd = code.find('\n', version);
+        if (lineEnd == string::npos)
+            lineEnd = code.size();
+        // number of the line following #version
+        long nextLine = long(count(code.begin(), code.begin() + lineEnd, '\n')) + 2;
+
+        string injected = code.substr(0, lineEnd) + "\n";
+        for (const string& define : defines)
+            injected += "#define " + define + "\n";
+        injected += "#line " + to_string(nextLine) + "\n";
+        if (lineEnd < code.size())
+            injected += code.substr(lineEnd + 1);
+        return injected;
+    }
+
+    //////////////////////////////////////////
+
+    // we query the linked program for all its active uniforms (uniforms inside blocks excluded), and we store their locations
+    void reflectUniforms()
+    {
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(this->Program, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(this->Program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        vector<GLchar> nameBuffer(max(maxLength, 1));
+
+        for (GLint i = 0; i < count; i++)
+        {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type;
+            glGetActiveUniform(this->Program, (GLuint)i, maxLength, &length, &size, &type, nameBuffer.data());
+            string name(nameBuffer.data(), length);
+
+            // uniforms stored in a block have location -1: they are managed through uniform buffers
+            GLint location = glGetUniformLocation(this->Program, name.c_str());
+            if (location < 0)
+                continue;
+
+            this->uniformLocations[name] = location;
+            // for arrays, the driver reports the name of the first element ("name[0]"):
+            // we store the base name too, and the locations of the other elements
+            string::size_type bracket = name.find('[');
+            if (bracket != string::npos)
+            {
+                string baseName = name.substr(0, bracket);
+                this->uniformLocations[baseName] = location;
+                for (GLint j = 1; j < size; j++)
+                {
+                    string elementName = baseName + "[" + to_string(j) + "]";
+                    this->uniformLocations[elementName] = glGetUniformLocation(this->Program, elementName.c_str());
+                }
+            }
+        }
+    }
+
+    //////////////////////////////////////////
+
+    // Check compilation and linking errors. It returns the compile (or link) status
+    GLint checkCompileErrors(GLuint shader, const string& type)
+    {
+        GLint success;
+        GLchar infoLog[1024];
+        if (type != "PROGRAM")
+        {
+            glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+            if (!success)
+            {
+                glGetShaderInfoLog(shader, 1024, NULL, infoLog);
+                cout << "| ERROR::SHADER: Shader-Compilation-Error of type: " << type << "|\n" << infoLog << "\n| -- --------------------------------------------------- -- |" << endl;
+            }
+        }
+        else
+        {
+            glGetProgramiv(shader, GL_LINK_STATUS, &success);
+            if (!success)
+            {
+                glGetProgramInfoLog(shader, 1024, NULL, infoLog);
+                cout << "| ERROR::Shader: Program-Linking-Error of type: " << type << "|\n" << infoLog << "\n| -- --------------------------------------------------- -- |" << endl;
+            }
+        }
+        return success;
+    }
+};
+
+// features of the scene which select a permutation, besides the number of lights (the values are bit flags)
+enum ShaderFeature {
+    // the material does not repeat the textures (repeat == 1): the shaders use the UVs directly
+    UNIT_REPEAT_FEATURE = 1,
+    // geometry pass of deferred shading: the fragment shaders write the G-buffer instead of the lit color (see gbuffer.h)
+    GBUFFER_OUTPUT_FEATURE = 2,
+    // the height map is a cone step map, and parallax mapping uses cone stepping instead of the linear search (see cone_step_map.h)
+    CONE_STEP_FEATURE = 4
+};
+
+/////////////////// SHADERPERMUTATIONS class ///////////////////////
+// set of the permutations of a Shader Program (see N.B. 4 above)
+class ShaderPermutations
+{
+public:
+    // the setup function is called on every permutation after its creation (e.g., to bind the uniform blocks)
+    ShaderPermutations(const GLchar* vertexPath, const GLchar* fragmentPath, const GLchar* tessControlPath = nullptr, const GLchar* tessEvaluationPath = nullptr,
+                       ProgramCache* cache = nullptr, function<void(Shader&)> setup = nullptr)
+        : paths{ vertexPath, fragmentPath, tessControlPath ? tessControlPath : "", tessEvaluationPath ? tessEvaluationPath : "" },
+          cache(cache), setup(setup), generic(this->create({}))
+    {}
+
+    // the program compiled without defines, valid for any number of lights and any feature
+    Shader& Generic()
+    {
+        return this->generic;
+    }
+
+    // the permutation for the given number of lights and features (bit flags of ShaderFeature). If nLights is negative, the permutation
+    // is not specialized on the number of lights (the lights are read from the clusters, see light_clusters.h).
+    // If it has never been requested, its compilation starts now; until it is ready, the generic program is returned
+    // (unless wait is true: e.g., the replay of an input log must render the same frames at each run, see input_log.h)
+    Shader& Select(GLint nLights, GLuint features, bool wait = false)
+    {
+        GLuint key = (features << 16) | GLuint(max(nLights, -1) + 1);
+        auto it = this->permutations.find(key);
+        if (it == this->permutations.end())
+        {
+            vector<string> defines;
+            if (nLights >= 0)
+                defines.push_back("NR_LIGHTS " + to_string(nLights));
+            if (features & UNIT_REPEAT_FEATURE)
+                defines.push_back("UNIT_REPEAT");
+            if (features & GBUFFER_OUTPUT_FEATURE)
+                defines.push_back("GBUFFER_OUTPUT");
+            if (features & CONE_STEP_FEATURE)
+                defines.push_back("CONE_STEP_MAPPING");
+            it = this->permutations.emplace(key, this->create(defines)).first;
+        }
+        // the G-buffer permutation has different outputs, so the generic program cannot replace it: in that case we wait for the compilation
+        if (!wait && !it->second.IsReady() && !(features & GBUFFER_OUTPUT_FEATURE))
+            return this->generic;
+        it->second.Finalize();
+        return it->second;
+    }
+
+    // we finalize all the programs already compiled by the driver
+    void Update()
+    {
+        if (this->generic.IsReady())
+            this->generic.Finalize();
+        for (auto& permutation : this->permutations)
+            if (permutation.second.IsReady())
+                permutation.second.Finalize();
+    }
+
+    // number of programs (generic included)
+    size_t Size() const
+    {
+        return this->permutations.size() + 1;
+    }
+
+    // We delete all the Shader Programs when application closes
+    void Delete()
+    {
+        this->generic.Delete();
+        for (auto& permutation : this->permutations)
+            permutation.second.Delete();
+        this->permutations.clear();
+    }
+
+private:
+    // paths of the stages (empty strings if tessellation is not used)
+    string paths[4];
+    ProgramCache* cache;
+    function<void(Shader&)> setup;
+    Shader generic;
+    // permutations, with key (features << 16) | (number of lights + 1)
+    unordered_map<GLuint, Shader> permutations;
+
+    //////////////////////////////////////////
+
+    Shader create(const vector<string>& defines)
+    {
+        bool tessellation = !this->paths[2].empty() && !this->paths[3].empty();
+        Shader shader(this->paths[0].c_str(), this->paths[1].c_str(), tessellation ? this->paths[2].c_str() : nullptr, tessellation ? this->paths[3].c_str() : nullptr,
+                      this->cache, defines);
+        if (this->setup)
+            this->setup(shader);
+        return shader;
+    }
+};
@@ -1,49 +1,119 @@
-#version 410 core
-
-// number of lights in the scene
-#define MAX_NR_LIGHTS 5
-
-out vec4 colorFrag;
-
-uniform vec3 ambientColor;
-uniform vec3 specularColor;
-uniform float Ka;
-uniform float Kd;
-uniform float Ks;
-uniform float shininess;
-uniform int repeat;
-uniform int nLights; //actual number of lights in the scene
-
-in vec2 UV;
-in vec3 normal;
-in vec3 lightDir[MAX_NR_LIGHTS];
-in vec3 viewDir;
-
-uniform sampler2D diffuseMap;
-
-void main(){
-
-    vec2 repeated_UV = mod(UV * repeat, 1.0);
-    vec3 color = Ka * ambientColor;
-    vec3 N = normalize(normal);
-    vec3 surface = texture(diffuseMap, repeated_UV).rgb;
-
-    //for all the lights in the scene
-    for(int i=0; i<nLights; i++){
-
-        vec3 L = normalize(lightDir[i]);
-        float lambertian = max(dot(L,N), 0.0);
-
-        // if the lambert coefficient is positive, then I can calculate the specular component
-        if(lambertian > 0.0)
-        { 
-            vec3 V = normalize(viewDir);
-            vec3 H = normalize(L + V);
-            float specAngle = max(dot(H, N), 0.0);
-            float specular = pow(specAngle, shininess);
-            color += vec3( Kd * lambertian * surface + Ks * specular * specularColor);
-        }
-    }
-    
-    colorFrag = vec4(color, 1.0);
+#version 410 core
+
+// in the permutations specialized on the number of lights (see ShaderPermutations in shader.h), NR_LIGHTS is defined before compilation:
+// all the lights are evaluated in a loop with a constant bound (so it is unrolled). Otherwise, only the lights in the list of the cluster
+// containing the fragment are evaluated (clustered forward lighting, see light_clusters.h)
+#ifdef NR_LIGHTS
+    #define LIGHTS_COUNT NR_LIGHTS
+    #define LIGHT_INDEX(i) (i)
+#else
+    #define LIGHTS_COUNT int(cluster.y)
+    #define LIGHT_INDEX(i) int(texelFetch(clusterLightIndices, int(cluster.x) + (i)).r)
+#endif
+
+#ifdef GBUFFER_OUTPUT
+// geometry pass of deferred shading (see gbuffer.h): the parameters of the surface are written in the G-buffer, without lighting
+layout (location = 0) out vec4 gAlbedoSpecular;
+layout (location = 1) out vec4 gNormalShininess;
+#else
+out vec4 colorFrag;
+#endif
+
+// camera uniform block, shared by all the Shader Programs
+layout (std140) uniform Camera
+{
+    mat4 projectionMatrix;
+    mat4 viewMatrix;
+    vec3 viewPosition;
+};
+
+// lights uniform block, shared by all the Shader Programs: parameters of the grid of clusters (see LightsBlock in uniform_buffer.h)
+layout (std140) uniform Lights
+{
+    ivec4 clusterGrid;  //number of clusters along x, y, z
+    vec4 clusterScale;  //size of a tile in pixels (xy), scale and bias of the slice index (zw)
+    int nLights;  //actual number of lights in the scene
+};
+
+// Blinn-Phong material uniform block, shared by all the Shader Programs
+layout (std140) uniform Material
+{
+    vec3 ambientColor;
+    float Ka;
+    vec3 specularColor;
+    float Kd;
+    float Ks;
+    float shininess;
+    int repeat;
+    float height_scale;
+};
+
+in vec2 UV;
+in vec3 normal;
+in vec3 fragPos;
+in vec3 viewDir;
+
+uniform sampler2D diffuseMap;
+
+// lights (2 texels for each light: position and radius, color) and lists of lights of the clusters (see light_clusters.h)
+uniform samplerBuffer lightData;
+uniform usamplerBuffer clusterData;
+uniform usamplerBuffer clusterLightIndices;
+
+// attenuation of a light: it goes smoothly to zero at the radius of the light
+float attenuation(float distance, float radius)
+{
+    float x = distance / radius;
+    float window = clamp(1.0 - x * x * x * x, 0.0, 1.0);
+    return window * window;
+}
+
+// offset in clusterLightIndices, and number of lights, of the list of the cluster containing the fragment (world space position)
+uvec2 clusterLights(vec3 position)
+{
+    float depth = -(viewMatrix * vec4(position, 1.0)).z;
+    ivec3 cluster = ivec3(ivec2(gl_FragCoord.xy / clusterScale.xy), int(floor(log(depth) * clusterScale.z + clusterScale.w)));
+    cluster = clamp(cluster, ivec3(0), clusterGrid.xyz - 1);
+    return texelFetch(clusterData, (cluster.z * clusterGrid.y + cluster.y) * clusterGrid.x + cluster.x).rg;
+}
+
+void main(){
+
+#ifdef UNIT_REPEAT
+    // permutation specialized for repeat == 1 (see ShaderPermutations in shader.h): the UVs are used directly
+    vec2 repeated_UV = UV;
+#else
+    vec2 repeated_UV = mod(UV * repeat, 1.0);
+#endif
+    vec3 color = Ka * ambientColor;
+    vec3 N = normalize(normal);
+    vec3 surface = texture(diffuseMap, repeated_UV).rgb;
+
+#ifdef GBUFFER_OUTPUT
+    gAlbedoSpecular = vec4(Kd * surface, Ks);
+    gNormalShininess = vec4(N, shininess);
+#else
+    //for all the lights affecting the fragment
+    uvec2 cluster = clusterLights(fragPos);
+    for(int i=0; i<LIGHTS_COUNT; i++){
+
+        int light = LIGHT_INDEX(i);
+        vec4 lightPosition = texelFetch(lightData, 2 * light);  //xyz = position, w = radius
+        vec3 lightColor = texelFetch(lightData, 2 * light + 1).rgb;
+        vec3 lightVector = lightPosition.xyz - fragPos;
+        float lightAttenuation = attenuation(length(lightVector), lightPosition.w);
+        vec3 L = normalize(lightVector);
+        float lambertian = max(dot(L,N), 0.0);
+
+        // the specular component is added only if the lambert coefficient is positive: we use a selection instead of a branch,
+        // so the loop has no divergent flow control
+        vec3 V = normalize(viewDir);
+        vec3 H = normalize(L + V);
+        float specAngle = max(dot(H, N), 0.0);
+        float specular = (lambertian > 0.0) ? pow(specAngle, shininess) : 0.0;
+        color += lightAttenuation * lightColor * (Kd * lambertian * surface + Ks * specular * specularColor);
+    }
+    
+    colorFrag = vec4(color, 1.0);
+#endif
 }
\ No newline at end of file
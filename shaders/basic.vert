@@ -1,36 +1,48 @@
-#version 410 core
-
-// number of lights in the scene
-#define MAX_NR_LIGHTS 5
-
-layout (location = 0) in vec3 aPosition;
-layout (location = 1) in vec3 aNormal;
-layout (location = 2) in vec2 aUV;
-
-uniform mat4 modelMatrix;
-uniform mat4 viewMatrix;
-uniform mat4 projectionMatrix;
-uniform mat3 normalMatrix;
-uniform int nLights;  //actual number of lights in the scene
-
-uniform vec3 pointLightPosition[MAX_NR_LIGHTS];
-uniform vec3 viewPosition; 
-
-out vec2 UV;
-out vec3 normal;
-out vec3 lightDir[MAX_NR_LIGHTS];
-out vec3 viewDir;
-
-void main(){
-  vec4 fragPos = modelMatrix * vec4( aPosition, 1.0 );  //apply model transformations -> fragment position in world space
-  normal = normalize( normalMatrix * aNormal );         //transform normal in world space
-  
-  //for all the lights in the scene
-  for(int i=0; i<nLights; i++){
-    lightDir[i] = normalize(pointLightPosition[i] - fragPos.xyz);   //calculate light direction in world space
-  } 
-  
-  viewDir = normalize(viewPosition - fragPos.xyz);    //calculate view direction in world space
-  UV = aUV;
-  gl_Position = projectionMatrix * viewMatrix * fragPos;  //apply project-view trasformation
-}
+#version 410 core
+
+// with the packed vertex format (see mesh.h), the xy components of aNormal contain the octahedral encoding of the normal
+layout (location = 0) in vec3 aPosition;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aUV;
+
+// per-instance model and normal matrices, read from the instance buffer (see batch_renderer.h)
+layout (location = 5) in mat4 modelMatrix;
+layout (location = 9) in mat3 normalMatrix;
+
+// true if the mesh uses the packed vertex format
+uniform bool packedVertex;
+
+// decoding of a direction with octahedral encoding (see OctahedralEncode in mesh.h)
+vec3 octahedralDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    // the lower half of the octahedron was folded on the upper one
+    float t = max(-n.z, 0.0);
+    n.x += (n.x >= 0.0) ? -t : t;
+    n.y += (n.y >= 0.0) ? -t : t;
+    return normalize(n);
+}
+
+// camera uniform block, shared by all the Shader Programs
+layout (std140) uniform Camera
+{
+    mat4 projectionMatrix;
+    mat4 viewMatrix;
+    vec3 viewPosition;
+};
+
+out vec2 UV;
+out vec3 normal;
+out vec3 fragPos;
+out vec3 viewDir;
+
+void main(){
+  vec4 worldPos = modelMatrix * vec4( aPosition, 1.0 );  //apply model transformations -> fragment position in world space
+  vec3 vNormal = packedVertex ? octahedralDecode(aNormal.xy) : aNormal;  //decode normal if the vertex format is packed
+  normal = normalize( normalMatrix * vNormal );         //transform normal in world space
+  // the light directions are computed in the fragment shader, for the lights of the cluster of the fragment (see light_clusters.h)
+  fragPos = worldPos.xyz;
+  viewDir = normalize(viewPosition - worldPos.xyz);    //calculate view direction in world space
+  UV = aUV;
+  gl_Position = projectionMatrix * viewMatrix * worldPos;  //apply project-view trasformation
+}
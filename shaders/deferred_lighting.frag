@@ -0,0 +1,118 @@
+#version 410 core
+
+// lighting pass of deferred shading (see gbuffer.h): the Blinn-Phong model is computed once per pixel, with the parameters of the surface
+// read from the G-buffer. As in the forward shaders, the permutations specialized on the number of lights (see ShaderPermutations in shader.h)
+// evaluate all the lights, otherwise only the lights in the list of the cluster containing the pixel are evaluated (see light_clusters.h)
+#ifdef NR_LIGHTS
+    #define LIGHTS_COUNT NR_LIGHTS
+    #define LIGHT_INDEX(i) (i)
+#else
+    #define LIGHTS_COUNT int(cluster.y)
+    #define LIGHT_INDEX(i) int(texelFetch(clusterLightIndices, int(cluster.x) + (i)).r)
+#endif
+
+out vec4 colorFrag;
+
+// camera uniform block, shared by all the Shader Programs
+layout (std140) uniform Camera
+{
+    mat4 projectionMatrix;
+    mat4 viewMatrix;
+    vec3 viewPosition;
+};
+
+// lights uniform block, shared by all the Shader Programs: parameters of the grid of clusters (see LightsBlock in uniform_buffer.h)
+layout (std140) uniform Lights
+{
+    ivec4 clusterGrid;  //number of clusters along x, y, z
+    vec4 clusterScale;  //size of a tile in pixels (xy), scale and bias of the slice index (zw)
+    int nLights;  //actual number of lights in the scene
+};
+
+// Blinn-Phong material uniform block, shared by all the Shader Programs
+layout (std140) uniform Material
+{
+    vec3 ambientColor;
+    float Ka;
+    vec3 specularColor;
+    float Kd;
+    float Ks;
+    float shininess;
+    int repeat;
+    float height_scale;
+};
+
+// G-buffer: albedo * Kd and Ks, normal in world space and shininess, depth
+uniform sampler2D gAlbedoSpecular;
+uniform sampler2D gNormalShininess;
+uniform sampler2D gDepth;
+
+// inverse of projection * view matrix, to reconstruct the world space position from the depth
+uniform mat4 inverseProjectionView;
+
+// lights (2 texels for each light: position and radius, color) and lists of lights of the clusters (see light_clusters.h)
+uniform samplerBuffer lightData;
+uniform usamplerBuffer clusterData;
+uniform usamplerBuffer clusterLightIndices;
+
+// attenuation of a light: it goes smoothly to zero at the radius of the light
+float attenuation(float distance, float radius)
+{
+    float x = distance / radius;
+    float window = clamp(1.0 - x * x * x * x, 0.0, 1.0);
+    return window * window;
+}
+
+// offset in clusterLightIndices, and number of lights, of the list of the cluster containing the fragment (world space position)
+uvec2 clusterLights(vec3 position)
+{
+    float depth = -(viewMatrix * vec4(position, 1.0)).z;
+    ivec3 cluster = ivec3(ivec2(gl_FragCoord.xy / clusterScale.xy), int(floor(log(depth) * clusterScale.z + clusterScale.w)));
+    cluster = clamp(cluster, ivec3(0), clusterGrid.xyz - 1);
+    return texelFetch(clusterData, (cluster.z * clusterGrid.y + cluster.y) * clusterGrid.x + cluster.x).rg;
+}
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gDepth, pixel, 0).r;
+    // no surface in this pixel: we keep the clear color
+    if (depth == 1.0)
+        discard;
+    // the depth of the G-buffer is copied in the current framebuffer, for the objects rendered after this pass
+    gl_FragDepth = depth;
+
+    vec4 albedoSpecular = texelFetch(gAlbedoSpecular, pixel, 0);
+    vec4 normalShininess = texelFetch(gNormalShininess, pixel, 0);
+    vec3 surface = albedoSpecular.rgb;  //already multiplied by Kd
+    float specularStrength = albedoSpecular.a;
+    vec3 N = normalize(normalShininess.xyz);
+    float surfaceShininess = normalShininess.w;
+
+    // world space position: from window coordinates to normalized device coordinates, then inverse of the projection and of the view
+    vec4 ndc = vec4(gl_FragCoord.xy / vec2(textureSize(gDepth, 0)), depth, 1.0) * 2.0 - 1.0;
+    vec4 worldPos = inverseProjectionView * ndc;
+    vec3 fragPos = worldPos.xyz / worldPos.w;
+    vec3 V = normalize(viewPosition - fragPos);
+
+    vec3 color = Ka * ambientColor;
+
+    //for all the lights affecting the pixel
+    uvec2 cluster = clusterLights(fragPos);
+    for(int i=0; i<LIGHTS_COUNT; i++){
+
+        int light = LIGHT_INDEX(i);
+        vec4 lightPosition = texelFetch(lightData, 2 * light);  //xyz = position, w = radius
+        vec3 lightColor = texelFetch(lightData, 2 * light + 1).rgb;
+        vec3 lightVector = lightPosition.xyz - fragPos;
+        float lightAttenuation = attenuation(length(lightVector), lightPosition.w);
+        vec3 L = normalize(lightVector);
+        float lambertian = max(dot(L,N), 0.0);
+
+        vec3 H = normalize(L + V);
+        float specAngle = max(dot(H, N), 0.0);
+        float specular = (lambertian > 0.0) ? pow(specAngle, surfaceShininess) : 0.0;
+        color += lightAttenuation * lightColor * (lambertian * surface + specularStrength * specular * specularColor);
+    }
+    colorFrag = vec4(color, 1.0);
+}
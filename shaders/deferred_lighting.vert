@@ -0,0 +1,9 @@
+#version 410 core
+
+// lighting pass of deferred shading (see gbuffer.h): a single triangle covering the whole screen, without vertex attributes.
+// The vertices (-1,-1), (3,-1), (-1,3) are computed from the index of the vertex, and the part of the triangle outside the screen is clipped
+void main()
+{
+    vec2 position = vec2((gl_VertexID == 1) ? 3.0 : -1.0, (gl_VertexID == 2) ? 3.0 : -1.0);
+    gl_Position = vec4(position, 0.0, 1.0);
+}
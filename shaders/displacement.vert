@@ -1,26 +1,53 @@
-#version 410 core
-
-layout (location = 0) in vec3 aPosition;
-layout (location = 1) in vec3 aNormal;
-layout (location = 2) in vec2 aUV;
-layout (location = 3) in vec3 aTangent;
-layout (location = 4) in vec3 aBitangent;
-
-uniform mat3 normalMatrix;
-uniform mat4 modelMatrix;
-
-out vec2 UVs;
-out vec3 normal;
-out vec3 tangent;
-out vec3 bitangent;
-
-// using tessellation vertex shader just apsses through UV, normal and position
-void main()
-{    
-    UVs = aUV;
-    normal = aNormal;
-    tangent = aTangent;
-    bitangent = aBitangent;
-    gl_Position = vec4( aPosition, 1.0 );
-
+#version 410 core
+
+// with the packed vertex format (see mesh.h), the xy components of aNormal contain the octahedral encoding of the normal,
+// the xy components of aTangent contain the octahedral encoding of the tangent, and its w component the handedness of the tangent space.
+// In this case aBitangent is not used, and the bitangent is reconstructed from normal and tangent
+layout (location = 0) in vec3 aPosition;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aUV;
+layout (location = 3) in vec4 aTangent;
+layout (location = 4) in vec3 aBitangent;
+
+// per-instance model and normal matrices, read from the instance buffer (see batch_renderer.h)
+layout (location = 5) in mat4 modelMatrix;
+layout (location = 9) in mat3 normalMatrix;
+
+// true if the mesh uses the packed vertex format
+uniform bool packedVertex;
+
+// decoding of a direction with octahedral encoding (see OctahedralEncode in mesh.h)
+vec3 octahedralDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    // the lower half of the octahedron was folded on the upper one
+    float t = max(-n.z, 0.0);
+    n.x += (n.x >= 0.0) ? -t : t;
+    n.y += (n.y >= 0.0) ? -t : t;
+    return normalize(n);
+}
+
+out vec2 UVs;
+out vec3 normal;
+out vec3 tangent;
+out vec3 bitangent;
+// the per-instance matrices are passed to the tessellation stages
+out mat4 vModelMatrix;
+out mat3 vNormalMatrix;
+
+// using tessellation vertex shader just apsses through UV, normal and position
+void main()
+{    
+    UVs = aUV;
+    // vertex normal, tangent and bitangent, decoded if the vertex format is packed
+    vec3 vNormal = packedVertex ? octahedralDecode(aNormal.xy) : aNormal;
+    vec3 vTangent = packedVertex ? octahedralDecode(aTangent.xy) : aTangent.xyz;
+    vec3 vBitangent = packedVertex ? cross(vNormal, vTangent) * (aTangent.w < 0.0 ? -1.0 : 1.0) : aBitangent;
+    normal = vNormal;
+    tangent = vTangent;
+    bitangent = vBitangent;
+    vModelMatrix = modelMatrix;
+    vNormalMatrix = normalMatrix;
+    gl_Position = vec4( aPosition, 1.0 );
+
 }
\ No newline at end of file
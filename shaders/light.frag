@@ -1,10 +1,10 @@
-
-#version 410 core
-
-out vec4 colorFrag;
-
-
-void main(){
-
-    colorFrag = vec4(1.0, 1.0, 1.0, 1.0);
+
+#version 410 core
+
+out vec4 colorFrag;
+
+
+void main(){
+
+    colorFrag = vec4(1.0, 1.0, 1.0, 1.0);
 }
\ No newline at end of file
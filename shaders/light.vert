@@ -1,14 +1,21 @@
-#version 410 core
-
-layout (location = 0) in vec3 aPosition;
-
-uniform mat4 modelMatrix;
-uniform mat4 viewMatrix;
-uniform mat4 projectionMatrix;
-uniform mat3 normalMatrix;
-
-void main()
-{    
-    gl_Position = projectionMatrix * viewMatrix * modelMatrix * vec4( aPosition, 1.0 );
-
+#version 410 core
+
+layout (location = 0) in vec3 aPosition;
+
+// per-instance model and normal matrices, read from the instance buffer (see batch_renderer.h)
+layout (location = 5) in mat4 modelMatrix;
+layout (location = 9) in mat3 normalMatrix;
+
+// camera uniform block, shared by all the Shader Programs
+layout (std140) uniform Camera
+{
+    mat4 projectionMatrix;
+    mat4 viewMatrix;
+    vec3 viewPosition;
+};
+
+void main()
+{    
+    gl_Position = projectionMatrix * viewMatrix * modelMatrix * vec4( aPosition, 1.0 );
+
 }
\ No newline at end of file
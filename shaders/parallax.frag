@@ -1,85 +1,211 @@
-#version 410 core
-
-// number of lights in the scene
-#define MAX_NR_LIGHTS 5
-
-out vec4 colorFrag;
-
-in vec2 UV;
-in vec3 tLightDir[MAX_NR_LIGHTS];
-in vec3 tViewDir;
-
-uniform vec3 ambientColor;
-uniform vec3 specularColor;
-uniform float Ka;
-uniform float Kd;
-uniform float Ks;
-uniform float shininess;
-uniform int repeat;
-uniform int nLights;  //actual number of lights in the scene
-
-uniform sampler2D diffuseMap;
-uniform sampler2D normalMap;
-uniform sampler2D heightMap;
-
-// takes as input the UV coordinate of the fragment and the view direction, outputs the new UV coordinate dispaced according to the height map
-vec2 OcclusionParallaxMapping(vec2 UV, vec3 viewDir);
-
-void main(){
-
-    vec2 repeated_UV = mod(UV * repeat, 1.0);
-    vec3 color = Ka * ambientColor;
-    vec3 V = normalize(tViewDir);
-    vec2 parallaxUV = OcclusionParallaxMapping(repeated_UV, V);
-    vec3 N = texture(normalMap, parallaxUV).rgb;
-    N = normalize(N * 2.0 - 1.0);       //transform from range [0,1] into [-1,1]
-    vec3 surface = texture(diffuseMap, parallaxUV).rgb;
-
-    //for all the lights in the scene
-    for(int i=0; i< nLights; i++){
-
-        vec3 L = normalize(tLightDir[i]);
-        float lambertian = max(dot(L,N), 0.0);
-
-        // if the lambert coefficient is positive, then I can calculate the specular component
-        if(lambertian > 0.0)
-        { 
-            vec3 H = normalize(L + V);
-            float specAngle = max(dot(H, N), 0.0);
-            float specular = pow(specAngle, shininess);
-            color += vec3( Kd * lambertian * surface + Ks * specular * specularColor);
-        }
-    }
-    colorFrag = vec4(color, 1.0);
-}
-
-vec2 OcclusionParallaxMapping(vec2 UV, vec3 viewDir)
-{ 
-    const float minLayers = 8.0;
-    const float maxLayers = 64.0;
-    float numLayers = mix(maxLayers, minLayers, max(dot(vec3(0.0, 0.0, 1.0), viewDir), 0.0));   //we take more samples when looking from an angle beacuse there is more displacement
-    float layerDepth = 1.0 / numLayers;
-    float currentLayerDepth = 0.0;
-    vec2 P = viewDir.xy * 0.2;     //0.2 is a value to scale height for better results, found empirically with some tests
-    vec2 deltaTexCoords = P / numLayers;
-    vec2  currentTexCoords = UV;
-    float currentDepthMapValue = 1.0 - texture(heightMap, currentTexCoords).r;  // we want "depth" value because depth is easier to fake, so (1 - height)
-
-    // search for the crossing point
-    while(currentLayerDepth < currentDepthMapValue)
-    {
-        currentTexCoords -= deltaTexCoords;
-        currentDepthMapValue = 1.0 - texture(heightMap, currentTexCoords).r;  
-        currentLayerDepth += layerDepth;  
-    }
-
-    vec2 prevTexCoords = currentTexCoords + deltaTexCoords;
-
-    float afterDepth  = currentDepthMapValue - currentLayerDepth;
-    float beforeDepth = 1.0 - texture(heightMap, prevTexCoords).r - currentLayerDepth + layerDepth;
-    
-    float weight = afterDepth / (afterDepth - beforeDepth);
-    vec2 finalTexCoords = prevTexCoords * weight + currentTexCoords * (1.0 - weight); //interpolation
-
-    return finalTexCoords;  
-}  
\ No newline at end of file
+#version 410 core
+
+// in the permutations specialized on the number of lights (see ShaderPermutations in shader.h), NR_LIGHTS is defined before compilation:
+// all the lights are evaluated in a loop with a constant bound (so it is unrolled). Otherwise, only the lights in the list of the cluster
+// containing the fragment are evaluated (clustered forward lighting, see light_clusters.h)
+#ifdef NR_LIGHTS
+    #define LIGHTS_COUNT NR_LIGHTS
+    #define LIGHT_INDEX(i) (i)
+#else
+    #define LIGHTS_COUNT int(cluster.y)
+    #define LIGHT_INDEX(i) int(texelFetch(clusterLightIndices, int(cluster.x) + (i)).r)
+#endif
+
+// in the permutation with CONE_STEP_MAPPING, the height map is a relaxed cone step map (height in R, square root of the cone ratio in G,
+// see cone_step_map.h), and the intersection is searched with cone stepping instead of the linear search
+#ifdef CONE_STEP_MAPPING
+    #define CONE_STEPS 64
+    #define BINARY_STEPS 6
+    #define CONE_RATIO_MAX 1.0
+    #define CONE_MIN_DEPTH (0.5 / 255.0)
+#endif
+
+#ifdef GBUFFER_OUTPUT
+// geometry pass of deferred shading (see gbuffer.h): the parameters of the surface are written in the G-buffer, without lighting
+layout (location = 0) out vec4 gAlbedoSpecular;
+layout (location = 1) out vec4 gNormalShininess;
+#else
+out vec4 colorFrag;
+#endif
+
+// camera uniform block, shared by all the Shader Programs
+layout (std140) uniform Camera
+{
+    mat4 projectionMatrix;
+    mat4 viewMatrix;
+    vec3 viewPosition;
+};
+
+// lights uniform block, shared by all the Shader Programs: parameters of the grid of clusters (see LightsBlock in uniform_buffer.h)
+layout (std140) uniform Lights
+{
+    ivec4 clusterGrid;  //number of clusters along x, y, z
+    vec4 clusterScale;  //size of a tile in pixels (xy), scale and bias of the slice index (zw)
+    int nLights;  //actual number of lights in the scene
+};
+
+// Blinn-Phong material uniform block, shared by all the Shader Programs
+layout (std140) uniform Material
+{
+    vec3 ambientColor;
+    float Ka;
+    vec3 specularColor;
+    float Kd;
+    float Ks;
+    float shininess;
+    int repeat;
+    float height_scale;
+};
+
+in vec2 UV;
+in vec3 fragPos;
+in mat3 tangentMatrix;
+in vec3 tViewDir;
+
+
+uniform sampler2D diffuseMap;
+uniform sampler2D normalMap;
+uniform sampler2D heightMap;
+
+// lights (2 texels for each light: position and radius, color) and lists of lights of the clusters (see light_clusters.h)
+uniform samplerBuffer lightData;
+uniform usamplerBuffer clusterData;
+uniform usamplerBuffer clusterLightIndices;
+
+// attenuation of a light: it goes smoothly to zero at the radius of the light
+float attenuation(float distance, float radius)
+{
+    float x = distance / radius;
+    float window = clamp(1.0 - x * x * x * x, 0.0, 1.0);
+    return window * window;
+}
+
+// offset in clusterLightIndices, and number of lights, of the list of the cluster containing the fragment (world space position)
+uvec2 clusterLights(vec3 position)
+{
+    float depth = -(viewMatrix * vec4(position, 1.0)).z;
+    ivec3 cluster = ivec3(ivec2(gl_FragCoord.xy / clusterScale.xy), int(floor(log(depth) * clusterScale.z + clusterScale.w)));
+    cluster = clamp(cluster, ivec3(0), clusterGrid.xyz - 1);
+    return texelFetch(clusterData, (cluster.z * clusterGrid.y + cluster.y) * clusterGrid.x + cluster.x).rg;
+}
+
+// takes as input the UV coordinate of the fragment and the view direction, outputs the new UV coordinate dispaced according to the height map
+vec2 OcclusionParallaxMapping(vec2 UV, vec3 viewDir);
+#ifdef CONE_STEP_MAPPING
+// same as OcclusionParallaxMapping, with relaxed cone stepping
+vec2 ConeStepMapping(vec2 UV, vec3 viewDir);
+#endif
+
+void main(){
+
+#ifdef UNIT_REPEAT
+    // permutation specialized for repeat == 1 (see ShaderPermutations in shader.h): the UVs are used directly
+    vec2 repeated_UV = UV;
+#else
+    vec2 repeated_UV = mod(UV * repeat, 1.0);
+#endif
+    vec3 color = Ka * ambientColor;
+    vec3 V = normalize(tViewDir);
+#ifdef CONE_STEP_MAPPING
+    vec2 parallaxUV = ConeStepMapping(repeated_UV, V);
+#else
+    vec2 parallaxUV = OcclusionParallaxMapping(repeated_UV, V);
+#endif
+    vec2 NXY = texture(normalMap, parallaxUV).rg * 2.0 - 1.0;     //transform from range [0,1] into [-1,1]
+    vec3 N = vec3(NXY, sqrt(max(1.0 - dot(NXY, NXY), 0.0)));   //Z is reconstructed from X and Y (compressed normal maps store only 2 channels)
+    vec3 surface = texture(diffuseMap, parallaxUV).rgb;
+
+#ifdef GBUFFER_OUTPUT
+    gAlbedoSpecular = vec4(Kd * surface, Ks);
+    gNormalShininess = vec4(normalize(transpose(tangentMatrix) * N), shininess);  //normal from tangent space to world space
+#else
+    //for all the lights affecting the fragment
+    uvec2 cluster = clusterLights(fragPos);
+    for(int i=0; i<LIGHTS_COUNT; i++){
+
+        int light = LIGHT_INDEX(i);
+        vec4 lightPosition = texelFetch(lightData, 2 * light);  //xyz = position, w = radius
+        vec3 lightColor = texelFetch(lightData, 2 * light + 1).rgb;
+        vec3 lightVector = lightPosition.xyz - fragPos;
+        float lightAttenuation = attenuation(length(lightVector), lightPosition.w);
+        vec3 L = normalize(tangentMatrix * lightVector);   //light direction in tangent space
+        float lambertian = max(dot(L,N), 0.0);
+
+        // the specular component is added only if the lambert coefficient is positive: we use a selection instead of a branch,
+        // so the loop has no divergent flow control
+        vec3 H = normalize(L + V);
+        float specAngle = max(dot(H, N), 0.0);
+        float specular = (lambertian > 0.0) ? pow(specAngle, shininess) : 0.0;
+        color += lightAttenuation * lightColor * (Kd * lambertian * surface + Ks * specular * specularColor);
+    }
+    colorFrag = vec4(color, 1.0);
+#endif
+}
+
+vec2 OcclusionParallaxMapping(vec2 UV, vec3 viewDir)
+{ 
+    const float minLayers = 8.0;
+    const float maxLayers = 64.0;
+    float numLayers = mix(maxLayers, minLayers, max(dot(vec3(0.0, 0.0, 1.0), viewDir), 0.0));   //we take more samples when looking from an angle beacuse there is more displacement
+    float layerDepth = 1.0 / numLayers;
+    float currentLayerDepth = 0.0;
+    vec2 P = viewDir.xy * 0.2;     //0.2 is a value to scale height for better results, found empirically with some tests
+    vec2 deltaTexCoords = P / numLayers;
+    vec2  currentTexCoords = UV;
+    float currentDepthMapValue = 1.0 - texture(heightMap, currentTexCoords).r;  // we want "depth" value because depth is easier to fake, so (1 - height)
+
+    // search for the crossing point
+    while(currentLayerDepth < currentDepthMapValue)
+    {
+        currentTexCoords -= deltaTexCoords;
+        currentDepthMapValue = 1.0 - texture(heightMap, currentTexCoords).r;  
+        currentLayerDepth += layerDepth;  
+    }
+
+    vec2 prevTexCoords = currentTexCoords + deltaTexCoords;
+
+    float afterDepth  = currentDepthMapValue - currentLayerDepth;
+    float beforeDepth = 1.0 - texture(heightMap, prevTexCoords).r - currentLayerDepth + layerDepth;
+    
+    float weight = afterDepth / (afterDepth - beforeDepth);
+    vec2 finalTexCoords = prevTexCoords * weight + currentTexCoords * (1.0 - weight); //interpolation
+
+    return finalTexCoords;  
+}
+
+#ifdef CONE_STEP_MAPPING
+vec2 ConeStepMapping(vec2 UV, vec3 viewDir)
+{
+    // the loops end at a different step for each fragment: the texture derivatives are computed before them, from the starting UVs
+    vec2 dUVdx = dFdx(UV), dUVdy = dFdy(UV);
+    // the ray moves in (UV, depth) space along the same direction of the linear search: for a unit of depth, the UVs move by 0.2 * viewDir.xy
+    vec3 rayDir = vec3(-viewDir.xy * 0.2, 1.0);
+    float rayLength = length(rayDir.xy);
+    vec3 rayPosition = vec3(UV, 0.0);
+    vec3 previousPosition = rayPosition;
+
+    // at each step, the ray moves to the boundary of the cone of the texel below it. The search ends when the ray is below the surface,
+    // or when it is nearer to the surface than the precision of the height map
+    for (int i = 0; i < CONE_STEPS; i++)
+    {
+        vec2 cone = textureGrad(heightMap, rayPosition.xy, dUVdx, dUVdy).rg;
+        float depth = 1.0 - cone.r - rayPosition.z;
+        if (depth < CONE_MIN_DEPTH)
+            break;
+        float ratio = cone.g * cone.g * CONE_RATIO_MAX;
+        previousPosition = rayPosition;
+        rayPosition += rayDir * (ratio * depth / (rayLength + ratio));
+    }
+
+    // the relaxed cones guarantee a single intersection between the last position above the surface and the current one
+    vec3 range = rayPosition - previousPosition;
+    rayPosition = previousPosition;
+    for (int i = 0; i < BINARY_STEPS; i++)
+    {
+        range *= 0.5;
+        if (rayPosition.z + range.z < 1.0 - textureGrad(heightMap, rayPosition.xy + range.xy, dUVdx, dUVdy).r)
+            rayPosition += range;
+    }
+    return rayPosition.xy + range.xy * 0.5;
+}
+#endif
@@ -0,0 +1,433 @@
+/*
+Texture compression
+- CPU encoders for the block-compressed formats used by the application:
+    BC1 (S3TC DXT1)  -> diffuse maps (RGB, 4 bits per pixel)
+    BC4 (RGTC1)      -> height maps (1 channel, 4 bits per pixel)
+    BC5 (RGTC2)      -> normal maps (2 channels, 8 bits per pixel: the Z component is reconstructed in the shaders)
+- generation of the full mip chain on the CPU (box filter, normals are renormalized at each level)
+- reading and writing of KTX 1.1 files, which contain the whole compressed mip chain
+
+Each format encodes blocks of 4x4 pixels in 8 bytes (BC1, BC4) or 16 bytes (BC5). The textures are uploaded with glCompressedTexImage2D, and they are decompressed by the GPU when sampled.
+See https://learn.microsoft.com/en-us/windows/win32/direct3d10/d3d10-graphics-programming-guide-resources-block-compression
+and https://registry.khronos.org/KTX/specs/1.0/ktxspec.v1.html for details.
+
+N.B. 1) the encoders are used offline by tools/compress_textures.cpp. The application only reads the KTX files (see TextureLoader class in texture_loader.h)
+
+N.B. 2) BC1 is provided by the EXT_texture_compression_s3tc extension (available on all the desktop drivers), BC4 and BC5 are core in OpenGL 4.1
+
+Real-Time Graphics Programming - a.a. 2022/2023
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+    #define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+
+// kind of map stored in a texture: it defines the compressed format
+enum TextureKind { DIFFUSE_MAP, NORMAL_MAP, HEIGHT_MAP };
+
+// compressed format used for each kind of map
+inline GLenum CompressedFormat(TextureKind kind)
+{
+    switch (kind)
+    {
+        case NORMAL_MAP: return GL_COMPRESSED_RG_RGTC2;
+        case HEIGHT_MAP: return GL_COMPRESSED_RED_RGTC1;
+        default: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    }
+}
+
+// size in bytes of a 4x4 block
+inline size_t BlockSize(GLenum format)
+{
+    return (format == GL_COMPRESSED_RG_RGTC2) ? 16 : 8;
+}
+
+// size in bytes of a compressed image (the dimensions are rounded up to multiples of 4)
+inline size_t CompressedImageSize(GLenum format, GLuint width, GLuint height)
+{
+    return ((width + 3) / 4) * ((height + 3) / 4) * BlockSize(format);
+}
+
+//////////////////////////////////////////
+// single level of a compressed mip chain
+struct CompressedLevel {
+    GLuint width, height;
+    // position and size of the level inside CompressedTexture::data
+    size_t offset, size;
+};
+
+// compressed texture with its full mip chain
+struct CompressedTexture {
+    GLenum format;
+    vector<CompressedLevel> levels;
+    vector<unsigned char> data;
+};
+
+//////////////////////////////////////////
+// BC4 block: two 8 bit endpoints and 16 indices of 3 bits into a palette of 8 values
+inline void EncodeBC4Block(const float values[16], unsigned char out[8])
+{
+    float minValue = values[0], maxValue = values[0];
+    for (int i = 1; i < 16; i++)
+    {
+        minValue = min(minValue, values[i]);
+        maxValue = max(maxValue, values[i]);
+    }
+    int a0 = (int)lround(maxValue * 255.0f);
+    int a1 = (int)lround(minValue * 255.0f);
+
+    // with a0 > a1 the palette has 6 interpolated values between the endpoints
+    // (with a0 == a1 all the indices are 0, so the other values do not matter)
+    float palette[8];
+    palette[0] = a0 / 255.0f;
+    palette[1] = a1 / 255.0f;
+    for (int i = 2; i < 8; i++)
+        palette[i] = ((8 - i) * a0 + (i - 1) * a1) / (7.0f * 255.0f);
+
+    uint64_t bits = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        int best = 0;
+        float bestError = fabs(values[i] - palette[0]);
+        for (int j = 1; j < 8; j++)
+        {
+            float error = fabs(values[i] - palette[j]);
+            if (error < bestError)
+            {
+                bestError = error;
+                best = j;
+            }
+        }
+        bits |= (uint64_t)best << (3 * i);
+    }
+
+    out[0] = (unsigned char)a0;
+    out[1] = (unsigned char)a1;
+    for (int i = 0; i < 6; i++)
+        out[2 + i] = (unsigned char)(bits >> (8 * i));
+}
+
+//////////////////////////////////////////
+// BC1 block: two RGB565 endpoints and 16 indices of 2 bits into a palette of 4 colors
+// The endpoints are found projecting the colors on their principal axis (calculated with power iteration on the covariance matrix)
+inline void EncodeBC1Block(const float colors[16][3], unsigned char out[8])
+{
+    float mean[3] = { 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < 16; i++)
+        for (int c = 0; c < 3; c++)
+            mean[c] += colors[i][c] / 16.0f;
+
+    float covariance[3][3] = {};
+    for (int i = 0; i < 16; i++)
+        for (int r = 0; r < 3; r++)
+            for (int c = 0; c < 3; c++)
+                covariance[r][c] += (colors[i][r] - mean[r]) * (colors[i][c] - mean[c]);
+
+    float axis[3] = { 1.0f, 1.0f, 1.0f };
+    for (int iteration = 0; iteration < 8; iteration++)
+    {
+        float next[3];
+        for (int r = 0; r < 3; r++)
+            next[r] = covariance[r][0] * axis[0] + covariance[r][1] * axis[1] + covariance[r][2] * axis[2];
+        float length = sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+        // uniform block: any axis is fine
+        if (length < 1e-12f)
+            break;
+        for (int c = 0; c < 3; c++)
+            axis[c] = next[c] / length;
+    }
+
+    float minT = 1e30f, maxT = -1e30f;
+    for (int i = 0; i < 16; i++)
+    {
+        float t = (colors[i][0] - mean[0]) * axis[0] + (colors[i][1] - mean[1]) * axis[1] + (colors[i][2] - mean[2]) * axis[2];
+        minT = min(minT, t);
+        maxT = max(maxT, t);
+    }
+
+    // quantization of the endpoints to RGB565
+    auto pack565 = [](const float color[3]) -> uint16_t {
+        int r = (int)lround(min(max(color[0], 0.0f), 1.0f) * 31.0f);
+        int g = (int)lround(min(max(color[1], 0.0f), 1.0f) * 63.0f);
+        int b = (int)lround(min(max(color[2], 0.0f), 1.0f) * 31.0f);
+        return (uint16_t)((r << 11) | (g << 5) | b);
+    };
+    auto unpack565 = [](uint16_t packed, float color[3]) {
+        int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+        color[0] = ((r << 3) | (r >> 2)) / 255.0f;
+        color[1] = ((g << 2) | (g >> 4)) / 255.0f;
+        color[2] = ((b << 3) | (b >> 2)) / 255.0f;
+    };
+    float endpoint0[3], endpoint1[3];
+    for (int c = 0; c < 3; c++)
+    {
+        endpoint0[c] = mean[c] + axis[c] * maxT;
+        endpoint1[c] = mean[c] + axis[c] * minT;
+    }
+    uint16_t c0 = pack565(endpoint0);
+    uint16_t c1 = pack565(endpoint1);
+    // c0 > c1 selects the 4 colors mode (c0 == c1 gives a uniform block, with all the indices = 0)
+    if (c0 < c1)
+        swap(c0, c1);
+
+    float palette[4][3];
+    unpack565(c0, palette[0]);
+    unpack565(c1, palette[1]);
+    for (int c = 0; c < 3; c++)
+    {
+        palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+        palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+    }
+
+    uint32_t indices = 0;
+    if (c0 != c1)
+    {
+        for (int i = 0; i < 16; i++)
+        {
+            int best = 0;
+            float bestError = 1e30f;
+            for (int j = 0; j < 4; j++)
+            {
+                float dr = colors[i][0] - palette[j][0], dg = colors[i][1] - palette[j][1], db = colors[i][2] - palette[j][2];
+                float error = dr * dr + dg * dg + db * db;
+                if (error < bestError)
+                {
+                    bestError = error;
+                    best = j;
+                }
+            }
+            indices |= (uint32_t)best << (2 * i);
+        }
+    }
+
+    out[0] = (unsigned char)(c0 & 0xFF);
+    out[1] = (unsigned char)(c0 >> 8);
+    out[2] = (unsigned char)(c1 & 0xFF);
+    out[3] = (unsigned char)(c1 >> 8);
+    for (int i = 0; i < 4; i++)
+        out[4 + i] = (unsigned char)(indices >> (8 * i));
+}
+
+//////////////////////////////////////////
+// compression of an image with 3 channels in [0,1] (for height maps only the first channel is used)
+// pixels outside the image (dimensions not multiple of 4) are replaced with the nearest pixel on the border
+inline void CompressImage(const vector<float>& rgb, GLuint width, GLuint height, GLenum format, unsigned char* out)
+{
+    size_t blockSize = BlockSize(format);
+    for (GLuint by = 0; by < height; by += 4)
+    {
+        for (GLuint bx = 0; bx < width; bx += 4)
+        {
+            float block[16][3];
+            for (GLuint y = 0; y < 4; y++)
+                for (GLuint x = 0; x < 4; x++)
+                {
+                    size_t source = ((size_t)min(by + y, height - 1) * width + min(bx + x, width - 1)) * 3;
+                    for (int c = 0; c < 3; c++)
+                        block[y * 4 + x][c] = rgb[source + c];
+                }
+
+            if (format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT)
+                EncodeBC1Block(block, out);
+            else
+            {
+                // BC4 uses the red channel, BC5 encodes red and green as two BC4 blocks
+                float channel[16];
+                for (GLuint c = 0; c < blockSize / 8; c++)
+                {
+                    for (int i = 0; i < 16; i++)
+                        channel[i] = block[i][c];
+                    EncodeBC4Block(channel, out + 8 * c);
+                }
+            }
+            out += blockSize;
+        }
+    }
+}
+
+//////////////////////////////////////////
+// next level of the mip chain (2x2 box filter). For normal maps the averaged normals are renormalized
+inline vector<float> DownsampleImage(const vector<float>& rgb, GLuint width, GLuint height, TextureKind kind)
+{
+    GLuint newWidth = max(1u, width / 2), newHeight = max(1u, height / 2);
+    vector<float> result((size_t)newWidth * newHeight * 3);
+    for (GLuint y = 0; y < newHeight; y++)
+        for (GLuint x = 0; x < newWidth; x++)
+        {
+            float sum[3] = { 0.0f, 0.0f, 0.0f };
+            for (GLuint dy = 0; dy < 2; dy++)
+                for (GLuint dx = 0; dx < 2; dx++)
+                {
+                    size_t source = ((size_t)min(2 * y + dy, height - 1) * width + min(2 * x + dx, width - 1)) * 3;
+                    for (int c = 0; c < 3; c++)
+                        sum[c] += rgb[source + c] / 4.0f;
+                }
+            if (kind == NORMAL_MAP)
+            {
+                float n[3] = { sum[0] * 2.0f - 1.0f, sum[1] * 2.0f - 1.0f, sum[2] * 2.0f - 1.0f };
+                float length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+                if (length > 1e-6f)
+                    for (int c = 0; c < 3; c++)
+                        sum[c] = n[c] / length * 0.5f + 0.5f;
+            }
+            size_t destination = ((size_t)y * newWidth + x) * 3;
+            for (int c = 0; c < 3; c++)
+                result[destination + c] = sum[c];
+        }
+    return result;
+}
+
+//////////////////////////////////////////
+// compression of a RGB image (8 bits per channel) with its full mip chain, down to 1x1
+inline CompressedTexture CompressTexture(const unsigned char* pixels, GLuint width, GLuint height, TextureKind kind)
+{
+    CompressedTexture texture;
+    texture.format = CompressedFormat(kind);
+
+    vector<float> level((size_t)width * height * 3);
+    for (size_t i = 0; i < level.size(); i++)
+        level[i] = pixels[i] / 255.0f;
+
+    while (true)
+    {
+        CompressedLevel info;
+        info.width = width;
+        info.height = height;
+        info.offset = texture.data.size();
+        info.size = CompressedImageSize(texture.format, width, height);
+        texture.data.resize(info.offset + info.size);
+        CompressImage(level, width, height, texture.format, texture.data.data() + info.offset);
+        texture.levels.push_back(info);
+
+        if (width == 1 && height == 1)
+            break;
+        level = DownsampleImage(level, width, height, kind);
+        width = max(1u, width / 2);
+        height = max(1u, height / 2);
+    }
+    return texture;
+}
+
+//////////////////////////////////////////
+// KTX 1.1 files
+
+// identifier at the beginning of the KTX 1.1 files
+const unsigned char KTX_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+struct KTXHeader {
+    uint32_t endianness;
+    uint32_t glType;
+    uint32_t glTypeSize;
+    uint32_t glFormat;
+    uint32_t glInternalFormat;
+    uint32_t glBaseInternalFormat;
+    uint32_t pixelWidth;
+    uint32_t pixelHeight;
+    uint32_t pixelDepth;
+    uint32_t numberOfArrayElements;
+    uint32_t numberOfFaces;
+    uint32_t numberOfMipmapLevels;
+    uint32_t bytesOfKeyValueData;
+};
+
+// we save a compressed texture in a KTX file. It returns false if the file cannot be written
+inline bool WriteKTX(const string& path, const CompressedTexture& texture)
+{
+    ofstream file(path, ios::binary | ios::trunc);
+    if (!file)
+        return false;
+
+    KTXHeader header = {};
+    header.endianness = 0x04030201;
+    // for compressed textures glType and glFormat are 0, and glTypeSize is 1
+    header.glTypeSize = 1;
+    header.glInternalFormat = texture.format;
+    header.glBaseInternalFormat = (texture.format == GL_COMPRESSED_RG_RGTC2) ? GL_RG : (texture.format == GL_COMPRESSED_RED_RGTC1) ? GL_RED : GL_RGB;
+    header.pixelWidth = texture.levels[0].width;
+    header.pixelHeight = texture.levels[0].height;
+    header.numberOfFaces = 1;
+    header.numberOfMipmapLevels = (uint32_t)texture.levels.size();
+    file.write((const char*)KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER));
+    file.write((const char*)&header, sizeof(header));
+
+    // each level is preceded by its size. Compressed sizes are multiple of 8 bytes, so no padding is needed
+    for (const CompressedLevel& level : texture.levels)
+    {
+        uint32_t imageSize = (uint32_t)level.size;
+        file.write((const char*)&imageSize, sizeof(imageSize));
+        file.write((const char*)texture.data.data() + level.offset, level.size);
+    }
+    return (bool)file;
+}
+
+// we read a KTX file written by WriteKTX. It returns false if the file is missing, or if it is not a compressed 2D texture in one of our formats
+inline bool ReadKTX(const string& path, CompressedTexture& texture)
+{
+    ifstream file(path, ios::binary);
+    if (!file)
+        return false;
+
+    unsigned char identifier[12];
+    KTXHeader header;
+    file.read((char*)identifier, sizeof(identifier));
+    file.read((char*)&header, sizeof(header));
+    if (!file || memcmp(identifier, KTX_IDENTIFIER, sizeof(identifier)) != 0 || header.endianness != 0x04030201)
+        return false;
+    if (header.glInternalFormat != GL_COMPRESSED_RGB_S3TC_DXT1_EXT && header.glInternalFormat != GL_COMPRESSED_RED_RGTC1 && header.glInternalFormat != GL_COMPRESSED_RG_RGTC2)
+        return false;
+    if (header.pixelDepth > 1 || header.numberOfArrayElements > 0 || header.numberOfFaces != 1)
+        return false;
+    file.seekg(header.bytesOfKeyValueData, ios::cur);
+
+    texture.format = header.glInternalFormat;
+    texture.levels.clear();
+    texture.data.clear();
+    GLuint width = header.pixelWidth, height = header.pixelHeight;
+    for (uint32_t i = 0; i < max(1u, header.numberOfMipmapLevels); i++)
+    {
+        uint32_t imageSize = 0;
+        file.read((char*)&imageSize, sizeof(imageSize));
+        if (!file || imageSize != CompressedImageSize(texture.format, width, height))
+            return false;
+
+        CompressedLevel level;
+        level.width = width;
+        level.height = height;
+        level.offset = texture.data.size();
+        level.size = imageSize;
+        texture.data.resize(level.offset + level.size);
+        file.read((char*)texture.data.data() + level.offset, level.size);
+        if (!file)
+            return false;
+        texture.levels.push_back(level);
+
+        width = max(1u, width / 2);
+        height = max(1u, height / 2);
+    }
+    return true;
+}
+
+// path of the KTX file corresponding to an image (e.g. "textures/cobble/normal.png" -> "textures/cobble/normal.ktx")
+inline string KTXPath(const string& imagePath)
+{
+    string::size_type dot = imagePath.find_last_of('.');
+    string::size_type slash = imagePath.find_last_of("/\\");
+    if (dot == string::npos || (slash != string::npos && dot < slash))
+        return imagePath + ".ktx";
+    return imagePath.substr(0, dot) + ".ktx";
+}
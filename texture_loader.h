@@ -0,0 +1,722 @@
+/*
+TextureLoader class
+- asynchronous loading of the textures: the images are decoded in parallel by a pool of worker threads, and uploaded to the GPU by the OpenGL thread through a PBO
+- Load returns immediately a valid texture name, which contains a 1x1 placeholder color until the image has been uploaded. In this way the first frames are not blocked waiting for all the textures
+- streaming of the mip levels: at first only the smallest levels of each texture are uploaded, and the larger ones are loaded when they are needed on the screen,
+  within a budget of GPU memory. When the budget is exceeded, the levels of the least recently used textures are released
+- Use must be called in each frame for the textures used by the frame, with the resolution needed on the screen
+- Update must be called once per frame by the thread owning the OpenGL context: it uploads the decoded images, within a budget of bytes per frame,
+  it requests the missing levels of the used textures and it releases the levels over the memory budget
+- Finish blocks until all the requested textures are uploaded (e.g., before measuring performance)
+
+PBO : Pixel Buffer Object - a buffer used as source of pixel data for glTexImage2D. The copy from CPU memory to the buffer is done by us, while the transfer from the buffer to the texture is performed by the driver asynchronously, without stalling the application.
+See http://www.songho.ca/opengl/gl_pbo.html for details.
+
+N.B. 1) each image is decoded only once for each request: stbi_info reads only the header to know the number of channels, then the image is decoded with the right number of components (RGB or RGBA)
+
+N.B. 2) the stb_image vertical flip setting is global: it is set before starting the workers, and never changed while they are running
+
+N.B. 3) TextureLoader owns its threads and its PBO, and it is not copyable
+
+N.B. 4) if a block-compressed KTX file with the same name of the image exists (e.g. "normal.png" -> "normal.ktx", created with tools/compress_textures.cpp),
+it is used instead of the image: the mip levels are read from the file and uploaded with glCompressedTexImage2D (see texture_compression.h)
+
+N.B. 5) the height maps loaded with LoadConeStepMap are converted in cone step maps (two channels: height and cone ratio, see cone_step_map.h).
+The baking is slow, so its result is saved next to the image (e.g. "height.png" -> "height.png.conemap") with the hash of the image,
+and it is reused at the next runs until the image changes
+
+N.B. 6) the height maps loaded with LoadDerivativeMap are converted in derivative maps (two channels: derivatives of the height along u and v,
+see derivative_map.h). The conversion takes a few milliseconds, so it is done at every load
+
+N.B. 7) mip streaming
+The mip levels of a texture are resident from its finest resident level to the last one: the texture is sampled only in this range,
+setting GL_TEXTURE_BASE_LEVEL, so the shaders do not need to know which levels are resident.
+- the "tail" of the mip chain (the levels with both sides up to STREAMING_TAIL_SIZE texels) is uploaded at first, and it is never released:
+  the textures of the materials not in use cost only a few KB
+- the resolution needed by a texture is estimated by the application from the size on the screen of the objects using it. If the finest
+  resident level is coarser, a worker decodes the image again (the files are the only copy of the data on the CPU side), it generates the
+  missing levels and they are uploaded
+- the finest level of a texture is released setting the base level to the next one and redefining it with size 0x0. The levels are released
+  starting from the least recently used textures, and from the levels finer than the needed ones of the textures in use.
+  The requests are limited to the levels which fit in the budget after releasing all the releasable levels, so the textures in use
+  never compete for the memory, and the same levels are not loaded and released in alternate frames
+- the memory of the textures is estimated from their sizes and formats: the drivers can add some padding (e.g., RGB8 texels are stored in 4 bytes)
+
+Real-Time Graphics Programming - a.a. 2022/2023
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <type_traits>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <iostream>
+#include <chrono>
+
+#include "stb_image/stb_image.h"
+
+#include <utils/texture_compression.h>
+#include <utils/cone_step_map.h>
+#include <utils/derivative_map.h>
+// the textures are bound through the state cache
+#include <utils/gl_state.h>
+
+// maximum size in texels of the sides of the mip levels always resident (see N.B. 7 above)
+#define STREAMING_TAIL_SIZE 64
+
+// RGB color of the 1x1 placeholder of a texture
+struct TexturePlaceholder {
+    GLubyte r, g, b;
+};
+
+// neutral placeholders for the different kind of maps
+const TexturePlaceholder DIFFUSE_PLACEHOLDER = { 128, 128, 128 };
+const TexturePlaceholder NORMAL_PLACEHOLDER = { 128, 128, 255 };
+const TexturePlaceholder HEIGHT_PLACEHOLDER = { 0, 0, 0 };
+const TexturePlaceholder DERIVATIVE_PLACEHOLDER = { 0, 0, 0 };
+
+/////////////////// TEXTURELOADER class ///////////////////////
+class TextureLoader
+{
+public:
+    // maximum number of bytes uploaded in a single call to Update (at least one image is uploaded in each call)
+    size_t uploadBudget = 64 * 1024 * 1024;
+    // maximum GPU memory used by the mip levels of the textures (the tails of the mip chains are always resident, see N.B. 7 above)
+    size_t memoryBudget = 256 * 1024 * 1024;
+
+    TextureLoader(const TextureLoader& copy) = delete; //disallow copy
+    TextureLoader& operator=(const TextureLoader &) = delete;
+
+    // the worker threads are started in the constructor. It must be called by the thread owning the OpenGL context
+    TextureLoader(GLuint nWorkers = max(1u, thread::hardware_concurrency()))
+    {
+        stbi_set_flip_vertically_on_load(1);
+        glGenBuffers(1, &this->PBO);
+        // BC1 textures can be used only if the driver supports S3TC compression (BC4 and BC5 are core)
+        GLint nExtensions = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &nExtensions);
+        for (GLint i = 0; i < nExtensions; i++)
+            if (strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), "GL_EXT_texture_compression_s3tc") == 0)
+                this->s3tcSupported = true;
+        for (GLuint i = 0; i < nWorkers; i++)
+            this->workers.emplace_back(&TextureLoader::workerLoop, this);
+    }
+
+    ~TextureLoader()
+    {
+        {
+            lock_guard<mutex> lock(this->jobsMutex);
+            this->stopping = true;
+        }
+        this->jobsCondition.notify_all();
+        for (thread& worker : this->workers)
+            worker.join();
+        glDeleteBuffers(1, &this->PBO);
+    }
+
+    //////////////////////////////////////////
+
+    // we create the texture with the placeholder and we add the tail of its mip chain to the decoding queue. It returns the texture name
+    GLuint Load(const char* path, TexturePlaceholder placeholder)
+    {
+        return this->add(path, placeholder, NO_CONVERSION);
+    }
+
+    // as Load, but the height map is converted in a cone step map (see N.B. 5 above).
+    // The placeholder has height 0 and cone ratio 0, so the parallax mapping leaves the UVs unchanged until the upload
+    GLuint LoadConeStepMap(const char* path)
+    {
+        return this->add(path, HEIGHT_PLACEHOLDER, CONE_STEP_CONVERSION);
+    }
+
+    // as Load, but the height map is converted in a derivative map (see N.B. 6 above).
+    // The placeholder has null derivatives, so the normals are not perturbed until the upload
+    GLuint LoadDerivativeMap(const char* path)
+    {
+        return this->add(path, DERIVATIVE_PLACEHOLDER, DERIVATIVE_CONVERSION);
+    }
+
+    //////////////////////////////////////////
+
+    // the texture is used in the current frame, and it is needed with (at least) the given number of texels along its largest side
+    void Use(GLuint texture, float texels)
+    {
+        auto it = this->textures.find(texture);
+        if (it == this->textures.end())
+            return;
+        StreamedTexture& streamed = it->second;
+        if (streamed.lastUsed != this->frame)
+        {
+            streamed.lastUsed = this->frame;
+            streamed.neededTexels = 0.0f;
+        }
+        streamed.neededTexels = max(streamed.neededTexels, texels);
+    }
+
+    // we upload the images decoded so far, until the budget of bytes is reached. Then, we request the missing levels of the textures
+    // used in the last frame, and we release the levels over the memory budget
+    void Update()
+    {
+        this->uploadDecoded();
+        this->stream();
+        this->frame++;
+    }
+
+    // we wait until all the requested textures are uploaded
+    void Finish()
+    {
+        while (this->pending > 0)
+        {
+            {
+                unique_lock<mutex> lock(this->decodedMutex);
+                this->decodedCondition.wait(lock, [this] { return !this->decoded.empty(); });
+            }
+            this->uploadDecoded();
+        }
+    }
+
+    // true if the image of the texture has been uploaded (or if its loading failed)
+    bool Ready(GLuint texture) const
+    {
+        auto it = this->textures.find(texture);
+        return it != this->textures.end() && it->second.ready;
+    }
+
+    // estimated GPU memory used by the resident mip levels
+    size_t ResidentBytes() const
+    {
+        return this->residentBytes;
+    }
+
+private:
+    // conversion of the image after the decoding
+    enum Conversion { NO_CONVERSION, CONE_STEP_CONVERSION, DERIVATIVE_CONVERSION };
+    // decoding request, for the mip levels from firstLevel (included) to endLevel (excluded).
+    // The first request of a texture has firstLevel = -1 (the tail of the mip chain) and endLevel = -1 (the last level)
+    struct Job {
+        GLuint texture;
+        string path;
+        Conversion conversion;
+        GLint firstLevel, endLevel;
+    };
+    // mip levels decoded by a worker, waiting for the upload.
+    // format and type are the ones of the data for glTexImage2D (format is GL_NONE if the levels are block-compressed)
+    struct DecodedImage {
+        GLuint texture;
+        // size of the first level of the mip chain
+        GLuint width, height;
+        GLenum internalFormat, format, type;
+        // index of the first decoded level in the mip chain, and the decoded levels (offsets and sizes inside data)
+        GLuint firstLevel;
+        vector<CompressedLevel> levels;
+        vector<unsigned char> data;
+        // estimated GPU memory of each level of the whole mip chain
+        vector<size_t> levelSizes;
+    };
+    // state of the mip levels of a texture (used only by the OpenGL thread)
+    struct StreamedTexture {
+        string path;
+        Conversion conversion;
+        GLenum internalFormat;
+        bool compressed;
+        // number of levels of the mip chain (0 until the first upload, or if the loading failed), first level of the tail,
+        // finest resident level (= nLevels if only the placeholder is resident), finest level needed in the last frame
+        GLuint nLevels, tailLevel, residentLevel, neededLevel;
+        GLuint width, height;
+        vector<size_t> levelSizes;
+        // last frame using the texture, and texels needed in that frame
+        uint64_t lastUsed;
+        float neededTexels;
+        // a request of the texture is in the decoding queue, with the memory of its levels
+        bool requested;
+        size_t requestedBytes;
+        // the first request has been uploaded
+        bool ready;
+    };
+    // image decoded by a worker, before the generation of the mip levels: the whole mip chain if it has been read from a KTX file,
+    // otherwise the first level, with channels components of componentSize bytes for each texel
+    struct SourceImage {
+        CompressedTexture compressed;
+        vector<unsigned char> pixels;
+        GLuint width, height, channels, componentSize;
+        GLenum internalFormat, format, type;
+    };
+
+    GLuint PBO;
+    vector<thread> workers;
+    bool s3tcSupported = false;
+
+    // queue of the images to decode
+    deque<Job> jobs;
+    mutex jobsMutex;
+    condition_variable jobsCondition;
+    bool stopping = false;
+
+    // queue of the decoded images
+    deque<DecodedImage> decoded;
+    mutex decodedMutex;
+    condition_variable decodedCondition;
+
+    // number of requests not uploaded yet, and state of the textures (used only by the OpenGL thread)
+    GLuint pending = 0;
+    unordered_map<GLuint, StreamedTexture> textures;
+    // memory of the resident levels, and of the requested levels not uploaded yet
+    size_t residentBytes = 0, requestedBytes = 0;
+    // current frame (the frames start from 1, so lastUsed = 0 means never used)
+    uint64_t frame = 1;
+
+    //////////////////////////////////////////
+
+    // texture containing only the 1x1 placeholder color
+    GLuint createPlaceholder(TexturePlaceholder placeholder)
+    {
+        GLuint texture;
+        glGenTextures(1, &texture);
+        GLState().BindTexture(GL_TEXTURE_2D, texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, &placeholder);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        // we set how to consider UVs outside [0,1] range
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        // we set the filtering for minification and magnification
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        GLState().BindTexture(GL_TEXTURE_2D, 0);
+        return texture;
+    }
+
+    // we create the texture with the placeholder, and we request the tail of its mip chain
+    GLuint add(const char* path, TexturePlaceholder placeholder, Conversion conversion)
+    {
+        GLuint texture = this->createPlaceholder(placeholder);
+        StreamedTexture& streamed = this->textures[texture];
+        streamed = { path, conversion, GL_NONE, false, 0, 0, 0, 0, 0, 0, {}, 0, 0.0f, true, 0, false };
+        this->push({ texture, path, conversion, -1, -1 });
+        return texture;
+    }
+
+    // we add a request to the decoding queue
+    void push(const Job& job)
+    {
+        {
+            lock_guard<mutex> lock(this->jobsMutex);
+            this->jobs.push_back(job);
+            this->pending++;
+        }
+        this->jobsCondition.notify_one();
+    }
+
+    //////////////////////////////////////////
+
+    // each worker takes the next request from the queue, it decodes the image and it generates the requested mip levels
+    void workerLoop()
+    {
+        while (true)
+        {
+            Job job;
+            {
+                unique_lock<mutex> lock(this->jobsMutex);
+                this->jobsCondition.wait(lock, [this] { return this->stopping || !this->jobs.empty(); });
+                // when the loader is destroyed, the images still in the queue are not decoded
+                if (this->stopping)
+                    return;
+                job = this->jobs.front();
+                this->jobs.pop_front();
+            }
+
+            // if the decoding fails, the image has no levels, and the texture keeps the placeholder
+            DecodedImage image = { job.texture, 0, 0, GL_NONE, GL_NONE, GL_NONE, 0, {}, {}, {} };
+            SourceImage source = { {}, {}, 0, 0, 0, 1, GL_NONE, GL_NONE, GL_UNSIGNED_BYTE };
+            if (this->decode(job, source))
+                this->generateLevels(job, source, image);
+            else
+                cout << "Failed to load texture! " << job.path << endl;
+
+            {
+                lock_guard<mutex> lock(this->decodedMutex);
+                this->decoded.push_back(std::move(image));
+            }
+            this->decodedCondition.notify_one();
+        }
+    }
+
+    // we decode the image of the request, applying its conversion
+    bool decode(const Job& job, SourceImage& source)
+    {
+        if (job.conversion == CONE_STEP_CONVERSION)
+            return this->loadConeStepMap(job.path, source);
+        if (job.conversion == DERIVATIVE_CONVERSION)
+            return this->loadDerivativeMap(job.path, source);
+
+        // if available, we use the compressed version of the image
+        if (ReadKTX(KTXPath(job.path), source.compressed) && (source.compressed.format != GL_COMPRESSED_RGB_S3TC_DXT1_EXT || this->s3tcSupported))
+        {
+            source.width = source.compressed.levels[0].width;
+            source.height = source.compressed.levels[0].height;
+            source.internalFormat = source.compressed.format;
+            return true;
+        }
+        source.compressed.levels.clear();
+
+        // we read the number of channels from the header, so the image is decoded only once: 4 channels = RGBA, otherwise RGB
+        int width = 0, height = 0, fileChannels = 0;
+        if (!stbi_info(job.path.c_str(), &width, &height, &fileChannels))
+            return false;
+        int channels = (fileChannels == 4) ? STBI_rgb_alpha : STBI_rgb;
+        unsigned char* pixels = stbi_load(job.path.c_str(), &width, &height, &fileChannels, channels);
+        if (pixels == nullptr)
+            return false;
+        source.pixels.assign(pixels, pixels + (size_t)width * height * channels);
+        stbi_image_free(pixels);
+        source.width = width;
+        source.height = height;
+        source.channels = channels;
+        source.internalFormat = source.format = (channels == STBI_rgb_alpha) ? GL_RGBA : GL_RGB;
+        return true;
+    }
+
+    // we read the cone step map of the height map from its file, or we bake it (and we save it) if the file is missing or outdated
+    bool loadConeStepMap(const string& path, SourceImage& source)
+    {
+        uint64_t hash = HashFile(path);
+        if (hash == 0)
+            return false;
+        source.channels = 2;
+        source.internalFormat = GL_RG8;
+        source.format = GL_RG;
+        if (ReadConeStepMap(ConeStepMapPath(path), hash, source.width, source.height, source.pixels))
+            return true;
+
+        int width = 0, height = 0, fileChannels = 0;
+        unsigned char* heights = stbi_load(path.c_str(), &width, &height, &fileChannels, STBI_grey);
+        if (heights == nullptr)
+            return false;
+        auto start = chrono::steady_clock::now();
+        source.pixels = ConeStepBaker(heights, width, height).Bake();
+        stbi_image_free(heights);
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        cout << "Cone step map of " << path << " baked in " << elapsed.count() << " s" << endl;
+        source.width = width;
+        source.height = height;
+        if (!WriteConeStepMap(ConeStepMapPath(path), hash, source.width, source.height, source.pixels))
+            cout << "Failed to save the cone step map! " << ConeStepMapPath(path) << endl;
+        return true;
+    }
+
+    // we compute the derivative map of the height map: the derivatives are copied as bytes, and uploaded as floats
+    bool loadDerivativeMap(const string& path, SourceImage& source)
+    {
+        int width = 0, height = 0, fileChannels = 0;
+        unsigned char* heights = stbi_load(path.c_str(), &width, &height, &fileChannels, STBI_grey);
+        if (heights == nullptr)
+            return false;
+        vector<float> derivatives = BakeDerivativeMap(heights, width, height);
+        stbi_image_free(heights);
+        source.width = width;
+        source.height = height;
+        source.channels = 2;
+        source.componentSize = sizeof(float);
+        source.internalFormat = GL_RG16F;
+        source.format = GL_RG;
+        source.type = GL_FLOAT;
+        source.pixels.resize(derivatives.size() * sizeof(float));
+        memcpy(source.pixels.data(), derivatives.data(), source.pixels.size());
+        return true;
+    }
+
+    //////////////////////////////////////////
+
+    // we select the requested levels of the mip chain: they are copied from the KTX file, or generated from the first level with a box filter
+    void generateLevels(const Job& job, SourceImage& source, DecodedImage& image)
+    {
+        bool compressed = !source.compressed.levels.empty();
+        GLuint nLevels = compressed ? GLuint(source.compressed.levels.size()) : GLuint(floor(log2(max(source.width, source.height)))) + 1;
+        image.width = source.width;
+        image.height = source.height;
+        image.internalFormat = source.internalFormat;
+        image.format = compressed ? GL_NONE : source.format;
+        image.type = source.type;
+
+        // memory of all the levels, and first level of the tail
+        GLuint tailLevel = nLevels - 1;
+        for (GLuint level = nLevels; level-- > 0;)
+        {
+            GLuint width = max(1u, source.width >> level), height = max(1u, source.height >> level);
+            image.levelSizes.insert(image.levelSizes.begin(), compressed ? source.compressed.levels[level].size
+                                                                       : (size_t)width * height * bytesPerTexel(source.internalFormat));
+            if (max(width, height) <= STREAMING_TAIL_SIZE)
+                tailLevel = level;
+        }
+        GLuint firstLevel = (job.firstLevel < 0) ? tailLevel : min(GLuint(job.firstLevel), nLevels - 1);
+        GLuint endLevel = (job.endLevel < 0) ? nLevels : min(GLuint(job.endLevel), nLevels);
+        image.firstLevel = firstLevel;
+
+        if (compressed)
+        {
+            for (GLuint level = firstLevel; level < endLevel; level++)
+                this->appendLevel(image, source.compressed.levels[level].width, source.compressed.levels[level].height,
+                                  &source.compressed.data[source.compressed.levels[level].offset], source.compressed.levels[level].size);
+            return;
+        }
+
+        // each level is computed from the previous one, up to the last requested level
+        vector<unsigned char> current = std::move(source.pixels), next;
+        GLuint width = source.width, height = source.height;
+        size_t texelSize = (size_t)source.channels * source.componentSize;
+        for (GLuint level = 0; level < endLevel; level++)
+        {
+            if (level >= firstLevel)
+                this->appendLevel(image, width, height, current.data(), (size_t)width * height * texelSize);
+            if (level + 1 == endLevel)
+                break;
+            GLuint nextWidth = max(1u, width / 2), nextHeight = max(1u, height / 2);
+            next.resize((size_t)nextWidth * nextHeight * texelSize);
+            if (source.componentSize == sizeof(float))
+                downsampleLevel((const float*)current.data(), width, height, source.channels, (float*)next.data());
+            else
+                downsampleLevel(current.data(), width, height, source.channels, next.data());
+            swap(current, next);
+            width = nextWidth;
+            height = nextHeight;
+        }
+    }
+
+    // we add a level at the end of the decoded data
+    void appendLevel(DecodedImage& image, GLuint width, GLuint height, const unsigned char* data, size_t size)
+    {
+        image.levels.push_back({ width, height, image.data.size(), size });
+        image.data.insert(image.data.end(), data, data + size);
+    }
+
+    // next level of a mip chain: each texel is the average of a block of 2x2 texels (the sides of 1 texel are not halved)
+    template <typename T>
+    static void downsampleLevel(const T* source, GLuint width, GLuint height, GLuint channels, T* destination)
+    {
+        GLuint newWidth = max(1u, width / 2), newHeight = max(1u, height / 2);
+        for (GLuint y = 0; y < newHeight; y++)
+        {
+            const T* row0 = source + (size_t)min(2 * y, height - 1) * width * channels;
+            const T* row1 = source + (size_t)min(2 * y + 1, height - 1) * width * channels;
+            for (GLuint x = 0; x < newWidth; x++)
+            {
+                size_t x0 = (size_t)min(2 * x, width - 1) * channels, x1 = (size_t)min(2 * x + 1, width - 1) * channels;
+                for (GLuint c = 0; c < channels; c++)
+                {
+                    float value = 0.25f * (float(row0[x0 + c]) + float(row0[x1 + c]) + float(row1[x0 + c]) + float(row1[x1 + c]));
+                    // the bytes are rounded to the nearest value
+                    destination[((size_t)y * newWidth + x) * channels + c] = is_integral<T>::value ? T(value + 0.5f) : T(value);
+                }
+            }
+        }
+    }
+
+    // estimated GPU memory of a texel of an uncompressed format
+    static size_t bytesPerTexel(GLenum internalFormat)
+    {
+        switch (internalFormat)
+        {
+            case GL_RG8: return 2;
+            case GL_RG16F: return 4;
+            // RGB8 texels are usually padded to 4 bytes
+            default: return 4;
+        }
+    }
+
+    //////////////////////////////////////////
+
+    // we upload the images decoded so far, until the budget of bytes is reached
+    void uploadDecoded()
+    {
+        size_t uploaded = 0;
+        while (uploaded < this->uploadBudget)
+        {
+            DecodedImage image;
+            {
+                lock_guard<mutex> lock(this->decodedMutex);
+                if (this->decoded.empty())
+                    return;
+                image = std::move(this->decoded.front());
+                this->decoded.pop_front();
+            }
+            uploaded += this->upload(image);
+        }
+    }
+
+    // we copy the levels in the PBO and we start their transfer to the texture. It returns the number of uploaded bytes
+    size_t upload(DecodedImage& image)
+    {
+        this->pending--;
+        StreamedTexture& streamed = this->textures[image.texture];
+        streamed.ready = true;
+        streamed.requested = false;
+        this->requestedBytes -= streamed.requestedBytes;
+        streamed.requestedBytes = 0;
+        // if the loading failed, the texture keeps the placeholder (and it is never requested again, since nLevels is 0)
+        if (image.levels.empty())
+            return 0;
+        if (streamed.nLevels == 0)
+        {
+            // first upload: only the placeholder is resident
+            streamed.nLevels = streamed.residentLevel = GLuint(image.levelSizes.size());
+            streamed.tailLevel = image.firstLevel;
+            streamed.levelSizes = image.levelSizes;
+            streamed.internalFormat = image.internalFormat;
+            streamed.compressed = (image.format == GL_NONE);
+            streamed.width = image.width;
+            streamed.height = image.height;
+        }
+
+        size_t size = image.data.size();
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, this->PBO);
+        // we "orphan" the previous content of the PBO, so we do not wait for the end of the previous transfer
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+        void* destination = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (destination)
+        {
+            memcpy(destination, image.data.data(), size);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+            // with a PBO bound, the last parameter of glTexImage2D is an offset inside the buffer.
+            // The texture is left bound to the active unit: the state cache knows it, and the next bind of the unit replaces it
+            GLState().BindTexture(GL_TEXTURE_2D, image.texture);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            for (GLuint i = 0; i < image.levels.size(); i++)
+            {
+                const CompressedLevel& level = image.levels[i];
+                GLint index = GLint(image.firstLevel + i);
+                if (image.format == GL_NONE)
+                    glCompressedTexImage2D(GL_TEXTURE_2D, index, image.internalFormat, level.width, level.height, 0, (GLsizei)level.size, (GLvoid*)level.offset);
+                else
+                    glTexImage2D(GL_TEXTURE_2D, index, image.internalFormat, level.width, level.height, 0, image.format, image.type, (GLvoid*)level.offset);
+                this->residentBytes += streamed.levelSizes[index];
+            }
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+            // the texture is sampled only in the resident levels (see N.B. 7 above)
+            streamed.residentLevel = image.firstLevel;
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, GLint(streamed.residentLevel));
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, GLint(streamed.nLevels) - 1);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return size;
+    }
+
+    //////////////////////////////////////////
+
+    // finest level needed by a texture in use: the first level with at least the needed texels along the largest side
+    GLuint neededLevel(const StreamedTexture& streamed) const
+    {
+        float size = float(max(streamed.width, streamed.height));
+        if (streamed.neededTexels <= 0.0f)
+            return streamed.tailLevel;
+        float level = floor(log2(size / streamed.neededTexels));
+        return GLuint(min(max(level, 0.0f), float(streamed.tailLevel)));
+    }
+
+    // levels of a texture which can be released (from the finest resident level to the returned one, excluded):
+    // all the levels before the tail for the textures not used in the last frame, the levels finer than the needed ones for the textures in use
+    // (or all the levels before the tail, if inUse is true)
+    GLuint releasableEnd(const StreamedTexture& streamed, bool inUse = false) const
+    {
+        if (streamed.nLevels == 0 || streamed.requested)
+            return streamed.residentLevel;
+        GLuint end = (streamed.lastUsed == this->frame && !inUse) ? min(streamed.neededLevel, streamed.tailLevel) : streamed.tailLevel;
+        return max(end, streamed.residentLevel);
+    }
+
+    // we request the missing levels of the textures used in the last frame, and we release the levels over the memory budget (see N.B. 7 above)
+    void stream()
+    {
+        for (auto& entry : this->textures)
+            if (entry.second.nLevels > 0 && entry.second.lastUsed == this->frame)
+                entry.second.neededLevel = this->neededLevel(entry.second);
+
+        // memory available for the requests, after releasing all the releasable levels
+        size_t releasable = 0;
+        for (auto& entry : this->textures)
+        {
+            const StreamedTexture& streamed = entry.second;
+            for (GLuint level = streamed.residentLevel; level < this->releasableEnd(streamed); level++)
+                releasable += streamed.levelSizes[level];
+        }
+        size_t committed = this->residentBytes + this->requestedBytes;
+        size_t available = (committed < this->memoryBudget) ? this->memoryBudget - committed + releasable : releasable;
+
+        for (auto& entry : this->textures)
+        {
+            StreamedTexture& streamed = entry.second;
+            if (streamed.nLevels == 0 || streamed.requested || streamed.lastUsed != this->frame || streamed.neededLevel >= streamed.residentLevel)
+                continue;
+            // finest level which fits in the available memory
+            GLuint level = streamed.residentLevel;
+            size_t bytes = 0;
+            while (level > streamed.neededLevel && bytes + streamed.levelSizes[level - 1] <= available)
+                bytes += streamed.levelSizes[--level];
+            if (level == streamed.residentLevel)
+                continue;
+            available -= bytes;
+            streamed.requested = true;
+            streamed.requestedBytes = bytes;
+            this->requestedBytes += bytes;
+            this->push({ entry.first, streamed.path, streamed.conversion, GLint(level), GLint(streamed.residentLevel) });
+        }
+
+        // we release the finest levels of the least recently used textures, until the resident and requested levels fit in the budget.
+        // If the budget has been reduced below the memory of the textures in use, their levels are released too, and they are not
+        // requested again in the next frames, since they do not fit in the available memory
+        bool inUse = false;
+        while (this->residentBytes + this->requestedBytes > this->memoryBudget)
+        {
+            GLuint texture = 0;
+            StreamedTexture* victim = nullptr;
+            for (auto& entry : this->textures)
+            {
+                StreamedTexture& streamed = entry.second;
+                if (this->releasableEnd(streamed, inUse) == streamed.residentLevel)
+                    continue;
+                // among the textures used in the same frame, we release the largest level first
+                if (!victim || streamed.lastUsed < victim->lastUsed ||
+                    (streamed.lastUsed == victim->lastUsed && streamed.levelSizes[streamed.residentLevel] > victim->levelSizes[victim->residentLevel]))
+                {
+                    texture = entry.first;
+                    victim = &streamed;
+                }
+            }
+            if (!victim)
+            {
+                if (inUse)
+                    break;
+                inUse = true;
+                continue;
+            }
+            this->release(texture, *victim);
+        }
+    }
+
+    // we release the finest resident level of a texture: the texture is sampled from the next level, and the level is redefined with size 0x0
+    void release(GLuint texture, StreamedTexture& streamed)
+    {
+        GLuint level = streamed.residentLevel++;
+        GLState().BindTexture(GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, GLint(streamed.residentLevel));
+        if (streamed.compressed)
+            glCompressedTexImage2D(GL_TEXTURE_2D, GLint(level), streamed.internalFormat, 0, 0, 0, 0, NULL);
+        else
+            glTexImage2D(GL_TEXTURE_2D, GLint(level), streamed.internalFormat, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        this->residentBytes -= streamed.levelSizes[level];
+    }
+};
@@ -0,0 +1,84 @@
+/*
+compress_textures
+- offline tool which converts the textures of the application in block-compressed KTX files, with the full mip chain
+- diffuse maps -> BC1, normal maps -> BC5 (X and Y only), height maps -> BC4 (see texture_compression.h)
+- the KTX file is saved next to the source image, with the same name and .ktx extension: the application uses it instead of the image if it exists
+
+Usage:
+compress_textures <diffuse|normal|height> <image> [<image> ...]
+
+e.g.
+compress_textures diffuse ../../textures/cobble/diffuse.png ../../textures/bw/diffuse.png ../../textures/sofa/diffuse.jpg
+compress_textures normal ../../textures/cobble/normal.png ../../textures/bw/normal.png ../../textures/sofa/normal.jpg
+compress_textures height ../../textures/cobble/height.png ../../textures/bw/height.png ../../textures/sofa/height.jpg
+
+N.B.) the tool does not need an OpenGL context: only the GL enums are used, to write them in the KTX header
+
+Real-Time Graphics Programming - a.a. 2022/2023
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+// Std. Includes
+#include <string>
+#include <cstring>
+#include <iostream>
+
+#include <glad/glad.h>
+
+// we include the library for images loading
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image/stb_image.h"
+
+#include <utils/texture_compression.h>
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        std::cout << "Usage: compress_textures <diffuse|normal|height> <image> [<image> ...]" << std::endl;
+        return -1;
+    }
+
+    TextureKind kind;
+    if (strcmp(argv[1], "diffuse") == 0)
+        kind = DIFFUSE_MAP;
+    else if (strcmp(argv[1], "normal") == 0)
+        kind = NORMAL_MAP;
+    else if (strcmp(argv[1], "height") == 0)
+        kind = HEIGHT_MAP;
+    else
+    {
+        std::cout << "Unknown kind of map: " << argv[1] << std::endl;
+        return -1;
+    }
+
+    // the images are flipped like in the application, so the KTX levels are already in the OpenGL order
+    stbi_set_flip_vertically_on_load(1);
+
+    int result = 0;
+    for (int i = 2; i < argc; i++)
+    {
+        int w, h, channels;
+        unsigned char* image = stbi_load(argv[i], &w, &h, &channels, STBI_rgb);
+        if (image == nullptr)
+        {
+            std::cout << "Failed to load texture! " << argv[i] << std::endl;
+            result = -1;
+            continue;
+        }
+
+        CompressedTexture texture = CompressTexture(image, w, h, kind);
+        stbi_image_free(image);
+
+        std::string output = KTXPath(argv[i]);
+        if (!WriteKTX(output, texture))
+        {
+            std::cout << "Failed to write " << output << std::endl;
+            result = -1;
+            continue;
+        }
+        std::cout << argv[i] << " -> " << output << " (" << w << "x" << h << ", " << texture.levels.size() << " levels, " << texture.data.size() / 1024 << " KB)" << std::endl;
+    }
+    return result;
+}
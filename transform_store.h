@@ -0,0 +1,238 @@
+/*
+TransformStore class
+- storage of the transformations (position, rotation as a quaternion, scale) of many objects, in "structure of arrays" (SoA) layout:
+  each component has its own array (all the x of the positions, then all the y, ...), instead of an array of structures
+- the model and normal matrices of the objects are composed only for the entries modified after the last Update ("dirty" entries),
+  and they are written in a tightly packed array of InstanceData, ready to be uploaded in the instance buffer (see batch_renderer.h)
+
+In SoA layout, the same component of 4 consecutive entries is contiguous in memory, so it can be loaded in a single SSE register,
+and the matrices of 4 entries are computed with the same instructions needed for a single entry (SIMD: Single Instruction, Multiple Data).
+See https://www.intel.com/content/www/us/en/docs/intrinsics-guide/index.html for the SSE instructions.
+
+N.B. 1)
+The matrices are composed directly as model = T * R * S, with R the rotation matrix of the quaternion: the columns of the upper 3x3 matrix are the
+columns of R multiplied by the scale factors. Since R is orthonormal, the normal matrix (inverse transpose of R * S) is R * S^-1:
+the columns of R divided by the scale factors. So we do not need the general matrix inversion of glm::inverseTranspose.
+
+N.B. 2)
+The entries are processed in blocks of 4 (TRANSFORM_BLOCK_SIZE): a block is recomputed if at least one of its entries is dirty.
+The arrays are allocated with a size multiple of 4, so the last block can always be loaded and stored entirely.
+The SSE code is used if the compiler targets an x86 CPU with SSE (always true for x86-64), and it can be disabled defining TRANSFORM_STORE_NO_SIMD:
+in this case (and on the other CPUs, e.g. ARM), the same computation is performed with a scalar loop on the 4 entries of the block.
+
+Real-Time Graphics Programming - a.a. 2022/2023
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <vector>
+#include <cstdint>
+#include <cstring>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#if !defined(TRANSFORM_STORE_NO_SIMD) && (defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1))
+#include <xmmintrin.h>
+#define TRANSFORM_STORE_SSE
+#endif
+
+// number of entries processed together (width of a SSE register)
+#define TRANSFORM_BLOCK_SIZE 4
+
+// matrices of an instance, in the layout of the instance buffer (see batch_renderer.h)
+struct InstanceData {
+    glm::mat4 modelMatrix;
+    glm::mat3 normalMatrix;
+};
+
+/////////////////// TRANSFORMSTORE class ///////////////////////
+class TransformStore
+{
+public:
+    // components of the transformations, one array for each component
+    vector<float> positionX, positionY, positionZ;
+    // rotations as unit quaternions
+    vector<float> rotationX, rotationY, rotationZ, rotationW;
+    vector<float> scaleX, scaleY, scaleZ;
+    // 1 if the entry has been modified after the last Update
+    vector<uint8_t> dirty;
+    // model and normal matrices of each entry
+    vector<InstanceData> instances;
+    // number of entries recomputed by the last Update
+    GLuint updatedEntries;
+
+    TransformStore() : updatedEntries(0), count(0) {}
+
+    // number of entries
+    GLuint Size() const
+    {
+        return this->count;
+    }
+
+    // addition of an entry: it returns its index
+    GLuint Add(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale)
+    {
+        GLuint index = this->count++;
+        // the arrays grow by a whole block (see N.B. 2 above)
+        if (this->count > this->dirty.size())
+        {
+            size_t size = this->dirty.size() + TRANSFORM_BLOCK_SIZE;
+            for (vector<float>* component : { &this->positionX, &this->positionY, &this->positionZ, &this->rotationX, &this->rotationY, &this->rotationZ })
+                component->resize(size, 0.0f);
+            for (vector<float>* component : { &this->rotationW, &this->scaleX, &this->scaleY, &this->scaleZ })
+                component->resize(size, 1.0f);
+            this->dirty.resize(size, 0);
+            this->instances.resize(size);
+        }
+        this->SetPosition(index, position);
+        this->SetRotation(index, rotation);
+        this->SetScale(index, scale);
+        this->dirty[index] = 1;
+        return index;
+    }
+
+    // removal of the last entry: the arrays keep their size, so an entry added later does not need allocations
+    void RemoveLast()
+    {
+        if (this->count > 0)
+            this->dirty[--this->count] = 0;
+    }
+
+    // the setters mark the entry as dirty only if the value is changed
+    void SetPosition(GLuint index, const glm::vec3& position)
+    {
+        this->set(this->positionX, index, position.x);
+        this->set(this->positionY, index, position.y);
+        this->set(this->positionZ, index, position.z);
+    }
+
+    void SetRotation(GLuint index, const glm::quat& rotation)
+    {
+        glm::quat unit = glm::normalize(rotation);
+        this->set(this->rotationX, index, unit.x);
+        this->set(this->rotationY, index, unit.y);
+        this->set(this->rotationZ, index, unit.z);
+        this->set(this->rotationW, index, unit.w);
+    }
+
+    void SetScale(GLuint index, const glm::vec3& scale)
+    {
+        this->set(this->scaleX, index, scale.x);
+        this->set(this->scaleY, index, scale.y);
+        this->set(this->scaleZ, index, scale.z);
+    }
+
+    // composition of the matrices of the dirty entries
+    void Update()
+    {
+        this->updatedEntries = 0;
+        for (size_t first = 0; first < this->count; first += TRANSFORM_BLOCK_SIZE)
+        {
+            // the 4 flags of the block are checked with a single comparison
+            uint32_t blockDirty;
+            memcpy(&blockDirty, &this->dirty[first], sizeof(blockDirty));
+            if (!blockDirty)
+                continue;
+            this->composeBlock(first);
+            memset(&this->dirty[first], 0, TRANSFORM_BLOCK_SIZE);
+            this->updatedEntries += TRANSFORM_BLOCK_SIZE;
+        }
+    }
+
+private:
+    GLuint count;
+
+    //////////////////////////////////////////
+
+    void set(vector<float>& component, GLuint index, float value)
+    {
+        if (component[index] != value)
+        {
+            component[index] = value;
+            this->dirty[index] = 1;
+        }
+    }
+
+#ifdef TRANSFORM_STORE_SSE
+    // matrices of the 4 entries of the block starting from first, with SSE instructions: each register contains the same element of the 4 matrices
+    void composeBlock(size_t first)
+    {
+        __m128 x = _mm_loadu_ps(&this->rotationX[first]);
+        __m128 y = _mm_loadu_ps(&this->rotationY[first]);
+        __m128 z = _mm_loadu_ps(&this->rotationZ[first]);
+        __m128 w = _mm_loadu_ps(&this->rotationW[first]);
+        __m128 one = _mm_set1_ps(1.0f);
+        __m128 two = _mm_set1_ps(2.0f);
+
+        // products of the components of the quaternions, multiplied by 2
+        __m128 xx = _mm_mul_ps(two, _mm_mul_ps(x, x)), yy = _mm_mul_ps(two, _mm_mul_ps(y, y)), zz = _mm_mul_ps(two, _mm_mul_ps(z, z));
+        __m128 xy = _mm_mul_ps(two, _mm_mul_ps(x, y)), xz = _mm_mul_ps(two, _mm_mul_ps(x, z)), yz = _mm_mul_ps(two, _mm_mul_ps(y, z));
+        __m128 wx = _mm_mul_ps(two, _mm_mul_ps(w, x)), wy = _mm_mul_ps(two, _mm_mul_ps(w, y)), wz = _mm_mul_ps(two, _mm_mul_ps(w, z));
+
+        // rotation matrix: rotation[c][r] is the element in column c and row r (same convention of glm::mat3_cast)
+        __m128 rotation[3][3] = {
+            { _mm_sub_ps(one, _mm_add_ps(yy, zz)), _mm_add_ps(xy, wz), _mm_sub_ps(xz, wy) },
+            { _mm_sub_ps(xy, wz), _mm_sub_ps(one, _mm_add_ps(xx, zz)), _mm_add_ps(yz, wx) },
+            { _mm_add_ps(xz, wy), _mm_sub_ps(yz, wx), _mm_sub_ps(one, _mm_add_ps(xx, yy)) } };
+
+        __m128 scale[3] = { _mm_loadu_ps(&this->scaleX[first]), _mm_loadu_ps(&this->scaleY[first]), _mm_loadu_ps(&this->scaleZ[first]) };
+        __m128 position[3] = { _mm_loadu_ps(&this->positionX[first]), _mm_loadu_ps(&this->positionY[first]), _mm_loadu_ps(&this->positionZ[first]) };
+        __m128 zero = _mm_setzero_ps();
+
+        for (int c = 0; c < 3; c++)
+        {
+            // column c of the model matrix (see N.B. 1 above): after the transpose, the register k contains the column of the entry first + k
+            __m128 model[4] = { _mm_mul_ps(rotation[c][0], scale[c]), _mm_mul_ps(rotation[c][1], scale[c]), _mm_mul_ps(rotation[c][2], scale[c]), zero };
+            _MM_TRANSPOSE4_PS(model[0], model[1], model[2], model[3]);
+            __m128 inverseScale = _mm_div_ps(one, scale[c]);
+            __m128 normal[4] = { _mm_mul_ps(rotation[c][0], inverseScale), _mm_mul_ps(rotation[c][1], inverseScale), _mm_mul_ps(rotation[c][2], inverseScale), zero };
+            _MM_TRANSPOSE4_PS(normal[0], normal[1], normal[2], normal[3]);
+            for (int k = 0; k < TRANSFORM_BLOCK_SIZE; k++)
+            {
+                _mm_storeu_ps(&this->instances[first + k].modelMatrix[c][0], model[k]);
+                // the columns of the normal matrix have 3 floats: we store the lower 2 and then the third one
+                float* column = &this->instances[first + k].normalMatrix[c][0];
+                _mm_storel_pi((__m64*)column, normal[k]);
+                _mm_store_ss(column + 2, _mm_movehl_ps(normal[k], normal[k]));
+            }
+        }
+
+        // translation column
+        __m128 translation[4] = { position[0], position[1], position[2], one };
+        _MM_TRANSPOSE4_PS(translation[0], translation[1], translation[2], translation[3]);
+        for (int k = 0; k < TRANSFORM_BLOCK_SIZE; k++)
+            _mm_storeu_ps(&this->instances[first + k].modelMatrix[3][0], translation[k]);
+    }
+#else
+    // matrices of the 4 entries of the block starting from first, with the same computation of the SSE version, one entry at a time
+    void composeBlock(size_t first)
+    {
+        for (size_t i = first; i < first + TRANSFORM_BLOCK_SIZE; i++)
+        {
+            float x = this->rotationX[i], y = this->rotationY[i], z = this->rotationZ[i], w = this->rotationW[i];
+            float xx = 2.0f * x * x, yy = 2.0f * y * y, zz = 2.0f * z * z;
+            float xy = 2.0f * x * y, xz = 2.0f * x * z, yz = 2.0f * y * z;
+            float wx = 2.0f * w * x, wy = 2.0f * w * y, wz = 2.0f * w * z;
+            glm::vec3 rotation[3] = {
+                glm::vec3(1.0f - (yy + zz), xy + wz, xz - wy),
+                glm::vec3(xy - wz, 1.0f - (xx + zz), yz + wx),
+                glm::vec3(xz + wy, yz - wx, 1.0f - (xx + yy)) };
+            float scale[3] = { this->scaleX[i], this->scaleY[i], this->scaleZ[i] };
+
+            InstanceData& instance = this->instances[i];
+            for (int c = 0; c < 3; c++)
+            {
+                instance.modelMatrix[c] = glm::vec4(rotation[c] * scale[c], 0.0f);
+                instance.normalMatrix[c] = rotation[c] * (1.0f / scale[c]);
+            }
+            instance.modelMatrix[3] = glm::vec4(this->positionX[i], this->positionY[i], this->positionZ[i], 1.0f);
+        }
+    }
+#endif
+};
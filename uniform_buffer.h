@@ -0,0 +1,151 @@
+/*
+UniformBuffer class
+- the class allocates a UBO (Uniform Buffer Object) and connects it to a binding point shared by all the Shader Programs
+- the data blocks used in the application (camera, lights, Blinn-Phong material) are declared here, with the same memory layout of the std140 uniform blocks declared in the shaders
+
+UBO : Uniform Buffer Object - memory allocated on GPU to store the values of a uniform block. The same UBO can be read by all the Shader Programs which have connected the block to its binding point, so the values are uploaded once per frame instead of once for each program and each draw call.
+See https://learnopengl.com/Advanced-OpenGL/Advanced-GLSL (Uniform buffer objects) for details.
+
+N.B. 1)
+In std140 layout a vec3 is aligned to 16 bytes, and each element of an array is aligned to 16 bytes.
+CPU-side we use glm::vec4 for array elements and vec3 members are always followed by a float which fills the 4th component.
+If a block is changed in the shaders, the corresponding struct must be changed accordingly (and vice versa).
+
+N.B. 2)
+The last uploaded block is kept in a CPU copy: if Update is called with the same values (e.g., the material when the GUI is not used,
+or the camera when it does not move), the upload is skipped (see also the state cache in gl_state.h).
+
+N.B. 3)
+UniformBuffer follows RAII principles and it is a "move-only" class, like the Mesh class.
+
+Real-Time Graphics Programming - a.a. 2022/2023
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <vector>
+#include <cstring>
+
+// we use GLM data structures to define the blocks with the same layout of the shaders ones
+#include <glm/glm.hpp>
+
+// the skipped uploads are counted by the state cache
+#include <utils/gl_state.h>
+
+// maximum number of lights in the scene. The lights are stored in a texture buffer (see light_clusters.h), so the shaders do not depend on this value:
+// it is limited only by the 16 bit indices of the lists of lights of the clusters
+#define MAX_NR_LIGHTS 1024
+
+// binding points of the uniform blocks shared by all the Shader Programs
+enum UniformBlockBinding { CAMERA_BLOCK = 0, LIGHTS_BLOCK = 1, MATERIAL_BLOCK = 2 };
+
+// std140 "Camera" block: projection and view matrices, and camera position
+struct CameraBlock {
+    glm::mat4 projectionMatrix;
+    glm::mat4 viewMatrix;
+    // xyz = camera position, w is not used
+    glm::vec4 viewPosition;
+};
+
+// std140 "Lights" block: parameters of the grid of clusters and actual number of lights (the lights are in texture buffers, see light_clusters.h)
+struct LightsBlock {
+    // number of clusters along x, y and z, w is not used
+    glm::ivec4 clusterGrid;
+    // xy = size of a tile in pixels, zw = scale and bias to compute the slice from the logarithm of the view depth
+    glm::vec4 clusterScale;
+    GLint nLights;
+    GLint padding[3];
+};
+
+// std140 "Material" block: Blinn-Phong parameters and objects appearance
+struct MaterialBlock {
+    glm::vec3 ambientColor;
+    GLfloat Ka;
+    glm::vec3 specularColor;
+    GLfloat Kd;
+    GLfloat Ks;
+    GLfloat shininess;
+    GLint repeat;
+    GLfloat height_scale;
+};
+
+/////////////////// UNIFORMBUFFER class ///////////////////////
+class UniformBuffer {
+public:
+    // UBO
+    GLuint UBO;
+
+    // We want UniformBuffer to be a move-only class. We delete copy constructor and copy assignment
+    UniformBuffer(const UniformBuffer& copy) = delete; //disallow copy
+    UniformBuffer& operator=(const UniformBuffer &) = delete;
+
+    // Constructor: we allocate the buffer (the data are uploaded later with Update) and we connect it to the binding point
+    UniformBuffer(GLsizeiptr size, GLuint bindingPoint) noexcept
+        : size(size)
+    {
+        glGenBuffers(1, &this->UBO);
+        glBindBuffer(GL_UNIFORM_BUFFER, this->UBO);
+        glBufferData(GL_UNIFORM_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, bindingPoint, this->UBO);
+    }
+
+    // Move constructor
+    UniformBuffer(UniformBuffer&& move) noexcept
+        : UBO(move.UBO), size(move.size), uploaded(std::move(move.uploaded))
+    {
+        move.UBO = 0;
+    }
+
+    // Move assignment
+    UniformBuffer& operator=(UniformBuffer&& move) noexcept
+    {
+        freeGPUresources();
+        UBO = move.UBO;
+        size = move.size;
+        uploaded = std::move(move.uploaded);
+        move.UBO = 0;
+        return *this;
+    }
+
+    // destructor
+    ~UniformBuffer() noexcept
+    {
+        freeGPUresources();
+    }
+
+    //////////////////////////////////////////
+
+    // we upload the whole block, if it is different from the last upload (see N.B. 2 above). The call to glBufferSubData is preceded by a glBufferData with NULL pointer,
+    // so the driver can give us a new memory area instead of waiting for the GPU to finish reading the previous frame values ("orphaning")
+    void Update(const void* data)
+    {
+        bool changed = (this->uploaded.empty() || memcmp(this->uploaded.data(), data, this->size) != 0);
+        GLState().Count(changed);
+        if (!changed)
+            return;
+        this->uploaded.assign((const char*)data, (const char*)data + this->size);
+        glBindBuffer(GL_UNIFORM_BUFFER, this->UBO);
+        glBufferData(GL_UNIFORM_BUFFER, this->size, NULL, GL_DYNAMIC_DRAW);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, this->size, data);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+private:
+    // dimension of the block in bytes
+    GLsizeiptr size;
+    // copy of the last uploaded block
+    vector<char> uploaded;
+
+    void freeGPUresources()
+    {
+        // If UBO is 0, this instance has been through a move, and no longer owns GPU resources
+        if (UBO)
+            glDeleteBuffers(1, &this->UBO);
+    }
+};